@@ -19,6 +19,8 @@
 #include <QSignalMapper>
 #include <glog/logging.h>
 
+#include "ubuntu/transfers/i18n.h"
+#include "ubuntu/transfers/system/file_manager.h"
 #include "ubuntu/transfers/system/logger.h"
 #include "ubuntu/transfers/system/network_session.h"
 #include "queue.h"
@@ -67,20 +69,52 @@ Queue::remove(const QString& path) {
     auto transfer = _transfers[path];
     _sortedPaths[transfer->transferAppId()]->removeOne(path);
     _transfers.remove(path);
+    _held.remove(path);
 
     transfer->deleteLater();
     emit transferRemoved(path);
 }
 
+int
+Queue::maxConcurrentPerApp() {
+    return _maxPerApp;
+}
+
+void
+Queue::setMaxConcurrentPerApp(int max) {
+    TRACE << max;
+    _maxPerApp = (max < 1) ? 1 : max;
+    // lowering the limit does not stop the running transfers, they are
+    // allowed to complete and the limit is respected from then on
+    updateCurrentTransfer();
+}
+
+int
+Queue::maxConcurrent() {
+    return _maxTotal;
+}
+
+void
+Queue::setMaxConcurrent(int max) {
+    TRACE << max;
+    _maxTotal = (max < 0) ? 0 : max;
+    updateCurrentTransfer();
+}
+
 QString
 Queue::currentTransfer(const QString& appId) {
-    if(_current.contains(appId)) {
-        return _current[appId];
+    if(_current.contains(appId) && !_current[appId].isEmpty()) {
+        return _current[appId].first();
     } else {
         return "";
     }
 }
 
+QStringList
+Queue::currentTransfers(const QString& appId) {
+    return _current.value(appId);
+}
+
 QStringList
 Queue::paths() {
     QStringList allPaths;
@@ -113,21 +147,23 @@ Queue::onManagedTransferStateChanged() {
     switch (transfer->state()) {
         case Transfer::RESUME:
         case Transfer::START:
-            if (!_current.contains(transfer->transferAppId()) 
-                    || (_current.contains(transfer->transferAppId()) 
-                        && _current[transfer->transferAppId()].isEmpty())) {
+            if (_current.value(transfer->transferAppId()).size()
+                    < _maxPerApp) {
                 // only start or resume the transfer in the update method
                 updateCurrentTransfer(transfer->transferAppId());
             }
             break;
         case Transfer::PAUSE:
+            // a held transfer waits for space again once resumed
+            _held.remove(transfer->path());
             transfer->pauseTransfer();
             updateCurrentTransfer(transfer->transferAppId());
             break;
         case Transfer::CANCEL:
             // cancel and remove the transfer
+            _held.remove(transfer->path());
             transfer->cancelTransfer();
-            if (_current.contains(transfer->transferAppId()) && _current[transfer->transferAppId()] == transfer->path())
+            if (_current.value(transfer->transferAppId()).contains(transfer->path()))
                 updateCurrentTransfer(transfer->transferAppId());
             else
                 remove(transfer->path());
@@ -136,11 +172,12 @@ Queue::onManagedTransferStateChanged() {
         case Transfer::UNCOLLECTED:
             // remove the registered object in dbus, remove the transfer
             // and the adapter from the list
-            if (_current.contains(transfer->transferAppId()) && _current[transfer->transferAppId()] == transfer->path())
+            _held.remove(transfer->path());
+            if (_current.value(transfer->transferAppId()).contains(transfer->path()))
                 updateCurrentTransfer(transfer->transferAppId());
             break;
         case Transfer::FINISH:
-            if (_current.contains(transfer->transferAppId()) && _current[transfer->transferAppId()] == transfer->path()) {
+            if (_current.value(transfer->transferAppId()).contains(transfer->path())) {
                 updateCurrentTransfer(transfer->transferAppId());
             } else {
                 // Remove from the queue even if it wasn't the current transfer
@@ -182,61 +219,167 @@ Queue::onSessionTypeChanged(QNetworkConfiguration::BearerType type) {
     }
 }
 
+bool
+Queue::pruneCurrentTransfers(const QString& appId) {
+    // check if any of the current transfers was canceled/finished and
+    // return if any of them is no longer current
+    bool pruned = false;
+    foreach(const QString& path, _current.value(appId)) {
+        auto currentTransfer = _transfers[path];
+        auto state = currentTransfer->state();
+        if (state == Transfer::CANCEL || state == Transfer::FINISH
+            || state == Transfer::ERROR) {
+            LOG(INFO) << "State is CANCEL || FINISH || ERROR";
+            _current[appId].removeOne(path);
+            remove(path);
+            pruned = true;
+        } else if (state == Transfer::UNCOLLECTED) {
+            LOG(INFO) << "State is UNCOLLECTED";
+            _current[appId].removeOne(path);
+            pruned = true;
+        } else if (!currentTransfer->canTransfer()
+                || state == Transfer::PAUSE) {
+            LOG(INFO) << "States is Cannot Transfer || PAUSE";
+            _current[appId].removeOne(path);
+            pruned = true;
+        }
+    }
+
+    if (_current.contains(appId) && _current[appId].isEmpty()) {
+        _current.remove(appId);
+    }
+    return pruned;
+}
+
+bool
+Queue::hasSpaceFor(Transfer* transfer) {
+    auto required = transfer->requiredSpace();
+    if (required <= 0) {
+        return true;
+    }
+
+    qint64 available = 0;
+    qulonglong fileSystem = 0;
+    auto fileMan = FileManager::instance();
+    if (!fileMan->freeSpace(transfer->storagePath(), available, fileSystem)) {
+        // do not block transfers because we cannot check
+        return true;
+    }
+
+    if (required > available) {
+        auto path = transfer->path();
+        _held.remove(path);
+        LOG(ERROR) << "Not enough space for " << path << ": "
+            << required << " > " << available;
+        transfer->failTransfer(QString(
+            _("Not enough space in the disk: %1 bytes needed and %2 available"))
+                .arg(required).arg(available));
+        // the transfer never was current, it would not be pruned
+        if (_transfers.contains(path)) {
+            remove(path);
+        }
+        return false;
+    }
+
+    // the running transfers in the same file system are going to use
+    // part of the space that is free right now
+    qint64 reserved = 0;
+    foreach(const QStringList& paths, _current.values()) {
+        foreach(const QString& path, paths) {
+            auto current = _transfers[path];
+            auto needed = current->requiredSpace();
+            qint64 currentAvailable = 0;
+            qulonglong currentFileSystem = 0;
+            if (needed > 0 && fileMan->freeSpace(current->storagePath(),
+                    currentAvailable, currentFileSystem)
+                    && currentFileSystem == fileSystem) {
+                reserved += needed;
+            }
+        }
+    }
+
+    if (required + reserved > available) {
+        // held until the running ones are done
+        LOG(INFO) << "Holding " << transfer->path() << " until "
+            << required << " bytes are free";
+        _held.insert(transfer->path());
+        return false;
+    }
+    _held.remove(transfer->path());
+    return true;
+}
+
+int
+Queue::currentCount() {
+    int count = 0;
+    foreach(const QStringList& paths, _current.values()) {
+        count += paths.size();
+    }
+    return count;
+}
+
 void
 Queue::updateCurrentTransfer(const QString& appIdToUpdate) {
     TRACE;
 
     // If we don't get given a specific appId to update transfers for
-    // we update all the transfers
+    // we update all the transfers. When there is a global limit a slot
+    // freed by one app can be used by the rest, so they are updated too
+    // but the given app gets the first chance. The same happens with the
+    // space in the disk when there are transfers waiting for it.
     QStringList appIds;
     if (appIdToUpdate.isEmpty()) {
         appIds = _sortedPaths.keys();
     } else {
         appIds.append(appIdToUpdate);
+        if (_maxTotal > 0 || !_held.isEmpty()) {
+            foreach(const QString& appId, _sortedPaths.keys()) {
+                if (appId != appIdToUpdate) {
+                    appIds.append(appId);
+                }
+            }
+        }
     }
 
     foreach(QString appId, appIds) {
-        if (_current.contains(appId)) {
-            // check if it was canceled/finished
-            auto currentTransfer = _transfers[_current[appId]];
-            auto state = currentTransfer->state();
-            if (state == Transfer::CANCEL || state == Transfer::FINISH
-                || state == Transfer::ERROR) {
-                LOG(INFO) << "State is CANCEL || FINISH || ERROR";
-                remove(_current[appId]);
-                _current.remove(appId);
-            } else if (state == Transfer::UNCOLLECTED) {
-                LOG(INFO) << "State is UNCOLLECTED";
-                _current.remove(appId);
-            } else if (!currentTransfer->canTransfer()
-                    || state == Transfer::PAUSE) {
-                LOG(INFO) << "States is Cannot Transfer || PAUSE";
-                _current.remove(appId);
-            } else {
-                break;
-            }
+        auto pruned = pruneCurrentTransfers(appId);
+        if (_current.value(appId).size() >= _maxPerApp) {
+            continue;
         }
 
-        // loop via the transfers and choose the first that is
-        // started or resumed
+        // loop via the transfers and choose the first ones that are
+        // started or resumed keeping the order in which they were added
+        QStringList started;
         foreach(const QString& path, *_sortedPaths[appId]) {
+            if (_current.value(appId).size() >= _maxPerApp
+                    || (_maxTotal > 0 && currentCount() >= _maxTotal)) {
+                break;
+            }
+            if (_current.value(appId).contains(path)) {
+                continue;
+            }
             auto transfer = _transfers[path];
             auto state = transfer->state();
             if (transfer->canTransfer()
                     && (state == Transfer::START
-                        || state == Transfer::RESUME)) {
-                _current[appId] = path;
+                        || state == Transfer::RESUME)
+                    && hasSpaceFor(transfer)) {
+                _current[appId].append(path);
+                started.append(path);
                 if (state == Transfer::START) {
                     transfer->startTransfer();
                 } else
                     transfer->resumeTransfer();
-                break;
             }
         }
-        if (_current.contains(appId) && !_current[appId].isEmpty()) {
-            emit currentChanged(appId, _current[appId]);
-        } else {
-            emit currentChanged(appId, "");
+
+        if (!started.isEmpty()) {
+            foreach(const QString& path, started) {
+                emit currentChanged(appId, path);
+            }
+        } else if (appId == appIdToUpdate || appIdToUpdate.isEmpty()
+                || pruned) {
+            emit currentChanged(appId, currentTransfer(appId));
         }
     }
 }
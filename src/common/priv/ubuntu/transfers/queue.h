@@ -23,6 +23,7 @@
 #include <QStringList>
 #include <QList>
 #include <QPair>
+#include <QSet>
 #include <QSharedPointer>
 
 #include "ubuntu/transfers/system/network_session.h"
@@ -42,8 +43,16 @@ class Queue : public QObject {
 
     virtual void add(Transfer* transfer);
 
+    // number of transfers that can be performed at the same time per app
+    // and in total, a total of 0 means that there is no global limit
+    virtual int maxConcurrentPerApp();
+    virtual void setMaxConcurrentPerApp(int max);
+    virtual int maxConcurrent();
+    virtual void setMaxConcurrent(int max);
+
     // accessors for useful info
     virtual QString currentTransfer(const QString& appId);
+    virtual QStringList currentTransfers(const QString& appId);
     virtual QStringList paths();
     virtual QHash<QString, Transfer*> transfers();
     virtual int size();
@@ -60,11 +69,17 @@ class Queue : public QObject {
     void onSessionTypeChanged(QNetworkConfiguration::BearerType type);
     void remove(const QString& path);
     void updateCurrentTransfer(const QString& appIdToUpdate = "");
+    bool pruneCurrentTransfers(const QString& appId);
+    bool hasSpaceFor(Transfer* transfer);
+    int currentCount();
 
  private:
-    QHash<QString, QString> _current;
+    int _maxPerApp = 1;
+    int _maxTotal = 0;
+    QHash<QString, QStringList> _current;  // kept in start order
     QHash<QString, Transfer*> _transfers;  // quick for access
     QHash<QString, QStringList*> _sortedPaths;  // keep the order
+    QSet<QString> _held;  // waiting for space in the disk
 };
 
 }  // Transfers
@@ -22,7 +22,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
 #include <QDir>
+#include <QFileInfo>
 #include <QRegExp>
 #include <QStandardPaths>
 #include <ubuntu/transfers/system/logger.h>
@@ -31,6 +33,13 @@
 #include "pending_reply.h"
 #include "uuid_utils.h"
 
+namespace {
+    const QString DBUS_SERVICE = "org.freedesktop.DBus";
+    const QString DBUS_PATH = "/org/freedesktop/DBus";
+    const QString DBUS_INTERFACE = "org.freedesktop.DBus";
+    const QString NAME_OWNER_CHANGED = "NameOwnerChanged";
+}
+
 namespace Ubuntu {
 
 namespace Transfers {
@@ -44,6 +53,16 @@ AppArmor::AppArmor(DBusConnection* connection,
     : QObject(parent) {
     _dbus = DBusProxyFactory::instance()->createDBusProxy(connection, this);
     _uuidFactory = new UuidFactory(this);
+
+    // the cached contexts are only valid while the connection that was
+    // queried keeps its name
+    _cacheContexts = connection->connection().connect(DBUS_SERVICE,
+        DBUS_PATH, DBUS_INTERFACE, NAME_OWNER_CHANGED, this,
+        SLOT(onNameOwnerChanged(QString, QString, QString)));
+    if (!_cacheContexts) {
+        LOG(WARNING) << "Could not connect to NameOwnerChanged, security "
+            << "contexts will not be cached";
+    }
 }
 
 AppArmor::~AppArmor() {
@@ -70,14 +89,11 @@ AppArmor::getSecurityDetails(const QString& connName,
 
 QString
 AppArmor::appId(QString caller) {
-    QScopedPointer<PendingReply<QString> > reply(
-        _dbus->GetConnectionAppArmorSecurityContext(caller));
-    // blocking but should be ok for now
-    reply->waitForFinished();
-    if (reply->isError()) {
+    QString context;
+    if (!securityContext(caller, context)) {
         return "";
     }
-    return reply->value();
+    return context;
 }
 
 bool
@@ -98,19 +114,15 @@ AppArmor::getSecurityDetails(const QString& connName,
         return;
     }
 
-    QScopedPointer<PendingReply<QString> > reply (
-        _dbus->GetConnectionAppArmorSecurityContext(connName));
-    // blocking but should be ok for now
-    reply->waitForFinished();
-    if (reply->isError()) {
-        LOG(ERROR) << reply->error();
+    QString context;
+    if (!securityContext(connName, context)) {
         details->dbusPath = QString(BASE_ACCOUNT_URL) + "/" + details->id;
         details->localPath = getLocalPath("");
         details->isConfined = false;
         return;
     } else {
         // use the returned value
-        details->appId = reply->value();
+        details->appId = context;
 
         if (details->appId.isEmpty() || details->appId == UNCONFINED_ID) {
             LOG(INFO) << "UNCONFINED APP";
@@ -145,6 +157,77 @@ AppArmor::getSecurityDetails(const QString& connName,
     }  // no dbus error
 }
 
+bool
+AppArmor::securityContext(const QString& connName, QString& context) {
+    if (_contexts.contains(connName)) {
+        context = _contexts[connName];
+        return true;
+    }
+
+    QScopedPointer<PendingReply<QString> > reply (
+        _dbus->GetConnectionAppArmorSecurityContext(connName));
+    // blocking but should be ok for now
+    reply->waitForFinished();
+    if (reply->isError()) {
+        LOG(ERROR) << reply->error();
+        return false;
+    }
+    context = reply->value();
+    // errors are not cached so that they are retried
+    if (_cacheContexts) {
+        _contexts[connName] = context;
+    }
+    return true;
+}
+
+bool
+AppArmor::resolveSecurityContext(const QString& connName) {
+    if (!_cacheContexts || connName.isEmpty()
+            || _contexts.contains(connName)) {
+        return false;
+    }
+
+    if (_resolving.contains(connName)) {
+        // already waiting for the bus
+        return true;
+    }
+
+    _resolving.insert(connName);
+    QScopedPointer<PendingReply<QString> > reply (
+        _dbus->GetConnectionAppArmorSecurityContext(connName));
+    auto watcher = new QDBusPendingCallWatcher(reply->pendingCall(), this);
+    CHECK(connect(watcher, &QDBusPendingCallWatcher::finished,
+        this, [this, connName](QDBusPendingCallWatcher* call) {
+            QDBusPendingReply<QString> result = *call;
+            // the name could have changed owner while we waited
+            bool resolved = false;
+            if (_resolving.remove(connName)) {
+                if (result.isError()) {
+                    LOG(ERROR) << result.error();
+                } else {
+                    _contexts[connName] = result.value();
+                    resolved = true;
+                }
+            }
+            call->deleteLater();
+            emit securityContextResolved(connName, resolved);
+        })) << "Could not connect to signal";
+    return true;
+}
+
+void
+AppArmor::onNameOwnerChanged(const QString& name,
+                             const QString& oldOwner,
+                             const QString& newOwner) {
+    Q_UNUSED(newOwner);
+    _contexts.remove(name);
+    _resolving.remove(name);
+    if (!oldOwner.isEmpty()) {
+        _contexts.remove(oldOwner);
+        _resolving.remove(oldOwner);
+    }
+}
+
 QPair<QString, QString>
 AppArmor::getDBusPath() {
     QUuid uuid = _uuidFactory->createUuid();
@@ -191,10 +274,16 @@ AppArmor::getLocalPath(const QString& appId) {
 
         QString path = pathComponents.join(QDir::separator());
 
-        bool wasCreated = QDir().mkpath(path);
-        if (!wasCreated) {
-            LOG(ERROR) << "Could not create the data path"
-                << path;
+        // only create the directory the first time that it is used, or
+        // again if it was removed since
+        if (!_localPaths.contains(path) || !QFileInfo(path).isDir()) {
+            bool wasCreated = QDir().mkpath(path);
+            if (!wasCreated) {
+                LOG(ERROR) << "Could not create the data path"
+                    << path;
+            } else {
+                _localPaths.insert(path);
+            }
         }
         LOG(INFO) << "Local path is" << path;
         return path;
@@ -19,8 +19,10 @@
 #ifndef DOWNLOADER_LIB_APP_ARMOR_H
 #define DOWNLOADER_LIB_APP_ARMOR_H
 
+#include <QHash>
 #include <QObject>
 #include <QPair>
+#include <QSet>
 #include <QString>
 #include <ubuntu/transfers/system/dbus_connection.h>
 #include "dbus_proxy.h"
@@ -59,11 +61,27 @@ class AppArmor : public QObject {
     virtual QString appId(QString caller);
     virtual bool isConfined(QString appId);
 
+    // starts looking up the security context of the connection without
+    // blocking, securityContextResolved is emitted once the bus answers
+    // and states whether the context could be retrieved.
+    // Returns false when there is nothing to wait for, either because
+    // the context is already known or because it cannot be cached.
+    virtual bool resolveSecurityContext(const QString& connName);
+
     static QString UNCONFINED_ID;
 
+ signals:
+    void securityContextResolved(const QString& connName, bool resolved);
+
+ private slots:  // NOLINT(whitespace/indent)
+    void onNameOwnerChanged(const QString& name,
+                            const QString& oldOwner,
+                            const QString& newOwner);
+
  private:
     void getSecurityDetails(const QString& connName,
                             SecurityDetails* details);
+    bool securityContext(const QString& connName, QString& context);
     QString getLocalPath(const QString& appId);
 
  private:
@@ -71,6 +89,13 @@ class AppArmor : public QObject {
 
     DBusProxy* _dbus;
     UuidFactory* _uuidFactory;
+    // security contexts per connection name, a name is removed as soon
+    // as its owner changes
+    bool _cacheContexts = false;
+    QHash<QString, QString> _contexts;
+    QSet<QString> _resolving;
+    // local paths that are known to exist
+    QSet<QString> _localPaths;
 };
 
 }  // System
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "buffer_pool.h"
+
+namespace Ubuntu {
+
+namespace Transfers {
+
+namespace System {
+
+BufferPool* BufferPool::_instance = nullptr;
+QMutex BufferPool::_mutex;
+
+BufferPool::BufferPool(QObject* parent)
+    : QObject(parent) {
+    setBudget(DEFAULT_BUDGET);
+}
+
+BufferPool::~BufferPool() {
+    foreach(char* buffer, _free) {
+        delete[] buffer;
+    }
+    _free.clear();
+}
+
+char*
+BufferPool::acquire() {
+    QMutexLocker locker(&_buffersMutex);
+    if (_used >= _maxUsed) {
+        _exhausted = true;
+        return nullptr;
+    }
+
+    _used++;
+    if (_free.isEmpty()) {
+        return new char[BUFFER_SIZE];
+    }
+    return _free.takeLast();
+}
+
+void
+BufferPool::release(char* buffer) {
+    if (buffer == nullptr) {
+        return;
+    }
+
+    bool notify = false;
+    {
+        QMutexLocker locker(&_buffersMutex);
+        _used--;
+        if (_free.count() >= MAX_FREE_BUFFERS) {
+            delete[] buffer;
+        } else {
+            _free.append(buffer);
+        }
+
+        // wait until half of the budget is free so that the readers do
+        // not wake up for a single buffer
+        if (_exhausted && _used <= _maxUsed / 2) {
+            _exhausted = false;
+            notify = true;
+        }
+    }
+
+    if (notify) {
+        emit available();
+    }
+}
+
+int
+BufferPool::freeCount() {
+    QMutexLocker locker(&_buffersMutex);
+    return _free.count();
+}
+
+int
+BufferPool::usedCount() {
+    QMutexLocker locker(&_buffersMutex);
+    return _used;
+}
+
+qint64
+BufferPool::budget() {
+    QMutexLocker locker(&_buffersMutex);
+    return static_cast<qint64>(_maxUsed) * BUFFER_SIZE;
+}
+
+void
+BufferPool::setBudget(qint64 bytes) {
+    bool notify = false;
+    {
+        QMutexLocker locker(&_buffersMutex);
+        // at least one buffer must be available else nothing is read
+        _maxUsed = qMax(1, static_cast<int>(bytes / BUFFER_SIZE));
+        if (_exhausted && _used < _maxUsed) {
+            _exhausted = false;
+            notify = true;
+        }
+    }
+
+    if (notify) {
+        emit available();
+    }
+}
+
+BufferPool*
+BufferPool::instance() {
+    if(_instance == nullptr) {
+        _mutex.lock();
+        if(_instance == nullptr)
+            _instance = new BufferPool();
+        _mutex.unlock();
+    }
+    return _instance;
+}
+
+void
+BufferPool::setInstance(BufferPool* instance) {
+    _instance = instance;
+}
+
+void
+BufferPool::deleteInstance() {
+    if(_instance != nullptr) {
+        _mutex.lock();
+        if(_instance != nullptr) {
+            delete _instance;
+            _instance = nullptr;
+        }
+        _mutex.unlock();
+    }
+}
+
+}  // System
+
+}  // Transfers
+
+}  // Ubuntu
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOWNLOADER_LIB_BUFFER_POOL_H
+#define DOWNLOADER_LIB_BUFFER_POOL_H
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+
+namespace Ubuntu {
+
+namespace Transfers {
+
+namespace System {
+
+// Pool of fixed size buffers shared by all the transfers so that the data
+// read from the network does not need a new allocation per chunk. Buffers
+// are only allocated while the pool warms up, released buffers are kept
+// for reuse up to a maximum and freed after that.
+//
+// The pool also enforces the memory budget of the data that was read but
+// not yet written, once all the buffers of the budget are in use acquire
+// fails and the transfers stop reading until available is emitted.
+class BufferPool : public QObject {
+    Q_OBJECT
+
+ public:
+    static const int BUFFER_SIZE = 64 * 1024;
+    static const int MAX_FREE_BUFFERS = 64;
+    static const qint64 DEFAULT_BUDGET = 32 * 1024 * 1024;
+
+    virtual ~BufferPool();
+
+    // returns a buffer of BUFFER_SIZE bytes that must be given back
+    // with release once it is no longer used, or nullptr when the
+    // budget is exhausted
+    virtual char* acquire();
+    virtual void release(char* buffer);
+    int freeCount();
+    int usedCount();
+
+    qint64 budget();
+    // max amount of bytes that can be held in buffers at once
+    void setBudget(qint64 bytes);
+
+    static BufferPool* instance();
+
+    // only used for testing so that we can inject a fake
+    static void setInstance(BufferPool* instance);
+    static void deleteInstance();
+
+ signals:
+    // emitted when buffers are released after acquire failed
+    void available();
+
+ protected:
+    explicit BufferPool(QObject* parent = 0);
+
+ private:
+    QMutex _buffersMutex;
+    QList<char*> _free;
+    int _used = 0;
+    int _maxUsed = 0;
+    bool _exhausted = false;
+
+    // used for the singleton
+    static BufferPool* _instance;
+    static QMutex _mutex;
+};
+
+}  // System
+
+}  // Transfers
+
+}  // Ubuntu
+
+#endif  // DOWNLOADER_LIB_BUFFER_POOL_H
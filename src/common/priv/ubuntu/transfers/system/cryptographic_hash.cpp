@@ -39,6 +39,16 @@ CryptographicHash::addData(QIODevice * device) {
     return _hash.addData(device);
 }
 
+void
+CryptographicHash::addBytes(const QByteArray& data) {
+    _hash.addData(data);
+}
+
+void
+CryptographicHash::addBytes(const char* data, int length) {
+    _hash.addData(data, length);
+}
+
 QByteArray
 CryptographicHash::result() const {
     return _hash.result();
@@ -36,6 +36,8 @@ class CryptographicHash : public QObject {
     CryptographicHash(QCryptographicHash::Algorithm method,
                       QObject* parent = 0);
     virtual bool addData(QIODevice* device);
+    virtual void addBytes(const QByteArray& data);
+    virtual void addBytes(const char* data, int length);
     virtual QByteArray result() const;
 
  private:
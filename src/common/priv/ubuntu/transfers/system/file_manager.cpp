@@ -16,15 +16,27 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
 #include <QFile>
 #include <QFileInfo>
+#include <QVarLengthArray>
 #include <QTemporaryFile>
 #include "file_manager.h"
+#include "file_remover.h"
 
 namespace Ubuntu {
 
 namespace Transfers {
 
+namespace {
+    // amount of data written back at once, smaller windows mean more
+    // syscalls and bigger ones more dirty pages in memory
+    const qint64 CACHE_WINDOW_SIZE = 8 * 1024 * 1024;
+}
+
 namespace System {
 
 File::File(const QString& name) {
@@ -35,8 +47,16 @@ File::File(QFile* file)
     : _file(file) {
 }
 
+File::File(int anonymousFd)
+    : _anonymousFd(anonymousFd) {
+    _file = new QFile();
+}
+
 File::~File() {
     delete _file;
+    if (_anonymousFd != -1) {
+        ::close(_anonymousFd);
+    }
 }
 
 void
@@ -59,9 +79,32 @@ File::flush() {
     return _file->flush();
 }
 
+bool
+File::sync() {
+    if (!_file->flush()) {
+        return false;
+    }
+    auto fd = _file->handle();
+    return fd == -1 || fdatasync(fd) == 0;
+}
+
 bool
 File::open(QIODevice::OpenMode mode) {
-    return _file->open(mode);
+    if (_anonymousFd == -1) {
+        return _file->open(mode);
+    }
+
+    // the file cannot be opened again by name, reuse the descriptor
+    // with the new mode
+    if (_file->isOpen()) {
+        _file->close();
+    }
+    auto flags = fcntl(_anonymousFd, F_GETFL);
+    flags = (mode & QIODevice::Append)? flags | O_APPEND : flags & ~O_APPEND;
+    if (fcntl(_anonymousFd, F_SETFL, flags) == -1) {
+        return false;
+    }
+    return _file->open(_anonymousFd, mode, QFileDevice::DontCloseHandle);
 }
 
 QByteArray
@@ -71,7 +114,15 @@ File::readAll() {
 
 bool
 File::remove() {
-    return _file->remove();
+    _file->close();
+    if (_anonymousFd == -1) {
+        return FileRemover::instance()->remove(_file->fileName());
+    }
+
+    // closing the last descriptor frees the data
+    FileRemover::instance()->close(_anonymousFd);
+    _anonymousFd = -1;
+    return true;
 }
 
 bool
@@ -79,6 +130,33 @@ File::reset() {
     return _file->reset();
 }
 
+bool
+File::resize(qint64 size) {
+    return _file->resize(size);
+}
+
+bool
+File::reserve(qint64 size) {
+    auto fd = _file->handle();
+    if (fd == -1 || size <= 0) {
+        return true;
+    }
+
+    // keep the size so that the file still tells how much data was
+    // written, appending and resuming from its size keep working
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) == 0) {
+        return true;
+    }
+
+    // file systems that do not support it are written as usual
+    return errno != ENOSPC && errno != EDQUOT;
+}
+
+bool
+File::seek(qint64 pos) {
+    return _file->seek(pos);
+}
+
 qint64
 File::size() const {
     return _file->size();
@@ -89,12 +167,174 @@ File::write(const QByteArray& byteArray) {
     return _file->write(byteArray);
 }
 
+qint64
+File::writev(const struct iovec* iov, int count) {
+    auto fd = _file->handle();
+    if (fd == -1 || !(_file->openMode() & QIODevice::Append)
+            || !_file->flush()) {
+        // the position of the QFile has to be respected, write the
+        // buffers one by one
+        qint64 total = 0;
+        for (int index = 0; index < count; index++) {
+            auto written = _file->write(static_cast<const char*>(
+                iov[index].iov_base), iov[index].iov_len);
+            if (written < 0) {
+                return (total > 0)? total : -1;
+            }
+            total += written;
+            if (written != static_cast<qint64>(iov[index].iov_len)) {
+                break;
+            }
+        }
+        return total;
+    }
+
+    // the QFile has nothing buffered and the kernel appends to the end
+    // of the file
+    return writeFully(fd, iov, count);
+}
+
+qint64
+File::writevAt(const struct iovec* iov, int count, qint64 offset) {
+    auto fd = _file->handle();
+    if (fd == -1 || !_file->flush()) {
+        // not backed by a descriptor, go through the QFile
+        if (!_file->seek(offset)) {
+            return -1;
+        }
+        return writev(iov, count);
+    }
+    return writeFully(fd, iov, count, offset);
+}
+
+qint64
+File::writeFully(int fd, const struct iovec* iov, int count,
+                 qint64 offset) {
+    QVarLengthArray<struct iovec, 16> pending(count);
+    for (int index = 0; index < count; index++) {
+        pending[index] = iov[index];
+    }
+
+    // keep writing until all data is out or there is an error
+    qint64 total = 0;
+    struct iovec* current = pending.data();
+    int left = count;
+    while (left > 0) {
+        auto written = (offset < 0)? ::writev(fd, current, left) :
+            ::pwritev(fd, current, left, offset + total);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (total > 0)? total : -1;
+        }
+        if (written == 0) {
+            break;
+        }
+        total += written;
+
+        // skip the buffers that were fully written
+        while (left > 0
+                && static_cast<size_t>(written) >= current->iov_len) {
+            written -= current->iov_len;
+            current++;
+            left--;
+        }
+        if (left > 0) {
+            current->iov_base = static_cast<char*>(current->iov_base)
+                + written;
+            current->iov_len -= written;
+        }
+    }
+    return total;
+}
 
 QIODevice*
 File::device() {
     return _file;
 }
 
+int
+File::handle() const {
+    return _file->handle();
+}
+
+bool
+File::isAnonymous() const {
+    return _anonymousFd != -1;
+}
+
+bool
+File::link(const QString& path) {
+    if (_anonymousFd == -1 || !_file->flush()) {
+        return false;
+    }
+
+    // linkat with AT_EMPTY_PATH needs extra capabilities, going through
+    // proc does not
+    auto procPath = "/proc/self/fd/" + QByteArray::number(_anonymousFd);
+    return linkat(AT_FDCWD, procPath.constData(), AT_FDCWD,
+        QFile::encodeName(path).constData(), AT_SYMLINK_FOLLOW) == 0;
+}
+
+void
+File::setDropCache(bool drop) {
+    _dropCache = drop;
+}
+
+bool
+File::dropsCache() const {
+    return _dropCache;
+}
+
+void
+File::releaseCache(qint64 size) {
+    if (size < _writebackOffset) {
+        // the file was truncated, start again
+        _writebackOffset = 0;
+        _droppedOffset = 0;
+    }
+
+    if (!_dropCache || size - _writebackOffset < CACHE_WINDOW_SIZE) {
+        return;
+    }
+
+    // the previous window had time to be written back, wait for it so
+    // that its pages are clean, dirty pages cannot be dropped
+    auto length = _writebackOffset - _droppedOffset;
+    if (length > 0) {
+        writeBack(_droppedOffset, length, true);
+        dropPages(_droppedOffset, length);
+        _droppedOffset = _writebackOffset;
+    }
+
+    // do not wait for the new data, it is dropped in the next call
+    writeBack(_writebackOffset, size - _writebackOffset, false);
+    _writebackOffset = size;
+}
+
+void
+File::writeBack(qint64 offset, qint64 length, bool wait) {
+    auto fd = _file->handle();
+    if (fd == -1) {
+        return;
+    }
+    unsigned int flags = SYNC_FILE_RANGE_WRITE;
+    if (wait) {
+        flags |= SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WAIT_AFTER;
+    }
+    sync_file_range(fd, offset, length, flags);
+}
+
+void
+File::dropPages(qint64 offset, qint64 length) {
+    auto fd = _file->handle();
+    if (fd == -1) {
+        return;
+    }
+    posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
 FileManager* FileManager::_instance = nullptr;
 QMutex FileManager::_mutex;
 
@@ -103,6 +343,16 @@ FileManager::createFile(const QString& name) {
     return new File(name);
 }
 
+File*
+FileManager::createAnonymousFile(const QString& dir) {
+    auto fd = ::open(QFile::encodeName(dir).constData(),
+        O_TMPFILE | O_RDWR, 0666);
+    if (fd == -1) {
+        return nullptr;
+    }
+    return new File(fd);
+}
+
 File*
 FileManager::copyToTempFile(const QString& name) {
     // create a temp file, and copy the old name to the
@@ -133,6 +383,19 @@ FileManager::isDir(const QString& path) {
     return QFileInfo(path).isDir();
 }
 
+bool
+FileManager::freeSpace(const QString& path,
+                       qint64& bytes,
+                       qulonglong& fileSystem) {
+    struct statvfs info;
+    if (statvfs(QFile::encodeName(path).constData(), &info) != 0) {
+        return false;
+    }
+    bytes = static_cast<qint64>(info.f_bavail) * info.f_frsize;
+    fileSystem = info.f_fsid;
+    return true;
+}
+
 FileManager* FileManager::instance() {
     if(_instance == nullptr) {
         _mutex.lock();
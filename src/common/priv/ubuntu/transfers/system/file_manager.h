@@ -19,6 +19,8 @@
 #ifndef DOWNLOADER_LIB_FILE_MANAGER_H
 #define DOWNLOADER_LIB_FILE_MANAGER_H
 
+#include <atomic>
+#include <sys/uio.h>
 #include <QIODevice>
 #include <QFile>
 #include <QMutex>
@@ -43,20 +45,67 @@ class File : public QObject {
     virtual QFile::FileError error() const;  // virtual for testing purposes
     virtual QString fileName() const;
     virtual bool flush();  // virtual for testing purposes
+    // flushes the data to the disk and not only to the kernel
+    virtual bool sync();
     virtual bool open(QIODevice::OpenMode mode);
     virtual QByteArray readAll();
     virtual bool remove();
     virtual bool reset();
+    virtual bool resize(qint64 size);
+    // allocates the disk blocks for size bytes without changing the size
+    // of the file, returns false only when there is not enough space
+    virtual bool reserve(qint64 size);
+    virtual bool seek(qint64 pos);
     virtual qint64 size() const;
     virtual qint64 write(const QByteArray& byteArray);
+    // writes all the buffers with a single call when the file is appended
+    // to, returns the number of bytes written or -1 on error
+    virtual qint64 writev(const struct iovec* iov, int count);
+    // writes all the buffers at the given offset, the file must not be
+    // in append mode
+    virtual qint64 writevAt(const struct iovec* iov, int count,
+                            qint64 offset);
     virtual QIODevice* device();
+    virtual int handle() const;
+
+    // anonymous files have no name until they are published with link,
+    // if never published their data is gone once they are closed
+    bool isAnonymous() const;
+    virtual bool link(const QString& path);
+
+    // when set the data that was written is dropped from the page cache,
+    // big downloads do not evict the working set of the applications
+    void setDropCache(bool drop);
+    bool dropsCache() const;
+    // starts the write back of the data up to size and drops the pages
+    // of the data that was written back since the previous call, it must
+    // only be called from the thread that writes the file
+    virtual void releaseCache(qint64 size);
+
+    // writes all the buffers to the descriptor retrying partial writes,
+    // at the given offset unless it is negative, returns the number of
+    // bytes written or -1 on error
+    static qint64 writeFully(int fd, const struct iovec* iov, int count,
+                             qint64 offset = -1);
 
  protected:
     explicit File(const QString& name);
     explicit File(QFile* file);
+    explicit File(int anonymousFd);
+
+    // wrappers around sync_file_range and posix_fadvise used by
+    // releaseCache, virtual for testing purposes
+    virtual void writeBack(qint64 offset, qint64 length, bool wait);
+    virtual void dropPages(qint64 offset, qint64 length);
 
  private:
     QFile* _file = nullptr;
+    int _anonymousFd = -1;
+    // set from the main thread while the writer may be using the file
+    std::atomic<bool> _dropCache{false};
+    // owned by the thread that writes the file
+    qint64 _writebackOffset = 0;
+    qint64 _droppedOffset = 0;
 
 };
 
@@ -65,11 +114,19 @@ class FileManager : public QObject {
 
  public:
     virtual File* createFile(const QString& name);
+    // creates an unnamed file in the given dir, returns nullptr when the
+    // kernel or the file system do not support them
+    virtual File* createAnonymousFile(const QString& dir);
     virtual File* copyToTempFile(const QString& name);
     virtual bool remove(const QString& path);
     virtual bool exists(const QString& path);
     virtual bool rename(const QString& oldName, const QString& newName);
     virtual bool isDir(const QString& path);
+    // bytes available to unprivileged users in the file system of path
+    // and the id of the file system, false when it cannot be checked
+    virtual bool freeSpace(const QString& path,
+                           qint64& bytes,
+                           qulonglong& fileSystem);
 
     static FileManager* instance();
 
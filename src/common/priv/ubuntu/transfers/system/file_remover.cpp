@@ -0,0 +1,255 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QUuid>
+
+#include <glog/logging.h>
+#include <ubuntu/transfers/system/logger.h>
+
+#include "file_manager.h"
+#include "file_remover.h"
+#include "uuid_utils.h"
+
+namespace {
+    const QString REMOVED_PREFIX = ".udm-removed-";
+}
+
+namespace Ubuntu {
+
+namespace Transfers {
+
+namespace System {
+
+FileRemover* FileRemover::_instance = nullptr;
+QMutex FileRemover::_mutex;
+
+FileRemover::FileRemover(QObject* parent)
+    : QThread(parent) {
+    // do not leave the thread running when the daemon exits, the files
+    // that are left are removed the next time
+    if (QCoreApplication::instance() != nullptr) {
+        CHECK(connect(QCoreApplication::instance(),
+            &QCoreApplication::aboutToQuit, this, &FileRemover::stop))
+                << "Could not connect to signal";
+    }
+}
+
+FileRemover::~FileRemover() {
+    stop();
+}
+
+bool
+FileRemover::remove(const QString& path) {
+    if (!isRunning()) {
+        // nothing frees the blocks in the background, the file manager
+        // removes the file right away
+        return FileManager::instance()->remove(path);
+    }
+
+    // a rename is cheap, the slow part is freeing the blocks
+    auto removedPath = QFileInfo(path).absolutePath() + QDir::separator()
+        + REMOVED_PREFIX + UuidUtils::getDBusString(QUuid::createUuid());
+
+    // the hidden name is in the disk before the file gets it, a crash
+    // in between can never leave a file that nobody knows about. The
+    // lock keeps the thread from dropping the list until it is queued.
+    QMutexLocker locker(&_queueMutex);
+    storeEntry(removedPath);
+    if (::rename(QFile::encodeName(path).constData(),
+            QFile::encodeName(removedPath).constData()) != 0) {
+        auto error = errno;
+        locker.unlock();
+        if (error == ENOENT) {
+            return false;
+        }
+        LOG(WARNING) << "Could not move '" << path << "' to be removed: "
+            << error;
+        return FileManager::instance()->remove(path);
+    }
+
+    Entry entry;
+    entry.path = removedPath;
+    entry.fd = -1;
+    _entries.push_back(entry);
+    _queued.wakeOne();
+    return true;
+}
+
+void
+FileRemover::close(int fd) {
+    if (!isRunning()) {
+        ::close(fd);
+        return;
+    }
+
+    Entry entry;
+    entry.fd = fd;
+    enqueue(entry);
+}
+
+void
+FileRemover::enqueue(const Entry& entry) {
+    QMutexLocker locker(&_queueMutex);
+    _entries.push_back(entry);
+    _queued.wakeOne();
+}
+
+void
+FileRemover::storeEntry(const QString& path) {
+    if (_listPath.isEmpty()) {
+        return;
+    }
+
+    // the names of files that are already gone are ignored when the
+    // list is read, a stored name is never lost
+    QFile list(_listPath);
+    if (!list.open(QIODevice::WriteOnly | QIODevice::Append)
+            || list.write(QFile::encodeName(path) + "\n") < 0
+            || !list.flush() || fdatasync(list.handle()) != 0) {
+        LOG(WARNING) << "Could not store '" << path << "' to be removed";
+    }
+}
+
+void
+FileRemover::setListPath(const QString& path) {
+    QMutexLocker locker(&_queueMutex);
+    _listPath = path;
+
+    // queue the files that a previous run did not remove
+    QFile list(_listPath);
+    if (!list.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    foreach(const QByteArray& line, list.readAll().split('\n')) {
+        if (line.isEmpty()) {
+            continue;
+        }
+        Entry entry;
+        entry.path = QFile::decodeName(line);
+        entry.fd = -1;
+        _entries.push_back(entry);
+    }
+    _queued.wakeOne();
+}
+
+void
+FileRemover::waitForAll() {
+    QMutexLocker locker(&_queueMutex);
+    while (isRunning() && (!_entries.empty() || _running > 0)) {
+        _removed.wait(&_queueMutex);
+    }
+}
+
+void
+FileRemover::stop() {
+    {
+        QMutexLocker locker(&_queueMutex);
+        _stopping = true;
+        _queued.wakeAll();
+    }
+    wait();
+
+    // the descriptors cannot be kept for the next run
+    QMutexLocker locker(&_queueMutex);
+    std::deque<Entry> paths;
+    for (auto entry : _entries) {
+        if (entry.fd != -1) {
+            ::close(entry.fd);
+        } else {
+            paths.push_back(entry);
+        }
+    }
+    _entries.swap(paths);
+    _stopping = false;
+    _removed.wakeAll();
+}
+
+void
+FileRemover::run() {
+    QMutexLocker locker(&_queueMutex);
+    while (!_stopping) {
+        if (_entries.empty()) {
+            _queued.wait(&_queueMutex);
+            continue;
+        }
+
+        auto entry = _entries.front();
+        _entries.pop_front();
+        _running++;
+
+        // do not hold the lock while removing so that more files can be
+        // queued by the main thread
+        locker.unlock();
+        if (entry.fd != -1) {
+            ::close(entry.fd);
+        } else if (!QFile::remove(entry.path) && QFile::exists(entry.path)) {
+            LOG(WARNING) << "Could not remove '" << entry.path << "'";
+        }
+        locker.relock();
+
+        _running--;
+        if (_entries.empty()) {
+            // every stored file is gone
+            if (!_listPath.isEmpty()) {
+                QFile::remove(_listPath);
+            }
+            _removed.wakeAll();
+        }
+    }
+}
+
+FileRemover*
+FileRemover::instance() {
+    if(_instance == nullptr) {
+        _mutex.lock();
+        if(_instance == nullptr)
+            _instance = new FileRemover();
+        _mutex.unlock();
+    }
+    return _instance;
+}
+
+void
+FileRemover::setInstance(FileRemover* instance) {
+    _instance = instance;
+}
+
+void
+FileRemover::deleteInstance() {
+    if(_instance != nullptr) {
+        _mutex.lock();
+        if(_instance != nullptr) {
+            delete _instance;
+            _instance = nullptr;
+        }
+        _mutex.unlock();
+    }
+}
+
+}  // System
+
+}  // Transfers
+
+}  // Ubuntu
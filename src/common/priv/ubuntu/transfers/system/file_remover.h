@@ -0,0 +1,100 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOWNLOADER_LIB_FILE_REMOVER_H
+#define DOWNLOADER_LIB_FILE_REMOVER_H
+
+#include <deque>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+namespace Ubuntu {
+
+namespace Transfers {
+
+namespace System {
+
+// Thread that deletes the files of canceled and failed transfers so that
+// unlinking a big file does not block the main loop. The files are moved
+// to a unique hidden name next to them before being queued, that way the
+// original name can be used right away and the names kept in the list
+// of pending files are never reused. The list is stored in the disk so
+// that the files left by a crash are removed the next time. Until the
+// thread is started the files are removed right away by the FileManager.
+class FileRemover : public QThread {
+    Q_OBJECT
+
+ public:
+    virtual ~FileRemover();
+
+    // false when the file could not be moved or removed
+    virtual bool remove(const QString& path);
+    // closes a descriptor, closing the last one of an unlinked file
+    // frees its data
+    virtual void close(int fd);
+    // file used to store the pending files, the files left in it by a
+    // previous run are queued
+    void setListPath(const QString& path);
+    // blocks until all the queued files are removed
+    void waitForAll();
+    void stop();
+
+    static FileRemover* instance();
+
+    // only used for testing so that we can inject a fake
+    static void setInstance(FileRemover* instance);
+    static void deleteInstance();
+
+ protected:
+    explicit FileRemover(QObject* parent = 0);
+    void run() override;
+
+ private:
+    struct Entry {
+        QString path;
+        int fd;
+    };
+
+    void enqueue(const Entry& entry);
+    // appends the path to the list in the disk, the queue lock must be
+    // held
+    void storeEntry(const QString& path);
+
+ private:
+    bool _stopping = false;
+    int _running = 0;
+    QString _listPath;
+    QMutex _queueMutex;
+    QWaitCondition _queued;
+    QWaitCondition _removed;
+    std::deque<Entry> _entries;
+
+    // used for the singleton
+    static FileRemover* _instance;
+    static QMutex _mutex;
+};
+
+}  // System
+
+}  // Transfers
+
+}  // Ubuntu
+
+#endif  // DOWNLOADER_LIB_FILE_REMOVER_H
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <QCoreApplication>
+
+#include <glog/logging.h>
+#include <ubuntu/transfers/system/logger.h>
+
+#include "buffer_pool.h"
+#include "file_writer.h"
+
+namespace Ubuntu {
+
+namespace Transfers {
+
+namespace System {
+
+FileWriter* FileWriter::_instance = nullptr;
+QMutex FileWriter::_mutex;
+
+FileWriter::FileWriter(QObject* parent)
+    : QThread(parent) {
+    // do not leave the thread running when the daemon exits
+    if (QCoreApplication::instance() != nullptr) {
+        CHECK(connect(QCoreApplication::instance(),
+            &QCoreApplication::aboutToQuit, this, &FileWriter::stop))
+                << "Could not connect to signal";
+    }
+}
+
+FileWriter::~FileWriter() {
+    stop();
+}
+
+void
+FileWriter::append(File* file, const struct iovec* iov, int count) {
+    write(file, iov, count, -1);
+}
+
+void
+FileWriter::write(File* file, const struct iovec* iov, int count,
+                  qint64 offset) {
+    // more buffers than a chunk holds are queued as consecutive chunks,
+    // every buffer is written and given back to the pool
+    while (count > 0) {
+        Chunk chunk;
+        chunk.file = file;
+        chunk.fd = file->handle();
+        chunk.count = qMin(count, static_cast<int>(MAX_CHUNK_BUFFERS));
+        chunk.offset = offset;
+        chunk.size = 0;
+        chunk.sync = false;
+        // the cache is released in order, data written in place is not
+        chunk.dropCache = offset < 0 && file->dropsCache();
+        for (int index = 0; index < chunk.count; index++) {
+            chunk.iov[index] = iov[index];
+            chunk.size += iov[index].iov_len;
+        }
+        enqueue(chunk);
+
+        iov += chunk.count;
+        count -= chunk.count;
+        if (offset >= 0) {
+            offset += chunk.size;
+        }
+    }
+}
+
+void
+FileWriter::sync(File* file) {
+    Chunk chunk;
+    chunk.file = file;
+    chunk.fd = file->handle();
+    chunk.count = 0;
+    chunk.offset = -1;
+    chunk.size = 0;
+    chunk.sync = true;
+    chunk.dropCache = false;
+    enqueue(chunk);
+}
+
+void
+FileWriter::enqueue(Chunk& chunk) {
+    QMutexLocker locker(&_queueMutex);
+    auto& state = _files[chunk.file];
+    if (state.chunks == 0) {
+        state.size = chunk.file->size();
+    }
+    state.chunks++;
+    if (chunk.offset < 0) {
+        state.size += chunk.size;
+    } else {
+        state.size = qMax(state.size, chunk.offset + chunk.size);
+    }
+    chunk.end = state.size;
+    _chunks.push_back(chunk);
+    _queued.wakeOne();
+}
+
+qint64
+FileWriter::size(File* file) {
+    {
+        QMutexLocker locker(&_queueMutex);
+        if (_files.contains(file)) {
+            return _files[file].size;
+        }
+    }
+    return file->size();
+}
+
+void
+FileWriter::waitForFile(File* file) {
+    QMutexLocker locker(&_queueMutex);
+    while (_files.contains(file)) {
+        _written.wait(&_queueMutex);
+    }
+}
+
+void
+FileWriter::stop() {
+    {
+        QMutexLocker locker(&_queueMutex);
+        _stopping = true;
+        _queued.wakeAll();
+    }
+    wait();
+
+    QMutexLocker locker(&_queueMutex);
+    _stopping = false;
+}
+
+void
+FileWriter::run() {
+    QMutexLocker locker(&_queueMutex);
+    // the pending data is written before stopping, the files are
+    // waiting for it
+    while (!_stopping || !_chunks.empty()) {
+        if (_chunks.empty()) {
+            _queued.wait(&_queueMutex);
+            continue;
+        }
+
+        auto chunk = _chunks.front();
+        _chunks.pop_front();
+
+        // do not hold the lock while writing so that more data can be
+        // queued by the main thread
+        locker.unlock();
+        if (chunk.sync) {
+            if (fdatasync(chunk.fd) == 0) {
+                emit synced(chunk.file, chunk.end);
+            } else {
+                auto error = errno;
+                LOG(ERROR) << "Could not sync " << chunk.fd << ": " << error;
+                emit writeError(chunk.file, error);
+            }
+        } else {
+            auto written = File::writeFully(chunk.fd, chunk.iov,
+                chunk.count, chunk.offset);
+            auto error = errno;
+            releaseBuffers(chunk);
+            if (written != chunk.size) {
+                LOG(ERROR) << "Could not write to " << chunk.fd << ": "
+                    << error;
+                emit writeError(chunk.file, error);
+            } else if (chunk.dropCache) {
+                chunk.file->releaseCache(chunk.end);
+            }
+        }
+        locker.relock();
+
+        auto& state = _files[chunk.file];
+        state.chunks--;
+        if (state.chunks == 0) {
+            _files.remove(chunk.file);
+            _written.wakeAll();
+        }
+    }
+}
+
+void
+FileWriter::releaseBuffers(const Chunk& chunk) {
+    auto pool = BufferPool::instance();
+    for (int index = 0; index < chunk.count; index++) {
+        pool->release(static_cast<char*>(chunk.iov[index].iov_base));
+    }
+}
+
+FileWriter*
+FileWriter::instance() {
+    if(_instance == nullptr) {
+        _mutex.lock();
+        if(_instance == nullptr)
+            _instance = new FileWriter();
+        _mutex.unlock();
+    }
+    return _instance;
+}
+
+void
+FileWriter::setInstance(FileWriter* instance) {
+    _instance = instance;
+}
+
+void
+FileWriter::deleteInstance() {
+    if(_instance != nullptr) {
+        _mutex.lock();
+        if(_instance != nullptr) {
+            delete _instance;
+            _instance = nullptr;
+        }
+        _mutex.unlock();
+    }
+}
+
+}  // System
+
+}  // Transfers
+
+}  // Ubuntu
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOWNLOADER_LIB_FILE_WRITER_H
+#define DOWNLOADER_LIB_FILE_WRITER_H
+
+#include <deque>
+#include <sys/uio.h>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include "file_manager.h"
+
+namespace Ubuntu {
+
+namespace Transfers {
+
+namespace System {
+
+// Thread that appends the data of the transfers to their files so that a
+// slow file system does not block the main loop that also serves dbus.
+// The data is given as buffers of the BufferPool which are given back
+// once written. Until the thread is started no data is accepted and the
+// callers are expected to write it themselves.
+class FileWriter : public QThread {
+    Q_OBJECT
+
+ public:
+    static const int MAX_CHUNK_BUFFERS = 16;
+
+    virtual ~FileWriter();
+
+    // appends the buffers to the file taking over them, the file must
+    // have been opened for appending and must not be written by the
+    // caller until waitForFile returns
+    virtual void append(File* file, const struct iovec* iov, int count);
+    // same as append but the buffers are written at the given offset,
+    // used by the transfers that write their file in place
+    virtual void write(File* file, const struct iovec* iov, int count,
+                       qint64 offset);
+    // flushes the data of the file to the disk once the data queued
+    // before is written, synced is emitted when done
+    virtual void sync(File* file);
+    // the size the file will have once its pending data is written
+    virtual qint64 size(File* file);
+    // blocks until all the pending data of the file was written, must be
+    // called before the file is closed, moved or written directly
+    virtual void waitForFile(File* file);
+    void stop();
+
+    static FileWriter* instance();
+
+    // only used for testing so that we can inject a fake
+    static void setInstance(FileWriter* instance);
+    static void deleteInstance();
+
+ signals:
+    // emitted from the writer thread when the data could not be written
+    void writeError(File* file, int error);
+    // emitted from the writer thread when the first size bytes of the
+    // file are known to be on the disk
+    void synced(File* file, qint64 size);
+
+ protected:
+    explicit FileWriter(QObject* parent = 0);
+    void run() override;
+
+ private:
+    struct Chunk {
+        File* file;
+        int fd;
+        int count;
+        // negative when the data is appended
+        qint64 offset;
+        qint64 size;
+        // size of the file once the chunk is written
+        qint64 end;
+        bool sync;
+        // taken when queued so that the writer does not read the flag
+        // while the main thread changes it
+        bool dropCache;
+        struct iovec iov[MAX_CHUNK_BUFFERS];
+    };
+
+    struct FileState {
+        int chunks = 0;
+        qint64 size = 0;
+    };
+
+    void enqueue(Chunk& chunk);
+    void releaseBuffers(const Chunk& chunk);
+
+ private:
+    bool _stopping = false;
+    QMutex _queueMutex;
+    QWaitCondition _queued;
+    QWaitCondition _written;
+    std::deque<Chunk> _chunks;
+    QHash<File*, FileState> _files;
+
+    // used for the singleton
+    static FileWriter* _instance;
+    static QMutex _mutex;
+};
+
+}  // System
+
+}  // Transfers
+
+}  // Ubuntu
+
+#endif  // DOWNLOADER_LIB_FILE_WRITER_H
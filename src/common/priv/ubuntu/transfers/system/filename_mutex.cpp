@@ -16,6 +16,7 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <ubuntu/transfers/metadata.h>
@@ -35,6 +36,55 @@ FileNameMutex::FileNameMutex(QObject* parent)
     : QObject(parent) {
 }
 
+FileNameMutex::NameParts
+FileNameMutex::splitName(const QString& fileName) {
+    // Split the name into 2 parts - dot+extension, and everything
+    // else. For example, "file.tar.gz" becomes "file"+".tar.gz",
+    // while "file" (note lack of extension) becomes "file"+"".
+    auto secondPart = QFileInfo(fileName).completeSuffix();
+    auto firstPart = fileName;
+
+    if (!secondPart.isEmpty()) {
+        secondPart = "." + secondPart;
+        firstPart = fileName.left(fileName.size() - secondPart.size());
+    }
+    return qMakePair(firstPart, secondPart);
+}
+
+QHash<FileNameMutex::NameParts, int>&
+FileNameMutex::directoryIndex(const QString& dir) {
+    if (_indexes.contains(dir)) {
+        return _indexes[dir];
+    }
+
+    // find the names that already use a number suffix, "file (3).tar.gz"
+    // means that "file"+".tar.gz" has to start looking from 4
+    auto& index = _indexes[dir];
+    auto names = QDir(dir).entryList(QDir::AllEntries | QDir::Hidden
+        | QDir::System | QDir::NoDotAndDotDot);
+    foreach(const QString& name, names) {
+        auto parts = splitName(name);
+        auto firstPart = parts.first;
+        auto start = firstPart.lastIndexOf(" (");
+        if (start < 0 || !firstPart.endsWith(")")) {
+            continue;
+        }
+
+        bool ok = false;
+        auto number = firstPart.mid(start + 2,
+            firstPart.size() - start - 3).toInt(&ok);
+        if (!ok || number < 1) {
+            continue;
+        }
+
+        auto key = qMakePair(firstPart.left(start), parts.second);
+        if (number > index.value(key)) {
+            index[key] = number;
+        }
+    }
+    return index;
+}
+
 QString
 FileNameMutex::lockFileName(const QString& expectedName) {
     auto path = expectedName;
@@ -45,22 +95,17 @@ FileNameMutex::lockFileName(const QString& expectedName) {
         _mutex.unlock();
         return path;
     }
-    // Split the file into 2 parts - dot+extension, and everything
-    // else. For example, "path/file.tar.gz" becomes
-    // "path/file"+".tar.gz", while "path/file" (note lack of
-    // extension) becomes "path/file"+"".
-    auto secondPart = fileInfo.completeSuffix();
-    auto firstPart = expectedName;
-
-    if (!secondPart.isEmpty()) {
-        secondPart = "." + secondPart;
-        firstPart = expectedName.left(expectedName.size()
-            - secondPart.size());
-    }
-
-    // Try with an ever-increasing number suffix, until we've
-    // reached a file that does not yet exist.
-    for (int ii = 1; ; ii++) {
+    auto key = splitName(fileInfo.fileName());
+    auto firstPart = expectedName.left(expectedName.size()
+        - key.second.size());
+    auto secondPart = key.second;
+
+    // Try with an ever-increasing number suffix starting after the
+    // highest one in use, until we've reached a file that does not yet
+    // exist. Files created by others after the dir was indexed are
+    // still checked so that they are never overwritten.
+    auto& index = directoryIndex(fileInfo.absolutePath());
+    for (int ii = index.value(key) + 1; ; ii++) {
         // Construct the new file name by adding the unique
         // number between the first and second part.
         path = QString("%1 (%2)%3").arg(firstPart
@@ -68,6 +113,7 @@ FileNameMutex::lockFileName(const QString& expectedName) {
         // If no file exists with the new name, return it.
         if (!_paths.contains(path) && !QFile::exists(path)) {
             _paths.insert(path);
+            index[key] = ii;
             LOG(INFO) << "Locked path '" << path << "'";
             break;
         }
@@ -19,8 +19,10 @@
 #ifndef DOWNLOADER_LIB_FILENAME_MUTEX_H
 #define DOWNLOADER_LIB_FILENAME_MUTEX_H
 
+#include <QHash>
 #include <QMutex>
 #include <QObject>
+#include <QPair>
 #include <QVariant>
 #include <QSet>
 
@@ -52,7 +54,16 @@ class FileNameMutex : public QObject {
     static FileNameMutex* _instance;
     static QMutex _singletonMutex;
 
+    // name without the suffix and extension of the name
+    typedef QPair<QString, QString> NameParts;
+
+    static NameParts splitName(const QString& fileName);
+    QHash<NameParts, int>& directoryIndex(const QString& dir);
+
     QMutex _mutex;
+    // highest number suffix used per name in a dir, built from a single
+    // scan of the dir the first time that a collision happens in it
+    QHash<QString, QHash<NameParts, int> > _indexes;
 };
 
 }  // System
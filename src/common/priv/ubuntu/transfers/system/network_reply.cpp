@@ -29,19 +29,35 @@ namespace Transfers {
 
 namespace System {
 
+namespace {
+    // number of reads per second performed when throttled
+    const qint64 READS_PER_SECOND = 10;
+    const qint64 RATE_WINDOW_MSECS = 1000;
+    // max data that qt holds per reply when not throttled, once it is
+    // full the socket is no longer read and tcp makes the server wait
+    const qint64 UNTHROTTLED_READ_BUFFER_SIZE = 1024 * 1024;
+}
+
 NetworkReply::NetworkReply(QNetworkReply* reply, QObject* parent)
     : QObject(parent),
       _reply(reply) {
+    _rateClock.start();
+    _throttleTimer = new Timer(this);
+    CHECK(connect(_throttleTimer, &Timer::timeout,
+        this, &NetworkReply::onThrottleTimeout))
+            << "Could not connect to signal";
+
     // connect to all the signals so that we forward them
     if (_reply != nullptr) {
+        _reply->setReadBufferSize(UNTHROTTLED_READ_BUFFER_SIZE);
         CHECK(connect(_reply, &QNetworkReply::downloadProgress,
-            this, &NetworkReply::downloadProgress))
+            this, &NetworkReply::onDownloadProgress))
                 << "Could not connect to signal";
         CHECK(connect(_reply, &QNetworkReply::uploadProgress,
             this, &NetworkReply::uploadProgress))
                 << "Could not connect to signal";
         CHECK(connect(_reply, &QNetworkReply::finished,
-            this, &NetworkReply::finished))
+            this, &NetworkReply::onFinished))
                 << "Could not connect to signal";
         CHECK(connect(_reply, &QNetworkReply::sslErrors,
             this, &NetworkReply::sslErrors))
@@ -60,19 +76,138 @@ NetworkReply::~NetworkReply() {
 
 QByteArray
 NetworkReply::readAll() {
-    return _reply->readAll();
+    QByteArray data;
+    if (_bucket.isLimited()) {
+        auto allowed = _bucket.consume(_reply->bytesAvailable());
+        data = _reply->read(allowed);
+        if (_reply->bytesAvailable() > 0 || _finishPending) {
+            scheduleRead();
+        }
+    } else {
+        data = _reply->readAll();
+    }
+    updateTransferRate(data.size());
+    return data;
+}
+
+qint64
+NetworkReply::read(char* data, qint64 maxSize) {
+    auto size = maxSize;
+    if (_bucket.isLimited()) {
+        size = _bucket.consume(qMin(_reply->bytesAvailable(), maxSize));
+    }
+
+    qint64 read = 0;
+    if (size > 0) {
+        read = _reply->read(data, size);
+    }
+
+    if (_bucket.isLimited()
+            && (_reply->bytesAvailable() > 0 || _finishPending)) {
+        scheduleRead();
+    }
+
+    if (read > 0) {
+        updateTransferRate(read);
+    }
+    return read;
 }
 
 void
 NetworkReply::abort() {
+    _throttleTimer->stop();
+    _finishPending = false;
     _reply->abort();
 }
 
 void
-NetworkReply::setReadBufferSize(uint size) {
+NetworkReply::setReadBufferSize(qint64 size) {
     _reply->setReadBufferSize(size);
 }
 
+void
+NetworkReply::setThrottle(qulonglong speed, qulonglong burst) {
+    _bucket.setRate(speed, burst);
+    if (_bucket.isLimited()) {
+        // do not let qt buffer more than what we can read at once, that
+        // way the socket is not read and the server has to slow down
+        setReadBufferSize(static_cast<qint64>(_bucket.burst()));
+    } else {
+        // an unlimited buffer would hold all the data that the disk
+        // was not able to keep up with
+        setReadBufferSize(UNTHROTTLED_READ_BUFFER_SIZE);
+    }
+
+    // data that was held back by the previous limit has to be read
+    if (_reply->bytesAvailable() > 0 || _finishPending) {
+        scheduleRead();
+    }
+}
+
+qulonglong
+NetworkReply::transferRate() {
+    // do not report an old rate if we stopped reading
+    if (_rateClock.elapsed() >= 2 * RATE_WINDOW_MSECS) {
+        return 0;
+    }
+    return _transferRate;
+}
+
+void
+NetworkReply::scheduleRead() {
+    if (_throttleTimer->isActive()) {
+        return;
+    }
+    auto chunk = qMax(static_cast<qint64>(_bucket.rate()) / READS_PER_SECOND,
+        Q_INT64_C(1));
+    auto wanted = qMin(_reply->bytesAvailable(), chunk);
+    _throttleTimer->start(_bucket.msecsUntilAvailable(wanted));
+}
+
+void
+NetworkReply::updateTransferRate(qint64 bytes) {
+    _rateBytes += bytes;
+    auto elapsed = _rateClock.elapsed();
+    if (elapsed >= RATE_WINDOW_MSECS) {
+        _transferRate = static_cast<qulonglong>(_rateBytes * 1000 / elapsed);
+        _rateBytes = 0;
+        _rateClock.restart();
+    }
+}
+
+void
+NetworkReply::onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal) {
+    _bytesReceived = bytesReceived;
+    _bytesTotal = bytesTotal;
+    emit downloadProgress(bytesReceived, bytesTotal);
+}
+
+void
+NetworkReply::onFinished() {
+    // when throttled the reply might still have data that we did not let
+    // the owner read, finished is emitted once it was consumed
+    if (_bucket.isLimited() && _reply->bytesAvailable() > 0) {
+        _finishPending = true;
+        scheduleRead();
+        return;
+    }
+    emit finished();
+}
+
+void
+NetworkReply::onThrottleTimeout() {
+    if (_reply->bytesAvailable() > 0) {
+        // let the owner know that there is data that can be read
+        emit downloadProgress(_bytesReceived, _bytesTotal);
+    }
+
+    if (_finishPending && _reply->bytesAvailable() == 0) {
+        _throttleTimer->stop();
+        _finishPending = false;
+        emit finished();
+    }
+}
+
 void
 NetworkReply::setAcceptedCertificates(const QList<QSslCertificate>& certs) {
     _certs = certs;
@@ -24,6 +24,8 @@
 #include <QNetworkReply>
 #include <QVariant>
 #include <QSslError>
+#include "timer.h"
+#include "token_bucket.h"
 
 namespace Ubuntu {
 
@@ -39,8 +41,16 @@ class NetworkReply : public QObject {
     virtual ~NetworkReply();
 
     virtual QByteArray readAll();
+    // reads at most maxSize bytes into data honouring the throttle, returns
+    // the number of bytes read
+    virtual qint64 read(char* data, qint64 maxSize);
     virtual void abort();
-    virtual void setReadBufferSize(uint size);
+    virtual void setReadBufferSize(qint64 size);
+    // limits the bytes per second returned by readAll, burst is the
+    // amount of bytes that can be read at once, 0 means a second of data
+    virtual void setThrottle(qulonglong speed, qulonglong burst = 0);
+    // bytes per second that were read during the last measured second
+    virtual qulonglong transferRate();
     virtual void setAcceptedCertificates(const QList<QSslCertificate>& certs);
     virtual bool canIgnoreSslErrors(const QList<QSslError>& errors);
     virtual QVariant attribute(QNetworkRequest::Attribute code) const;
@@ -57,6 +67,23 @@ class NetworkReply : public QObject {
     void sslErrors(const QList<QSslError>& errors);
 
  private:
+    void scheduleRead();
+    void updateTransferRate(qint64 bytes);
+
+    // slots used to react to signals
+    void onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
+    void onFinished();
+    void onThrottleTimeout();
+
+ private:
+    bool _finishPending = false;
+    qint64 _bytesReceived = 0;
+    qint64 _bytesTotal = -1;
+    qint64 _rateBytes = 0;
+    qulonglong _transferRate = 0;
+    QElapsedTimer _rateClock;
+    TokenBucket _bucket;
+    Timer* _throttleTimer;
     QList<QSslCertificate> _certs;
     QList<QSslError> _sslErrors;
     QNetworkReply* _reply;
@@ -61,6 +61,11 @@ class PendingReply {
         _reply.waitForFinished();
     }
 
+    // allows to be notified of the reply without blocking
+    virtual QDBusPendingCall pendingCall() const {
+        return _reply;
+    }
+
  private:
     QDBusPendingReply<T> _reply;
 };
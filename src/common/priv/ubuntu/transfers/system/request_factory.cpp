@@ -69,6 +69,12 @@ RequestFactory::get(const QNetworkRequest& request) {
     return buildRequest(qreply);
 }
 
+NetworkReply*
+RequestFactory::head(const QNetworkRequest& request) {
+    auto qreply = _nam->head(request);
+    return buildRequest(qreply);
+}
+
 NetworkReply*
 RequestFactory::post(const QNetworkRequest& request, File* data) {
     auto qreply = _nam->post(request, data->device());
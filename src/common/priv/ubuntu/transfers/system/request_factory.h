@@ -39,6 +39,9 @@ class RequestFactory : public QObject {
 
  public:
     virtual NetworkReply* get(const QNetworkRequest& request);
+    // request used to learn about a resource without its body, null when
+    // the factory cannot perform it
+    virtual NetworkReply* head(const QNetworkRequest& request);
     virtual NetworkReply* post(const QNetworkRequest& request, File* data);
     virtual NetworkReply* put(const QNetworkRequest& request, File* data);
 
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <cmath>
+
+#include "token_bucket.h"
+
+namespace Ubuntu {
+
+namespace Transfers {
+
+namespace System {
+
+TokenBucket::TokenBucket(qulonglong rate, qulonglong burst) {
+    _clock.start();
+    setRate(rate, burst);
+}
+
+void
+TokenBucket::setRate(qulonglong rate, qulonglong burst) {
+    _rate = rate;
+    // by default a second worth of data can be used at once, a smaller
+    // burst smooths the reads at the cost of more wake ups
+    _burst = (burst == 0)? rate : burst;
+    // start full so that the first read does not have to wait
+    _tokens = static_cast<double>(_burst);
+    _lastRefill = _clock.elapsed();
+}
+
+qint64
+TokenBucket::consume(qint64 bytes) {
+    return consume(bytes, _clock.elapsed());
+}
+
+qint64
+TokenBucket::consume(qint64 bytes, qint64 nowMsecs) {
+    if (!isLimited() || bytes <= 0) {
+        return qMax(bytes, Q_INT64_C(0));
+    }
+
+    refill(nowMsecs);
+    auto allowed = qMin(bytes, static_cast<qint64>(_tokens));
+    _tokens -= allowed;
+    return allowed;
+}
+
+int
+TokenBucket::msecsUntilAvailable(qint64 bytes) {
+    return msecsUntilAvailable(bytes, _clock.elapsed());
+}
+
+int
+TokenBucket::msecsUntilAvailable(qint64 bytes, qint64 nowMsecs) {
+    if (!isLimited()) {
+        return 0;
+    }
+
+    refill(nowMsecs);
+    // we can never have more than burst tokens
+    auto wanted = qMin(static_cast<double>(bytes),
+        static_cast<double>(_burst));
+    if (_tokens >= wanted) {
+        return 0;
+    }
+    return static_cast<int>(std::ceil((wanted - _tokens) * 1000 / _rate));
+}
+
+void
+TokenBucket::refill(qint64 nowMsecs) {
+    auto elapsed = nowMsecs - _lastRefill;
+    if (elapsed <= 0) {
+        return;
+    }
+    _lastRefill = nowMsecs;
+    _tokens = qMin(static_cast<double>(_burst),
+        _tokens + static_cast<double>(_rate) * elapsed / 1000);
+}
+
+}  // System
+
+}  // Transfers
+
+}  // Ubuntu
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOWNLOADER_LIB_TOKEN_BUCKET_H
+#define DOWNLOADER_LIB_TOKEN_BUCKET_H
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+
+namespace Ubuntu {
+
+namespace Transfers {
+
+namespace System {
+
+// Token bucket used to limit the number of bytes per second that are
+// consumed. The bucket is refilled at rate bytes per second and holds at
+// most burst bytes, which is the amount that can be consumed at once
+// after being idle. A rate of 0 means that there is no limit and a burst
+// of 0 that a second worth of data can be used at once.
+class TokenBucket {
+ public:
+    explicit TokenBucket(qulonglong rate = 0, qulonglong burst = 0);
+
+    void setRate(qulonglong rate, qulonglong burst);
+
+    qulonglong rate() const {
+        return _rate;
+    }
+
+    qulonglong burst() const {
+        return _burst;
+    }
+
+    bool isLimited() const {
+        return _rate > 0;
+    }
+
+    // returns how many of the requested bytes can be used right now and
+    // removes them from the bucket
+    qint64 consume(qint64 bytes);
+    qint64 consume(qint64 bytes, qint64 nowMsecs);
+
+    // returns the msecs that have to pass until the given amount of
+    // bytes can be consumed
+    int msecsUntilAvailable(qint64 bytes);
+    int msecsUntilAvailable(qint64 bytes, qint64 nowMsecs);
+
+ private:
+    void refill(qint64 nowMsecs);
+
+ private:
+    qulonglong _rate = 0;
+    qulonglong _burst = 0;
+    double _tokens = 0;
+    qint64 _lastRefill = 0;
+    QElapsedTimer _clock;
+};
+
+}  // System
+
+}  // Transfers
+
+}  // Ubuntu
+
+#endif  // DOWNLOADER_LIB_TOKEN_BUCKET_H
@@ -89,6 +89,12 @@ Transfer::setState(Transfer::State state) {
     }
 }
 
+void
+Transfer::failTransfer(const QString& error) {
+    setState(Transfer::ERROR);
+    emit this->error(error);
+}
+
 bool
 Transfer::canTransfer() {
     TRACE;
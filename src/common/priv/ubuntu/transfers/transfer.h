@@ -68,6 +68,12 @@ class Transfer : public QObject {
     virtual void pauseTransfer() {}
     virtual void resumeTransfer() {}
     virtual void startTransfer() {}
+    // bytes that the transfer still has to write in the disk and where,
+    // used to decide if there is space to start it, 0 when unknown
+    virtual qint64 requiredSpace() { return 0; }
+    virtual QString storagePath() { return rootPath(); }
+    // moves the transfer to the error state without performing it
+    virtual void failTransfer(const QString& error);
 
  public slots:  // NOLINT(whitespace/indent)
 
@@ -34,11 +34,27 @@ const QString Metadata::SHOW_IN_INDICATOR_KEY = "indicator-shown";
 const QString Metadata::CLICK_PACKAGE_KEY = "click-package";
 const QString Metadata::DEFLATE_KEY = "deflate";
 const QString Metadata::EXTRACT_KEY = "extract";
+const QString Metadata::SEGMENTS_KEY = "segments";
+const QString Metadata::THROTTLE_BURST_KEY = "throttle-burst";
+const QString Metadata::PROGRESS_INTERVAL_KEY = "progress-interval";
+const QString Metadata::DROP_CACHE_KEY = "drop-cache";
+const QString Metadata::DURABILITY_KEY = "durability";
+const QString Metadata::DURABILITY_NONE = "none";
+const QString Metadata::DURABILITY_PERIODIC = "periodic";
+const QString Metadata::DURABILITY_FINISH = "finish";
+const QString Metadata::RETRIES_KEY = "retries";
+const QString Metadata::RETRY_DELAY_KEY = "retry-delay";
+const QString Metadata::STALL_TIMEOUT_KEY = "stall-timeout";
+const QString Metadata::MIN_SPEED_KEY = "min-speed";
+const QString Metadata::METALINK_KEY = "metalink";
+const QString Metadata::METALINK_URL_KEY = "metalink-url";
 const QString Metadata::CUSTOM_PREFIX = "custom_";
 const QString Metadata::APP_ID = "app-id";
 
 namespace {
     const QString APP_ID_ENV = "APP_ID";
+    const int DEFAULT_PROGRESS_INTERVAL = 250;
+    const int DEFAULT_STALL_TIMEOUT = 60000;
 }
 
 Metadata::Metadata() {
@@ -191,6 +207,184 @@ Metadata::hasExtract() const {
     return contains(Metadata::EXTRACT_KEY);
 }
 
+int
+Metadata::segments() const {
+    return (contains(Metadata::SEGMENTS_KEY))?
+        value(Metadata::SEGMENTS_KEY).toInt():1;
+}
+
+void
+Metadata::setSegments(int segments) {
+    insert(Metadata::SEGMENTS_KEY, segments);
+}
+
+bool
+Metadata::hasSegments() const {
+    return contains(Metadata::SEGMENTS_KEY);
+}
+
+qulonglong
+Metadata::throttleBurst() const {
+    return (contains(Metadata::THROTTLE_BURST_KEY))?
+        value(Metadata::THROTTLE_BURST_KEY).toULongLong():0;
+}
+
+void
+Metadata::setThrottleBurst(qulonglong burst) {
+    insert(Metadata::THROTTLE_BURST_KEY, burst);
+}
+
+bool
+Metadata::hasThrottleBurst() const {
+    return contains(Metadata::THROTTLE_BURST_KEY);
+}
+
+int
+Metadata::progressInterval() const {
+    return (contains(Metadata::PROGRESS_INTERVAL_KEY))?
+        value(Metadata::PROGRESS_INTERVAL_KEY).toInt():
+        DEFAULT_PROGRESS_INTERVAL;
+}
+
+void
+Metadata::setProgressInterval(int interval) {
+    insert(Metadata::PROGRESS_INTERVAL_KEY, interval);
+}
+
+bool
+Metadata::hasProgressInterval() const {
+    return contains(Metadata::PROGRESS_INTERVAL_KEY);
+}
+
+bool
+Metadata::dropCache() const {
+    return (contains(Metadata::DROP_CACHE_KEY))?
+        value(Metadata::DROP_CACHE_KEY).toBool():false;
+}
+
+void
+Metadata::setDropCache(bool drop) {
+    insert(Metadata::DROP_CACHE_KEY, drop);
+}
+
+bool
+Metadata::hasDropCache() const {
+    return contains(Metadata::DROP_CACHE_KEY);
+}
+
+QString
+Metadata::durability() const {
+    return (contains(Metadata::DURABILITY_KEY))?
+        value(Metadata::DURABILITY_KEY).toString():
+        Metadata::DURABILITY_NONE;
+}
+
+void
+Metadata::setDurability(const QString& durability) {
+    insert(Metadata::DURABILITY_KEY, durability);
+}
+
+bool
+Metadata::hasDurability() const {
+    return contains(Metadata::DURABILITY_KEY);
+}
+
+int
+Metadata::retries() const {
+    return (contains(Metadata::RETRIES_KEY))?
+        value(Metadata::RETRIES_KEY).toInt():0;
+}
+
+void
+Metadata::setRetries(int retries) {
+    insert(Metadata::RETRIES_KEY, retries);
+}
+
+bool
+Metadata::hasRetries() const {
+    return contains(Metadata::RETRIES_KEY);
+}
+
+int
+Metadata::retryDelay() const {
+    return (contains(Metadata::RETRY_DELAY_KEY))?
+        value(Metadata::RETRY_DELAY_KEY).toInt():0;
+}
+
+void
+Metadata::setRetryDelay(int delay) {
+    insert(Metadata::RETRY_DELAY_KEY, delay);
+}
+
+bool
+Metadata::hasRetryDelay() const {
+    return contains(Metadata::RETRY_DELAY_KEY);
+}
+
+int
+Metadata::stallTimeout() const {
+    return (contains(Metadata::STALL_TIMEOUT_KEY))?
+        value(Metadata::STALL_TIMEOUT_KEY).toInt():DEFAULT_STALL_TIMEOUT;
+}
+
+void
+Metadata::setStallTimeout(int timeout) {
+    insert(Metadata::STALL_TIMEOUT_KEY, timeout);
+}
+
+bool
+Metadata::hasStallTimeout() const {
+    return contains(Metadata::STALL_TIMEOUT_KEY);
+}
+
+qulonglong
+Metadata::minSpeed() const {
+    return (contains(Metadata::MIN_SPEED_KEY))?
+        value(Metadata::MIN_SPEED_KEY).toULongLong():0;
+}
+
+void
+Metadata::setMinSpeed(qulonglong speed) {
+    insert(Metadata::MIN_SPEED_KEY, speed);
+}
+
+bool
+Metadata::hasMinSpeed() const {
+    return contains(Metadata::MIN_SPEED_KEY);
+}
+
+QString
+Metadata::metalink() const {
+    return (contains(Metadata::METALINK_KEY))?
+        value(Metadata::METALINK_KEY).toString():"";
+}
+
+void
+Metadata::setMetalink(const QString& document) {
+    insert(Metadata::METALINK_KEY, document);
+}
+
+bool
+Metadata::hasMetalink() const {
+    return contains(Metadata::METALINK_KEY);
+}
+
+bool
+Metadata::metalinkUrl() const {
+    return (contains(Metadata::METALINK_URL_KEY))?
+        value(Metadata::METALINK_URL_KEY).toBool():false;
+}
+
+void
+Metadata::setMetalinkUrl(bool isMetalink) {
+    insert(Metadata::METALINK_URL_KEY, isMetalink);
+}
+
+bool
+Metadata::hasMetalinkUrl() const {
+    return contains(Metadata::METALINK_URL_KEY);
+}
+
 QString
 Metadata::destinationApp() const {
     return (contains(Metadata::APP_ID))?
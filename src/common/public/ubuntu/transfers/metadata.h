@@ -41,6 +41,20 @@ class Metadata : public QVariantMap {
     static const QString CLICK_PACKAGE_KEY;
     static const QString DEFLATE_KEY;
     static const QString EXTRACT_KEY;
+    static const QString SEGMENTS_KEY;
+    static const QString THROTTLE_BURST_KEY;
+    static const QString PROGRESS_INTERVAL_KEY;
+    static const QString DROP_CACHE_KEY;
+    static const QString DURABILITY_KEY;
+    static const QString DURABILITY_NONE;
+    static const QString DURABILITY_PERIODIC;
+    static const QString DURABILITY_FINISH;
+    static const QString RETRIES_KEY;
+    static const QString RETRY_DELAY_KEY;
+    static const QString STALL_TIMEOUT_KEY;
+    static const QString MIN_SPEED_KEY;
+    static const QString METALINK_KEY;
+    static const QString METALINK_URL_KEY;
     static const QString CUSTOM_PREFIX;
     static const QString APP_ID;
 
@@ -77,6 +91,65 @@ class Metadata : public QVariantMap {
     void setExtract(bool extract);
     bool hasExtract() const;
 
+    int segments() const;
+    void setSegments(int segments);
+    bool hasSegments() const;
+
+    qulonglong throttleBurst() const;
+    void setThrottleBurst(qulonglong burst);
+    bool hasThrottleBurst() const;
+
+    // minimum number of ms between progress signals, 0 emits them all
+    // and a negative value none
+    int progressInterval() const;
+    void setProgressInterval(int interval);
+    bool hasProgressInterval() const;
+
+    // drop the written data from the page cache, when not present the
+    // daemon does it for big downloads
+    bool dropCache() const;
+    void setDropCache(bool drop);
+    bool hasDropCache() const;
+
+    // when the data of the temp file is synced to the disk, resuming only
+    // trusts the synced data. One of the DURABILITY_ values, none if missing
+    QString durability() const;
+    void setDurability(const QString& durability);
+    bool hasDurability() const;
+
+    // times a transient network error is retried before it is reported,
+    // when not present the default of the daemon is used
+    int retries() const;
+    void setRetries(int retries);
+    bool hasRetries() const;
+
+    // ms to wait before the first retry, doubled for each following one
+    int retryDelay() const;
+    void setRetryDelay(int delay);
+    bool hasRetryDelay() const;
+
+    // ms without data after which a download reconnects, 0 disables it
+    int stallTimeout() const;
+    void setStallTimeout(int timeout);
+    bool hasStallTimeout() const;
+
+    // bytes per second under which a download reconnects when measured
+    // over the stall timeout, 0 disables it
+    qulonglong minSpeed() const;
+    void setMinSpeed(qulonglong speed);
+    bool hasMinSpeed() const;
+
+    // metalink (RFC 5854) document that describes the file, its mirrors
+    // are used instead of the url of the download
+    QString metalink() const;
+    void setMetalink(const QString& document);
+    bool hasMetalink() const;
+
+    // the url of the download is a metalink document to be fetched first
+    bool metalinkUrl() const;
+    void setMetalinkUrl(bool isMetalink);
+    bool hasMetalinkUrl() const;
+
     QString destinationApp() const;
     void setOwner(const QString &id);
     bool hasOwner() const;
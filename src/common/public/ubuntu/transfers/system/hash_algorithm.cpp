@@ -60,7 +60,7 @@ HashAlgorithm::getHashAlgo(QCryptographicHash::Algorithm algorithm) {
         case QCryptographicHash::Sha224:
             return "sha224";
         case QCryptographicHash::Sha256:
-            return "shq256";
+            return "sha256";
         case QCryptographicHash::Sha384:
             return "sha384";
         case QCryptographicHash::Sha512:
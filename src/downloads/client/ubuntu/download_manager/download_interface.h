@@ -52,6 +52,10 @@ public:
     inline QString title() const
     { return qvariant_cast< QString >(property("Title")); }
 
+    Q_PROPERTY(qulonglong TransferRate READ transferRate)
+    inline qulonglong transferRate() const
+    { return qvariant_cast< qulonglong >(property("TransferRate")); }
+
 public Q_SLOTS: // METHODS
     inline QDBusPendingReply<> allowGSMDownload(bool allowed)
     {
@@ -164,6 +164,33 @@ class Manager : public QObject {
                                 StringMap headers,
                                 GroupCb cb,
                                 GroupCb errCb) = 0;
+
+    /*!
+        \fn void createDownloads(DownloadStructList downs)
+
+        Creates several downloads at once using the data found in the
+        structures. The downloads are validated, stored and registered
+        as a whole, if any of them is not valid none is created. The
+        downloadsCreated(DownloadsList* downloads) signal can be used to
+        get the new created downloads.
+    */
+    virtual void createDownloads(DownloadStructList downs) = 0;
+
+    /*!
+        \fn void createDownloads(DownloadStructList downs, DownloadsListCb cb, DownloadsListCb errCb)
+
+        Creates several downloads at once using the data found in the
+        structures. \a cb will be executed when all the downloads were
+        created while \a errCb will be executed when there was an error
+        and none of them was created.
+
+        \note Even when the callbacks are executed the
+              downloadsCreated(DownloadsList* downloads) is emitted.
+    */
+    virtual void createDownloads(DownloadStructList downs,
+                                 DownloadsListCb cb,
+                                 DownloadsListCb errCb) = 0;
+
     /*!
         \fn void getAllDownloads(const QString& appId, bool uncollected)
 
@@ -281,6 +308,25 @@ class Manager : public QObject {
     */
     virtual void setDefaultThrottle(qulonglong speed) = 0;
 
+    /*!
+        \fn int progressBatchInterval()
+
+        Returns the number of milliseconds between the progressBatch
+        signals of the download manager, 0 means that they are not sent.
+    */
+    virtual int progressBatchInterval() = 0;
+
+    /*!
+        \fn void setProgressBatchInterval(int interval)
+
+        Allows to set the number of milliseconds between the progressBatch
+        signals of the download manager. Clients that follow many downloads
+        should use them and set the "progress-interval" metadata of their
+        downloads to a negative value to stop the per download progress
+        signals.
+    */
+    virtual void setProgressBatchInterval(int interval) = 0;
+
     /*!
         \fn void exit()
 
@@ -330,6 +376,14 @@ class Manager : public QObject {
         download manager.
     */
     void downloadCreated(Download* down);
+
+    /*!
+        \fn void downloadsCreated(DownloadsList* downloads)
+
+        This signal is emitted whenever several downloads are created at
+        once by the download manager.
+    */
+    void downloadsCreated(DownloadsList* downloads);
     void downloadsFound(DownloadsList* downloads);
     void downloadsWithMetadataFound(const QString& name,
                                     const QString& value,
@@ -343,6 +397,14 @@ class Manager : public QObject {
     */
     void groupCreated(GroupDownload* down);
 
+    /*!
+        \fn void progressBatch(ProgressList progress)
+
+        This signal is emitted every progress batch interval with the
+        progress of the active downloads that changed since the last one.
+    */
+    void progressBatch(ProgressList progress);
+
 };
 
 }  // DownloadManager
@@ -76,11 +76,21 @@ ManagerImpl::init() {
     qDBusRegisterMetaType<DownloadStruct>();
     qDBusRegisterMetaType<GroupDownloadStruct>();
     qDBusRegisterMetaType<StructList>();
+    qDBusRegisterMetaType<DownloadStructList>();
+    qDBusRegisterMetaType<DownloadProgressStruct>();
+    qDBusRegisterMetaType<ProgressList>();
     qDBusRegisterMetaType<AuthErrorStruct>();
     qDBusRegisterMetaType<HashErrorStruct>();
     qDBusRegisterMetaType<HttpErrorStruct>();
     qDBusRegisterMetaType<NetworkErrorStruct>();
     qDBusRegisterMetaType<ProcessErrorStruct>();
+
+    auto connected = connect(_dbusInterface, &ManagerInterface::progressBatch,
+        this, &Manager::progressBatch);
+    if (!connected) {
+        Logger::log(Logger::Critical,
+            "Could not connect to signal &ManagerInterface::progressBatch");
+    }
 }
 
 Download*
@@ -144,6 +154,30 @@ ManagerImpl::createDownload(StructList downs,
     }
 }
 
+void
+ManagerImpl::createDownloads(DownloadStructList downs) {
+    Logger::log(Logger::Debug,
+        QString("Manager createDownloads(%1)").arg(downs.size()));
+    DownloadsListCb cb = [](DownloadsList*) {};
+    createDownloads(downs, cb, cb);
+}
+
+void
+ManagerImpl::createDownloads(DownloadStructList downs,
+                             DownloadsListCb cb,
+                             DownloadsListCb errCb) {
+    QDBusPendingCall call = _dbusInterface->createDownloads(downs);
+    auto watcher = new CreatedDownloadsListManagerPCW(
+        _conn, _servicePath, call, cb, errCb, this);
+    auto connected = connect(watcher,
+        &CreatedDownloadsListManagerPCW::callbackExecuted,
+        this, &ManagerImpl::onWatcherDone);
+    if (!connected) {
+        Logger::log(Logger::Critical,
+            "Could not connect to signal &CreatedDownloadsListManagerPCW::callbackExecuted");
+    }
+}
+
 void
 ManagerImpl::getAllDownloads(const QString &appId, bool uncollected) {
     Logger::log(Logger::Debug, QString("Manager getAllDownloads(%1, %2)").arg(appId).arg(uncollected));
@@ -277,6 +311,38 @@ ManagerImpl::setDefaultThrottle(qulonglong speed) {
     }
 }
 
+int
+ManagerImpl::progressBatchInterval() {
+    Logger::log(Logger::Debug, "Manager progressBatchInterval()");
+    QDBusPendingReply<int> reply =
+        _dbusInterface->progressBatchInterval();
+    // we block but because we expect it to be fast
+    reply.waitForFinished();
+    if (reply.isError()) {
+        auto err = reply.error();
+        Logger::log(Logger::Error, "Error getting the progress batch interval");
+        setLastError(err);
+        return 0;
+    } else {
+        return reply.value();
+    }
+}
+
+void
+ManagerImpl::setProgressBatchInterval(int interval) {
+    Logger::log(Logger::Debug,
+        QString("Manager setProgressBatchInterval(%1)").arg(interval));
+    QDBusPendingReply<> reply =
+        _dbusInterface->setProgressBatchInterval(interval);
+    // we block but because we expect it to be fast
+    reply.waitForFinished();
+    if (reply.isError()) {
+        auto err = reply.error();
+        Logger::log(Logger::Error, "Error setting the progress batch interval");
+        setLastError(err);
+    }
+}
+
 void
 ManagerImpl::exit() {
     Logger::log(Logger::Debug, "Manager exit()");
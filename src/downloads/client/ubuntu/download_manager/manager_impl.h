@@ -72,6 +72,10 @@ class UBUNTU_TRANSFERS_PRIVATE ManagerImpl : public Manager {
                                 StringMap headers,
                                 GroupCb cb,
                                 GroupCb errCb);
+    virtual void createDownloads(DownloadStructList downs);
+    virtual void createDownloads(DownloadStructList downs,
+                                 DownloadsListCb cb,
+                                 DownloadsListCb errCb);
     virtual void getAllDownloads(const QString &appId, bool uncollected);
     virtual void getAllDownloads(const QString &appId,
                                  bool uncollected,
@@ -90,6 +94,8 @@ class UBUNTU_TRANSFERS_PRIVATE ManagerImpl : public Manager {
     bool isMobileDataDownload();
     qulonglong defaultThrottle();
     void setDefaultThrottle(qulonglong speed);
+    int progressBatchInterval();
+    void setProgressBatchInterval(int interval);
     void exit();
 
  protected:
@@ -57,6 +57,13 @@ public Q_SLOTS: // METHODS
         return asyncCallWithArgumentList(QLatin1String("createDownload"), argumentList);
     }
 
+    inline QDBusPendingReply<QList<QDBusObjectPath> > createDownloads(DownloadStructList downloads)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(downloads);
+        return asyncCallWithArgumentList(QLatin1String("createDownloads"), argumentList);
+    }
+
     inline QDBusPendingReply<QDBusObjectPath> createDownloadGroup(StructList downloads, const QString &algorithm, bool allowed3G, const QVariantMap &metadata, StringMap headers)
     {
         QList<QVariant> argumentList;
@@ -97,6 +104,19 @@ public Q_SLOTS: // METHODS
         return asyncCallWithArgumentList(QLatin1String("isGSMDownloadAllowed"), argumentList);
     }
 
+    inline QDBusPendingReply<int> progressBatchInterval()
+    {
+        QList<QVariant> argumentList;
+        return asyncCallWithArgumentList(QLatin1String("progressBatchInterval"), argumentList);
+    }
+
+    inline QDBusPendingReply<> setProgressBatchInterval(int interval)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(interval);
+        return asyncCallWithArgumentList(QLatin1String("setProgressBatchInterval"), argumentList);
+    }
+
     inline QDBusPendingReply<> setDefaultThrottle(qulonglong speed)
     {
         QList<QVariant> argumentList;
@@ -106,6 +126,7 @@ public Q_SLOTS: // METHODS
 
 Q_SIGNALS: // SIGNALS
     void downloadCreated(const QDBusObjectPath &path);
+    void progressBatch(ProgressList progress);
 };
 
 }  // DownloadManager
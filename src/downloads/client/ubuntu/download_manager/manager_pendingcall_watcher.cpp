@@ -124,6 +124,54 @@ DownloadsListManagerPCW::onFinished(QDBusPendingCallWatcher* watcher) {
     watcher->deleteLater();
 }
 
+CreatedDownloadsListManagerPCW::CreatedDownloadsListManagerPCW(
+                                            const QDBusConnection& conn,
+                                            const QString& servicePath,
+                                            const QDBusPendingCall& call,
+                                            DownloadsListCb cb,
+                                            DownloadsListCb errCb,
+                                            QObject* parent)
+    : PendingCallWatcher(conn, servicePath, call, parent),
+      _cb(cb),
+      _errCb(errCb) {
+    auto connected = connect(this, &QDBusPendingCallWatcher::finished,
+        this, &CreatedDownloadsListManagerPCW::onFinished);
+    if (!connected) {
+        Logger::log(Logger::Critical,
+            "Could not connect to signal &QDBusPendingCallWatcher::finished");
+    }
+}
+
+void
+CreatedDownloadsListManagerPCW::onFinished(QDBusPendingCallWatcher* watcher) {
+    QDBusPendingReply<QList<QDBusObjectPath> > reply = *watcher;
+    DownloadsListImpl* list;
+    auto man = static_cast<Manager*>(parent());
+    if (reply.isError()) {
+        auto dbusErr = reply.error();
+        Logger::log(Logger::Error,
+            QString("%1 %2").arg(dbusErr.name()).arg(dbusErr.message()));
+        auto err = new DBusError(reply.error());
+        list = new DownloadsListImpl(err);
+        _errCb(list);
+        emit man->downloadsCreated(list);
+    } else {
+        auto paths = reply.value();
+        QList<QSharedPointer<Download> > downloads;
+        foreach(const QDBusObjectPath& path, paths) {
+            QSharedPointer<Download> down =
+                QSharedPointer<Download>(new DownloadImpl(_conn,
+                            _servicePath, path));
+            downloads.append(down);
+        }
+        list = new DownloadsListImpl(downloads);
+        emit man->downloadsCreated(list);
+        _cb(list);
+    }
+    emit callbackExecuted();
+    watcher->deleteLater();
+}
+
 MetadataDownloadsListManagerPCW::MetadataDownloadsListManagerPCW(
                                     const QDBusConnection& conn,
                                     const QString& servicePath,
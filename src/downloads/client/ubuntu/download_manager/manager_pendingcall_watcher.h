@@ -76,6 +76,24 @@ class UBUNTU_TRANSFERS_PRIVATE DownloadsListManagerPCW : public PendingCallWatch
     DownloadsListCb _errCb;
 };
 
+class UBUNTU_TRANSFERS_PRIVATE CreatedDownloadsListManagerPCW : public PendingCallWatcher {
+    Q_OBJECT
+
+ public:
+    CreatedDownloadsListManagerPCW(const QDBusConnection& conn,
+                                   const QString& servicePath,
+                                   const QDBusPendingCall& call,
+                                   DownloadsListCb cb,
+                                   DownloadsListCb errCb,
+                                   QObject* parent = 0);
+ private slots:
+    void onFinished(QDBusPendingCallWatcher* watcher);
+
+ private:
+    DownloadsListCb _cb;
+    DownloadsListCb _errCb;
+};
+
 class UBUNTU_TRANSFERS_PRIVATE MetadataDownloadsListManagerPCW : public PendingCallWatcher {
     Q_OBJECT
 
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <QDBusArgument>
+#include <QDBusObjectPath>
+#include "download_progress_struct.h"
+
+namespace Ubuntu {
+
+namespace DownloadManager {
+
+DownloadProgressStruct::DownloadProgressStruct()
+    : _path(QString::null),
+      _received(0),
+      _total(0) {
+}
+
+DownloadProgressStruct::DownloadProgressStruct(const QString& path,
+                                               qulonglong received,
+                                               qulonglong total)
+    : _path(path),
+      _received(received),
+      _total(total) {
+}
+
+DownloadProgressStruct::DownloadProgressStruct(
+                                        const DownloadProgressStruct& other)
+    : _path(other._path),
+      _received(other._received),
+      _total(other._total) {
+}
+
+DownloadProgressStruct&
+DownloadProgressStruct::operator=(const DownloadProgressStruct& other) {
+    _path = other._path;
+    _received = other._received;
+    _total = other._total;
+
+    return *this;
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument,
+                          const DownloadProgressStruct& progress) {
+    argument.beginStructure();
+    argument << QDBusObjectPath(progress._path);
+    argument << progress._received;
+    argument << progress._total;
+    argument.endStructure();
+
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument,
+                                DownloadProgressStruct& progress) {
+    QDBusObjectPath path;
+    argument.beginStructure();
+    argument >> path;
+    argument >> progress._received;
+    argument >> progress._total;
+    argument.endStructure();
+    progress._path = path.path();
+
+    return argument;
+}
+
+QString
+DownloadProgressStruct::getPath() const {
+    return _path;
+}
+
+qulonglong
+DownloadProgressStruct::getReceived() const {
+    return _received;
+}
+
+qulonglong
+DownloadProgressStruct::getTotal() const {
+    return _total;
+}
+
+}  // DownloadManager
+
+}  // Ubuntu
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOWNLOAD_PROGRESS_STRUCT_H
+#define DOWNLOAD_PROGRESS_STRUCT_H
+
+#include <QString>
+
+class QDBusArgument;
+namespace Ubuntu {
+
+namespace DownloadManager {
+
+/*!
+    \class DownloadProgressStruct
+    \brief The DownloadProgressStruct represents the dbus structure that is
+           used by the download manager to report the progress of one of
+           the downloads in a progress batch.
+    \since 1.3
+*/
+class DownloadProgressStruct {
+    Q_PROPERTY(QString path READ getPath)
+    Q_PROPERTY(qulonglong received READ getReceived)
+    Q_PROPERTY(qulonglong total READ getTotal)
+
+ public:
+
+    /*
+       Default constructor.
+     */
+    DownloadProgressStruct();
+
+    /*
+       Creates a new structure with the progress of the download
+       exposed in \a path.
+     */
+    DownloadProgressStruct(const QString& path,
+                           qulonglong received,
+                           qulonglong total);
+
+    /*
+       Copy constructor.
+    */
+    DownloadProgressStruct(const DownloadProgressStruct& other);
+
+    /*
+       Assign operator.
+    */
+    DownloadProgressStruct& operator=(const DownloadProgressStruct& other);
+
+    /*
+        \internal
+    */
+    friend QDBusArgument &operator<<(QDBusArgument &argument, const DownloadProgressStruct& progress);
+
+    /*
+        \internal
+    */
+    friend const QDBusArgument &operator>>(const QDBusArgument &argument, DownloadProgressStruct& progress);
+
+    /*
+       \fn QString getPath()
+
+       Returns the dbus object path of the download.
+    */
+    QString getPath() const;
+
+    /*
+       \fn qulonglong getReceived()
+
+       Returns the number of bytes that have been received.
+    */
+    qulonglong getReceived() const;
+
+    /*
+       \fn qulonglong getTotal()
+
+       Returns the size of the download, it is equal to the received
+       bytes when the size is not known.
+    */
+    qulonglong getTotal() const;
+
+ private:
+
+    /*
+        \internal
+    */
+    QString _path = QString::null;
+
+    /*
+        \internal
+    */
+    qulonglong _received = 0;
+
+    /*
+        \internal
+    */
+    qulonglong _total = 0;
+};
+
+}
+
+}
+
+#endif
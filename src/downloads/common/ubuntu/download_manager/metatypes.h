@@ -25,6 +25,7 @@
 #include <ubuntu/transfers/errors/http_error_struct.h>
 #include <ubuntu/transfers/errors/network_error_struct.h>
 #include <ubuntu/transfers/errors/process_error_struct.h>
+#include "download_progress_struct.h"
 #include "download_state_struct.h"
 #include "download_struct.h"
 #include "group_download_struct.h"
@@ -34,6 +35,8 @@ using namespace Ubuntu::Transfers::Errors;
 
 typedef QMap<QString, QString> StringMap;
 typedef QList<GroupDownloadStruct> StructList;
+typedef QList<DownloadStruct> DownloadStructList;
+typedef QList<DownloadProgressStruct> ProgressList;
 
 Q_DECLARE_METATYPE(AuthErrorStruct)
 Q_DECLARE_METATYPE(HashErrorStruct)
@@ -42,6 +45,9 @@ Q_DECLARE_METATYPE(NetworkErrorStruct)
 Q_DECLARE_METATYPE(ProcessErrorStruct)
 Q_DECLARE_METATYPE(DownloadStruct)
 Q_DECLARE_METATYPE(DownloadStateStruct)
+Q_DECLARE_METATYPE(DownloadProgressStruct)
+Q_DECLARE_METATYPE(ProgressList)
 Q_DECLARE_METATYPE(StringMap)
 Q_DECLARE_METATYPE(StructList)
+Q_DECLARE_METATYPE(DownloadStructList)
 
@@ -16,6 +16,11 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <unistd.h>
+#include <QDir>
+#include <QStandardPaths>
+#include <ubuntu/transfers/system/file_remover.h>
+#include <ubuntu/transfers/system/file_writer.h>
 #include "download_adaptor_factory.h"
 #include "download_manager_factory.h"
 #include "manager.h"
@@ -47,11 +52,23 @@ DownloadDaemon::DownloadDaemon(ManagerFactory* managerFactory,
 
 void
 DownloadDaemon::start() {
-    BaseDaemon::start(DownloadManager::SERVICE_PATH);
+    start(DownloadManager::SERVICE_PATH);
 }
 
 void
 DownloadDaemon::start(const QString& path) {
+    // write the data of the downloads away from the main loop
+    System::FileWriter::instance()->start();
+
+    // remove the files of the downloads away from the main loop too,
+    // next to the db so that the files of a crash are found again
+    QString dataPath = (getuid() == 0)? "/var/cache" :
+        QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+    dataPath += QDir::separator() + QString("ubuntu-download-manager");
+    QDir().mkpath(dataPath);
+    auto remover = System::FileRemover::instance();
+    remover->setListPath(dataPath + QDir::separator() + "removed-files");
+    remover->start();
     BaseDaemon::start(path);
 }
 
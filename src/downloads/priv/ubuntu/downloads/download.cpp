@@ -53,12 +53,49 @@ Download::setAdaptor(const QString& interface, QObject* adaptor) {
     _adaptors[interface] = adaptor;
 }
 
+void
+Download::setRetryPolicy(int retries, int delay) {
+    _defaultRetries = qMax(retries, 0);
+    _defaultRetryDelay = qMax(delay, 0);
+}
+
+int
+Download::retries() const {
+    Metadata metadata(_metadata);
+    return (metadata.hasRetries())?
+        qMax(metadata.retries(), 0) : _defaultRetries;
+}
+
+int
+Download::retryDelay() const {
+    Metadata metadata(_metadata);
+    return (metadata.hasRetryDelay())?
+        qMax(metadata.retryDelay(), 0) : _defaultRetryDelay;
+}
+
 void
 Download::emitError(const QString& errorStr) {
     setState(Download::ERROR);
     emit error(errorStr);
 }
 
+void
+Download::emitProgress(qulonglong received, qulonglong total, bool force) {
+    auto interval = Metadata(_metadata).progressInterval();
+    if (interval < 0) {
+        // the client opted out and follows the manager progress batches
+        return;
+    }
+
+    if (!force && interval > 0 && _lastProgress.isValid()
+            && !_lastProgress.hasExpired(interval)) {
+        return;
+    }
+
+    _lastProgress.start();
+    emit progress(received, total);
+}
+
 QString
 Download::clickPackage() const {
     return (_metadata.contains(Metadata::CLICK_PACKAGE_KEY))?
@@ -19,6 +19,7 @@
 #ifndef DOWNLOADER_LIB_DOWNLOAD_H
 #define DOWNLOADER_LIB_DOWNLOAD_H
 
+#include <QElapsedTimer>
 #include <QNetworkAccessManager>
 #include <QObject>
 #include <QProcess>
@@ -44,6 +45,7 @@ class Download : public Transfer {
     Q_PROPERTY(bool ShowInIndicator READ showInIndicator)
     Q_PROPERTY(QString Title READ title)
     Q_PROPERTY(QString DownloadOwner READ destinationApp)
+    Q_PROPERTY(qulonglong TransferRate READ transferRate)
 
  public:
     Download(const QString& id,
@@ -67,6 +69,14 @@ class Download : public Transfer {
         return true;
     }
 
+    void failTransfer(const QString& error) override {
+        emitError(error);
+    }
+
+    // retries and initial delay in ms used for transient network errors
+    // when the metadata does not set them
+    virtual void setRetryPolicy(int retries, int delay);
+
  public slots:  // NOLINT(whitespace/indent)
     // slots that are exposed via dbus, they just change the state,
     // the downloader takes care of the actual download operations
@@ -113,6 +123,11 @@ class Download : public Transfer {
     virtual qulonglong totalSize() = 0;
     virtual QString filePath() = 0;
 
+    // bytes per second that are being received
+    virtual qulonglong transferRate() {
+        return 0;
+    }
+
  signals:
     // signals that are exposed via dbus
     void processing(const QString& file);
@@ -120,9 +135,17 @@ class Download : public Transfer {
 
  protected:
     virtual void emitError(const QString& error);
+    // emits the progress signal at most once per progress interval of
+    // the metadata, forced updates (like completion) are always sent
+    void emitProgress(qulonglong received,
+                      qulonglong total,
+                      bool force = false);
     virtual QString clickPackage() const;
     virtual bool showInIndicator() const;
     virtual QString title() const;
+    // retry policy of the metadata or else the one of the daemon
+    int retries() const;
+    int retryDelay() const;
 
  protected:
     QVariantMap _metadata;
@@ -131,6 +154,9 @@ class Download : public Transfer {
     QString _destinationApp = QString::null;
     QMap<QString, QString> _headers;
     QMap<QString, QObject*> _adaptors;
+    QElapsedTimer _lastProgress;
+    int _defaultRetries = 0;
+    int _defaultRetryDelay = 1000;
 };
 
 }  // Daemon
@@ -56,6 +56,12 @@ QString DownloadAdaptor::title() const
     return qvariant_cast< QString >(parent()->property("Title"));
 }
 
+qulonglong DownloadAdaptor::transferRate() const
+{
+    // get the value of property TransferRate
+    return qvariant_cast< qulonglong >(parent()->property("TransferRate"));
+}
+
 void DownloadAdaptor::allowGSMDownload(bool allowed)
 {
     // handle method call com.canonical.applications.Download.allowGSMDownload
@@ -131,6 +131,7 @@ class DownloadAdaptor: public QDBusAbstractAdaptor
 "    <property access=\"read\" type=\"s\" name=\"Title\"/>\n"
 "    <property access=\"read\" type=\"s\" name=\"ClickPackage\"/>\n"
 "    <property access=\"read\" type=\"s\" name=\"DestinationApp\"/>\n"
+"    <property access=\"read\" type=\"t\" name=\"TransferRate\"/>\n"
 "  </interface>\n"
         "")
 public:
@@ -150,6 +151,9 @@ public: // PROPERTIES
     Q_PROPERTY(QString Title READ title)
     QString title() const;
 
+    Q_PROPERTY(qulonglong TransferRate READ transferRate)
+    qulonglong transferRate() const;
+
 public Q_SLOTS: // METHODS
     void allowGSMDownload(bool allowed);
     void cancel();
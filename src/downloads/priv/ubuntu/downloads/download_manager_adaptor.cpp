@@ -53,6 +53,14 @@ QDBusObjectPath DownloadManagerAdaptor::createDownload(DownloadStruct download)
     return downloadPath;
 }
 
+QList<QDBusObjectPath> DownloadManagerAdaptor::createDownloads(DownloadStructList downloads)
+{
+    // handle method call com.canonical.applications.DownloadManager.createDownloads
+    QList<QDBusObjectPath> downloadPaths;
+    QMetaObject::invokeMethod(parent(), "createDownloads", Q_RETURN_ARG(QList<QDBusObjectPath>, downloadPaths), Q_ARG(DownloadStructList, downloads));
+    return downloadPaths;
+}
+
 QDBusObjectPath DownloadManagerAdaptor::createDownloadGroup(StructList downloads, const QString &algorithm, bool allowed3G, const QVariantMap &metadata, StringMap headers)
 {
     // handle method call com.canonical.applications.DownloadManager.createDownloadGroup
@@ -107,6 +115,22 @@ DownloadStateStruct DownloadManagerAdaptor::getDownloadState(const QString &down
     return state;
 }
 
+int DownloadManagerAdaptor::defaultRetries()
+{
+    // handle method call com.canonical.applications.DownloadManager.defaultRetries
+    int retries;
+    QMetaObject::invokeMethod(parent(), "defaultRetries", Q_RETURN_ARG(int, retries));
+    return retries;
+}
+
+int DownloadManagerAdaptor::defaultRetryDelay()
+{
+    // handle method call com.canonical.applications.DownloadManager.defaultRetryDelay
+    int delay;
+    QMetaObject::invokeMethod(parent(), "defaultRetryDelay", Q_RETURN_ARG(int, delay));
+    return delay;
+}
+
 bool DownloadManagerAdaptor::isGSMDownloadAllowed()
 {
     // handle method call com.canonical.applications.DownloadManager.isGSMDownloadAllowed
@@ -115,12 +139,66 @@ bool DownloadManagerAdaptor::isGSMDownloadAllowed()
     return allowed;
 }
 
+int DownloadManagerAdaptor::maxConcurrentDownloads()
+{
+    // handle method call com.canonical.applications.DownloadManager.maxConcurrentDownloads
+    int max;
+    QMetaObject::invokeMethod(parent(), "maxConcurrentDownloads", Q_RETURN_ARG(int, max));
+    return max;
+}
+
+int DownloadManagerAdaptor::maxConcurrentDownloadsPerApp()
+{
+    // handle method call com.canonical.applications.DownloadManager.maxConcurrentDownloadsPerApp
+    int max;
+    QMetaObject::invokeMethod(parent(), "maxConcurrentDownloadsPerApp", Q_RETURN_ARG(int, max));
+    return max;
+}
+
+int DownloadManagerAdaptor::progressBatchInterval()
+{
+    // handle method call com.canonical.applications.DownloadManager.progressBatchInterval
+    int interval;
+    QMetaObject::invokeMethod(parent(), "progressBatchInterval", Q_RETURN_ARG(int, interval));
+    return interval;
+}
+
+void DownloadManagerAdaptor::setDefaultRetries(int retries)
+{
+    // handle method call com.canonical.applications.DownloadManager.setDefaultRetries
+    QMetaObject::invokeMethod(parent(), "setDefaultRetries", Q_ARG(int, retries));
+}
+
+void DownloadManagerAdaptor::setDefaultRetryDelay(int delay)
+{
+    // handle method call com.canonical.applications.DownloadManager.setDefaultRetryDelay
+    QMetaObject::invokeMethod(parent(), "setDefaultRetryDelay", Q_ARG(int, delay));
+}
+
 void DownloadManagerAdaptor::setDefaultThrottle(qulonglong speed)
 {
     // handle method call com.canonical.applications.DownloadManager.setDefaultThrottle
     QMetaObject::invokeMethod(parent(), "setDefaultThrottle", Q_ARG(qulonglong, speed));
 }
 
+void DownloadManagerAdaptor::setMaxConcurrentDownloads(int max)
+{
+    // handle method call com.canonical.applications.DownloadManager.setMaxConcurrentDownloads
+    QMetaObject::invokeMethod(parent(), "setMaxConcurrentDownloads", Q_ARG(int, max));
+}
+
+void DownloadManagerAdaptor::setMaxConcurrentDownloadsPerApp(int max)
+{
+    // handle method call com.canonical.applications.DownloadManager.setMaxConcurrentDownloadsPerApp
+    QMetaObject::invokeMethod(parent(), "setMaxConcurrentDownloadsPerApp", Q_ARG(int, max));
+}
+
+void DownloadManagerAdaptor::setProgressBatchInterval(int interval)
+{
+    // handle method call com.canonical.applications.DownloadManager.setProgressBatchInterval
+    QMetaObject::invokeMethod(parent(), "setProgressBatchInterval", Q_ARG(int, interval));
+}
+
 }  // Daemon
 
 }  // DownloadManager
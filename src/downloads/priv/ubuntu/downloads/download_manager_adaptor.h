@@ -45,6 +45,11 @@ class DownloadManagerAdaptor: public QDBusAbstractAdaptor
 "      <arg direction=\"in\" type=\"(sssa{sv}a{ss})\" name=\"download\"/>\n"
 "      <arg direction=\"out\" type=\"o\" name=\"downloadPath\"/>\n"
 "    </method>\n"
+"    <method name=\"createDownloads\">\n"
+"      <annotation value=\"DownloadStructList\" name=\"org.qtproject.QtDBus.QtTypeName.In0\"/>\n"
+"      <arg direction=\"in\" type=\"a(sssa{sv}a{ss})\" name=\"downloads\"/>\n"
+"      <arg direction=\"out\" type=\"ao\" name=\"downloadPaths\"/>\n"
+"    </method>\n"
 "    <method name=\"createMmsDownload\">\n"
 "      <arg direction=\"in\" type=\"s\" name=\"url\"/>\n"
 "      <arg direction=\"in\" type=\"s\" name=\"hostname\"/>\n"
@@ -83,6 +88,36 @@ class DownloadManagerAdaptor: public QDBusAbstractAdaptor
 "    <method name=\"defaultThrottle\">\n"
 "      <arg direction=\"out\" type=\"t\" name=\"speed\"/>\n"
 "    </method>\n"
+"    <method name=\"setMaxConcurrentDownloads\">\n"
+"      <arg direction=\"in\" type=\"i\" name=\"max\"/>\n"
+"    </method>\n"
+"    <method name=\"maxConcurrentDownloads\">\n"
+"      <arg direction=\"out\" type=\"i\" name=\"max\"/>\n"
+"    </method>\n"
+"    <method name=\"setMaxConcurrentDownloadsPerApp\">\n"
+"      <arg direction=\"in\" type=\"i\" name=\"max\"/>\n"
+"    </method>\n"
+"    <method name=\"maxConcurrentDownloadsPerApp\">\n"
+"      <arg direction=\"out\" type=\"i\" name=\"max\"/>\n"
+"    </method>\n"
+"    <method name=\"setProgressBatchInterval\">\n"
+"      <arg direction=\"in\" type=\"i\" name=\"interval\"/>\n"
+"    </method>\n"
+"    <method name=\"progressBatchInterval\">\n"
+"      <arg direction=\"out\" type=\"i\" name=\"interval\"/>\n"
+"    </method>\n"
+"    <method name=\"setDefaultRetries\">\n"
+"      <arg direction=\"in\" type=\"i\" name=\"retries\"/>\n"
+"    </method>\n"
+"    <method name=\"defaultRetries\">\n"
+"      <arg direction=\"out\" type=\"i\" name=\"retries\"/>\n"
+"    </method>\n"
+"    <method name=\"setDefaultRetryDelay\">\n"
+"      <arg direction=\"in\" type=\"i\" name=\"delay\"/>\n"
+"    </method>\n"
+"    <method name=\"defaultRetryDelay\">\n"
+"      <arg direction=\"out\" type=\"i\" name=\"delay\"/>\n"
+"    </method>\n"
 "    <method name=\"allowGSMDownload\">\n"
 "      <arg direction=\"in\" type=\"b\" name=\"allowed\"/>\n"
 "    </method>\n"
@@ -93,6 +128,10 @@ class DownloadManagerAdaptor: public QDBusAbstractAdaptor
 "    <signal name=\"downloadCreated\">\n"
 "      <arg direction=\"out\" type=\"o\" name=\"path\"/>\n"
 "    </signal>\n"
+"    <signal name=\"progressBatch\">\n"
+"      <annotation value=\"ProgressList\" name=\"org.qtproject.QtDBus.QtTypeName.In0\"/>\n"
+"      <arg direction=\"out\" type=\"a(ott)\" name=\"progress\"/>\n"
+"    </signal>\n"
 "  </interface>\n"
         "")
 public:
@@ -103,6 +142,7 @@ public: // PROPERTIES
 public Q_SLOTS: // METHODS
     void allowGSMDownload(bool allowed);
     QDBusObjectPath createDownload(DownloadStruct download);
+    QList<QDBusObjectPath> createDownloads(DownloadStructList downloads);
     QDBusObjectPath createDownloadGroup(StructList downloads, const QString &algorithm, bool allowed3G, const QVariantMap &metadata, StringMap headers);
     QDBusObjectPath createMmsDownload(const QString &url, const QString &hostname, int port);
     qulonglong defaultThrottle();
@@ -110,10 +150,21 @@ public Q_SLOTS: // METHODS
     QList<QDBusObjectPath> getAllDownloads(const QString &appId, bool uncollected);
     QList<QDBusObjectPath> getAllDownloadsWithMetadata(const QString &name, const QString &value);
     DownloadStateStruct getDownloadState(const QString &downloadId);
+    int defaultRetries();
+    int defaultRetryDelay();
     bool isGSMDownloadAllowed();
+    int maxConcurrentDownloads();
+    int maxConcurrentDownloadsPerApp();
+    int progressBatchInterval();
+    void setDefaultRetries(int retries);
+    void setDefaultRetryDelay(int delay);
     void setDefaultThrottle(qulonglong speed);
+    void setMaxConcurrentDownloads(int max);
+    void setMaxConcurrentDownloadsPerApp(int max);
+    void setProgressBatchInterval(int interval);
 Q_SIGNALS: // SIGNALS
     void downloadCreated(const QDBusObjectPath &path);
+    void progressBatch(ProgressList progress);
 };
 
 }  // Daemon
@@ -0,0 +1,352 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <glog/logging.h>
+
+#include <ubuntu/transfers/system/buffer_pool.h>
+#include <ubuntu/transfers/system/file_writer.h>
+#include <ubuntu/transfers/system/logger.h>
+
+#include "download_segment.h"
+
+namespace {
+    // number of times a segment is requested again when the server
+    // closes the connection before the range was fully sent
+    const int MAX_RESTARTS = 3;
+    const int PARTIAL_CONTENT = 206;
+}
+
+namespace Ubuntu {
+
+namespace DownloadManager {
+
+namespace Daemon {
+
+DownloadSegment::DownloadSegment(qint64 start,
+                                 qint64 end,
+                                 qint64 received,
+                                 QObject* parent)
+    : QObject(parent),
+      _start(start),
+      _end(end),
+      _received(received) {
+    // queued because buffers are released while the data is written
+    CHECK(connect(BufferPool::instance(), &BufferPool::available,
+        this, &DownloadSegment::onBuffersAvailable, Qt::QueuedConnection))
+            << "Could not connect to signal";
+}
+
+DownloadSegment::~DownloadSegment() {
+    delete _reply;
+}
+
+void
+DownloadSegment::startTransfer(const QNetworkRequest& request, File* file) {
+    TRACE << _start << _end << _received;
+    if (_reply != nullptr || isCompleted()) {
+        return;
+    }
+
+    _file = file;
+    _request = request;
+    _validated = false;
+    _waitingForBuffers = false;
+    _finishPending = false;
+
+    // overrides the range header, each segment only asks for the bytes
+    // that it is missing
+    QByteArray rangeHeaderValue = "bytes=" +
+        QByteArray::number(_start + _received) + "-" +
+        QByteArray::number(_end);
+    _request.setRawHeader("Range", rangeHeaderValue);
+
+    _reply = RequestFactory::instance()->get(_request);
+    _reply->setThrottle(_throttle, _burst);
+    connectToReplySignals();
+}
+
+bool
+DownloadSegment::pauseTransfer() {
+    TRACE << _start << _end;
+    if (_reply == nullptr) {
+        return true;
+    }
+
+    disconnectFromReplySignals();
+    // do abort before reading
+    _reply->abort();
+    auto written = writeData(_reply->readAll());
+    releaseReply();
+    return written;
+}
+
+void
+DownloadSegment::cancelTransfer() {
+    TRACE << _start << _end;
+    if (_reply != nullptr) {
+        disconnectFromReplySignals();
+        _reply->abort();
+        releaseReply();
+    }
+}
+
+void
+DownloadSegment::setThrottle(qulonglong speed, qulonglong burst) {
+    _throttle = speed;
+    _burst = burst;
+    if (_reply != nullptr) {
+        _reply->setThrottle(speed, burst);
+    }
+}
+
+void
+DownloadSegment::connectToReplySignals() {
+    CHECK(connect(_reply, &NetworkReply::downloadProgress,
+        this, &DownloadSegment::onDownloadProgress))
+            << "Could not connect to signal";
+    CHECK(connect(_reply, &NetworkReply::error,
+        this, &DownloadSegment::error))
+            << "Could not connect to signal";
+    CHECK(connect(_reply, &NetworkReply::finished,
+        this, &DownloadSegment::onFinished))
+            << "Could not connect to signal";
+    CHECK(connect(_reply, &NetworkReply::sslErrors,
+        this, &DownloadSegment::sslErrors))
+            << "Could not connect to signal";
+}
+
+void
+DownloadSegment::disconnectFromReplySignals() {
+    disconnect(_reply, &NetworkReply::downloadProgress,
+        this, &DownloadSegment::onDownloadProgress);
+    disconnect(_reply, &NetworkReply::error,
+        this, &DownloadSegment::error);
+    disconnect(_reply, &NetworkReply::finished,
+        this, &DownloadSegment::onFinished);
+    disconnect(_reply, &NetworkReply::sslErrors,
+        this, &DownloadSegment::sslErrors);
+}
+
+void
+DownloadSegment::releaseReply() {
+    _reply->deleteLater();
+    _reply = nullptr;
+    _waitingForBuffers = false;
+    _finishPending = false;
+}
+
+bool
+DownloadSegment::writeData(QByteArray data) {
+    // never write outside of the range of the segment, else we would
+    // overwrite the data of the following one
+    auto missing = length() - _received;
+    if (data.size() > missing) {
+        data.truncate(missing);
+    }
+
+    if (data.isEmpty()) {
+        return true;
+    }
+
+    // the data queued before is for other offsets, the order of the
+    // writes does not matter
+    struct iovec iov;
+    iov.iov_base = data.data();
+    iov.iov_len = static_cast<size_t>(data.size());
+    auto written = _file->writevAt(&iov, 1, _start + _received);
+    if (written != data.size()) {
+        return false;
+    }
+    _received += written;
+    return true;
+}
+
+bool
+DownloadSegment::writeReplyData() {
+    // same as the downloads without segments, the data is read into
+    // buffers of the shared pool and written at the offset of the
+    // segment by the writer when it runs
+    auto pool = BufferPool::instance();
+    auto writer = FileWriter::instance();
+    struct iovec iov[FileWriter::MAX_CHUNK_BUFFERS];
+    auto more = true;
+    while (more) {
+        int count = 0;
+        qint64 size = 0;
+        while (count < FileWriter::MAX_CHUNK_BUFFERS) {
+            // never read more than the range of the segment, else we
+            // would overwrite the data of the following one
+            auto missing = length() - _received - size;
+            if (missing <= 0) {
+                more = false;
+                break;
+            }
+            auto buffer = pool->acquire();
+            if (buffer == nullptr) {
+                // leave the data in the reply until memory is available
+                _waitingForBuffers = true;
+                more = false;
+                break;
+            }
+            auto wanted = qMin(missing,
+                static_cast<qint64>(BufferPool::BUFFER_SIZE));
+            auto read = _reply->read(buffer, wanted);
+            if (read <= 0) {
+                pool->release(buffer);
+                more = false;
+                break;
+            }
+            iov[count].iov_base = buffer;
+            iov[count].iov_len = static_cast<size_t>(read);
+            size += read;
+            count++;
+            if (read < wanted) {
+                // nothing else is available right now
+                more = false;
+                break;
+            }
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        auto offset = _start + _received;
+        _received += size;
+        if (writer->isRunning()) {
+            // a failed write is reported by the writer
+            writer->write(_file, iov, count, offset);
+            continue;
+        }
+
+        auto written = _file->writevAt(iov, count, offset);
+        for (int index = 0; index < count; index++) {
+            pool->release(static_cast<char*>(iov[index].iov_base));
+        }
+        if (written != size) {
+            _received -= size;
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+DownloadSegment::onDownloadProgress(qint64, qint64) {
+    if (!_validated) {
+        // a server that ignores the range header answers with the
+        // complete resource, writing it at our offset would corrupt
+        // the file
+        auto statusCode = _reply->attribute(
+            QNetworkRequest::HttpStatusCodeAttribute);
+        if (statusCode.isValid() && statusCode.toInt() != PARTIAL_CONTENT) {
+            LOG(WARNING) << "Segment " << _start << "-" << _end
+                << " got status " << statusCode.toInt();
+            disconnectFromReplySignals();
+            _reply->abort();
+            releaseReply();
+            emit rangeNotSupported();
+            return;
+        }
+        _validated = true;
+    }
+
+    if (!writeReplyData()) {
+        LOG(ERROR) << "Could not write segment " << _start << "-" << _end;
+        disconnectFromReplySignals();
+        _reply->abort();
+        releaseReply();
+        emit writeError();
+        return;
+    }
+
+    emit progress();
+
+    if (isCompleted()) {
+        // we got all the data we wanted, ignore anything else the
+        // server might send
+        disconnectFromReplySignals();
+        _reply->abort();
+        releaseReply();
+        emit completed();
+    }
+}
+
+void
+DownloadSegment::onBuffersAvailable() {
+    if (!_waitingForBuffers) {
+        return;
+    }
+
+    _waitingForBuffers = false;
+    if (_reply == nullptr) {
+        return;
+    }
+
+    if (_finishPending) {
+        _finishPending = false;
+        onFinished();
+        return;
+    }
+    onDownloadProgress(0, 0);
+}
+
+void
+DownloadSegment::onFinished() {
+    TRACE << _start << _end << _received;
+    if (!writeReplyData()) {
+        disconnectFromReplySignals();
+        releaseReply();
+        emit writeError();
+        return;
+    }
+
+    if (_waitingForBuffers && !isCompleted()) {
+        // the rest of the data is written once memory is available
+        _finishPending = true;
+        return;
+    }
+
+    if (isCompleted()) {
+        disconnectFromReplySignals();
+        releaseReply();
+        emit progress();
+        emit completed();
+        return;
+    }
+
+    // the server closed the connection before sending the full range,
+    // ask again for what is missing a limited number of times
+    if (_restarts >= MAX_RESTARTS) {
+        LOG(ERROR) << "Segment " << _start << "-" << _end
+            << " closed prematurely too many times";
+        emit error(QNetworkReply::RemoteHostClosedError);
+        return;
+    }
+
+    _restarts++;
+    disconnectFromReplySignals();
+    releaseReply();
+    startTransfer(_request, _file);
+}
+
+}  // Daemon
+
+}  // DownloadManager
+
+}  // Ubuntu
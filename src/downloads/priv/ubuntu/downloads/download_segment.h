@@ -0,0 +1,129 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOWNLOADER_LIB_DOWNLOAD_SEGMENT_H
+#define DOWNLOADER_LIB_DOWNLOAD_SEGMENT_H
+
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QSslError>
+#include <ubuntu/transfers/system/file_manager.h>
+#include <ubuntu/transfers/system/network_reply.h>
+#include <ubuntu/transfers/system/request_factory.h>
+
+namespace Ubuntu {
+
+using namespace Transfers::System;
+
+namespace DownloadManager {
+
+namespace Daemon {
+
+// A segment is an inclusive byte range [start, end] of a download that
+// is retrieved with its own range request and written in place in the
+// temp file that is shared with the rest of the segments.
+class DownloadSegment : public QObject {
+    Q_OBJECT
+
+ public:
+    DownloadSegment(qint64 start,
+                    qint64 end,
+                    qint64 received = 0,
+                    QObject* parent = 0);
+    virtual ~DownloadSegment();
+
+    qint64 start() const {
+        return _start;
+    }
+
+    qint64 end() const {
+        return _end;
+    }
+
+    qint64 received() const {
+        return _received;
+    }
+
+    qint64 length() const {
+        return _end - _start + 1;
+    }
+
+    bool isCompleted() const {
+        return _received >= length();
+    }
+
+    bool isRunning() const {
+        return _reply != nullptr;
+    }
+
+    NetworkReply* reply() const {
+        return _reply;
+    }
+
+    // request the bytes of the segment that are still missing, the
+    // range header of the request is overridden
+    virtual void startTransfer(const QNetworkRequest& request, File* file);
+    // abort the request keeping the data that was already received
+    virtual bool pauseTransfer();
+    // abort the request dropping any data that was not yet written
+    virtual void cancelTransfer();
+    virtual void setThrottle(qulonglong speed, qulonglong burst);
+
+ signals:
+    void progress();
+    void completed();
+    void error(QNetworkReply::NetworkError code);
+    void sslErrors(const QList<QSslError>& errors);
+    void rangeNotSupported();
+    void writeError();
+
+ private:
+    void connectToReplySignals();
+    void disconnectFromReplySignals();
+    void releaseReply();
+    bool writeData(QByteArray data);
+    bool writeReplyData();
+
+    // slots used to react to signals
+    void onDownloadProgress(qint64, qint64);
+    void onFinished();
+    void onBuffersAvailable();
+
+ private:
+    qint64 _start = 0;
+    qint64 _end = 0;
+    qint64 _received = 0;
+    int _restarts = 0;
+    bool _validated = false;
+    bool _waitingForBuffers = false;
+    bool _finishPending = false;  // finished while waiting for buffers
+    qulonglong _throttle = 0;
+    qulonglong _burst = 0;
+    QNetworkRequest _request;
+    File* _file = nullptr;
+    NetworkReply* _reply = nullptr;
+};
+
+}  // Daemon
+
+}  // DownloadManager
+
+}  // Ubuntu
+
+#endif  // DOWNLOADER_LIB_DOWNLOAD_SEGMENT_H
@@ -16,6 +16,7 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <QCoreApplication>
 #include <QDir>
 #include <QFile>
 #include <QJsonDocument>
@@ -44,7 +45,18 @@ namespace {
         "total_size TEXT, "\
         "throttle TEXT, "\
         "metadata TEXT, "\
-        "headers TEXT)";
+        "headers TEXT, "\
+        "etag TEXT, "\
+        "last_modified TEXT, "\
+        "durable_size TEXT)";
+
+    // columns that were added after the first version of the table, dbs
+    // created before get them when initialized
+    const QString SINGLE_DOWNLOAD_COLUMNS = "PRAGMA table_info(SingleDownload)";
+    const QString ADD_SINGLE_DOWNLOAD_COLUMN = "ALTER TABLE SingleDownload "\
+        "ADD COLUMN %1 TEXT";
+    const QStringList ADDED_COLUMNS = QStringList() << "etag"
+        << "last_modified" << "durable_size";
 
     const QString GROUP_DOWNLOAD_TABLE = "CREATE TABLE IF NOT EXISTS GroupDownload("\
         "uuid VARCHAR(40) PRIMARY KEY, "\
@@ -61,31 +73,43 @@ namespace {
         "FOREIGN KEY(group_id) REFERENCES GroupDownload(uuid), "\
         "FOREIGN KEY(download_id) REFERENCES SingleDownload(uuid))";
 
-    const QString PRESENT_SINGLE_DOWNLOAD = "SELECT count(uuid) FROM SingleDownload "\
-        "WHERE uuid=:uuid;";
-
+    // a download is updated and only inserted when it was not present,
+    // upserts are not used since they are not supported by older sqlite
     const QString INSERT_SINGLE_DOWNLOAD = "INSERT INTO SingleDownload("\
         "uuid, appId, url, dbus_path, local_path, hash, hash_algo, state, total_size, "\
-        "throttle, metadata, headers) VALUES (:uuid, :appId, :url, :dbus_path, "\
-        ":local_path, :hash, :hash_algo, :state, :total_size, :throttle, "\
-        ":metadata, :headers)";
+        "throttle, metadata, headers, etag, last_modified, durable_size) "\
+        "VALUES (:uuid, :appId, :url, :dbus_path, :local_path, :hash, "\
+        ":hash_algo, :state, :total_size, :throttle, :metadata, :headers, "\
+        ":etag, :last_modified, :durable_size)";
 
     const QString UPDATE_SINGLE_DOWNLOAD = "UPDATE SingleDownload SET "\
-        "url=:url, dbus_path=:dbus_path, local_path=:local_path, "\
+        "appId=:appId, url=:url, dbus_path=:dbus_path, local_path=:local_path, "\
         "hash=:hash, hash_algo=:hash_algo, state=:state, total_size=:total_size, "\
-        "throttle=:throttle, metadata=:metadata, headers=:headers "\
-        "WHERE uuid=:uuid";
+        "throttle=:throttle, metadata=:metadata, headers=:headers, "\
+        "etag=:etag, last_modified=:last_modified, "\
+        "durable_size=:durable_size WHERE uuid=:uuid";
 
     const QString GET_SINGLE_DOWNLOAD_STATE = "SELECT state, url, local_path, hash, "\
         "metadata FROM SingleDownload WHERE uuid=:uuid";
 
     const QString GET_UNCOLLECTED_DOWNLOADS = "SELECT uuid, appId, url, dbus_path, "\
-        "local_path, hash, hash_algo, state, metadata, headers FROM SingleDownload "\
+        "local_path, hash, hash_algo, state, metadata, headers, etag, "\
+        "last_modified, durable_size FROM SingleDownload "\
         "WHERE appId=:appId AND state='uncoll'";
 
     const QString UPDATE_UNCOLLECTED_DOWNLOADS = "UPDATE SingleDownload SET state='finish' "\
         "WHERE state='uncoll' AND appId=:appId";
 
+    const QString WAL_JOURNAL_MODE = "PRAGMA journal_mode=WAL";
+    const QString NORMAL_SYNCHRONOUS = "PRAGMA synchronous=NORMAL";
+
+    const QString CONNECTION_NAME = "ubuntu-download-manager-%1";
+
+    // changes are written at most after this delay or as soon as there
+    // are enough downloads waiting to fill a batch
+    const int FLUSH_DELAY = 250;
+    const int MAX_BATCH_SIZE = 100;
+
     const QString IDLE_STRING = "idle";
     const QString START_STRING = "start";
     const QString PAUSE_STRING = "pause";
@@ -111,6 +135,28 @@ DownloadsDb::DownloadsDb(QObject* parent)
     : QObject(parent) {
     _fileManager = FileManager::instance();
     internalInit();
+
+    _flushTimer = new Timer(this);
+    CHECK(connect(_flushTimer, &Timer::timeout,
+        this, &DownloadsDb::flushPendingChanges))
+            << "Could not connect to signal";
+    if (QCoreApplication::instance() != nullptr) {
+        CHECK(connect(QCoreApplication::instance(),
+            &QCoreApplication::aboutToQuit,
+            this, &DownloadsDb::flushPendingChanges))
+                << "Could not connect to signal";
+    }
+}
+
+DownloadsDb::~DownloadsDb() {
+    flushPendingChanges();
+    clearPreparedQueries();
+    if (_connection.isOpen()) {
+        _connection.close();
+    }
+    // the handle has to be released before the connection is removed
+    _connection = QSqlDatabase();
+    QSqlDatabase::removeDatabase(_connectionName);
 }
 
 QSqlDatabase
@@ -148,33 +194,100 @@ DownloadsDb::internalInit() {
     _dbName = path + QDir::separator() + "downloads.db";
     _db = QSqlDatabase::addDatabase("QSQLITE");
     _db.setDatabaseName(_dbName);
+
+    // each instance owns a connection that stays open for its lifetime
+    _connectionName = CONNECTION_NAME.arg(
+        reinterpret_cast<quintptr>(this));
+    _connection = QSqlDatabase::addDatabase("QSQLITE", _connectionName);
+    _connection.setDatabaseName(_dbName);
     LOG(INFO) << "Db file is " << _dbName;
 }
 
+bool
+DownloadsDb::openConnection() {
+    if (_connection.isOpen()) {
+        return true;
+    }
+
+    // statements prepared against a previous connection are no longer valid
+    clearPreparedQueries();
+
+    bool opened = _connection.open();
+    if (!opened) {
+        LOG(ERROR) << _connection.lastError().text();
+        return false;
+    }
+
+    // with a write ahead log readers do not block the writer and commits
+    // only need to be synced at checkpoints, a power loss can lose the
+    // last transactions but never corrupts the db
+    QSqlQuery pragma(_connection);
+    if (!pragma.exec(WAL_JOURNAL_MODE)) {
+        LOG(WARNING) << pragma.lastError().text();
+    }
+    if (!pragma.exec(NORMAL_SYNCHRONOUS)) {
+        LOG(WARNING) << pragma.lastError().text();
+    }
+    return true;
+}
+
+QSqlQuery*
+DownloadsDb::preparedQuery(const QString& sql) {
+    if (!openConnection()) {
+        return nullptr;
+    }
+
+    if (!_queries.contains(sql)) {
+        auto query = new QSqlQuery(_connection);
+        if (!query->prepare(sql)) {
+            LOG(ERROR) << query->lastError().text();
+            delete query;
+            return nullptr;
+        }
+        _queries[sql] = query;
+    }
+    return _queries[sql];
+}
+
+void
+DownloadsDb::clearPreparedQueries() {
+    qDeleteAll(_queries);
+    _queries.clear();
+}
+
 bool
 DownloadsDb::init() {
     TRACE;
     // create the required tables
-    bool opened = _db.open();
-    if (!opened) {
-        LOG(ERROR) << _db.lastError().text();
+    if (!openConnection()) {
         return false;
     }
 
-    _db.transaction();
+    _connection.transaction();
 
     // create the required tables and indexes
     bool success = true;
-    QSqlQuery query;
+    QSqlQuery query(_connection);
     success &= query.exec(SINGLE_DOWNLOAD_TABLE);
     success &= query.exec(GROUP_DOWNLOAD_TABLE);
     success &= query.exec(GROUP_DOWNLOAD_RELATION);
 
+    // update the tables of older dbs
+    QStringList columns;
+    success &= query.exec(SINGLE_DOWNLOAD_COLUMNS);
+    while (success && query.next()) {
+        columns << query.value(1).toString();
+    }
+    foreach(const QString& column, ADDED_COLUMNS) {
+        if (success && !columns.contains(column)) {
+            success &= query.exec(ADD_SINGLE_DOWNLOAD_COLUMN.arg(column));
+        }
+    }
+
     if (success)
-        _db.commit();
+        _connection.commit();
     else
-        _db.rollback();
-    _db.close();
+        _connection.rollback();
     return success;
 }
 
@@ -271,147 +384,170 @@ DownloadsDb::store(Download* down) {
     return false;
 }
 
+bool
+DownloadsDb::storeAll(const QList<Download*>& downloads) {
+    // a single transaction means a single sync for the whole list
+    bool transaction = downloads.size() > 1 && openConnection()
+        && _connection.transaction();
+    bool stored = true;
+    foreach(Download* down, downloads) {
+        stored &= store(down);
+    }
+    if (transaction && !_connection.commit()) {
+        LOG(ERROR) << _connection.lastError().text();
+        _connection.rollback();
+        return false;
+    }
+    return stored;
+}
+
 DownloadStateStruct
 DownloadsDb::getDownloadState(const QString &downloadId) {
-    bool opened = _db.open();
-
-    if (!opened) {
-        LOG(ERROR) << _db.lastError().text();
+    auto query = preparedQuery(GET_SINGLE_DOWNLOAD_STATE);
+    if (query == nullptr) {
         return DownloadStateStruct();
     }
 
-    QSqlQuery query;
-    /* const QString GET_SINGLE_DOWNLOAD_STATE = "SELECT state, url, local_path, hash "\
-      "metadata FROM SingleDownload WHERE uuid=:uuid"; */
-    query.prepare(GET_SINGLE_DOWNLOAD_STATE);
-    query.bindValue(":uuid", downloadId);
+    query->bindValue(":uuid", downloadId);
 
-    bool success = query.exec();
-    if (success && query.next()) {
+    bool success = query->exec();
+    if (success && query->next()) {
         // grab the data and create the state structure
-        auto state = stringToState(query.value(0).toString());
-        auto url = query.value(1).toString();
-        auto localPath = query.value(2).toString();
-        auto hash = query.value(3).isValid()?query.value(3).toString():"";
-        QVariantMap metadata = stringToVariantMap(query.value(4).toString());
+        auto state = stringToState(query->value(0).toString());
+        auto url = query->value(1).toString();
+        auto localPath = query->value(2).toString();
+        auto hash = query->value(3).isValid()?query->value(3).toString():"";
+        QVariantMap metadata = stringToVariantMap(query->value(4).toString());
 
         DownloadStateStruct result(state, url, localPath, hash, metadata);
-        _db.close();
+        // reset the statement so that it does not keep the read lock
+        query->finish();
 
         return result;
     }
     if (!success) {
-        LOG(ERROR) << query.lastError().text();
+        LOG(ERROR) << query->lastError().text();
     }
+    query->finish();
     return DownloadStateStruct();
 }
 
 QList<Download*>
 DownloadsDb::getUncollectedDownloads(const QString &appId) {
-    bool opened = _db.open();
     QList<Download*> downloadList;
-
-    if (!opened) {
-        LOG(ERROR) << _db.lastError().text();
+    auto query = preparedQuery(GET_UNCOLLECTED_DOWNLOADS);
+    if (query == nullptr) {
         return downloadList;
     }
 
-    QSqlQuery query;
-    query.prepare(GET_UNCOLLECTED_DOWNLOADS);
-    query.bindValue(":appId", appId);
+    query->bindValue(":appId", appId);
 
-    bool success = query.exec();
+    bool success = query->exec();
     if (!success) {
-        LOG(ERROR) << query.lastError().text();
-        _db.close();
+        LOG(ERROR) << query->lastError().text();
         return downloadList;
     }
-    while (query.next()) {
-        auto uuid = query.value(0).toString();
-        auto appId = query.value(1).toString();
-        auto url = query.value(2).toString();
-        auto dbusPath = query.value(3).toString();
-        auto filePath = query.value(4).toString();
+    while (query->next()) {
+        auto uuid = query->value(0).toString();
+        auto appId = query->value(1).toString();
+        auto url = query->value(2).toString();
+        auto dbusPath = query->value(3).toString();
+        auto filePath = query->value(4).toString();
         auto basePath = QFileInfo(filePath).absolutePath();
-        auto hash = query.value(5).isValid() ? query.value(5).toString() : "";
-        auto algo = query.value(6).isValid() ? query.value(6).toString() : "";
-        auto state = stringToState(query.value(7).toString());
-        QVariantMap metadata = stringToVariantMap(query.value(8).toString());
-        QMap<QString, QString> headers = stringToStringMap(query.value(9).toString());
+        auto hash = query->value(5).isValid() ? query->value(5).toString() : "";
+        auto algo = query->value(6).isValid() ? query->value(6).toString() : "";
+        auto state = stringToState(query->value(7).toString());
+        QVariantMap metadata = stringToVariantMap(query->value(8).toString());
+        QMap<QString, QString> headers = stringToStringMap(query->value(9).toString());
         FileDownload *download = new FileDownload(uuid, appId, dbusPath, 1, basePath, url, hash, algo, metadata, headers);
         download->setState(state);
         download->setFilePath(filePath);
+        download->setValidators(query->value(10).toByteArray(),
+            query->value(11).toByteArray());
+        // the data after it might not be in the disk
+        bool hasDurableSize = false;
+        auto durableSize = query->value(12).toString().toLongLong(
+            &hasDurableSize);
+        if (hasDurableSize) {
+            download->setDurableSize(durableSize);
+        }
         auto downAdaptor = new DownloadAdaptor(download);
         download->setAdaptor(DOWNLOAD_INTERFACE, downAdaptor);
 
         downloadList << download;
 
     }
+    query->finish();
 
-    QSqlQuery updateQuery;
-    updateQuery.prepare(UPDATE_UNCOLLECTED_DOWNLOADS);
-    updateQuery.bindValue(":appId", appId);
-    success = updateQuery.exec();
+    auto updateQuery = preparedQuery(UPDATE_UNCOLLECTED_DOWNLOADS);
+    if (updateQuery == nullptr) {
+        return downloadList;
+    }
+    updateQuery->bindValue(":appId", appId);
+    success = updateQuery->exec();
     if (!success) {
-        LOG(ERROR) << updateQuery.lastError().text();
+        LOG(ERROR) << updateQuery->lastError().text();
     }
 
-    _db.close();
     return downloadList;
 }
 
 bool
 DownloadsDb::storeSingleDownload(FileDownload* download) {
-    // decide if we store it as a new download or update an existing one
-    bool opened = _db.open();
-
-    if (!opened) {
-        LOG(ERROR) << _db.lastError().text();
+    auto query = preparedQuery(UPDATE_SINGLE_DOWNLOAD);
+    if (query == nullptr) {
         return false;
     }
 
-    QSqlQuery query;
-    query.prepare(PRESENT_SINGLE_DOWNLOAD);
-    query.bindValue(":uuid", download->transferId());
+    bindSingleDownload(query, download);
+    bool success = query->exec();
+    if (!success) {
+        LOG(ERROR) << query->lastError().text();
+        return success;
+    }
 
-    query.exec();
-    int rows = 0;
-    if (query.next())
-        rows = query.value(0).toInt();
+    if (query->numRowsAffected() > 0) {
+        return success;
+    }
 
-    if (rows > 0) {
-        LOG(INFO) << "Update download";
-        query.prepare(UPDATE_SINGLE_DOWNLOAD);
-    } else {
-        LOG(INFO) << "Insert download";
-        query.prepare(INSERT_SINGLE_DOWNLOAD);
+    // first time the download is stored
+    query = preparedQuery(INSERT_SINGLE_DOWNLOAD);
+    if (query == nullptr) {
+        return false;
     }
 
-    query.bindValue(":uuid", download->transferId());
-    query.bindValue(":appId", download->transferAppId());
-    query.bindValue(":url", download->url().toString());
-    query.bindValue(":dbus_path", download->path());
-    query.bindValue(":local_path", download->filePath());
-    query.bindValue(":hash", download->hash());
-    query.bindValue(":hash_algo",
+    bindSingleDownload(query, download);
+    success = query->exec();
+    if (!success)
+        LOG(ERROR) << query->lastError().text();
+
+    return success;
+}
+
+void
+DownloadsDb::bindSingleDownload(QSqlQuery* query, FileDownload* download) {
+    query->bindValue(":uuid", download->transferId());
+    query->bindValue(":appId", download->transferAppId());
+    query->bindValue(":url", download->url().toString());
+    query->bindValue(":dbus_path", download->path());
+    query->bindValue(":local_path", download->filePath());
+    query->bindValue(":hash", download->hash());
+    query->bindValue(":hash_algo",
         HashAlgorithm::getHashAlgo(download->hashAlgorithm()));
-    query.bindValue(":state", stateToString(download->state()));
-    query.bindValue(":total_size",
+    query->bindValue(":state", stateToString(download->state()));
+    query->bindValue(":total_size",
         QString::number(download->totalSize()));
-    query.bindValue(":throttle",
+    query->bindValue(":throttle",
         QString::number(download->throttle()));
-    query.bindValue(":metadata",
+    query->bindValue(":metadata",
         metadataToString(download->metadata()));
-    query.bindValue(":headers",
+    query->bindValue(":headers",
         headersToString(download->headers()));
-
-    bool success = query.exec();
-    if (!success)
-        LOG(ERROR) << query.lastError().text();
-
-    _db.close();
-
-    return success;
+    query->bindValue(":etag", QString::fromLatin1(download->etag()));
+    query->bindValue(":last_modified",
+        QString::fromLatin1(download->lastModified()));
+    query->bindValue(":durable_size",
+        QString::number(download->durableSize()));
 }
 
 void
@@ -422,6 +558,14 @@ DownloadsDb::connectToDownload(Download* download) {
     CHECK(connect(download, &Download::throttleChanged,
         this, &DownloadsDb::onDownloadChanged))
             << "Could not connect to signal";
+
+    // resume only trusts the data that is known to be in the disk
+    auto fileDown = qobject_cast<FileDownload*>(download);
+    if (fileDown != nullptr) {
+        CHECK(connect(fileDown, &FileDownload::durableSizeChanged,
+            this, &DownloadsDb::onDownloadChanged))
+                << "Could not connect to signal";
+    }
 }
 
 void
@@ -430,21 +574,71 @@ DownloadsDb::disconnectFromDownload(Download* download) {
         this, &DownloadsDb::onDownloadChanged);
     disconnect(download, &Download::throttleChanged,
         this, &DownloadsDb::onDownloadChanged);
+    auto fileDown = qobject_cast<FileDownload*>(download);
+    if (fileDown != nullptr) {
+        disconnect(fileDown, &FileDownload::durableSizeChanged,
+            this, &DownloadsDb::onDownloadChanged);
+    }
+
+    // do not lose the changes that were waiting to be written
+    if (_pending.contains(download)) {
+        _pending.removeAll(download);
+        store(download);
+    }
 }
 
 void
 DownloadsDb::onDownloadChanged() {
     auto down = qobject_cast<Download*>(sender());
-    if (down != nullptr) {
-        store(down);
-        auto state = down->state();
-        if (state == Download::FINISH
-                || state == Download::CANCEL
-                || state == Download::ERROR) {
-            LOG(INFO) << "Disconnecting from" << down->transferId();
-            disconnectFromDownload(down);
+    if (down == nullptr) {
+        return;
+    }
+
+    // the row contains the complete state of the download, so several
+    // changes in a row can be written with a single store
+    if (!_pending.contains(down)) {
+        _pending.append(down);
+    }
+
+    auto state = down->state();
+    if (state == Download::FINISH
+            || state == Download::CANCEL
+            || state == Download::ERROR) {
+        // terminal states are written right away, the download is about
+        // to be removed and the client might look it up in the db
+        flushPendingChanges();
+        LOG(INFO) << "Disconnecting from" << down->transferId();
+        disconnectFromDownload(down);
+    } else if (_pending.size() >= MAX_BATCH_SIZE) {
+        flushPendingChanges();
+    } else if (!_flushTimer->isActive()) {
+        _flushTimer->start(FLUSH_DELAY);
+    }
+}
+
+void
+DownloadsDb::flushPendingChanges() {
+    _flushTimer->stop();
+    if (_pending.isEmpty()) {
+        return;
+    }
+
+    auto pending = _pending;
+    _pending.clear();
+
+    // write the whole batch in a single transaction so that it is
+    // synced once
+    bool transaction = pending.size() > 1 && openConnection()
+        && _connection.transaction();
+    foreach(const QPointer<Download>& down, pending) {
+        if (!down.isNull()) {
+            store(down.data());
         }
     }
+    if (transaction && !_connection.commit()) {
+        LOG(ERROR) << _connection.lastError().text();
+        _connection.rollback();
+    }
 }
 
 DownloadsDb*
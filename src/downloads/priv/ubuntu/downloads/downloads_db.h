@@ -19,10 +19,15 @@
 #ifndef DOWNLOADER_LIB_DOWNLOADS_DATABASE_H
 #define DOWNLOADER_LIB_DOWNLOADS_DATABASE_H
 
+#include <QHash>
+#include <QList>
+#include <QPointer>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QObject>
 
 #include <ubuntu/transfers/system/file_manager.h>
+#include <ubuntu/transfers/system/timer.h>
 #include <ubuntu/download_manager/download_state_struct.h>
 
 #include "file_download.h"
@@ -44,12 +49,18 @@ class DownloadsDb : public QObject {
     static void setInstance(DownloadsDb* instance);
     static void deleteInstance();
 
+    virtual ~DownloadsDb();
+
+    // connection that can be freely opened and closed, the daemon uses
+    // its own long lived connection to the same file
     QSqlDatabase db();
     QString filename();
     bool dbExists();  // return if the db is present and valid
     bool init();  // init or update the db
 
     virtual bool store(Download* down);
+    // store several downloads in a single transaction
+    virtual bool storeAll(const QList<Download*>& downloads);
     virtual DownloadStateStruct getDownloadState(const QString &downloadId);
     virtual QList<Download*> getUncollectedDownloads(const QString &appId);
 
@@ -59,6 +70,8 @@ class DownloadsDb : public QObject {
 
  public slots:
     void onDownloadChanged();
+    // store all the downloads whose changes are waiting to be written
+    void flushPendingChanges();
 
  protected:
     explicit DownloadsDb(QObject *parent = 0);
@@ -66,6 +79,10 @@ class DownloadsDb : public QObject {
  private:
     QString headersToString(const QMap<QString, QString>& headers);
     void internalInit();
+    bool openConnection();
+    QSqlQuery* preparedQuery(const QString& sql);
+    void bindSingleDownload(QSqlQuery* query, FileDownload* download);
+    void clearPreparedQueries();
     QString metadataToString(const QVariantMap& metadata);
     QVariantMap stringToVariantMap(const QString &str);
     QMap<QString, QString> stringToStringMap(const QString &str);
@@ -80,6 +97,13 @@ class DownloadsDb : public QObject {
     QString _dbName;
     FileManager* _fileManager;
     QSqlDatabase _db;
+    QString _connectionName;
+    QSqlDatabase _connection;
+    // prepared statements are cached for as long as the connection lives
+    QHash<QString, QSqlQuery*> _queries;
+    // downloads with changes that have not been written yet
+    QList<QPointer<Download>> _pending;
+    Timer* _flushTimer;
 };
 
 }  // Daemon
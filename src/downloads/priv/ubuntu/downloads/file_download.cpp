@@ -16,17 +16,22 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <cerrno>
+#include <cstring>
 #include <map>
+#include <random>
 
 #include <glog/logging.h>
 
 #include <QBuffer>
 #include <QCryptographicHash>
+#include <QDateTime>
 #include <QDBusConnection>
 #include <QDBusMessage>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QLocale>
 #include <QMimeDatabase>
 #include <QMimeType>
 #include <QStringList>
@@ -34,7 +39,10 @@
 
 #include <ubuntu/transfers/i18n.h>
 #include <ubuntu/transfers/metadata.h>
+#include <ubuntu/transfers/system/buffer_pool.h>
 #include <ubuntu/transfers/system/dbus_connection.h>
+#include <ubuntu/transfers/system/file_remover.h>
+#include <ubuntu/transfers/system/file_writer.h>
 #include <ubuntu/transfers/system/hash_algorithm.h>
 #include <ubuntu/transfers/system/cryptographic_hash.h>
 #include <ubuntu/transfers/system/logger.h>
@@ -45,6 +53,7 @@
 
 #include "header_parser.h"
 #include "file_download.h"
+#include "metalink.h"
 
 #define DOWN_LOG(LEVEL) LOG(LEVEL) << ((parent() != nullptr)?"GroupDownload {" + parent()->objectName() + " } ":"") << "Download ID{" << objectName() << " } "
 
@@ -151,6 +160,7 @@ namespace {
     const QString DATA_FILE_NAME = "data.download";
     const QString NETWORK_ERROR = "NETWORK ERROR";
     const QString HASH_ERROR = "HASH ERROR";
+    const QString METALINK_ERROR = "METALINK ERROR";
     const QString COMMAND_ERROR = "COMMAND ERROR";
     const QString SSL_ERROR = "SSL ERROR";
     const QString FILE_SYSTEM_ERROR = "FILE SYSTEM ERROR: %1";
@@ -160,7 +170,87 @@ namespace {
     const QString UNEXPECTED_ERROR = "UNEXPECTED_ERROR";
     const QByteArray CONTENT_DISPOSITION = "Content-Disposition";
     const QByteArray CONTENT_TYPE = "Content-Type";
+    const QByteArray ACCEPT_RANGES = "Accept-Ranges";
+    const QByteArray CONTENT_LENGTH = "Content-Length";
+    const QByteArray CONTENT_RANGE = "Content-Range";
+    const QByteArray ETAG = "ETag";
+    const QByteArray LAST_MODIFIED = "Last-Modified";
+    const QByteArray WEAK_ETAG_PREFIX = "W/";
+    const QByteArray RETRY_AFTER = "Retry-After";
+    const QString HTTP_DATE_FORMAT = "ddd, dd MMM yyyy hh:mm:ss 'GMT'";
     const QString DATA_URI_PREFIX = "data:";
+    const int HTTP_OK = 200;
+    const int HTTP_PARTIAL_CONTENT = 206;
+    const int HTTP_BAD_REQUEST = 400;
+    const int MAX_SEGMENTS = 8;
+    // do not split downloads in pieces smaller than 1MiB, the cost of the
+    // extra connections would not pay off
+    const qint64 MIN_SEGMENT_SIZE = 1024 * 1024;
+    // pooled buffers that are filled before they are written at once
+    const int MAX_WRITE_BUFFERS = 16;
+    // names tried when the one of the download is taken while publishing
+    const int MAX_PUBLISH_ATTEMPTS = 3;
+    // downloads from this size on do not keep their data in the page
+    // cache unless the metadata says otherwise
+    const qint64 DROP_CACHE_THRESHOLD = 256 * 1024 * 1024;
+    // periodic durability syncs after this amount of data or time
+    const qint64 PERIODIC_SYNC_BYTES = 16 * 1024 * 1024;
+    const qint64 PERIODIC_SYNC_MSECS = 5000;
+    // longest wait between retries unless the server asks for more,
+    // which is capped too
+    const qint64 MAX_RETRY_DELAY = 5 * 60 * 1000;
+    const qint64 MAX_RETRY_AFTER = 60 * 60 * 1000;
+    // times a piece that does not match is fetched from the last mirror
+    const int MAX_PIECE_FAILURES = 3;
+
+    // errors that are likely to go away if the request is done again
+    bool isTransientError(QNetworkReply::NetworkError code) {
+        switch (code) {
+            case QNetworkReply::ConnectionRefusedError:
+            case QNetworkReply::RemoteHostClosedError:
+            case QNetworkReply::TimeoutError:
+            case QNetworkReply::TemporaryNetworkFailureError:
+            case QNetworkReply::NetworkSessionFailedError:
+            case QNetworkReply::ProxyConnectionClosedError:
+            case QNetworkReply::ProxyTimeoutError:
+            case QNetworkReply::UnknownNetworkError:
+            case QNetworkReply::ServiceUnavailableError:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool isTransientStatus(int status) {
+        // request timeout, too many requests, bad gateway, service
+        // unavailable and gateway timeout
+        return status == 408 || status == 429 || status == 502
+            || status == 503 || status == 504;
+    }
+
+    // ms to wait per a Retry-After header, either seconds or a date,
+    // -1 if it cannot be parsed
+    qint64 parseRetryAfter(const QByteArray& value) {
+        bool isNumber = false;
+        auto seconds = value.trimmed().toLongLong(&isNumber);
+        if (isNumber) {
+            return (seconds < 0)? -1 : seconds * 1000;
+        }
+
+        auto date = QLocale::c().toDateTime(
+            QString::fromLatin1(value.trimmed()), HTTP_DATE_FORMAT);
+        if (!date.isValid()) {
+            return -1;
+        }
+        date.setTimeSpec(Qt::UTC);
+        return qMax(QDateTime::currentDateTimeUtc().msecsTo(date), 0LL);
+    }
+
+    qint64 randomDelay(qint64 min, qint64 max) {
+        static std::mt19937_64 generator(std::random_device{}());
+        std::uniform_int_distribution<qint64> distribution(min, max);
+        return distribution(generator);
+    }
 }
 
 namespace Ubuntu {
@@ -203,10 +293,11 @@ FileDownload::FileDownload(const QString& id,
       _totalSize(0),
       _url(url),
       _hash(hash) {
-    init();
+    // set before init so that the hash of a metalink is not overridden
     _algo = HashAlgorithm::getHashAlgo(algo);
+    init();
     // check that the algorithm is correct if the hash is not empty
-    if (!_hash.isEmpty() && !HashAlgorithm::isValidAlgo(algo)) {
+    if (!hash.isEmpty() && !HashAlgorithm::isValidAlgo(algo)) {
         setIsValid(false);
         setLastError(QString(_("Invalid hash algorithm: '%1'")).arg(algo));
     }
@@ -214,10 +305,14 @@ FileDownload::FileDownload(const QString& id,
 
 FileDownload::~FileDownload() {
     if (_currentData != nullptr) {
+        waitForWrites();
         _currentData->close();
     }
     delete _currentData;
     delete _reply;
+    delete _probe;
+    delete _metalinkReply;
+    delete _pieces;
 }
 
 void
@@ -232,6 +327,17 @@ FileDownload::cancelTransfer() {
         _reply->deleteLater();
         _reply = nullptr;
     }
+    _waitingForBuffers = false;
+    _completionPending = false;
+    if (_probe != nullptr) {
+        releaseProbe();
+    }
+    if (_metalinkReply != nullptr) {
+        releaseMetalinkReply();
+    }
+    cancelSegments();
+    _retryTimer->stop();
+    _watchdog->stop();
 
     // remove current data and metadata
     cleanUpCurrentData();
@@ -250,6 +356,47 @@ FileDownload::pauseTransfer() {
         _downloading = false;
         emit paused(false);
     } else {
+        // the data of a failed request was stored when the retry was
+        // scheduled, there is nothing else to keep
+        auto retrying = _retryTimer->isActive();
+        _retryTimer->stop();
+        _watchdog->stop();
+
+        if (hasRunningSegments()) {
+            DOWN_LOG(INFO) << "Pausing segmented download" << _url;
+            if (!pauseSegments()) {
+                emit paused(false);
+            } else {
+                DOWN_LOG(INFO) << "EMIT paused(true)";
+                _downloading = false;
+                emit paused(true);
+            }
+            return;
+        }
+
+        if (_probe != nullptr || _metalinkReply != nullptr) {
+            // nothing was written yet, resuming requests the whole body
+            DOWN_LOG(INFO) << "Pausing download while probing" << _url;
+            if (_probe != nullptr) {
+                releaseProbe();
+            }
+            if (_metalinkReply != nullptr) {
+                releaseMetalinkReply();
+            }
+            DOWN_LOG(INFO) << "EMIT paused(true)";
+            _downloading = false;
+            emit paused(true);
+            return;
+        }
+
+        if (_reply == nullptr && retrying) {
+            DOWN_LOG(INFO) << "Pausing download waiting for a retry" << _url;
+            DOWN_LOG(INFO) << "EMIT paused(true)";
+            _downloading = false;
+            emit paused(true);
+            return;
+        }
+
         if (_reply == nullptr) {
             // cannot pause because is not running
             DOWN_LOG(INFO) << "Cannot pause download because reply is NULL";
@@ -264,14 +411,16 @@ FileDownload::pauseTransfer() {
         // the data in the reply and store it in a file
         disconnectFromReplySignals();
 
-        // do abort before reading
+        // do abort before reading, the hash is kept in memory so that
+        // the data does not have to be read again when resumed
         _reply->abort();
-        _currentData->write(_reply->readAll());
-        if (!flushFile()) {
+        if (!storeReplyData()) {
             emit paused(false);
         } else {
             _reply->deleteLater();
             _reply = nullptr;
+            _waitingForBuffers = false;
+            _completionPending = false;
             DOWN_LOG(INFO) << "EMIT paused(true)";
             _downloading = false;
             emit paused(true);
@@ -283,7 +432,8 @@ void
 FileDownload::resumeTransfer() {
     DOWN_LOG(INFO) << __PRETTY_FUNCTION__ << _url;
 
-    if (_reply != nullptr) {
+    if (_reply != nullptr || _probe != nullptr || _metalinkReply != nullptr
+            || hasRunningSegments()) {
         // cannot resume because it is already running
         DOWN_LOG(INFO) << "Cannot resume download because reply != NULL";
         DOWN_LOG(INFO) << "EMIT resumed(false)";
@@ -291,6 +441,9 @@ FileDownload::resumeTransfer() {
         return;
     }
 
+    // a scheduled retry is done right away
+    _retryTimer->stop();
+
     // it is not very probable, yet possible that we do reach this point with a data uri
 
     if (_url.toString().contains(DATA_URI_PREFIX)) {
@@ -298,20 +451,22 @@ FileDownload::resumeTransfer() {
         _downloading = true;
         emit resumed(true);
         writeDataUri();
+    } else if (!_segments.isEmpty()) {
+        DOWN_LOG(INFO) << "Resuming segmented download.";
+        startSegments();
+        startWatchdog();
+
+        DOWN_LOG(INFO) << "EMIT resumed(true)";
+        _downloading = true;
+        emit resumed(true);
     } else {
         DOWN_LOG(INFO) << "Resuming download.";
-        QNetworkRequest request = buildRequest();
-
-        // overrides the range header, we do not let clients set the range!!!
-        qint64 currentDataSize = _currentData->size();
-        QByteArray rangeHeaderValue = "bytes=" +
-                QByteArray::number(currentDataSize) + "-";
-        request.setRawHeader("Range", rangeHeaderValue);
-
-        _reply = _requestFactory->get(request);
-        _reply->setReadBufferSize(throttle());
-
-        connectToReplySignals();
+        if (needsMetalink()) {
+            fetchMetalink();
+        } else if (!requestRemainingData()) {
+            return;
+        }
+        startWatchdog();
 
         DOWN_LOG(INFO) << "EMIT resumed(true)";
         _downloading = true;
@@ -319,11 +474,92 @@ FileDownload::resumeTransfer() {
     }
 }
 
+bool
+FileDownload::storeReplyData() {
+    storeValidators(_reply);
+    if (_resumed) {
+        _resumed = false;
+        if (!checkResumedReply()) {
+            return false;
+        }
+    }
+    auto data = _reply->readAll();
+    waitForWrites();
+    updateHash(data, _currentData->write(data));
+    return flushFile();
+}
+
+bool
+FileDownload::requestRemainingData() {
+    QNetworkRequest request = buildRequest();
+
+    // overrides the range header, we do not let clients set the range!!!
+    qint64 currentDataSize = _currentData->size();
+    if (_trimToDurable) {
+        // the page cache of a running daemon has every byte that was
+        // written, only the data of a restored download might not have
+        // reached the disk
+        _trimToDurable = false;
+        if (_durableSize >= 0 && currentDataSize > _durableSize) {
+            DOWN_LOG(WARNING) << "Dropping " << currentDataSize - _durableSize
+                << " bytes that are not durable";
+            if (_currentData->resize(_durableSize)) {
+                currentDataSize = _durableSize;
+                resetHash();
+            }
+        }
+    }
+
+    if (_pieces != nullptr) {
+        // only the pieces that matched are kept, the data of a restored
+        // download was never checked and is read once
+        waitForWrites();
+        currentDataSize = _currentData->size();
+        auto verified = (currentDataSize > _pieces->fedSize())?
+            _pieces->verify(_currentData->device(), currentDataSize) :
+            _pieces->rewind(currentDataSize);
+        if (verified < currentDataSize) {
+            DOWN_LOG(WARNING) << "Dropping " << currentDataSize - verified
+                << " bytes that are not in a verified piece";
+            if (!_currentData->resize(verified)) {
+                auto err = _currentData->error();
+                DOWN_LOG(ERROR) << "Could not truncate the temp file" << err;
+                _downloading = false;
+                emitError(QString(FILE_SYSTEM_ERROR).arg(err));
+                return false;
+            }
+            currentDataSize = verified;
+            resetHash();
+            if (_durableSize > verified) {
+                updateDurableSize(verified);
+                _syncRequestedSize = verified;
+            }
+        }
+    }
+    QByteArray rangeHeaderValue = "bytes=" +
+            QByteArray::number(currentDataSize) + "-";
+    request.setRawHeader("Range", rangeHeaderValue);
+
+    // if the resource changed the server sends all of it instead of
+    // a part that would not match the data we have
+    auto validator = ifRangeValidator();
+    if (currentDataSize > 0 && !validator.isEmpty()) {
+        request.setRawHeader("If-Range", validator);
+    }
+    _resumed = currentDataSize > 0;
+
+    _reply = _requestFactory->get(request);
+    _reply->setThrottle(throttle(), throttleBurst());
+
+    connectToReplySignals();
+    return true;
+}
+
 void
 FileDownload::startTransfer() {
     TRACE << _url;
 
-    if (_reply != nullptr) {
+    if (_reply != nullptr || _probe != nullptr || _metalinkReply != nullptr) {
         // the download was already started, lets say that we did it
         DOWN_LOG(INFO) << "Cannot start download because reply != NULL";
         DOWN_LOG(INFO) << "EMIT started(false)";
@@ -333,7 +569,9 @@ FileDownload::startTransfer() {
 
     // create file that will be used to maintain the state of the
     // download when resumed.
-    _currentData = FileManager::instance()->createFile(_tempFilePath);
+    _currentData = createDataFile();
+    _currentData->setDropCache(
+        _metadata.value(Metadata::DROP_CACHE_KEY, false).toBool());
     bool canWrite = _currentData->open(QIODevice::ReadWrite | QFile::Append);
 
     if (!canWrite) {
@@ -361,21 +599,45 @@ FileDownload::startTransfer() {
         writeDataUri();
     } else {
         DOWN_LOG(INFO) << "Performing a network download.";
-        // signals should take care of calling deleteLater on the
-        // NetworkReply object
-        _reply = _requestFactory->get(buildRequest());
-        _reply->setReadBufferSize(throttle());
-
-        connectToReplySignals();
+        if (needsMetalink()) {
+            // the mirrors are known once the document is fetched
+            fetchMetalink();
+        } else {
+            // learn about the resource before its body is requested
+            _probeWithRange = false;
+            startProbe();
+        }
+        startWatchdog();
         DOWN_LOG(INFO) << "EMIT started(true)";
         _downloading = true;
         emit started(true);
     }
 }
 
+qint64
+FileDownload::requiredSpace() {
+    // reserved blocks are no longer counted as free by the file system
+    if (_totalSize == 0 || _spaceReserved) {
+        return 0;
+    }
+    return static_cast<qint64>(_totalSize) -
+        static_cast<qint64>(progress());
+}
+
+QString
+FileDownload::storagePath() {
+    return QFileInfo(_filePath).absolutePath();
+}
+
 qulonglong
 FileDownload::progress() {
-    return (_currentData == nullptr) ? 0 : _currentData->size();
+    if (!_segments.isEmpty()) {
+        // the temp file was resized to the total size, its size does
+        // not tell us how much data we have
+        return segmentsProgress();
+    }
+    return (_currentData == nullptr) ? 0 :
+        FileWriter::instance()->size(_currentData);
 }
 
 qulonglong
@@ -388,7 +650,33 @@ FileDownload::setThrottle(qulonglong speed) {
     TRACE << _url;
     Download::setThrottle(speed);
     if (_reply != nullptr)
-        _reply->setReadBufferSize(speed);
+        _reply->setThrottle(speed, throttleBurst());
+    // the limit is for the download, share it between the segments
+    foreach(DownloadSegment* segment, _segments) {
+        segment->setThrottle(segmentShare(speed),
+            segmentShare(throttleBurst()));
+    }
+}
+
+qulonglong
+FileDownload::segmentShare(qulonglong limit) {
+    // 0 means no limit, a small limit must not become one when divided
+    if (limit == 0 || _segments.isEmpty()) {
+        return limit;
+    }
+    return qMax(Q_UINT64_C(1),
+        limit / static_cast<qulonglong>(_segments.count()));
+}
+
+qulonglong
+FileDownload::transferRate() {
+    qulonglong rate = (_reply != nullptr)? _reply->transferRate() : 0;
+    foreach(DownloadSegment* segment, _segments) {
+        if (segment->isRunning()) {
+            rate += segment->reply()->transferRate();
+        }
+    }
+    return rate;
 }
 
 void
@@ -493,7 +781,14 @@ FileDownload::setMetadata(const QVariantMap& data) {
         }
     }
 
-    Download::setMetadata(data);
+    // the mirrors of a fetched metalink are needed to restore the download
+    auto metadata = data;
+    if (_metadata.contains(Metadata::METALINK_KEY)
+            && !metadata.contains(Metadata::METALINK_KEY)) {
+        metadata[Metadata::METALINK_KEY] = _metadata[Metadata::METALINK_KEY];
+    }
+
+    Download::setMetadata(metadata);
     emit propertiesChanged(changes);
 }
 
@@ -501,13 +796,42 @@ void
 FileDownload::onDownloadProgress(qint64 currentProgress, qint64 bytesTotal) {
     TRACE << _url << currentProgress << bytesTotal;
 
-    _currentData->write(_reply->readAll());
-    auto received = static_cast<qulonglong>(_currentData->size());
+    if (_resumed) {
+        _resumed = false;
+        if (!checkResumedReply()) {
+            return;
+        }
+    }
+
+    if (currentProgress > 0) {
+        // the connection works again, later errors get all the retries
+        _retriesDone = 0;
+    }
+
+    writeReplyData();
+    if (_pieces != nullptr && _pieces->hasFailed()) {
+        refetchPiece();
+        return;
+    }
+
+    if (_currentData->isAnonymous() && _namedDataPath.isEmpty()
+            && _reply->hasRawHeader(ACCEPT_RANGES)
+            && _reply->rawHeader(ACCEPT_RANGES).toLower().contains("bytes")) {
+        nameResumableData();
+    }
+
+    auto writer = FileWriter::instance();
+    auto received = static_cast<qulonglong>(writer->size(_currentData));
+    if (!writer->isRunning()) {
+        // else done by the writer once the data is in the file
+        _currentData->releaseCache(static_cast<qint64>(received));
+    }
+    syncPeriodically(static_cast<qint64>(received));
 
     if (bytesTotal == -1) {
         // we do not know the size of the download, simply return
         // the same for received and for total
-        emit Download::progress(received, received);
+        emitProgress(received, received);
         return;
     } else {
         if (_totalSize == 0) {
@@ -516,26 +840,256 @@ FileDownload::onDownloadProgress(qint64 currentProgress, qint64 bytesTotal) {
             // therefore we only do this once
             // update the metadata
             _totalSize = static_cast<qulonglong>(bytesTotal);
+            // the reply starts where the file ended when it was sent
+            auto offset = static_cast<qint64>(received) - currentProgress;
+            if (!reserveSpace(offset + bytesTotal)) {
+                return;
+            }
+            if (!_metadata.contains(Metadata::DROP_CACHE_KEY)) {
+                // do not let big downloads fill the page cache
+                _currentData->setDropCache(
+                    offset + bytesTotal >= DROP_CACHE_THRESHOLD);
+            }
+        }
+        emitProgress(received, _totalSize, received >= _totalSize);
+
+        if (!_segmentsChecked
+                && canUseSegments(bytesTotal, replyAcceptsRanges())) {
+            splitInSegments(static_cast<qint64>(received), bytesTotal);
         }
-        emit Download::progress(received, _totalSize);
         return;
     }
 }
 
 void
 FileDownload::onError(QNetworkReply::NetworkError code) {
+    // errors that are not retried move the download to the next mirror
+    auto retry = canRetry(_reply, code);
+    if (!retry && !hasNextMirror()) {
+        emitNetworkError(_reply, code);
+        return;
+    }
+
+    DOWN_LOG(WARNING) << _url << ((retry)? "transient error:" : "error:")
+        << code;
+    disconnectFromReplySignals();
+    auto delay = (retry)? nextRetryDelay(_reply) : 0;
+    if (replyHasHttpError(_reply)) {
+        // the body is the error page of the server
+        _resumed = false;
+    } else if (!storeReplyData()) {
+        return;
+    }
+    if (_reply != nullptr) {
+        _reply->deleteLater();
+        _reply = nullptr;
+    }
+
+    if (retry) {
+        scheduleRetry(delay);
+    } else {
+        useNextMirror();
+        requestRemainingData();
+    }
+}
+
+bool
+FileDownload::canRetry(NetworkReply* reply,
+                       QNetworkReply::NetworkError code) {
+    if (_retriesDone >= retries()) {
+        return false;
+    }
+
+    auto statusCode = reply->attribute(
+        QNetworkRequest::HttpStatusCodeAttribute);
+    if (statusCode.isValid() && statusCode.toInt() >= 300) {
+        return isTransientStatus(statusCode.toInt());
+    }
+    return isTransientError(code);
+}
+
+bool
+FileDownload::replyHasHttpError(NetworkReply* reply) {
+    auto statusCode = reply->attribute(
+        QNetworkRequest::HttpStatusCodeAttribute);
+    return statusCode.isValid() && statusCode.toInt() >= 300;
+}
+
+int
+FileDownload::nextRetryDelay(NetworkReply* reply) {
+    // exponential backoff with a random part so that the clients of a
+    // server that went down do not come back all at the same time
+    qint64 delay = static_cast<qint64>(retryDelay()) << qMin(_retriesDone, 20);
+    delay = qMin(delay, MAX_RETRY_DELAY);
+    delay = delay / 2 + randomDelay(0, delay / 2);
+    _retriesDone++;
+
+    if (reply->hasRawHeader(RETRY_AFTER)) {
+        auto after = parseRetryAfter(reply->rawHeader(RETRY_AFTER));
+        if (after >= 0) {
+            delay = qMin(after, MAX_RETRY_AFTER);
+        }
+    }
+    return static_cast<int>(delay);
+}
+
+void
+FileDownload::scheduleRetry(int delay) {
+    DOWN_LOG(INFO) << "Retry" << _retriesDone << "of" << retries()
+        << "in" << delay << "ms";
+    _retryTimer->start(delay);
+}
+
+void
+FileDownload::startWatchdog() {
+    auto window = Metadata(_metadata).stallTimeout();
+    if (window <= 0) {
+        return;
+    }
+    _watchdogReceived = watchdogProgress();
+    _watchdog->start(window);
+}
+
+qint64
+FileDownload::watchdogProgress() {
+    // bytes that came from the network, the size of the temp file lags
+    // behind while the writer thread has data queued
+    return (_segments.isEmpty())? _receivedBytes :
+        static_cast<qint64>(segmentsProgress());
+}
+
+bool
+FileDownload::isStalled(qint64 received, int window) {
+    if (received < 0) {
+        // started or stopped using segments, nothing to compare with
+        return false;
+    }
+    if (received == 0) {
+        return true;
+    }
+
+    // a throttled download is slow on purpose
+    Metadata metadata(_metadata);
+    auto minSpeed = metadata.minSpeed();
+    if (minSpeed == 0 || (throttle() > 0 && throttle() < minSpeed)) {
+        return false;
+    }
+    auto speed = static_cast<qulonglong>(received) * 1000 / window;
+    return speed < minSpeed;
+}
+
+void
+FileDownload::reconnect() {
+    DOWN_LOG(WARNING) << "Reconnecting stalled download" << _url;
+    if (_metalinkReply != nullptr) {
+        releaseMetalinkReply();
+        fetchMetalink();
+        return;
+    }
+
+    if (_probe != nullptr) {
+        releaseProbe();
+        startBodyRequest();
+        return;
+    }
+
+    if (!_segments.isEmpty()) {
+        // pausing keeps the data of every segment
+        if (pauseSegments()) {
+            startSegments();
+        }
+        return;
+    }
+
+    if (_reply == nullptr) {
+        return;
+    }
+    disconnectFromReplySignals();
+    _reply->abort();
+    if (!storeReplyData()) {
+        return;
+    }
+    _reply->deleteLater();
+    _reply = nullptr;
+    requestRemainingData();
+}
+
+void
+FileDownload::onWatchdogTimeout() {
+    auto currentState = state();
+    if (!_downloading || (currentState != Download::START
+            && currentState != Download::RESUME)) {
+        return;
+    }
+
+    auto window = Metadata(_metadata).stallTimeout();
+    if (window <= 0) {
+        return;
+    }
+
+    auto received = watchdogProgress();
+    auto delta = received - _watchdogReceived;
+    _watchdogReceived = received;
+
+    // nothing to watch while waiting for a retry, for the network or for
+    // memory to read the data that is already there
+    auto requesting = _reply != nullptr || _probe != nullptr
+        || _metalinkReply != nullptr || hasRunningSegments();
+    if (requesting && _connected && !_waitingForBuffers
+            && isStalled(delta, window)) {
+        reconnect();
+    }
+    _watchdog->start(window);
+}
+
+void
+FileDownload::setWatchdogTimer(Timer* timer) {
+    delete _watchdog;
+    _watchdog = timer;
+    _watchdog->setParent(this);
+    CHECK(connect(_watchdog, &Timer::timeout,
+        this, &FileDownload::onWatchdogTimeout))
+            << "Could not connect to signal";
+}
+
+void
+FileDownload::onRetryTimeout() {
+    TRACE << _url;
+    auto currentState = state();
+    if (!_downloading || _reply != nullptr
+            || (currentState != Download::START
+                && currentState != Download::RESUME)) {
+        return;
+    }
+
+    if (!_connected) {
+        // resumed once we are online again
+        DOWN_LOG(INFO) << "Not retrying while offline";
+        return;
+    }
+
+    if (!_segments.isEmpty()) {
+        startSegments();
+    } else {
+        requestRemainingData();
+    }
+}
+
+void
+FileDownload::emitNetworkError(NetworkReply* reply,
+                               QNetworkReply::NetworkError code) {
     DOWN_LOG(ERROR) << _url << " ERROR:" << ":" << code;
     _downloading = false;
     QString msg;
     QString errStr;
 
     // decide if we are talking about an http error or no
-    auto statusCode = _reply->attribute(
+    auto statusCode = reply->attribute(
         QNetworkRequest::HttpStatusCodeAttribute);
     if (statusCode.isValid()) {
         auto status = statusCode.toInt();
         if (status >= 300) {
-            auto reasonVar = _reply->attribute(
+            auto reasonVar = reply->attribute(
                 QNetworkRequest::HttpReasonPhraseAttribute);
             if (reasonVar.isValid()) {
                 msg = reasonVar.toString();
@@ -546,20 +1100,20 @@ FileDownload::onError(QNetworkReply::NetworkError code) {
             emit httpError(err);
             errStr = NETWORK_ERROR;
         } else {
-            NetworkErrorStruct err(code, _reply->errorString());
+            NetworkErrorStruct err(code, reply->errorString());
             emit networkError(err);
         }
     } else {
         if (code == QNetworkReply::AuthenticationRequiredError) {
-            AuthErrorStruct err(AuthErrorStruct::Server, _reply->errorString());
+            AuthErrorStruct err(AuthErrorStruct::Server, reply->errorString());
             emit authError(err);
             errStr = AUTH_ERROR;
         } else if (code == QNetworkReply::ProxyAuthenticationRequiredError) {
-            AuthErrorStruct err(AuthErrorStruct::Proxy, _reply->errorString());
+            AuthErrorStruct err(AuthErrorStruct::Proxy, reply->errorString());
             emit authError(err);
             errStr = PROXY_AUTH_ERROR;
         } else {
-            NetworkErrorStruct err(code, _reply->errorString());
+            NetworkErrorStruct err(code, reply->errorString());
             emit networkError(err);
         }
     }
@@ -580,6 +1134,7 @@ FileDownload::onRedirect(QUrl redirect) {
     }
     _visitedUrls.append(_url);
     _url = redirect;
+    _resumed = false;
 
     // clean the reply
     disconnectFromReplySignals();
@@ -592,16 +1147,22 @@ FileDownload::onRedirect(QUrl redirect) {
     cleanUpCurrentData();
 
     // perform again the request but do not emit started signal
-    _currentData = FileManager::instance()->createFile(_tempFilePath);
+    _currentData = createDataFile();
+    _currentData->setDropCache(
+        _metadata.value(Metadata::DROP_CACHE_KEY, false).toBool());
     bool canWrite = _currentData->open(QIODevice::ReadWrite | QFile::Append);
 
     if (!canWrite) {
         emitError(FILE_SYSTEM_ERROR);
         return;
     }
+    if (_pieces != nullptr) {
+        _pieces->rewind(0);
+    }
     _reply = _requestFactory->get(buildRequest());
-    _reply->setReadBufferSize(throttle());
+    _reply->setThrottle(throttle(), throttleBurst());
     _totalSize = 0;
+    _segmentsChecked = false;
 
     connectToReplySignals();
 }
@@ -609,6 +1170,12 @@ FileDownload::onRedirect(QUrl redirect) {
 void
 FileDownload::onDownloadCompleted() {
     TRACE << _url;
+    if (_pieces != nullptr && !_pieces->finish()) {
+        // the last piece is bad or the server sent less than the file
+        refetchPiece();
+        return;
+    }
+
     // ensure that if content-disposition is present we will use it
     updateFileNamePerContentDisposition();
 
@@ -746,50 +1313,401 @@ FileDownload::onFinished() {
             return;
         }
     }
+
+    if (_waitingForBuffers) {
+        // part of the body is still in the reply, it is written once the
+        // pool has memory again and the download is completed after it
+        DOWN_LOG(INFO) << "Waiting for buffers to complete" << _url;
+        _completionPending = true;
+        return;
+    }
     onDownloadCompleted();
 }
 
 void
-FileDownload::onSslErrors(const QList<QSslError>& errors) {
-    TRACE << errors;
-    if (!_reply->canIgnoreSslErrors(errors)) {
-        _downloading = false;
-        emitError(SSL_ERROR);
+FileDownload::startProbe() {
+    auto request = buildRequest();
+    if (_probeWithRange) {
+        request.setRawHeader("Range", "bytes=0-0");
+        _probe = _requestFactory->get(request);
+    } else {
+        _probe = _requestFactory->head(request);
+    }
+
+    if (_probe == nullptr) {
+        startBodyRequest();
+        return;
     }
+
+    // the headers are all we want, do not wait for a body that a server
+    // ignoring the range could send
+    CHECK(connect(_probe, &NetworkReply::downloadProgress,
+        this, &FileDownload::onProbeReply))
+            << "Could not connect to signal";
+    CHECK(connect(_probe, &NetworkReply::finished,
+        this, &FileDownload::onProbeReply))
+            << "Could not connect to signal";
 }
 
 void
-FileDownload::onProcessError(QProcess::ProcessError error) {
-    auto p = qobject_cast<Process*>(sender());
-    auto standardOut = p->readAllStandardOutput();
-    auto standardErr = p->readAllStandardError();
-    DOWN_LOG(ERROR) << "Error " << error << "executing"
-        << p->program() << "with args" << p->arguments()
-        << "Stdout:" << standardOut << "Stderr:" << standardErr;
-    p->deleteLater();
-    ProcessErrorStruct err(error, 0, standardOut, standardErr);
-    emit processError(err);
-    emitError(COMMAND_ERROR);
+FileDownload::releaseProbe() {
+    disconnect(_probe, &NetworkReply::downloadProgress,
+        this, &FileDownload::onProbeReply);
+    disconnect(_probe, &NetworkReply::finished,
+        this, &FileDownload::onProbeReply);
+    _probe->abort();
+    _probe->deleteLater();
+    _probe = nullptr;
 }
 
 void
-FileDownload::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus) {
-    TRACE << exitCode << exitStatus;
-    auto p = qobject_cast<Process*>(sender());
-    // remove the file since we are done with it
-    cleanUpCurrentData();
-    // remove the file because that is the contract that we have with
-    // the clients
-    auto fileMan = FileManager::instance();
+FileDownload::startBodyRequest() {
+    // signals should take care of calling deleteLater on the
+    // NetworkReply object
+    _reply = _requestFactory->get(buildRequest());
+    _reply->setThrottle(throttle(), throttleBurst());
 
-    if (fileMan->exists(_tempFilePath)) {
-        LOG(INFO) << "Removing '" << _tempFilePath << "'";
-        fileMan->remove(_tempFilePath);
-    }
+    connectToReplySignals();
+}
 
-    if (fileMan->exists(_filePath)) {
-        LOG(INFO) << "Removing '" << _filePath << "'";
-        fileMan->remove(_filePath);
+void
+FileDownload::setValidators(const QByteArray& etag,
+                            const QByteArray& lastModified) {
+    _etag = etag;
+    _lastModified = lastModified;
+}
+
+void
+FileDownload::storeValidators(NetworkReply* reply) {
+    if (reply->hasRawHeader(ETAG)) {
+        _etag = reply->rawHeader(ETAG);
+    }
+    if (reply->hasRawHeader(LAST_MODIFIED)) {
+        _lastModified = reply->rawHeader(LAST_MODIFIED);
+    }
+}
+
+QByteArray
+FileDownload::ifRangeValidator() {
+    // If-Range only accepts strong etags
+    if (!_etag.isEmpty() && !_etag.startsWith(WEAK_ETAG_PREFIX)) {
+        return _etag;
+    }
+    return _lastModified;
+}
+
+bool
+FileDownload::checkResumedReply() {
+    // a 200 is the whole resource, either because it changed or because
+    // the server ignores ranges, appending it would corrupt the file
+    auto statusCode = _reply->attribute(
+        QNetworkRequest::HttpStatusCodeAttribute);
+    if (!statusCode.isValid() || statusCode.toInt() != HTTP_OK) {
+        return true;
+    }
+
+    DOWN_LOG(WARNING) << "Range not honoured, restarting" << _url;
+    waitForWrites();
+    if (!_currentData->resize(0)) {
+        auto err = _currentData->error();
+        DOWN_LOG(ERROR) << "Could not truncate the temp file" << err;
+        disconnectFromReplySignals();
+        _reply->abort();
+        _reply->deleteLater();
+        _reply = nullptr;
+        _downloading = false;
+        emitError(QString(FILE_SYSTEM_ERROR).arg(err));
+        return false;
+    }
+    resetHash();
+    resetDurableSize();
+    if (_pieces != nullptr) {
+        _pieces->rewind(0);
+    }
+    _totalSize = 0;
+    _spaceReserved = false;
+    _etag.clear();
+    _lastModified.clear();
+    storeValidators(_reply);
+    return true;
+}
+
+void
+FileDownload::onProbeReply() {
+    TRACE << _url;
+    // follow the redirects so that the body is requested from the final
+    // location, loops are left to the body request
+    auto redirectVar = _probe->attribute(
+        QNetworkRequest::RedirectionTargetAttribute);
+    if (redirectVar.isValid()) {
+        auto redirect = _url.resolved(redirectVar.toUrl());
+        if (redirect != _url && !_visitedUrls.contains(redirect)) {
+            DOWN_LOG(INFO) << "Probe redirected to" << redirect;
+            _visitedUrls.append(_url);
+            _url = redirect;
+            releaseProbe();
+            startProbe();
+            return;
+        }
+    }
+
+    auto statusVar = _probe->attribute(
+        QNetworkRequest::HttpStatusCodeAttribute);
+    auto status = statusVar.isValid()? statusVar.toInt() : 0;
+    if (status != HTTP_OK && status != HTTP_PARTIAL_CONTENT) {
+        // servers that refuse HEAD are asked for the first byte, any
+        // other failure is reported by the body request
+        DOWN_LOG(INFO) << "Probe got status" << status;
+        releaseProbe();
+        if (!_probeWithRange && status >= HTTP_BAD_REQUEST) {
+            _probeWithRange = true;
+            startProbe();
+        } else {
+            startBodyRequest();
+        }
+        return;
+    }
+
+    qint64 size = -1;
+    bool acceptsRanges = false;
+    bool ok = false;
+    if (status == HTTP_PARTIAL_CONTENT) {
+        // Content-Range: bytes 0-0/<size>
+        auto range = _probe->rawHeader(CONTENT_RANGE);
+        size = range.mid(range.lastIndexOf('/') + 1).toLongLong(&ok);
+        acceptsRanges = true;
+    } else {
+        size = _probe->rawHeader(CONTENT_LENGTH).toLongLong(&ok);
+        acceptsRanges = _probe->hasRawHeader(ACCEPT_RANGES)
+            && _probe->rawHeader(ACCEPT_RANGES).toLower().contains("bytes");
+    }
+    if (!ok) {
+        size = -1;
+    }
+
+    storeValidators(_probe);
+    _contentType = (_probe->hasRawHeader(CONTENT_TYPE))?
+            QString(_probe->rawHeader(CONTENT_TYPE)) : QString();
+    if (_probe->hasRawHeader(CONTENT_DISPOSITION) && (
+            isConfined() || !_metadata.contains(Metadata::LOCAL_PATH_KEY))) {
+        updateFileNamePerContentDisposition(
+            _probe->rawHeader(CONTENT_DISPOSITION));
+    }
+    releaseProbe();
+
+    // a deflated body does not have the size of the resource
+    auto deflate = _metadata.value(Metadata::DEFLATE_KEY, false).toBool();
+    if (size > 0 && !deflate) {
+        _totalSize = static_cast<qulonglong>(size);
+        if (!hasFreeSpace() || !reserveSpace(size)) {
+            return;
+        }
+        if (!_metadata.contains(Metadata::DROP_CACHE_KEY)) {
+            _currentData->setDropCache(size >= DROP_CACHE_THRESHOLD);
+        }
+        emitProgress(0, _totalSize, true);
+    }
+
+    if (acceptsRanges) {
+        nameResumableData();
+    }
+
+    DOWN_LOG(INFO) << "EMIT headRequestCompleted" << size << acceptsRanges;
+    emit headRequestCompleted();
+
+    if (size > 0 && canUseSegments(size, acceptsRanges)) {
+        splitInSegments(0, size);
+    } else {
+        startBodyRequest();
+    }
+}
+
+bool
+FileDownload::applyMetalink(const QByteArray& document) {
+    Metalink metalink;
+    if (!metalink.parse(document)) {
+        DOWN_LOG(WARNING) << "Invalid metalink:" << metalink.error();
+        setLastError(QString(_("Invalid metalink: '%1'")).arg(
+            metalink.error()));
+        return false;
+    }
+
+    _mirrors = metalink.urls();
+    _mirror = 0;
+    _url = _mirrors.first();
+    _metalinkName = metalink.name();
+    DOWN_LOG(INFO) << "Metalink with" << _mirrors.count() << "mirrors";
+
+    // a hash given by the client takes precedence
+    if (_hash.isEmpty() && !metalink.hash().isEmpty()) {
+        _hash = metalink.hash();
+        _algo = HashAlgorithm::getHashAlgo(metalink.hashAlgorithm());
+    }
+
+    delete _pieces;
+    _pieces = nullptr;
+    if (!metalink.pieces().isEmpty()) {
+        _pieces = new PieceVerifier(metalink.pieceLength(),
+            HashAlgorithm::getHashAlgo(metalink.pieceAlgorithm()),
+            metalink.pieces());
+    }
+    return true;
+}
+
+bool
+FileDownload::needsMetalink() {
+    return _mirrors.isEmpty() && Metadata(_metadata).metalinkUrl();
+}
+
+void
+FileDownload::fetchMetalink() {
+    DOWN_LOG(INFO) << "Fetching metalink" << _url;
+    _metalinkReply = _requestFactory->get(buildRequest());
+    CHECK(connect(_metalinkReply, &NetworkReply::finished,
+        this, &FileDownload::onMetalinkFinished))
+            << "Could not connect to signal";
+    CHECK(connect(_metalinkReply, &NetworkReply::error,
+        this, &FileDownload::onMetalinkError))
+            << "Could not connect to signal";
+}
+
+void
+FileDownload::releaseMetalinkReply() {
+    disconnect(_metalinkReply, &NetworkReply::finished,
+        this, &FileDownload::onMetalinkFinished);
+    disconnect(_metalinkReply, &NetworkReply::error,
+        this, &FileDownload::onMetalinkError);
+    _metalinkReply->abort();
+    _metalinkReply->deleteLater();
+    _metalinkReply = nullptr;
+}
+
+void
+FileDownload::onMetalinkFinished() {
+    TRACE << _url;
+    auto redirectVar = _metalinkReply->attribute(
+        QNetworkRequest::RedirectionTargetAttribute);
+    if (redirectVar.isValid()) {
+        auto redirect = _url.resolved(redirectVar.toUrl());
+        if (redirect != _url && !_visitedUrls.contains(redirect)) {
+            DOWN_LOG(INFO) << "Metalink redirected to" << redirect;
+            _visitedUrls.append(_url);
+            _url = redirect;
+            releaseMetalinkReply();
+            fetchMetalink();
+            return;
+        }
+    }
+
+    auto document = _metalinkReply->readAll();
+    releaseMetalinkReply();
+    if (!applyMetalink(document)) {
+        _downloading = false;
+        emitError(METALINK_ERROR);
+        return;
+    }
+
+    // stored so that a restored download knows the mirrors
+    _metadata[Metadata::METALINK_KEY] = QString::fromUtf8(document);
+    if (!_metalinkName.isEmpty() && (isConfined()
+            || !_metadata.contains(Metadata::LOCAL_PATH_KEY))) {
+        updateFileName(_metalinkName);
+    }
+
+    _probeWithRange = false;
+    startProbe();
+}
+
+void
+FileDownload::onMetalinkError(QNetworkReply::NetworkError code) {
+    // the reply is released by the error cleanup
+    emitNetworkError(_metalinkReply, code);
+}
+
+bool
+FileDownload::hasNextMirror() {
+    return _mirror + 1 < _mirrors.count();
+}
+
+void
+FileDownload::useNextMirror() {
+    _mirror++;
+    _url = _mirrors[_mirror];
+    DOWN_LOG(WARNING) << "Using mirror" << _url;
+
+    // the validators and the redirects are the ones of the previous
+    // server, the pieces and the hash keep the data consistent
+    _etag.clear();
+    _lastModified.clear();
+    _visitedUrls.clear();
+    _retriesDone = 0;
+}
+
+void
+FileDownload::refetchPiece() {
+    auto offset = _pieces->verifiedSize();
+    DOWN_LOG(WARNING) << "Piece at" << offset << "does not match" << _url;
+    disconnectFromReplySignals();
+    _reply->abort();
+    _reply->deleteLater();
+    _reply = nullptr;
+    _resumed = false;
+
+    // a mirror that sends bad data is left, the last one gets a few
+    // chances per piece
+    _pieceFailures = (offset == _failedPieceOffset)? _pieceFailures + 1 : 1;
+    _failedPieceOffset = offset;
+    if (hasNextMirror()) {
+        useNextMirror();
+    } else if (_pieceFailures > MAX_PIECE_FAILURES) {
+        _downloading = false;
+        emitError(HASH_ERROR);
+        return;
+    }
+    requestRemainingData();
+}
+
+void
+FileDownload::onSslErrors(const QList<QSslError>& errors) {
+    TRACE << errors;
+    if (!_reply->canIgnoreSslErrors(errors)) {
+        _downloading = false;
+        emitError(SSL_ERROR);
+    }
+}
+
+void
+FileDownload::onProcessError(QProcess::ProcessError error) {
+    auto p = qobject_cast<Process*>(sender());
+    auto standardOut = p->readAllStandardOutput();
+    auto standardErr = p->readAllStandardError();
+    DOWN_LOG(ERROR) << "Error " << error << "executing"
+        << p->program() << "with args" << p->arguments()
+        << "Stdout:" << standardOut << "Stderr:" << standardErr;
+    p->deleteLater();
+    ProcessErrorStruct err(error, 0, standardOut, standardErr);
+    emit processError(err);
+    emitError(COMMAND_ERROR);
+}
+
+void
+FileDownload::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus) {
+    TRACE << exitCode << exitStatus;
+    auto p = qobject_cast<Process*>(sender());
+    // remove the file since we are done with it
+    cleanUpCurrentData();
+    // remove the file because that is the contract that we have with
+    // the clients
+    auto fileMan = FileManager::instance();
+
+    if (fileMan->exists(_tempFilePath)) {
+        LOG(INFO) << "Removing '" << _tempFilePath << "'";
+        fileMan->remove(_tempFilePath);
+    }
+
+    if (fileMan->exists(_filePath)) {
+        LOG(INFO) << "Removing '" << _filePath << "'";
+        fileMan->remove(_filePath);
     }
 
     if (exitCode == 0 && exitStatus == QProcess::NormalExit) {
@@ -820,7 +1738,7 @@ FileDownload::onOnlineStateChanged(bool online) {
 
     // if no longer online yet we have a reply (that is, we are trying
     // to get data from the missing connection) we pause
-    if (!_connected && _reply != nullptr) {
+    if (!_connected && (_reply != nullptr || hasRunningSegments())) {
         pauseTransfer();
         // set it to be downloading even when pause download sets it
         // to false
@@ -842,6 +1760,100 @@ FileDownload::onPropertiesChanged(const QVariantMap& changes) {
     DBusConnection::instance()->send(signal);
 }
 
+void
+FileDownload::onSegmentProgress() {
+    _retriesDone = 0;
+    auto received = segmentsProgress();
+    emitProgress(received, _totalSize, received >= _totalSize);
+}
+
+void
+FileDownload::onSegmentCompleted() {
+    foreach(DownloadSegment* segment, _segments) {
+        if (!segment->isCompleted()) {
+            return;
+        }
+    }
+
+    DOWN_LOG(INFO) << "All segments completed";
+    if (!_contentDisposition.isEmpty()) {
+        updateFileNamePerContentDisposition(_contentDisposition);
+    }
+
+    if (!flushFile()) {
+        return;
+    }
+    downloadPostProcessing(_contentType);
+}
+
+void
+FileDownload::onSegmentError(QNetworkReply::NetworkError code) {
+    auto segment = qobject_cast<DownloadSegment*>(sender());
+    auto retry = canRetry(segment->reply(), code);
+    if (!retry && !hasNextMirror()) {
+        emitNetworkError(segment->reply(), code);
+        return;
+    }
+
+    DOWN_LOG(WARNING) << _url << ((retry)? "transient error in segment:"
+        : "error in segment:") << code;
+    auto delay = (retry)? nextRetryDelay(segment->reply()) : 0;
+    if (replyHasHttpError(segment->reply())) {
+        segment->cancelTransfer();
+    } else if (!segment->pauseTransfer()) {
+        onSegmentWriteError();
+        return;
+    }
+    // the segments that are running carry on, the rest are started again
+    if (retry) {
+        scheduleRetry(delay);
+    } else {
+        useNextMirror();
+        startSegments();
+    }
+}
+
+void
+FileDownload::onSegmentSslErrors(const QList<QSslError>& errors) {
+    TRACE << errors;
+    auto segment = qobject_cast<DownloadSegment*>(sender());
+    if (!segment->reply()->canIgnoreSslErrors(errors)) {
+        _downloading = false;
+        emitError(SSL_ERROR);
+    }
+}
+
+void
+FileDownload::onSegmentRangeNotSupported() {
+    // the server lied about supporting ranges, the data we got cannot be
+    // trusted to be at the correct offsets, start from scratch using a
+    // single connection
+    DOWN_LOG(WARNING) << "Range requests not honored, using a single connection";
+    cancelSegments();
+
+    _currentData->close();
+    if (!_currentData->open(QIODevice::ReadWrite | QFile::Append)
+            || !_currentData->resize(0)) {
+        emitError(QString(FILE_SYSTEM_ERROR).arg(_currentData->error()));
+        return;
+    }
+    resetDurableSize();
+
+    _segmentsChecked = true;
+    _totalSize = 0;
+    _reply = _requestFactory->get(buildRequest());
+    _reply->setThrottle(throttle(), throttleBurst());
+    connectToReplySignals();
+}
+
+void
+FileDownload::onSegmentWriteError() {
+    auto err = _currentData->error();
+    DOWN_LOG(ERROR) << "Could not write that in the file system" << err;
+    _downloading = false;
+    emitError(QString(FILE_SYSTEM_ERROR).arg(err));
+}
+
 void
 FileDownload::init() {
     _requestFactory = RequestFactory::instance();
@@ -854,6 +1866,18 @@ FileDownload::init() {
         _metadata.remove(Metadata::CLICK_PACKAGE_KEY);
     }
 
+    if (_metadata.contains(Metadata::SEGMENTS_KEY)) {
+        _segmentsCount = qBound(1,
+            _metadata[Metadata::SEGMENTS_KEY].toInt(), MAX_SEGMENTS);
+    }
+
+    auto durability = _metadata.value(Metadata::DURABILITY_KEY).toString();
+    if (durability == Metadata::DURABILITY_PERIODIC) {
+        _durability = PeriodicDurability;
+    } else if (durability == Metadata::DURABILITY_FINISH) {
+        _durability = FinishDurability;
+    }
+
     // connect to the network changed signals
     CHECK(connect(NetworkSession::instance(), &NetworkSession::onlineStateChanged,
         this, &FileDownload::onOnlineStateChanged))
@@ -863,6 +1887,30 @@ FileDownload::init() {
         this, &FileDownload::onPropertiesChanged))
             << "Could not connect to signal";
 
+    // queued because buffers are released while the data is written
+    CHECK(connect(BufferPool::instance(), &BufferPool::available,
+        this, &FileDownload::onBuffersAvailable, Qt::QueuedConnection))
+            << "Could not connect to signal";
+    CHECK(connect(FileWriter::instance(), &FileWriter::writeError,
+        this, &FileDownload::onWriteError, Qt::QueuedConnection))
+            << "Could not connect to signal";
+    CHECK(connect(FileWriter::instance(), &FileWriter::synced,
+        this, &FileDownload::onSynced, Qt::QueuedConnection))
+            << "Could not connect to signal";
+
+    _retryTimer = new Timer(this);
+    CHECK(connect(_retryTimer, &Timer::timeout,
+        this, &FileDownload::onRetryTimeout))
+            << "Could not connect to signal";
+    setWatchdogTimer(new Timer());
+
+    // the mirrors of the metalink replace the url of the download
+    Metadata metadata(_metadata);
+    if (metadata.hasMetalink()
+            && !applyMetalink(metadata.metalink().toUtf8())) {
+        setIsValid(false);
+    }
+
     initFileNames();
 
     // ensure that the download is valid
@@ -915,9 +1963,129 @@ FileDownload::disconnectFromReplySignals() {
     }
 }
 
+bool
+FileDownload::hasFreeSpace() {
+    // the queue admitted the download before its size was known, fail
+    // now if it can never fit instead of filling the disk
+    auto required = requiredSpace();
+    qint64 available = 0;
+    qulonglong fileSystem = 0;
+    if (required <= 0 || !FileManager::instance()->freeSpace(storagePath(),
+            available, fileSystem) || required <= available) {
+        return true;
+    }
+
+    DOWN_LOG(ERROR) << "Not enough space to store " << required
+        << " bytes, " << available << " available";
+    _downloading = false;
+    emitError(QString(
+        _("Not enough space in the disk: %1 bytes needed and %2 available"))
+            .arg(required).arg(available));
+    return false;
+}
+
+bool
+FileDownload::reserveSpace(qint64 size) {
+    // allocating the whole file at once avoids fragmentation and lets
+    // us fail now rather than when the disk is full
+    if (_currentData->reserve(size)) {
+        _spaceReserved = true;
+        return true;
+    }
+
+    DOWN_LOG(ERROR) << "Not enough space to store " << size << " bytes";
+    if (_reply != nullptr) {
+        disconnectFromReplySignals();
+        _reply->abort();
+        _reply->deleteLater();
+        _reply = nullptr;
+    }
+    _downloading = false;
+    emitError(QString(FILE_SYSTEM_ERROR).arg(QFile::ResourceError));
+    return false;
+}
+
+void
+FileDownload::waitForWrites() {
+    if (_currentData != nullptr) {
+        FileWriter::instance()->waitForFile(_currentData);
+    }
+}
+
+void
+FileDownload::setDurableSize(qint64 size) {
+    if (_durability == NoDurability || size < 0) {
+        return;
+    }
+    _durableSize = size;
+    _syncRequestedSize = size;
+    _trimToDurable = true;
+}
+
+void
+FileDownload::resetDurableSize() {
+    _trimToDurable = false;
+    _syncRequestedSize = 0;
+    _syncClock.start();
+    updateDurableSize((_durability == NoDurability)? -1 : 0);
+}
+
+void
+FileDownload::updateDurableSize(qint64 size) {
+    if (size == _durableSize) {
+        return;
+    }
+    _durableSize = size;
+    emit durableSizeChanged();
+}
+
+void
+FileDownload::syncPeriodically(qint64 size) {
+    // segments write the data out of order, there is no durable prefix
+    if (_durability != PeriodicDurability || !_segments.isEmpty()
+            || size <= _syncRequestedSize) {
+        return;
+    }
+
+    if (size - _syncRequestedSize < PERIODIC_SYNC_BYTES
+            && _syncClock.elapsed() < PERIODIC_SYNC_MSECS) {
+        return;
+    }
+
+    _syncRequestedSize = size;
+    _syncClock.restart();
+
+    auto writer = FileWriter::instance();
+    if (writer->isRunning()) {
+        // onSynced records the durable size once done
+        writer->sync(_currentData);
+        return;
+    }
+
+    if (_currentData->sync()) {
+        updateDurableSize(size);
+    }
+}
+
+void
+FileDownload::onSynced(File* file, qint64 size) {
+    if (file == _currentData && _durableSize >= 0) {
+        updateDurableSize(size);
+    }
+}
+
 bool
 FileDownload::flushFile() {
+    waitForWrites();
     auto flushed  = _currentData->flush();
+    if (flushed && _durability != NoDurability && _segments.isEmpty()) {
+        // pausing and finishing make all the data durable
+        flushed = _currentData->sync();
+        if (flushed) {
+            updateDurableSize(_currentData->size());
+        }
+    }
+
     if (!flushed) {
         auto err = _currentData->error();
         DOWN_LOG(ERROR) << "Could not write that in the file system" << err;
@@ -931,13 +2099,20 @@ FileDownload::hashIsValid() {
     // if the hash is present we check it
     if (!_hash.isEmpty()) {
         emit processing(filePath());
-        _currentData->reset();
-        auto hashFactory = CryptographicHashFactory::instance();
-        QScopedPointer<CryptographicHash> hash(
-            hashFactory->createCryptographicHash(_algo, this));
-        // addData is smart enough to not load the entire file in memory
-        hash->addData(_currentData->device());
-        QString fileSig = QString(hash->result().toHex());
+        QString fileSig;
+        if (_incrementalHash != nullptr
+                && _hashedBytes == _currentData->size()) {
+            // the data was hashed as it arrived, no need to read it again
+            fileSig = QString(_incrementalHash->result().toHex());
+        } else {
+            _currentData->reset();
+            auto hashFactory = CryptographicHashFactory::instance();
+            QScopedPointer<CryptographicHash> hash(
+                hashFactory->createCryptographicHash(_algo, this));
+            // addData is smart enough to not load the entire file in memory
+            hash->addData(_currentData->device());
+            fileSig = QString(hash->result().toHex());
+        }
         if (fileSig != _hash) {
             DOWN_LOG(ERROR) << HASH_ERROR << fileSig << "!=" << _hash;
             emit hashError(HashErrorStruct(HashAlgorithm::getHashAlgo(_algo), _hash, fileSig));
@@ -947,12 +2122,211 @@ FileDownload::hashIsValid() {
     return true;
 }
 
+void
+FileDownload::writeReplyData() {
+    // read into buffers of the shared pool and write them with a single
+    // call, once the pool is warm no memory is allocated per chunk
+    auto pool = BufferPool::instance();
+    auto writer = FileWriter::instance();
+    struct iovec iov[MAX_WRITE_BUFFERS];
+    auto more = true;
+    while (more) {
+        int count = 0;
+        qint64 size = 0;
+        while (count < MAX_WRITE_BUFFERS) {
+            auto buffer = pool->acquire();
+            if (buffer == nullptr) {
+                // the memory budget is exhausted, leave the data in the
+                // reply so that the socket is not read until we resume
+                _waitingForBuffers = true;
+                more = false;
+                break;
+            }
+            auto read = _reply->read(buffer, BufferPool::BUFFER_SIZE);
+            if (read <= 0) {
+                pool->release(buffer);
+                more = false;
+                break;
+            }
+            iov[count].iov_base = buffer;
+            iov[count].iov_len = static_cast<size_t>(read);
+            size += read;
+            _receivedBytes += read;
+            count++;
+            if (read < BufferPool::BUFFER_SIZE) {
+                // nothing else is available right now
+                more = false;
+                break;
+            }
+        }
+
+        if (writer->isRunning()) {
+            // the buffers are hashed before they are handed to the writer,
+            // a failed write is reported with writeError
+            if (count > 0) {
+                updateHash(iov, count, size);
+                writer->append(_currentData, iov, count);
+            }
+            continue;
+        }
+
+        updateHash(iov, count, _currentData->writev(iov, count));
+
+        for (int index = 0; index < count; index++) {
+            pool->release(static_cast<char*>(iov[index].iov_base));
+        }
+    }
+}
+
+void
+FileDownload::onWriteError(File* file, int error) {
+    if (file != _currentData
+            || (_reply == nullptr && !hasRunningSegments())) {
+        return;
+    }
+
+    DOWN_LOG(ERROR) << "Could not write the data in the file system" << error;
+    resetHash();
+    if (_reply != nullptr) {
+        disconnectFromReplySignals();
+        _reply->abort();
+        _reply->deleteLater();
+        _reply = nullptr;
+    }
+    // the segments are cancelled by the error clean up
+    _downloading = false;
+    emitError(QString(FILE_SYSTEM_ERROR).arg(QFile::WriteError));
+}
+
+void
+FileDownload::onBuffersAvailable() {
+    if (!_waitingForBuffers) {
+        return;
+    }
+
+    _waitingForBuffers = false;
+    if (_reply == nullptr) {
+        _completionPending = false;
+        return;
+    }
+
+    TRACE << _url;
+    writeReplyData();
+    if (_pieces != nullptr && _pieces->hasFailed()) {
+        _completionPending = false;
+        refetchPiece();
+        return;
+    }
+
+    if (_completionPending && !_waitingForBuffers) {
+        // the reply finished while we were waiting and it is now empty
+        _completionPending = false;
+        onDownloadCompleted();
+        return;
+    }
+
+    auto received = static_cast<qulonglong>(
+        FileWriter::instance()->size(_currentData));
+    emitProgress(received, (_totalSize > 0)? _totalSize : received);
+}
+
+void
+FileDownload::updateHash(const QByteArray& data, qint64 written) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data.constData());
+    iov.iov_len = static_cast<size_t>(data.size());
+    updateHash(&iov, 1, written);
+}
+
+void
+FileDownload::updateHash(const struct iovec* iov, int count, qint64 written) {
+    // segments do not write the data in order, the hash is calculated
+    // once the download is completed
+    if (!_segments.isEmpty()) {
+        return;
+    }
+
+    if (_pieces != nullptr) {
+        // data that did not make it to the file is dropped when the
+        // verifier is rewound to the size of the file
+        for (int index = 0; index < count; index++) {
+            _pieces->addData(static_cast<const char*>(iov[index].iov_base),
+                static_cast<qint64>(iov[index].iov_len));
+        }
+    }
+
+    if (_hash.isEmpty()) {
+        return;
+    }
+
+    qint64 size = 0;
+    for (int index = 0; index < count; index++) {
+        size += iov[index].iov_len;
+    }
+
+    if (written != size) {
+        // we do not know what made it to the file, let the hash be
+        // recalculated from the file
+        resetHash();
+        return;
+    }
+
+    if (_incrementalHash == nullptr) {
+        _incrementalHash = CryptographicHashFactory::instance()->
+            createCryptographicHash(_algo, this);
+        // the writer gets the chunk after it was hashed, else it is
+        // already in the file
+        auto writer = FileWriter::instance();
+        auto inFile = !writer->isRunning();
+        auto previous = writer->size(_currentData);
+        if (inFile) {
+            previous -= written;
+        }
+        _hashedBytes = 0;
+        if (previous > 0) {
+            // the file has data from before the hash was created (it was
+            // dropped or the data was written by a previous request), catch
+            // up reading it once
+            waitForWrites();
+            _currentData->reset();
+            _incrementalHash->addData(_currentData->device());
+            _hashedBytes = previous;
+            if (inFile) {
+                // the chunk was read with the rest of the file
+                _hashedBytes += written;
+                return;
+            }
+        }
+    }
+
+    addToHash(iov, count);
+    _hashedBytes += written;
+}
+
+void
+FileDownload::addToHash(const struct iovec* iov, int count) {
+    for (int index = 0; index < count; index++) {
+        _incrementalHash->addBytes(static_cast<const char*>(
+            iov[index].iov_base), static_cast<int>(iov[index].iov_len));
+    }
+}
+
+void
+FileDownload::resetHash() {
+    if (_incrementalHash != nullptr) {
+        _incrementalHash->deleteLater();
+        _incrementalHash = nullptr;
+    }
+    _hashedBytes = 0;
+}
+
 void
 FileDownload::initFileNames() {
     // the mutex will ensure that we do not have race conditions about
     // the file names in the download manager
     QString path = _url.path();
-    _basename = QFileInfo(path).fileName();
+    _basename = (_metalinkName.isEmpty())?
+        QFileInfo(path).fileName() : _metalinkName;
 
     if (_basename.isEmpty()) {
         QScopedPointer<UuidFactory> uuidFactory(new UuidFactory());
@@ -998,6 +2372,10 @@ FileDownload::downloadPostProcessing(const QString& contentType) {
             && _metadata[Metadata::EXTRACT_KEY].toBool()
             && contentType == "application/zip") {
 
+        if (!publishFile()) {
+            return;
+        }
+
         auto postDownloadProcess = ProcessFactory::instance()->createProcess();
 
         CHECK(connect(postDownloadProcess, &Process::finished,
@@ -1007,16 +2385,6 @@ FileDownload::downloadPostProcessing(const QString& contentType) {
                 this, &FileDownload::onProcessError))
                 << "Could not connect to signal";
 
-        DOWN_LOG(INFO) << "Renaming '" << _tempFilePath << "'"
-                << "' to '" << _filePath << "'";
-
-        auto fileMan = FileManager::instance();
-        if (fileMan->exists(_tempFilePath)) {
-            LOG(INFO) << "Renaming: '" << _tempFilePath << "' to '"
-                    << _filePath << "'";
-            fileMan->rename(_tempFilePath, _filePath);
-        }
-
         QFileInfo fileInfo(filePath());
 
         QString command = HELPER_DIR + QString(QDir::separator()) + "udm-extractor";
@@ -1051,14 +2419,8 @@ FileDownload::downloadPostProcessing(const QString& contentType) {
         } else {
             // first item of the string list is the command
             // the rest is the arguments
-            DOWN_LOG(INFO) << "Renaming '" << _tempFilePath << "'"
-                    << "' to '" << _filePath << "'";
-
-            auto fileMan = FileManager::instance();
-            if (fileMan->exists(_tempFilePath)) {
-                LOG(INFO) << "Renaming: '" << _tempFilePath << "' to '"
-                        << _filePath << "'";
-                fileMan->rename(_tempFilePath, _filePath);
+            if (!publishFile()) {
+                return;
             }
 
             QString command = commandData.at(0);
@@ -1093,11 +2455,78 @@ FileDownload::downloadPostProcessing(const QString& contentType) {
     }
 }
 
-void
-FileDownload::emitFinished() {
+File*
+FileDownload::createDataFile() {
+    // an anonymous file in the destination dir leaves nothing behind if
+    // we crash and is published in place without copying the data, it
+    // gets the temp name as soon as the download can be resumed
     auto fileMan = FileManager::instance();
+    auto file = fileMan->createAnonymousFile(
+        QFileInfo(_filePath).absolutePath());
+    if (file == nullptr) {
+        file = fileMan->createFile(_tempFilePath);
+    }
+    _namedDataPath.clear();
+    _spaceReserved = false;
+    resetDurableSize();
+    return file;
+}
+
+void
+FileDownload::nameResumableData() {
+    // the data of a download that the server lets us resume has to
+    // survive a pause, a crash or the daemon exiting, the rest can only
+    // start from scratch and is dropped with the daemon
+    if (_currentData == nullptr || !_currentData->isAnonymous()
+            || !_namedDataPath.isEmpty()) {
+        return;
+    }
 
+    if (!_currentData->link(_tempFilePath)) {
+        DOWN_LOG(WARNING) << "Could not link data to '" << _tempFilePath
+            << "' due to " << strerror(errno);
+        return;
+    }
+    _namedDataPath = _tempFilePath;
+}
 
+bool
+FileDownload::publishFile() {
+    if (_currentData != nullptr && _currentData->isAnonymous()) {
+        waitForWrites();
+        // the name was locked but another process can create a file with
+        // it, a link never overwrites it so we move to a free name unless
+        // the client chose the path
+        auto canRename = isConfined()
+            || !_metadata.contains(Metadata::LOCAL_PATH_KEY);
+        for (int attempt = 1; ; attempt++) {
+            DOWN_LOG(INFO) << "Linking data to '" << _filePath << "'";
+            if (_currentData->link(_filePath)) {
+                if (!_namedDataPath.isEmpty()) {
+                    // the data has its final name, the temp one is a
+                    // second link that frees no blocks
+                    FileManager::instance()->remove(_namedDataPath);
+                    _namedDataPath.clear();
+                }
+                return true;
+            }
+
+            auto err = errno;
+            DOWN_LOG(WARNING) << "Could not link data to '" << _filePath
+                << "' due to " << strerror(err);
+            if (err != EEXIST || !canRename
+                    || attempt == MAX_PUBLISH_ATTEMPTS) {
+                emitError(QString(FILE_SYSTEM_ERROR).arg(QFile::RenameError));
+                return false;
+            }
+
+            auto taken = _filePath;
+            _filePath = _fileNameMutex->lockFileName(taken);
+            _fileNameMutex->unlockFileName(taken);
+        }
+    }
+
+    auto fileMan = FileManager::instance();
     if (fileMan->exists(_tempFilePath)) {
         DOWN_LOG(INFO) << "Rename '" << _tempFilePath << "' to '"
             << _filePath << "'";
@@ -1108,6 +2537,14 @@ FileDownload::emitFinished() {
                 << _filePath << "' due to " << tempFile.errorString();
         }
     }
+    return true;
+}
+
+void
+FileDownload::emitFinished() {
+    if (!publishFile()) {
+        return;
+    }
 
     setState(Download::UNCOLLECTED);
     unlockFilePath();
@@ -1142,37 +2579,54 @@ FileDownload::updateFileNamePerContentDisposition() {
     // unconfined
     if ((_reply->hasRawHeader(CONTENT_DISPOSITION) && (
             isConfined() || !_metadata.contains(Metadata::LOCAL_PATH_KEY)))) {
-        auto contentDisposition = _reply->rawHeader(CONTENT_DISPOSITION);
-        DOWN_LOG(INFO) << "Content-Disposition header" << contentDisposition;
-
-        if (contentDisposition.contains("filename")) {
-            auto serverName = HeaderParser::fileNameFromContentDisposition(
-                contentDisposition);
-            DOWN_LOG(INFO) << "Server name " << serverName;
-
-            if (!serverName.isEmpty()) {
-                QFileInfo fiContentDisposition(serverName);
-                auto filename = fiContentDisposition.fileName();
-                // replace the filename of the current _filePath with the new one
-                QFileInfo fiFilePath(_filePath);
-                auto currentFileName = fiFilePath.fileName();
-                auto newPath = _filePath.replace(currentFileName, filename);
-
-                // unlock the old path and lock the new one
-                _fileNameMutex->unlockFileName(_filePath);
-                _filePath = _fileNameMutex->lockFileName(newPath);
-                DOWN_LOG(INFO) << "Content disposition based file path is '"
-                    << serverName << "'";
-            }
+        updateFileNamePerContentDisposition(
+            _reply->rawHeader(CONTENT_DISPOSITION));
+    }
+}
+
+void
+FileDownload::updateFileNamePerContentDisposition(
+        const QByteArray& contentDisposition) {
+    DOWN_LOG(INFO) << "Content-Disposition header" << contentDisposition;
+    if (!_metalinkName.isEmpty()) {
+        // the name of the metalink is the same for all the mirrors
+        return;
+    }
+
+    if (contentDisposition.contains("filename")) {
+        auto serverName = HeaderParser::fileNameFromContentDisposition(
+            contentDisposition);
+        DOWN_LOG(INFO) << "Server name " << serverName;
+
+        if (!serverName.isEmpty()) {
+            updateFileName(serverName);
+            DOWN_LOG(INFO) << "Content disposition based file path is '"
+                << serverName << "'";
         }
     }
 }
 
+void
+FileDownload::updateFileName(const QString& name) {
+    QFileInfo fiName(name);
+    auto filename = fiName.fileName();
+    // replace the filename of the current _filePath with the new one
+    QFileInfo fiFilePath(_filePath);
+    auto currentFileName = fiFilePath.fileName();
+    auto newPath = _filePath.replace(currentFileName, filename);
+
+    // unlock the old path and lock the new one
+    _fileNameMutex->unlockFileName(_filePath);
+    _filePath = _fileNameMutex->lockFileName(newPath);
+}
+
 void
 FileDownload::cleanUpCurrentData() {
+    resetHash();
     bool success = true;
     QFile::FileError error = QFile::NoError;
     if (_currentData != nullptr) {
+        waitForWrites();
         success = _currentData->remove();
 
         if (!success)
@@ -1180,11 +2634,14 @@ FileDownload::cleanUpCurrentData() {
 
         _currentData->deleteLater();
         _currentData = nullptr;
+        if (!_namedDataPath.isEmpty()) {
+            // the anonymous data was linked to the temp name
+            success = FileRemover::instance()->remove(_namedDataPath)
+                && success;
+            _namedDataPath.clear();
+        }
     } else {
-        QScopedPointer<QFile> tempFile(new QFile(_tempFilePath));
-        success = tempFile->remove();
-        if (!success)
-            error = tempFile->error();
+        success = FileRemover::instance()->remove(_tempFilePath);
     }
 
     if (!success)
@@ -1192,6 +2649,12 @@ FileDownload::cleanUpCurrentData() {
             "removing file with path" << _filePath;
 }
 
+qulonglong
+FileDownload::throttleBurst() {
+    return (_metadata.contains(Metadata::THROTTLE_BURST_KEY))?
+        _metadata[Metadata::THROTTLE_BURST_KEY].toULongLong() : 0;
+}
+
 QNetworkRequest
 FileDownload::buildRequest() {
     QNetworkRequest request = QNetworkRequest(_url);
@@ -1213,11 +2676,180 @@ FileDownload::buildRequest() {
     return request;
 }
 
+bool
+FileDownload::canUseSegments(qint64 bytesTotal, bool acceptsRanges) {
+    // only the probe or the first response of a plain download are
+    // considered, resumed downloads get a 206 and are never split
+    _segmentsChecked = true;
+    if (!acceptsRanges || _segmentsCount < 2
+            || bytesTotal < 2 * MIN_SEGMENT_SIZE) {
+        return false;
+    }
+
+    // pieces are checked as the data is appended, segments write it in
+    // any order
+    if (_pieces != nullptr) {
+        return false;
+    }
+
+    // deflated downloads do not have a size we can split
+    return !(_metadata.contains(Metadata::DEFLATE_KEY)
+        && _metadata[Metadata::DEFLATE_KEY].toBool());
+}
+
+bool
+FileDownload::replyAcceptsRanges() {
+    auto statusCode = _reply->attribute(
+        QNetworkRequest::HttpStatusCodeAttribute);
+    if (!statusCode.isValid() || statusCode.toInt() != HTTP_OK) {
+        return false;
+    }
+
+    return _reply->hasRawHeader(ACCEPT_RANGES)
+        && _reply->rawHeader(ACCEPT_RANGES).toLower().contains("bytes");
+}
+
+void
+FileDownload::splitInSegments(qint64 received, qint64 bytesTotal) {
+    // keep the headers we need once all the segments are done since the
+    // current reply is going to be dropped, the probe already did it when
+    // there is no reply
+    if (_reply != nullptr) {
+        _contentType = (_reply->hasRawHeader(CONTENT_TYPE))?
+                QString(_reply->rawHeader(CONTENT_TYPE)) : QString();
+        if (_reply->hasRawHeader(CONTENT_DISPOSITION) && (
+                isConfined()
+                || !_metadata.contains(Metadata::LOCAL_PATH_KEY))) {
+            _contentDisposition = _reply->rawHeader(CONTENT_DISPOSITION);
+        }
+
+        disconnectFromReplySignals();
+        _reply->abort();
+        waitForWrites();
+        _currentData->write(_reply->readAll());
+        _reply->deleteLater();
+        _reply = nullptr;
+        received = _currentData->size();
+    }
+    // the segments write out of order, the data is hashed once completed
+    resetHash();
+
+    // segments write in place, the file cannot be in append mode and must
+    // have the final size
+    _currentData->close();
+    if (!_currentData->open(QIODevice::ReadWrite)
+            || !_currentData->resize(bytesTotal)) {
+        auto err = _currentData->error();
+        DOWN_LOG(ERROR) << "Could not allocate the segmented file" << err;
+        emitError(QString(FILE_SYSTEM_ERROR).arg(err));
+        return;
+    }
+
+    auto count = static_cast<int>(qMin(
+        static_cast<qint64>(_segmentsCount), bytesTotal / MIN_SEGMENT_SIZE));
+    auto segmentSize = bytesTotal / count;
+    for (int index = 0; index < count; index++) {
+        qint64 start = index * segmentSize;
+        qint64 end = (index == count - 1)?
+            bytesTotal - 1 : start + segmentSize - 1;
+        // the data that we already have is the beginning of the first one
+        qint64 done = (index == 0)? qMin(received, end - start + 1) : 0;
+
+        auto segment = new DownloadSegment(start, end, done, this);
+        CHECK(connect(segment, &DownloadSegment::progress,
+            this, &FileDownload::onSegmentProgress))
+                << "Could not connect to signal";
+        CHECK(connect(segment, &DownloadSegment::completed,
+            this, &FileDownload::onSegmentCompleted))
+                << "Could not connect to signal";
+        CHECK(connect(segment, &DownloadSegment::error,
+            this, &FileDownload::onSegmentError))
+                << "Could not connect to signal";
+        CHECK(connect(segment, &DownloadSegment::sslErrors,
+            this, &FileDownload::onSegmentSslErrors))
+                << "Could not connect to signal";
+        CHECK(connect(segment, &DownloadSegment::rangeNotSupported,
+            this, &FileDownload::onSegmentRangeNotSupported))
+                << "Could not connect to signal";
+        CHECK(connect(segment, &DownloadSegment::writeError,
+            this, &FileDownload::onSegmentWriteError))
+                << "Could not connect to signal";
+        _segments.append(segment);
+    }
+
+    DOWN_LOG(INFO) << "Downloading using" << count << "segments";
+    startSegments();
+}
+
+void
+FileDownload::startSegments() {
+    foreach(DownloadSegment* segment, _segments) {
+        if (!segment->isCompleted() && !segment->isRunning()) {
+            segment->setThrottle(segmentShare(throttle()),
+                segmentShare(throttleBurst()));
+            segment->startTransfer(buildRequest(), _currentData);
+        }
+    }
+}
+
+bool
+FileDownload::pauseSegments() {
+    bool written = true;
+    foreach(DownloadSegment* segment, _segments) {
+        written = segment->pauseTransfer() && written;
+    }
+    if (!written) {
+        auto err = _currentData->error();
+        DOWN_LOG(ERROR) << "Could not write that in the file system" << err;
+        emitError(QString(FILE_SYSTEM_ERROR).arg(err));
+        return false;
+    }
+    return flushFile();
+}
+
+void
+FileDownload::cancelSegments() {
+    foreach(DownloadSegment* segment, _segments) {
+        segment->cancelTransfer();
+        segment->deleteLater();
+    }
+    _segments.clear();
+}
+
+bool
+FileDownload::hasRunningSegments() {
+    foreach(DownloadSegment* segment, _segments) {
+        if (segment->isRunning()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+qulonglong
+FileDownload::segmentsProgress() {
+    qulonglong received = 0;
+    foreach(DownloadSegment* segment, _segments) {
+        received += static_cast<qulonglong>(segment->received());
+    }
+    return received;
+}
+
 void 
 FileDownload::errorCleanup() {
-    disconnectFromReplySignals();
-    _reply->deleteLater();
-    _reply = nullptr;
+    _waitingForBuffers = false;
+    _completionPending = false;
+    if (_reply != nullptr) {
+        disconnectFromReplySignals();
+        _reply->deleteLater();
+        _reply = nullptr;
+    }
+    if (_metalinkReply != nullptr) {
+        releaseMetalinkReply();
+    }
+    _retryTimer->stop();
+    _watchdog->stop();
+    cancelSegments();
     cleanUpCurrentData();
     // let other downloads use the same file name
     unlockFilePath();
@@ -28,9 +28,13 @@
 #include <ubuntu/transfers/errors/http_error_struct.h>
 #include <ubuntu/transfers/errors/network_error_struct.h>
 #include <ubuntu/transfers/errors/process_error_struct.h>
+#include <ubuntu/transfers/system/cryptographic_hash.h>
 #include <ubuntu/transfers/system/file_manager.h>
 #include <ubuntu/transfers/system/filename_mutex.h>
+#include <ubuntu/transfers/system/timer.h>
 #include "download.h"
+#include "download_segment.h"
+#include "piece_verifier.h"
 
 namespace Ubuntu {
 
@@ -79,18 +83,49 @@ class FileDownload : public Download, public QDBusContext {
         return _algo;
     }
 
+    // validators of the resource the data was downloaded from, used to
+    // ensure that a resumed download gets the rest of the same resource
+    virtual QByteArray etag() const {
+        return _etag;
+    }
+
+    virtual QByteArray lastModified() const {
+        return _lastModified;
+    }
+
+    void setValidators(const QByteArray& etag,
+                       const QByteArray& lastModified);
+
+    // bytes at the start of the temp file known to be in the disk, -1
+    // when the durability policy does not track them
+    virtual qint64 durableSize() const {
+        return _durableSize;
+    }
+
+    // used when the download is restored from the db, the data after
+    // the durable size might not have reached the disk before the daemon
+    // stopped and is dropped when the download is resumed
+    void setDurableSize(qint64 size);
+
     // methods that do perform the download
     virtual void cancelTransfer() override;
     virtual void pauseTransfer() override;
     virtual void resumeTransfer() override;
     virtual void startTransfer() override;
+    qint64 requiredSpace() override;
+    QString storagePath() override;
 
     void setFilePath(const QString& path);
 
+    // only used for testing so that we can inject a fake, the download
+    // takes ownership of the timer
+    void setWatchdogTimer(Timer* timer);
+
  public slots:  // NOLINT(whitespace/indent)
     qulonglong progress() override;
     qulonglong totalSize() override;
     virtual void setThrottle(qulonglong speed) override;
+    qulonglong transferRate() override;
     virtual void setDestinationDir(const QString& path);
     virtual void setHeaders(StringMap headers) override;
     virtual void setMetadata(const QVariantMap& metadata) override;
@@ -104,6 +139,11 @@ class FileDownload : public Download, public QDBusContext {
     void processError(ProcessErrorStruct error);
     void hashError(HashErrorStruct error);
     void propertiesChanged(const QVariantMap& changes);
+    // the probe of the resource is done, the size and name of the
+    // download are the ones of the server if it gave them
+    void headRequestCompleted();
+    // the durable size moved and has to be stored
+    void durableSizeChanged();
 
  protected:
     void emitError(const QString& error) override;
@@ -114,19 +154,76 @@ class FileDownload : public Download, public QDBusContext {
  private:
     // helper methods
     QNetworkRequest buildRequest();
+    qulonglong throttleBurst();
     void cleanUpCurrentData();
     void connectToReplySignals();
     void disconnectFromReplySignals();
     void emitFinished();
+    File* createDataFile();
+    void nameResumableData();
+    // false when the data could not be given its final name
+    bool publishFile();
+    bool hasFreeSpace();
+    bool reserveSpace(qint64 size);
+    void waitForWrites();
+    void resetDurableSize();
+    void updateDurableSize(qint64 size);
+    void syncPeriodically(qint64 size);
     bool flushFile();
     bool hashIsValid();
+    void writeReplyData();
+    void updateHash(const QByteArray& data, qint64 written);
+    void updateHash(const struct iovec* iov, int count, qint64 written);
+    void addToHash(const struct iovec* iov, int count);
+    void resetHash();
     void init();
     void initFileNames();
     void downloadPostProcessing(const QString& contentType);
     void unlockFilePath();
     void updateFileNamePerContentDisposition();
+    void updateFileNamePerContentDisposition(const QByteArray& contentDisposition);
+    void updateFileName(const QString& name);
     void writeDataUri();
+    void startProbe();
+    void releaseProbe();
+    void startBodyRequest();
+    bool storeReplyData();
+    bool requestRemainingData();
+    void storeValidators(NetworkReply* reply);
+    QByteArray ifRangeValidator();
+    bool checkResumedReply();
     void errorCleanup();
+    void emitNetworkError(NetworkReply* reply,
+                          QNetworkReply::NetworkError code);
+    bool canRetry(NetworkReply* reply, QNetworkReply::NetworkError code);
+    bool replyHasHttpError(NetworkReply* reply);
+    int nextRetryDelay(NetworkReply* reply);
+    void scheduleRetry(int delay);
+    void startWatchdog();
+    qint64 watchdogProgress();
+    bool isStalled(qint64 received, int window);
+    void reconnect();
+
+    // metalink helpers
+    bool applyMetalink(const QByteArray& document);
+    bool needsMetalink();
+    void fetchMetalink();
+    void releaseMetalinkReply();
+    bool hasNextMirror();
+    void useNextMirror();
+    void refetchPiece();
+
+    // segmented downloads helpers
+    bool canUseSegments(qint64 bytesTotal, bool acceptsRanges);
+    bool replyAcceptsRanges();
+    void splitInSegments(qint64 received, qint64 bytesTotal);
+    void startSegments();
+    bool pauseSegments();
+    void cancelSegments();
+    bool hasRunningSegments();
+    // part of a limit that each segment gets, never 0 if there is one
+    qulonglong segmentShare(qulonglong limit);
+    qulonglong segmentsProgress();
 
     // slots used to react to signals
     void onDownloadProgress(qint64 currentProgress, qint64);
@@ -134,28 +231,92 @@ class FileDownload : public Download, public QDBusContext {
     void onRedirect(QUrl redirect);
     void onDownloadCompleted();
     void onFinished();
+    void onProbeReply();
+    void onMetalinkFinished();
+    void onMetalinkError(QNetworkReply::NetworkError code);
+    void onRetryTimeout();
+    void onWatchdogTimeout();
     void onSslErrors(const QList<QSslError>&);
     void onProcessError(QProcess::ProcessError error);
     void onProcessFinished(int exitCode,
                            QProcess::ExitStatus exitStatus);
     void onOnlineStateChanged(bool);
     void onPropertiesChanged(const QVariantMap& changes);
-
+    void onSegmentProgress();
+    void onSegmentCompleted();
+    void onSegmentError(QNetworkReply::NetworkError code);
+    void onSegmentSslErrors(const QList<QSslError>& errors);
+    void onSegmentRangeNotSupported();
+    void onSegmentWriteError();
+    void onBuffersAvailable();
+    void onWriteError(File* file, int error);
+    void onSynced(File* file, qint64 size);
 
  private:
+    // when the data of the temp file is flushed to the disk
+    enum Durability {
+        NoDurability,
+        PeriodicDurability,
+        FinishDurability
+    };
+
     bool _downloading = false;
+    bool _waitingForBuffers = false;
+    bool _completionPending = false;  // finished while waiting for buffers
     bool _connected = false;
     qulonglong _totalSize = 0;
+    bool _spaceReserved = false;
     QUrl _url;
     QString _basename;
     QString _filePath;
     QString _tempFilePath;
+    // name given to an anonymous data file once it can be resumed
+    QString _namedDataPath;
     QString _hash;
     QCryptographicHash::Algorithm _algo;
+    CryptographicHash* _incrementalHash = nullptr;
+    qint64 _hashedBytes = 0;
     NetworkReply* _reply = nullptr;
+    // request done before the body one to learn about the resource, a
+    // HEAD or, when refused, a GET of its first byte
+    NetworkReply* _probe = nullptr;
+    bool _probeWithRange = false;
+    QByteArray _etag;
+    QByteArray _lastModified;
+    // the reply is a range request whose status was not yet checked
+    bool _resumed = false;
     File* _currentData = nullptr;
+    // pending retry of a request that failed with a transient error
+    Timer* _retryTimer = nullptr;
+    int _retriesDone = 0;
+    // reconnects the requests that stop sending data, like the ones of
+    // sockets left open after a network handover
+    Timer* _watchdog = nullptr;
+    qint64 _receivedBytes = 0;  // read from the replies, never reset
+    qint64 _watchdogReceived = 0;
+    Durability _durability = NoDurability;
+    // bytes of the temp file known to be in the disk, -1 if not tracked
+    qint64 _durableSize = -1;
+    bool _trimToDurable = false;  // restored from the db
+    qint64 _syncRequestedSize = 0;
+    QElapsedTimer _syncClock;
     FileNameMutex* _fileNameMutex = nullptr;
     QList<QUrl> _visitedUrls;
+    // mirrors of the metalink by priority, the url is the one in use
+    QList<QUrl> _mirrors;
+    int _mirror = 0;
+    QString _metalinkName;
+    // request of the metalink document when it is the url of the download
+    NetworkReply* _metalinkReply = nullptr;
+    // checks the pieces of the metalink as they are written
+    PieceVerifier* _pieces = nullptr;
+    qint64 _failedPieceOffset = -1;
+    int _pieceFailures = 0;
+    int _segmentsCount = 1;
+    bool _segmentsChecked = false;
+    QList<DownloadSegment*> _segments;
+    QString _contentType;
+    QByteArray _contentDisposition;
 };
 
 }  // Daemon
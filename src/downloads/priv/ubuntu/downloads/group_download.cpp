@@ -21,6 +21,7 @@
 #include <glog/logging.h>
 #include <ubuntu/transfers/i18n.h>
 #include <ubuntu/transfers/metadata.h>
+#include <ubuntu/transfers/system/file_remover.h>
 #include <ubuntu/transfers/system/hash_algorithm.h>
 #include "ubuntu/transfers/system/logger.h"
 #include "ubuntu/transfers/system/uuid_factory.h"
@@ -99,7 +100,6 @@ void
 GroupDownload::init(QList<GroupDownloadStruct> downloads,
               const QString& algo,
               bool isGSMDownloadAllowed) {
-    _fileManager = FileManager::instance();
     QVariantMap metadataMap = metadata();
     QMap<QString, QString> headersMap = headers();
     QStringList localPaths;
@@ -113,6 +113,9 @@ GroupDownload::init(QList<GroupDownloadStruct> downloads,
         FileDownload* singleDownload;
         QVariantMap downloadMetadata = QVariantMap(metadataMap);
         downloadMetadata[Metadata::LOCAL_PATH_KEY] = download.getLocalFile();
+        // the group rate limits its own progress, it needs every update
+        // of its downloads to do so
+        downloadMetadata[Metadata::PROGRESS_INTERVAL_KEY] = 0;
 
         if (hash.isEmpty()) {
             singleDownload = qobject_cast<FileDownload*>(
@@ -180,7 +183,7 @@ GroupDownload::cancelAllDownloads() {
     // loop over the finished downloads and remove the files
     foreach(const QString& path, _finishedDownloads) {
         GROUP_LOG(INFO) << "Removing file: " << path;
-        _fileManager->remove(path);
+        FileRemover::instance()->remove(path);
     }
 }
 
@@ -240,6 +243,15 @@ GroupDownload::startTransfer() {
     }
 }
 
+void
+GroupDownload::setRetryPolicy(int retries, int delay) {
+    Download::setRetryPolicy(retries, delay);
+    // the downloads of the group are not known by the manager
+    foreach(FileDownload* download, _downloads) {
+        download->setRetryPolicy(retries, delay);
+    }
+}
+
 qulonglong
 GroupDownload::progress() {
     qulonglong total = 0;
@@ -349,10 +361,10 @@ void
 GroupDownload::onProgress(qulonglong received, qulonglong total) {
     FileDownload* down = qobject_cast<FileDownload*>(sender());
     TRACE;
-    // TODO(mandel): the result is not real, we need to be smarter make
-    // a head request get size and name and the do all this, but atm is
-    // 'good enough' get the sender and check if we received
-    // progress from it, update its data and recalculate
+    // the downloads probe their size before requesting the body and
+    // report it right away, get the sender and check if we received
+    // progress from it, update its data and recalculate. Servers that do
+    // not give the size still make the total grow while downloading.
     QUrl url = down->url();
     if (_downloadsProgress.contains(url)) {
         QPair<qulonglong, qulonglong>& data = _downloadsProgress[url];
@@ -378,7 +390,8 @@ GroupDownload::onProgress(qulonglong received, qulonglong total) {
         totalTotal += progressList[index].second;
     }
 
-    emit Download::progress(totalReceived, totalTotal);
+    emitProgress(totalReceived, totalTotal,
+        totalTotal > 0 && totalReceived >= totalTotal);
 }
 
 void
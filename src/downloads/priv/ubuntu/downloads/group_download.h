@@ -57,6 +57,7 @@ class GroupDownload : public Download {
     virtual void pauseTransfer() override;
     virtual void resumeTransfer() override;
     virtual void startTransfer() override;
+    void setRetryPolicy(int retries, int delay) override;
 
  public slots:  // NOLINT(whitespace/indent)
     virtual qulonglong progress() override;
@@ -95,7 +96,6 @@ class GroupDownload : public Download {
     QStringList _finishedDownloads;
     QMap<QUrl, QPair<qulonglong, qulonglong> > _downloadsProgress;
     Factory* _downFactory = nullptr;
-    FileManager* _fileManager = nullptr;
 };
 
 }  // Daemon
@@ -43,7 +43,8 @@ DownloadManager::DownloadManager(Application* app,
       _throttle(0) {
     _conn = connection;
     RequestFactory::setStoppable(_stoppable);
-    _downloadFactory = new Factory(new System::AppArmor(connection), this);
+    _appArmor = new System::AppArmor(connection);
+    _downloadFactory = new Factory(_appArmor, this);
     _db = DownloadsDb::instance();
     _queue = new Queue(this);
     init();
@@ -76,6 +77,9 @@ DownloadManager::init() {
     qDBusRegisterMetaType<DownloadStruct>();
     qDBusRegisterMetaType<GroupDownloadStruct>();
     qDBusRegisterMetaType<StructList>();
+    qDBusRegisterMetaType<DownloadStructList>();
+    qDBusRegisterMetaType<DownloadProgressStruct>();
+    qDBusRegisterMetaType<ProgressList>();
     qDBusRegisterMetaType<AuthErrorStruct>();
     qDBusRegisterMetaType<HttpErrorStruct>();
     qDBusRegisterMetaType<HashErrorStruct>();
@@ -88,6 +92,19 @@ DownloadManager::init() {
     CHECK(connect(_queue, &Queue::transferAdded,
         this, &DownloadManager::onDownloadsChanged))
             << "Could not connect to signal";
+    if (_appArmor != nullptr) {
+        connectToSecurityContexts();
+    }
+
+    _progressTimer = new Timer(this);
+    connectToProgressTimer();
+}
+
+void
+DownloadManager::connectToProgressTimer() {
+    CHECK(connect(_progressTimer, &Timer::timeout,
+        this, &DownloadManager::onProgressBatchTimeout))
+            << "Could not connect to signal";
 }
 
 void
@@ -122,20 +139,111 @@ DownloadManager::onDownloadsChanged(QString path) {
 
 QString
 DownloadManager::getCaller() {
-    QString caller = "";
+    // when finishing a delayed creation we are no longer in the context
+    // of the dbus call
+    QString caller = _delayedCaller;
 
-    bool wasCalledFromDBus = calledFromDBus();
+    bool wasCalledFromDBus = isCalledFromDBus();
     if (wasCalledFromDBus) {
-        caller = connection().interface()->serviceOwner(
-            message().service());
+        // the service of a received call is the unique name of the
+        // sender, there is no need to ask the bus for its owner
+        caller = callMessage().service();
         LOG(INFO) << "Owner is: " << caller;
     }
     return caller;
 }
 
+System::AppArmor*
+DownloadManager::securityContexts() {
+    // share a single instance so that the security contexts of the
+    // callers are cached between calls
+    if (_appArmor == nullptr) {
+        _appArmor = new System::AppArmor(_conn, this);
+        connectToSecurityContexts();
+    }
+    return _appArmor;
+}
+
+void
+DownloadManager::connectToSecurityContexts() {
+    CHECK(connect(_appArmor, &System::AppArmor::securityContextResolved,
+        this, &DownloadManager::onSecurityContextResolved))
+            << "Could not connect to signal";
+}
+
+void
+DownloadManager::setSecurityContexts(System::AppArmor* appArmor) {
+    _appArmor = appArmor;
+    _appArmor->setParent(this);
+    connectToSecurityContexts();
+}
+
+void
+DownloadManager::setProgressTimer(Timer* timer) {
+    delete _progressTimer;
+    _progressTimer = timer;
+    _progressTimer->setParent(this);
+    connectToProgressTimer();
+}
+
+bool
+DownloadManager::isCalledFromDBus() {
+    return calledFromDBus();
+}
+
+QDBusMessage
+DownloadManager::callMessage() {
+    return message();
+}
+
+void
+DownloadManager::delayReply() {
+    setDelayedReply(true);
+}
+
+void
+DownloadManager::onSecurityContextResolved(const QString& caller,
+                                           bool resolved) {
+    TRACE << caller << resolved;
+    auto pending = _delayedCalls.take(caller);
+    if (!resolved) {
+        // going back to the blocking lookup would freeze the event loop
+        // on a slow bus, let the caller retry instead
+        foreach(const DelayedCall& call, pending) {
+            _conn->send(call.first.createErrorReply(QDBusError::AccessDenied,
+                "Could not get the security context of " + caller));
+        }
+        return;
+    }
+
+    _delayedCaller = caller;
+    foreach(const DelayedCall& call, pending) {
+        _conn->send(call.second(call.first));
+    }
+    _delayedCaller = "";
+}
+
+bool
+DownloadManager::delayUntilCallerIsKnown(const QString& caller,
+                                         DelayedReplyFunc replyFunc) {
+    // do not block the event loop, and with it all the transfers, while
+    // the bus tells us who the caller is. The call is finished once
+    // the security context is known.
+    if (!isCalledFromDBus()
+            || !securityContexts()->resolveSecurityContext(caller)) {
+        return false;
+    }
+
+    LOG(INFO) << "Delaying call until the context of " << caller
+        << " is known";
+    delayReply();
+    _delayedCalls[caller].append(DelayedCall(callMessage(), replyFunc));
+    return true;
+}
+
 QString
 DownloadManager::getDownloadOwner(const QVariantMap& metadata) {
-    QScopedPointer<System::AppArmor> appArmor(new System::AppArmor(_conn));
+    auto appArmor = securityContexts();
     auto owner = getCaller();
     auto appId = appArmor->appId(owner);
     if(appArmor->isConfined(appId)) {
@@ -150,16 +258,17 @@ DownloadManager::getDownloadOwner(const QVariantMap& metadata) {
     return "";
 }
 
-QDBusObjectPath
-DownloadManager::registerDownload(Download* download) {
+void
+DownloadManager::prepareDownload(Download* download) {
     download->setDownloadOwner(getDownloadOwner(download->metadata()));
 
     download->setThrottle(_throttle);
+    download->setRetryPolicy(_retries, _retryDelay);
     download->allowGSMDownload(_allowMobileData);
-    if (!_db->store(download)) {
-        LOG(WARNING) << download->transferId()
-            << "could not be stored in the db";
-    }
+}
+
+QDBusObjectPath
+DownloadManager::publishDownload(Download* download) {
     _db->connectToDownload(download);
     _queue->add(download);
     auto path = download->path();
@@ -174,9 +283,52 @@ DownloadManager::registerDownload(Download* download) {
     return objectPath;
 }
 
+QDBusObjectPath
+DownloadManager::registerDownload(Download* download) {
+    prepareDownload(download);
+    if (!_db->store(download)) {
+        LOG(WARNING) << download->transferId()
+            << "could not be stored in the db";
+    }
+    return publishDownload(download);
+}
+
+QList<QDBusObjectPath>
+DownloadManager::registerDownloads(QList<Download*> downloads) {
+    foreach(Download* download, downloads) {
+        prepareDownload(download);
+    }
+    if (!_db->storeAll(downloads)) {
+        LOG(WARNING) << "Downloads could not be stored in the db";
+    }
+
+    QList<QDBusObjectPath> paths;
+    foreach(Download* download, downloads) {
+        paths << publishDownload(download);
+    }
+    return paths;
+}
+
 QDBusObjectPath
 DownloadManager::createDownload(DownloadCreationFunc createDownloadFunc) {
     auto owner = getCaller();
+
+    DelayedReplyFunc replyFunc = [this, owner, createDownloadFunc](
+            const QDBusMessage& msg) {
+        auto download = createDownloadFunc(owner);
+        if (!download->isValid()) {
+            auto error = download->lastError();
+            download->deleteLater();
+            return msg.createErrorReply(QDBusError::InvalidArgs, error);
+        }
+        auto path = registerDownload(download);
+        return msg.createReply(QVariant::fromValue(path));
+    };
+    if (delayUntilCallerIsKnown(owner, replyFunc)) {
+        // the result will be ignored thanks to the delayed reply
+        return QDBusObjectPath();
+    }
+
     auto download = createDownloadFunc(owner);
 
     if (calledFromDBus() && !download->isValid()) {
@@ -188,6 +340,49 @@ DownloadManager::createDownload(DownloadCreationFunc createDownloadFunc) {
     return registerDownload(download);
 }
 
+Download*
+DownloadManager::createSingleDownload(const QString& owner,
+                                      const QString& url,
+                                      const QString& hash,
+                                      const QString& algo,
+                                      const QVariantMap& metadata,
+                                      StringMap headers) {
+    if (hash.isEmpty())
+        return _downloadFactory->createDownload(owner, url,
+            metadata, headers);
+    else
+        return _downloadFactory->createDownload(owner, url, hash,
+            algo, metadata, headers);
+}
+
+bool
+DownloadManager::createDownloads(const QString& owner,
+                                 DownloadStructList downloads,
+                                 QList<QDBusObjectPath>& paths,
+                                 QString& error) {
+    // validate all the downloads before any of them is registered, the
+    // batch is either accepted or rejected as a whole
+    QList<Download*> created;
+    foreach(DownloadStruct info, downloads) {
+        auto download = createSingleDownload(owner, info.getUrl(),
+            info.getHash(), info.getAlgorithm(), info.getMetadata(),
+            info.getHeaders());
+        if (!download->isValid()) {
+            error = QString("Download %1: %2").arg(created.size())
+                .arg(download->lastError());
+            download->deleteLater();
+            foreach(Download* down, created) {
+                down->deleteLater();
+            }
+            return false;
+        }
+        created.append(download);
+    }
+
+    paths = registerDownloads(created);
+    return true;
+}
+
 QDBusObjectPath
 DownloadManager::createDownload(const QString& url,
                                 const QString& hash,
@@ -199,14 +394,8 @@ DownloadManager::createDownload(const QString& url,
         << headers << "}";
     DownloadCreationFunc createDownloadFunc =
         [this, url, hash, algo, metadata, headers](QString owner) {
-        Download* download = nullptr;
-        if (hash.isEmpty())
-            download = _downloadFactory->createDownload(owner, url,
-                metadata, headers);
-        else
-            download = _downloadFactory->createDownload(owner, url, hash,
-                algo, metadata, headers);
-        return download;
+        return createSingleDownload(owner, url, hash, algo, metadata,
+            headers);
     };
     return createDownload(createDownloadFunc);
 }
@@ -217,6 +406,37 @@ DownloadManager::createDownload(DownloadStruct download) {
         download.getAlgorithm(), download.getMetadata(), download.getHeaders());
 }
 
+QList<QDBusObjectPath>
+DownloadManager::createDownloads(DownloadStructList downloads) {
+    LOG(INFO) << "Create downloads == {count:" << downloads.size() << "}";
+    auto owner = getCaller();
+
+    DelayedReplyFunc replyFunc = [this, owner, downloads](
+            const QDBusMessage& msg) {
+        QList<QDBusObjectPath> paths;
+        QString error;
+        if (!createDownloads(owner, downloads, paths, error)) {
+            return msg.createErrorReply(QDBusError::InvalidArgs, error);
+        }
+        return msg.createReply(QVariant::fromValue(paths));
+    };
+    if (delayUntilCallerIsKnown(owner, replyFunc)) {
+        // the result will be ignored thanks to the delayed reply
+        return QList<QDBusObjectPath>();
+    }
+
+    QList<QDBusObjectPath> paths;
+    QString error;
+    if (!createDownloads(owner, downloads, paths, error)) {
+        if (calledFromDBus()) {
+            sendErrorReply(QDBusError::InvalidArgs, error);
+        }
+        // the result will be ignored thanks to the sendErrorReply
+        return QList<QDBusObjectPath>();
+    }
+    return paths;
+}
+
 QDBusObjectPath
 DownloadManager::createMmsDownload(const QString& url,
                            const QString& hostname,
@@ -266,6 +486,115 @@ DownloadManager::setDefaultThrottle(qulonglong speed) {
     }
 }
 
+int
+DownloadManager::maxConcurrentDownloads() {
+    return _queue->maxConcurrent();
+}
+
+void
+DownloadManager::setMaxConcurrentDownloads(int max) {
+    LOG(INFO) << "Max concurrent downloads set to " << max;
+    _queue->setMaxConcurrent(max);
+}
+
+int
+DownloadManager::maxConcurrentDownloadsPerApp() {
+    return _queue->maxConcurrentPerApp();
+}
+
+void
+DownloadManager::setMaxConcurrentDownloadsPerApp(int max) {
+    LOG(INFO) << "Max concurrent downloads per app set to " << max;
+    _queue->setMaxConcurrentPerApp(max);
+}
+
+int
+DownloadManager::defaultRetries() {
+    return _retries;
+}
+
+void
+DownloadManager::setDefaultRetries(int retries) {
+    LOG(INFO) << "Default retries set to " << retries;
+    _retries = qMax(retries, 0);
+    updateRetryPolicy();
+}
+
+int
+DownloadManager::defaultRetryDelay() {
+    return _retryDelay;
+}
+
+void
+DownloadManager::setDefaultRetryDelay(int delay) {
+    LOG(INFO) << "Default retry delay set to " << delay;
+    _retryDelay = qMax(delay, 0);
+    updateRetryPolicy();
+}
+
+void
+DownloadManager::updateRetryPolicy() {
+    QHash<QString, Transfer*> downloads = _queue->transfers();
+    foreach(const QString& path, downloads.keys()) {
+        auto download = qobject_cast<Download*>(downloads[path]);
+        if (download != nullptr) {
+            download->setRetryPolicy(_retries, _retryDelay);
+        }
+    }
+}
+
+int
+DownloadManager::progressBatchInterval() {
+    return _progressInterval;
+}
+
+void
+DownloadManager::setProgressBatchInterval(int interval) {
+    LOG(INFO) << "Progress batch interval set to " << interval;
+    _progressInterval = qMax(interval, 0);
+    _lastProgress.clear();
+    if (_progressInterval > 0) {
+        _progressTimer->start(_progressInterval);
+    } else {
+        _progressTimer->stop();
+    }
+}
+
+void
+DownloadManager::onProgressBatchTimeout() {
+    // report all the active downloads whose progress changed in a single
+    // signal rather than flooding the bus with one signal per chunk
+    ProgressList batch;
+    QHash<QString, qulonglong> current;
+    foreach(Transfer* transfer, _queue->transfers().values()) {
+        auto state = transfer->state();
+        if (state != Transfer::START && state != Transfer::RESUME) {
+            continue;
+        }
+        auto download = qobject_cast<Download*>(transfer);
+        if (download == nullptr) {
+            continue;
+        }
+        auto path = download->path();
+        auto received = download->progress();
+        current[path] = received;
+        if (_lastProgress.contains(path)
+                && _lastProgress[path] == received) {
+            continue;
+        }
+        batch.append(DownloadProgressStruct(path, received,
+            download->totalSize()));
+    }
+    _lastProgress = current;
+
+    if (!batch.isEmpty()) {
+        emit progressBatch(batch);
+    }
+    if (_progressInterval > 0) {
+        _progressTimer->start(_progressInterval);
+    }
+}
+
 void
 DownloadManager::allowGSMDownload(bool allowed) {
     _allowMobileData = allowed;
@@ -284,7 +613,7 @@ QList<QDBusObjectPath>
 DownloadManager::getAllDownloads(const QString& appId, bool uncollected) {
     // filter per app id if owner is not "" and the app is confined else
     // return all downloads
-    QScopedPointer<System::AppArmor> appArmor(new System::AppArmor(_conn));
+    auto appArmor = securityContexts();
     auto owner = getCaller();
     auto ownerId = appArmor->appId(owner);
     QString getId;
@@ -319,7 +648,7 @@ DownloadManager::getAllDownloadsWithMetadata(const QString &name,
                                              const QString &value) {
     // filter per app id if owner is not "" and the app is confined else
     // return all downloads
-    QScopedPointer<System::AppArmor> appArmor(new System::AppArmor(_conn));
+    auto appArmor = securityContexts();
     auto owner = getCaller();
     auto appId = appArmor->appId(owner);
     auto isConfined = appArmor->isConfined(appId);
@@ -346,7 +675,7 @@ DownloadManager::getAllDownloadsWithMetadata(const QString &name,
 
 QList<QDBusObjectPath>
 DownloadManager::getUncollectedDownloads(const QString &appId) {
-    QScopedPointer<System::AppArmor> appArmor(new System::AppArmor(_conn));
+    auto appArmor = securityContexts();
     auto owner = getCaller();
     auto callerAppId = appArmor->appId(owner);
     QList<QDBusObjectPath> paths;
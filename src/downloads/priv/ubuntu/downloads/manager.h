@@ -22,12 +22,16 @@
 #include <functional>
 
 #include <QByteArray>
+#include <QDBusMessage>
 #include <QDBusObjectPath>
+#include <QHash>
 #include <QObject>
+#include <QPair>
 #include <QSslCertificate>
 
 #include <ubuntu/transfers/queue.h>
 #include <ubuntu/transfers/system/dbus_connection.h>
+#include <ubuntu/transfers/system/timer.h>
 #include <ubuntu/download_manager/metatypes.h>
 
 #include "ubuntu/transfers/base_manager.h"
@@ -65,10 +69,16 @@ class DownloadManager : public BaseManager {
     // mainly for testing purposes
     virtual QList<QSslCertificate> acceptedCertificates();
     virtual void setAcceptedCertificates(const QList<QSslCertificate>& certs);
+    // only used for testing so that we can inject fakes, the manager
+    // takes ownership of them
+    void setSecurityContexts(System::AppArmor* appArmor);
+    void setProgressTimer(Timer* timer);
     static const QString SERVICE_PATH;
 
  public slots:  // NOLINT(whitespace/indent)
     virtual QDBusObjectPath createDownload(DownloadStruct download);
+    virtual QList<QDBusObjectPath> createDownloads(
+                                            DownloadStructList downloads);
     virtual QDBusObjectPath createMmsDownload(const QString& url,
                                               const QString& hostname,
                                               int port);
@@ -81,6 +91,19 @@ class DownloadManager : public BaseManager {
 
     virtual qulonglong defaultThrottle();
     virtual void setDefaultThrottle(qulonglong speed);
+    virtual int maxConcurrentDownloads();
+    virtual void setMaxConcurrentDownloads(int max);
+    virtual int maxConcurrentDownloadsPerApp();
+    virtual void setMaxConcurrentDownloadsPerApp(int max);
+    // ms between progress batches, 0 stops them
+    virtual int progressBatchInterval();
+    virtual void setProgressBatchInterval(int interval);
+    // retries of transient network errors and ms before the first one
+    // for the downloads whose metadata does not set them
+    virtual int defaultRetries();
+    virtual void setDefaultRetries(int retries);
+    virtual int defaultRetryDelay();
+    virtual void setDefaultRetryDelay(int delay);
     virtual void allowGSMDownload(bool allowed);
     virtual bool isGSMDownloadAllowed();
     virtual QList<QDBusObjectPath> getAllDownloads(const QString& appId = "", bool uncollected = false);
@@ -92,6 +115,7 @@ class DownloadManager : public BaseManager {
     virtual DownloadStateStruct getDownloadState(const QString &downloadId);
  signals:
     void downloadCreated(const QDBusObjectPath& path);
+    void progressBatch(ProgressList progress);
 
  protected:
     Queue* queue() {
@@ -99,9 +123,20 @@ class DownloadManager : public BaseManager {
     }
 
     virtual QDBusObjectPath registerDownload(Download* download);
+    // registers several downloads storing all of them at once
+    virtual QList<QDBusObjectPath> registerDownloads(
+                                                QList<Download*> downloads);
+
+    // context of the dbus call being served, virtual so that the tests
+    // can fake calls coming from the bus
+    virtual bool isCalledFromDBus();
+    virtual QDBusMessage callMessage();
+    virtual void delayReply();
 
  private:
     typedef std::function<Download*(QString)> DownloadCreationFunc;
+    typedef std::function<QDBusMessage(const QDBusMessage&)> DelayedReplyFunc;
+    typedef QPair<QDBusMessage, DelayedReplyFunc> DelayedCall;
 
     void init();
     void loadPreviewsDownloads(QString path);
@@ -112,19 +147,49 @@ class DownloadManager : public BaseManager {
                                    const QString& algo,
                                    const QVariantMap& metadata,
                                    StringMap headers);
+    Download* createSingleDownload(const QString& owner,
+                                   const QString& url,
+                                   const QString& hash,
+                                   const QString& algo,
+                                   const QVariantMap& metadata,
+                                   StringMap headers);
+    bool createDownloads(const QString& owner,
+                         DownloadStructList downloads,
+                         QList<QDBusObjectPath>& paths,
+                         QString& error);
+    void prepareDownload(Download* download);
+    QDBusObjectPath publishDownload(Download* download);
     void onDownloadsChanged(QString);
     QString getCaller();
+    System::AppArmor* securityContexts();
+    void connectToSecurityContexts();
+    void connectToProgressTimer();
+    void onSecurityContextResolved(const QString& caller, bool resolved);
+    bool delayUntilCallerIsKnown(const QString& caller,
+                                 DelayedReplyFunc replyFunc);
     QString getDownloadOwner(const QVariantMap& metadata);
+    void onProgressBatchTimeout();
+    void updateRetryPolicy();
 
  private:
     Application* _app = nullptr;
     qulonglong _throttle;
     Factory* _downloadFactory = nullptr;
+    System::AppArmor* _appArmor = nullptr;  // owned by the factory or us
+    // calls waiting for the security context of their caller
+    QHash<QString, QList<DelayedCall>> _delayedCalls;
+    QString _delayedCaller;
     Queue* _queue = nullptr;
     DownloadsDb* _db = nullptr;
     DBusConnection* _conn = nullptr;
     bool _stoppable = false;
     bool _allowMobileData = true;
+    int _progressInterval = 0;
+    int _retries = 3;
+    int _retryDelay = 1000;
+    Timer* _progressTimer = nullptr;
+    // progress sent in the last batch so that only changes are sent
+    QHash<QString, qulonglong> _lastProgress;
 };
 
 }  // Daemon
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <algorithm>
+
+#include <QFileInfo>
+#include <QMap>
+#include <QPair>
+#include <QStringList>
+#include <QXmlStreamReader>
+
+#include <ubuntu/transfers/system/hash_algorithm.h>
+
+#include "metalink.h"
+
+namespace {
+    const QString METALINK_NAMESPACE = "urn:ietf:params:xml:ns:metalink";
+    const QString METALINK_ELEMENT = "metalink";
+    const QString FILE_ELEMENT = "file";
+    const QString SIZE_ELEMENT = "size";
+    const QString HASH_ELEMENT = "hash";
+    const QString PIECES_ELEMENT = "pieces";
+    const QString URL_ELEMENT = "url";
+    const QString NAME_ATTRIBUTE = "name";
+    const QString TYPE_ATTRIBUTE = "type";
+    const QString LENGTH_ATTRIBUTE = "length";
+    const QString PRIORITY_ATTRIBUTE = "priority";
+    // urls without a priority are the last ones to be used
+    const int LOWEST_PRIORITY = 999999;
+    // strongest first
+    const QStringList HASH_PREFERENCE = QStringList() << "sha512"
+        << "sha384" << "sha256" << "sha224" << "sha1" << "md5";
+    const QStringList SUPPORTED_SCHEMES = QStringList() << "http"
+        << "https" << "ftp";
+}
+
+namespace Ubuntu {
+
+using namespace Transfers::System;
+
+namespace DownloadManager {
+
+namespace Daemon {
+
+bool
+Metalink::parse(const QByteArray& document) {
+    reset();
+
+    QXmlStreamReader reader(document);
+    if (!reader.readNextStartElement() || reader.name() != METALINK_ELEMENT
+            || reader.namespaceUri() != METALINK_NAMESPACE) {
+        setError("Not a metalink document");
+        return false;
+    }
+
+    int files = 0;
+    QList<QPair<int, QUrl> > mirrors;
+    QMap<QString, QString> hashes;
+    while (reader.readNextStartElement()) {
+        if (reader.name() != FILE_ELEMENT) {
+            reader.skipCurrentElement();
+            continue;
+        }
+        if (++files > 1) {
+            setError("Only documents with a single file are supported");
+            return false;
+        }
+
+        // the name can have directories, they must not take the file
+        // out of the destination dir
+        _name = QFileInfo(reader.attributes().value(
+            NAME_ATTRIBUTE).toString()).fileName();
+
+        while (reader.readNextStartElement()) {
+            auto attributes = reader.attributes();
+            if (reader.name() == SIZE_ELEMENT) {
+                bool ok = false;
+                _size = reader.readElementText().trimmed().toLongLong(&ok);
+                if (!ok || _size < 0) {
+                    _size = -1;
+                }
+            } else if (reader.name() == HASH_ELEMENT) {
+                auto algorithm = algorithmName(
+                    attributes.value(TYPE_ATTRIBUTE).toString());
+                auto value = reader.readElementText().trimmed().toLower();
+                if (!algorithm.isEmpty() && !value.isEmpty()) {
+                    hashes[algorithm] = value;
+                }
+            } else if (reader.name() == PIECES_ELEMENT) {
+                auto algorithm = algorithmName(
+                    attributes.value(TYPE_ATTRIBUTE).toString());
+                bool ok = false;
+                auto length = attributes.value(
+                    LENGTH_ATTRIBUTE).toString().toLongLong(&ok);
+                QList<QByteArray> pieces;
+                while (reader.readNextStartElement()) {
+                    if (reader.name() == HASH_ELEMENT) {
+                        pieces.append(reader.readElementText().trimmed()
+                            .toLower().toLatin1());
+                    } else {
+                        reader.skipCurrentElement();
+                    }
+                }
+                if (!algorithm.isEmpty() && ok && length > 0
+                        && !pieces.isEmpty()) {
+                    _pieceLength = length;
+                    _pieceAlgorithm = algorithm;
+                    _pieces = pieces;
+                }
+            } else if (reader.name() == URL_ELEMENT) {
+                bool ok = false;
+                auto priority = attributes.value(
+                    PRIORITY_ATTRIBUTE).toString().toInt(&ok);
+                if (!ok || priority < 1) {
+                    priority = LOWEST_PRIORITY;
+                }
+                QUrl url(reader.readElementText().trimmed());
+                if (url.isValid()
+                        && SUPPORTED_SCHEMES.contains(url.scheme().toLower())) {
+                    mirrors.append(qMakePair(priority, url));
+                }
+            } else {
+                reader.skipCurrentElement();
+            }
+        }
+    }
+
+    if (reader.hasError()) {
+        setError(reader.errorString());
+        return false;
+    }
+
+    if (files == 0) {
+        setError("The document does not describe a file");
+        return false;
+    }
+
+    if (mirrors.isEmpty()) {
+        setError("The document does not have a url that can be used");
+        return false;
+    }
+
+    // lower values are preferred, the order of the document is kept for
+    // the ones with the same priority
+    std::stable_sort(mirrors.begin(), mirrors.end(),
+        [](const QPair<int, QUrl>& left, const QPair<int, QUrl>& right) {
+            return left.first < right.first;
+        });
+    for (const auto& mirror : mirrors) {
+        _urls.append(mirror.second);
+    }
+
+    foreach(const QString& algorithm, HASH_PREFERENCE) {
+        if (hashes.contains(algorithm)) {
+            _hashAlgorithm = algorithm;
+            _hash = hashes[algorithm];
+            break;
+        }
+    }
+
+    // pieces that do not cover the file cannot be checked
+    if (!_pieces.isEmpty() && _size >= 0) {
+        auto expected = (_size + _pieceLength - 1) / _pieceLength;
+        if (expected != _pieces.count()) {
+            _pieceLength = 0;
+            _pieceAlgorithm.clear();
+            _pieces.clear();
+        }
+    }
+    return true;
+}
+
+QString
+Metalink::error() const {
+    return _error;
+}
+
+QString
+Metalink::name() const {
+    return _name;
+}
+
+qint64
+Metalink::size() const {
+    return _size;
+}
+
+QList<QUrl>
+Metalink::urls() const {
+    return _urls;
+}
+
+QString
+Metalink::hash() const {
+    return _hash;
+}
+
+QString
+Metalink::hashAlgorithm() const {
+    return _hashAlgorithm;
+}
+
+qint64
+Metalink::pieceLength() const {
+    return _pieceLength;
+}
+
+QString
+Metalink::pieceAlgorithm() const {
+    return _pieceAlgorithm;
+}
+
+QList<QByteArray>
+Metalink::pieces() const {
+    return _pieces;
+}
+
+void
+Metalink::reset() {
+    _error.clear();
+    _name.clear();
+    _size = -1;
+    _urls.clear();
+    _hash.clear();
+    _hashAlgorithm.clear();
+    _pieceLength = 0;
+    _pieceAlgorithm.clear();
+    _pieces.clear();
+}
+
+void
+Metalink::setError(const QString& error) {
+    reset();
+    _error = error;
+}
+
+QString
+Metalink::algorithmName(const QString& type) {
+    // the IANA names have a dash, "sha-256", ours do not
+    auto name = type.trimmed().toLower().remove('-');
+    if (name.isEmpty() || !HashAlgorithm::isValidAlgo(name)) {
+        return QString();
+    }
+    return name;
+}
+
+}  // Daemon
+
+}  // DownloadManager
+
+}  // Ubuntu
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOWNLOADER_LIB_METALINK_H
+#define DOWNLOADER_LIB_METALINK_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QUrl>
+
+namespace Ubuntu {
+
+namespace DownloadManager {
+
+namespace Daemon {
+
+// File described by a Metalink (RFC 5854) document. A download is a single
+// file, documents that describe more than one are refused.
+class Metalink {
+ public:
+    // false when the document is not a metalink we can download, the
+    // reason is returned by error
+    bool parse(const QByteArray& document);
+    QString error() const;
+
+    // base name of the file, any directory in the document is dropped
+    QString name() const;
+    // -1 when the document does not have it
+    qint64 size() const;
+    // mirrors that can be used, the preferred ones first
+    QList<QUrl> urls() const;
+
+    // strongest hash of the whole file that we support, the algorithm
+    // uses the names of HashAlgorithm
+    QString hash() const;
+    QString hashAlgorithm() const;
+
+    // hashes of the consecutive pieces of the file, empty if the document
+    // does not have them or their algorithm is not supported
+    qint64 pieceLength() const;
+    QString pieceAlgorithm() const;
+    QList<QByteArray> pieces() const;
+
+ private:
+    void reset();
+    void setError(const QString& error);
+    static QString algorithmName(const QString& type);
+
+ private:
+    QString _error;
+    QString _name;
+    qint64 _size = -1;
+    QList<QUrl> _urls;
+    QString _hash;
+    QString _hashAlgorithm;
+    qint64 _pieceLength = 0;
+    QString _pieceAlgorithm;
+    QList<QByteArray> _pieces;
+};
+
+}  // Daemon
+
+}  // DownloadManager
+
+}  // Ubuntu
+
+#endif
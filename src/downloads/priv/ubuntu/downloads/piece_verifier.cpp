@@ -0,0 +1,150 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "piece_verifier.h"
+
+namespace Ubuntu {
+
+namespace DownloadManager {
+
+namespace Daemon {
+
+PieceVerifier::PieceVerifier(qint64 length,
+                             QCryptographicHash::Algorithm algorithm,
+                             const QList<QByteArray>& hashes)
+    : _length(length),
+      _hashes(hashes),
+      _hash(algorithm) {
+}
+
+bool
+PieceVerifier::addData(const char* data, qint64 size) {
+    _fed += size;
+    if (_failed) {
+        return false;
+    }
+
+    while (size > 0) {
+        if (_index >= _hashes.count()) {
+            // more data than the file described by the metalink
+            _failed = true;
+            return false;
+        }
+
+        auto count = qMin(_length - _pending, size);
+        _hash.addData(data, static_cast<int>(count));
+        _pending += count;
+        data += count;
+        size -= count;
+        if (_pending == _length && !checkPiece()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+PieceVerifier::finish() {
+    if (!_failed && _pending > 0 && !checkPiece()) {
+        return false;
+    }
+    return !_failed && _index == _hashes.count();
+}
+
+bool
+PieceVerifier::hasFailed() const {
+    return _failed;
+}
+
+qint64
+PieceVerifier::verifiedSize() const {
+    return _verified;
+}
+
+qint64
+PieceVerifier::fedSize() const {
+    return _fed;
+}
+
+qint64
+PieceVerifier::rewind(qint64 size) {
+    if (size < _verified) {
+        _verified = size - size % _length;
+        _index = static_cast<int>(_verified / _length);
+    }
+    _hash.reset();
+    _pending = 0;
+    _failed = false;
+    _fed = _verified;
+    return _verified;
+}
+
+qint64
+PieceVerifier::verify(QIODevice* device, qint64 size) {
+    _index = 0;
+    _verified = 0;
+    _pending = 0;
+    _failed = false;
+    _hash.reset();
+
+    if (device->seek(0)) {
+        while (_index < _hashes.count() && _verified < size) {
+            auto data = device->read(qMin(_length, size - _verified));
+            if (data.isEmpty()) {
+                break;
+            }
+            _hash.addData(data);
+            _pending = data.size();
+            if (_pending < _length && _index < _hashes.count() - 1) {
+                // an incomplete piece is fetched again
+                break;
+            }
+            if (!checkPiece()) {
+                break;
+            }
+        }
+    }
+
+    _hash.reset();
+    _pending = 0;
+    _failed = false;
+    _fed = _verified;
+    return _verified;
+}
+
+bool
+PieceVerifier::checkPiece() {
+    auto result = _hash.result().toHex();
+    _hash.reset();
+    if (result != _hashes[_index]) {
+        _failed = true;
+        _pending = 0;
+        return false;
+    }
+
+    _verified += _pending;
+    _pending = 0;
+    _index++;
+    return true;
+}
+
+}  // Daemon
+
+}  // DownloadManager
+
+}  // Ubuntu
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOWNLOADER_LIB_PIECE_VERIFIER_H
+#define DOWNLOADER_LIB_PIECE_VERIFIER_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QIODevice>
+#include <QList>
+
+namespace Ubuntu {
+
+namespace DownloadManager {
+
+namespace Daemon {
+
+// Checks the pieces of a file against the hashes of its metalink as the
+// data is appended to it, so that a bad piece is fetched again as soon as
+// it is completed instead of failing the whole file at the end.
+class PieceVerifier {
+ public:
+    // the hashes are hex encoded in lower case
+    PieceVerifier(qint64 length,
+                  QCryptographicHash::Algorithm algorithm,
+                  const QList<QByteArray>& hashes);
+
+    // false once a piece does not match, the data is ignored from then
+    // on until the verifier is rewound
+    bool addData(const char* data, qint64 size);
+    // checks the last piece, which can be shorter than the rest, and
+    // returns if every piece was seen and matched
+    bool finish();
+    bool hasFailed() const;
+
+    // bytes at the start of the file that belong to good pieces
+    qint64 verifiedSize() const;
+    // bytes that were given to the verifier, good or not
+    qint64 fedSize() const;
+
+    // forgets the data after the good pieces that are in the first size
+    // bytes and returns the size the file has to be cut to
+    qint64 rewind(qint64 size);
+    // starts again from the data already in the file, for files whose
+    // data was not given to the verifier
+    qint64 verify(QIODevice* device, qint64 size);
+
+ private:
+    bool checkPiece();
+
+ private:
+    qint64 _length;
+    QList<QByteArray> _hashes;
+    QCryptographicHash _hash;
+    int _index = 0;
+    qint64 _verified = 0;
+    qint64 _fed = 0;
+    qint64 _pending = 0;  // bytes of the current piece
+    bool _failed = false;
+};
+
+}  // Daemon
+
+}  // DownloadManager
+
+}  // Ubuntu
+
+#endif
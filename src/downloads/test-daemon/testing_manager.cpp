@@ -114,6 +114,23 @@ TestingManager::registerDownload(Download* download) {
     return path;
 }
 
+QList<QDBusObjectPath>
+TestingManager::registerDownloads(QList<Download*> downloads) {
+    QList<Download*> wrapped;
+    foreach(Download* download, downloads) {
+        auto fileDown = qobject_cast<FileDownload*>(download);
+        if (fileDown != nullptr) {
+            auto testDown = new TestingFileDownload(fileDown);
+            auto downAdaptor = new DownloadAdaptor(testDown);
+            Q_UNUSED(downAdaptor);
+            wrapped.append(testDown);
+        } else {
+            wrapped.append(download);
+        }
+    }
+    return DownloadManager::registerDownloads(wrapped);
+}
+
 QDBusObjectPath
 TestingManager::createDownload(DownloadStruct download) {
     if (calledFromDBus() && _returnErrors) {
@@ -123,6 +140,15 @@ TestingManager::createDownload(DownloadStruct download) {
     return DownloadManager::createDownload(download);
 }
 
+QList<QDBusObjectPath>
+TestingManager::createDownloads(DownloadStructList downloads) {
+    if (calledFromDBus() && _returnErrors) {
+        sendErrorReply(QDBusError::InvalidMember,
+        "createDownloads");
+    }
+    return DownloadManager::createDownloads(downloads);
+}
+
 QDBusObjectPath
 TestingManager::createDownloadGroup(StructList downloads,
                                     const QString& algorithm,
@@ -37,6 +37,8 @@ class TestingManager : public DownloadManager {
 
  public slots:  // NOLINT(whitespace/indent)
     QDBusObjectPath createDownload(DownloadStruct download) override;
+    QList<QDBusObjectPath> createDownloads(
+                                DownloadStructList downloads) override;
 
     QDBusObjectPath createDownloadGroup(StructList downloads,
                                         const QString& algorithm,
@@ -64,6 +66,8 @@ class TestingManager : public DownloadManager {
 
  protected:
     QDBusObjectPath registerDownload(Download* download) override;
+    QList<QDBusObjectPath> registerDownloads(
+                                    QList<Download*> downloads) override;
  private:
     bool _returnErrors = false;
 };
@@ -41,6 +41,9 @@ class MockAppArmor : public AppArmor {
         SecurityDetails*(const QString&, const QString&));
     MOCK_METHOD1(appId, QString(QString caller));
     MOCK_METHOD1(isConfined, bool(QString appId));
+    MOCK_METHOD1(resolveSecurityContext, bool(const QString&));
+
+    using AppArmor::securityContextResolved;
 };
 
 }  // Ubuntu
@@ -43,6 +43,7 @@ class MockDBusConnection : public DBusConnection {
         bool(const QString&, QObject*, QDBusConnection::RegisterOptions));
     MOCK_METHOD2(unregisterObject,
         void(const QString&, QDBusConnection::UnregisterMode));
+    MOCK_CONST_METHOD1(send, bool(const QDBusMessage&));
 };
 
 }  // Ubuntu
@@ -34,7 +34,32 @@ namespace Tests {
 class MockFile : public File {
  public:
     explicit MockFile(const QString& name)
-        : File(name) {}
+        : File(name) {
+        // most of the tests do not care about the space of the disk
+        ON_CALL(*this, reserve(::testing::_))
+            .WillByDefault(::testing::Return(true));
+        // let the tests set the expectations on the QByteArray version
+        ON_CALL(*this, writev(::testing::_, ::testing::_))
+            .WillByDefault(::testing::Invoke(this, &MockFile::writeAll));
+        ON_CALL(*this, writevAt(::testing::_, ::testing::_, ::testing::_))
+            .WillByDefault(::testing::Invoke(this, &MockFile::writeAllAt));
+    }
+
+    qint64 writeAllAt(const struct iovec* iov, int count, qint64 offset) {
+        if (!seek(offset)) {
+            return -1;
+        }
+        return writeAll(iov, count);
+    }
+
+    qint64 writeAll(const struct iovec* iov, int count) {
+        QByteArray data;
+        for (int index = 0; index < count; index++) {
+            data.append(static_cast<const char*>(iov[index].iov_base),
+                iov[index].iov_len);
+        }
+        return write(data);
+    }
 
     MOCK_METHOD0(close, void());
     MOCK_CONST_METHOD0(error, QFile::FileError());
@@ -45,18 +70,35 @@ class MockFile : public File {
     MOCK_METHOD0(remove, bool());
     MOCK_METHOD1(isDir, bool(const QString&));
     MOCK_METHOD0(reset, bool());
+    MOCK_METHOD1(resize, bool(qint64));
+    MOCK_METHOD1(reserve, bool(qint64));
+    MOCK_METHOD1(seek, bool(qint64));
     MOCK_CONST_METHOD0(size, qint64());
+    MOCK_METHOD0(sync, bool());
     MOCK_METHOD1(write, qint64(const QByteArray&));
+    MOCK_METHOD2(writev, qint64(const struct iovec*, int));
+    MOCK_METHOD3(writevAt, qint64(const struct iovec*, int, qint64));
     MOCK_METHOD0(device, QIODevice*());
+    MOCK_METHOD3(writeBack, void(qint64, qint64, bool));
+    MOCK_METHOD2(dropPages, void(qint64, qint64));
 };
 
 class MockFileManager : public FileManager {
  public:
     explicit MockFileManager(QObject *parent = 0)
-        : FileManager(parent) {}
+        : FileManager(parent) {
+        // use named files so that the tests can inject them
+        ON_CALL(*this, createAnonymousFile(::testing::_))
+            .WillByDefault(::testing::Return(nullptr));
+        // the free space is unknown unless a test sets it
+        ON_CALL(*this, freeSpace(::testing::_, ::testing::_, ::testing::_))
+            .WillByDefault(::testing::Return(false));
+    }
 
     MOCK_METHOD1(createFile, File*(const QString&));
+    MOCK_METHOD1(createAnonymousFile, File*(const QString&));
     MOCK_METHOD1(remove, bool(const QString&));
+    MOCK_METHOD3(freeSpace, bool(const QString&, qint64&, qulonglong&));
 };
 
 }  // Ubuntu
@@ -19,6 +19,8 @@
 #ifndef MATCHERS_H
 #define MATCHERS_H
 
+#include <QDBusMessage>
+#include <QDBusObjectPath>
 #include <QMap>
 #include <QNetworkRequest>
 #include <QPair>
@@ -135,5 +137,22 @@ MATCHER_P(QStringEndsWith, value, "Returns if the string has the given postfix."
     return str.endsWith(post);
 }
 
+MATCHER_P(DBusReplyWithPath, value, "Returns if the message is a reply with the given path.") {
+    auto msg = static_cast<QDBusMessage>(arg);
+    auto path = static_cast<QString>(value);
+    if (msg.type() != QDBusMessage::ReplyMessage
+            || msg.arguments().count() != 1) {
+        return false;
+    }
+    return msg.arguments()[0].value<QDBusObjectPath>().path() == path;
+}
+
+MATCHER_P(DBusErrorReplyEq, value, "Returns if the message is an error reply with the given error.") {
+    auto msg = static_cast<QDBusMessage>(arg);
+    auto errorName = static_cast<QString>(value);
+    return msg.type() == QDBusMessage::ErrorMessage
+        && msg.errorName() == errorName;
+}
+
 #endif
 
@@ -19,6 +19,7 @@
 #ifndef FAKE_REPLY_H
 #define FAKE_REPLY_H
 
+#include <cstring>
 #include <ubuntu/transfers/system/network_reply.h>
 #include <gmock/gmock.h>
 
@@ -33,11 +34,39 @@ namespace Tests {
 class MockNetworkReply : public NetworkReply {
  public:
     explicit MockNetworkReply(QObject *parent = 0)
-        : NetworkReply(nullptr, parent) {}
+        : NetworkReply(nullptr, parent) {
+        // let the tests set the expectations on readAll, the data it
+        // returns is handed out in as many reads as needed
+        ON_CALL(*this, read(::testing::_, ::testing::_))
+            .WillByDefault(::testing::Invoke(this,
+                &MockNetworkReply::readFromAll));
+    }
+
+    qint64 readFromAll(char* data, qint64 maxSize) {
+        if (!_reading) {
+            _pending = readAll();
+            _offset = 0;
+            _reading = true;
+        }
+
+        auto size = qMin(maxSize,
+            static_cast<qint64>(_pending.size()) - _offset);
+        memcpy(data, _pending.constData() + _offset, size);
+        _offset += size;
+        if (size < maxSize) {
+            // the caller stops reading, next time readAll is used again
+            _reading = false;
+            _pending.clear();
+        }
+        return size;
+    }
 
     MOCK_METHOD0(readAll, QByteArray());
+    MOCK_METHOD2(read, qint64(char*, qint64));
     MOCK_METHOD0(abort, void());
-    MOCK_METHOD1(setReadBufferSize, void(uint size));
+    MOCK_METHOD1(setReadBufferSize, void(qint64 size));
+    MOCK_METHOD2(setThrottle, void(qulonglong speed, qulonglong burst));
+    MOCK_METHOD0(transferRate, qulonglong());
     MOCK_METHOD1(setAcceptedCertificates,
         void(const QList<QSslCertificate>&));
     MOCK_METHOD1(canIgnoreSslErrors, bool(const QList<QSslError>&));
@@ -52,6 +81,11 @@ class MockNetworkReply : public NetworkReply {
     using NetworkReply::error;
     using NetworkReply::finished;
     using NetworkReply::sslErrors;
+
+ private:
+    bool _reading = false;
+    qint64 _offset = 0;
+    QByteArray _pending;
 };
 
 }  // Tests
@@ -37,9 +37,14 @@ namespace Tests {
 class MockRequestFactory : public RequestFactory {
  public:
     explicit MockRequestFactory(QObject* parent = 0)
-        : RequestFactory(parent) {}
+        : RequestFactory(parent) {
+        // skip the probe of the downloads unless a test wants it
+        ON_CALL(*this, head(::testing::_))
+            .WillByDefault(::testing::Return(nullptr));
+    }
 
     MOCK_METHOD1(get, NetworkReply*(const QNetworkRequest&));
+    MOCK_METHOD1(head, NetworkReply*(const QNetworkRequest&));
     MOCK_METHOD2(post, NetworkReply*(const QNetworkRequest&, File*));
     MOCK_METHOD0(acceptedCertificates, QList<QSslCertificate>());
     MOCK_METHOD1(setAcceptedCertificates,
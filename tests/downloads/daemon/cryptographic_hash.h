@@ -33,8 +33,20 @@ namespace Tests {
 class MockCryptographicHash : public CryptographicHash {
  public:
     explicit MockCryptographicHash(QObject* parent = 0)
-        : CryptographicHash(QCryptographicHash::Md5, parent) {}
+        : CryptographicHash(QCryptographicHash::Md5, parent) {
+        // let the tests set the expectations on the QByteArray version
+        ON_CALL(*this, addBytes(::testing::_, ::testing::_))
+            .WillByDefault(::testing::Invoke(this,
+                &MockCryptographicHash::addRawBytes));
+    }
+
+    void addRawBytes(const char* data, int length) {
+        addBytes(QByteArray(data, length));
+    }
+
     MOCK_METHOD1(addData, bool(QIODevice*));
+    MOCK_METHOD1(addBytes, void(const QByteArray&));
+    MOCK_METHOD2(addBytes, void(const char*, int));
     MOCK_CONST_METHOD0(result, QByteArray());
 };
 
@@ -26,6 +26,7 @@ class MockDatabase : public DownloadsDb {
     explicit MockDatabase(QObject* parent = 0)
         : DownloadsDb(parent) {}
     MOCK_METHOD1(store, bool(Download*));
+    MOCK_METHOD1(storeAll, bool(const QList<Download*>&));
 };
 
 #endif
@@ -49,6 +49,9 @@ class MockDownloadManager : public DownloadManager {
         QList<QSslCertificate>());
     MOCK_METHOD1(setAcceptedCertificates,
         void(const QList<QSslCertificate>&));
+    MOCK_METHOD0(isCalledFromDBus, bool());
+    MOCK_METHOD0(callMessage, QDBusMessage());
+    MOCK_METHOD0(delayReply, void());
 
     using DownloadManager::sizeChanged;
 };
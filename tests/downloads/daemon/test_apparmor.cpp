@@ -110,6 +110,51 @@ TestAppArmor::testAppId() {
     QVERIFY(Mock::VerifyAndClearExpectations(_dbusProxyFactory));
 }
 
+void
+TestAppArmor::testAppIdErrorNotCached() {
+    QString caller = "my app";
+    auto dbusProxy = new MockDBusProxy();
+    auto conn = new MockDBusConnection();
+    auto firstReply = new MockPendingReply<QString>();
+    auto secondReply = new MockPendingReply<QString>();
+
+    EXPECT_CALL(*_dbusProxyFactory, createDBusProxy(conn, _))
+        .Times(1)
+        .WillOnce(Return(dbusProxy));
+
+    // a failed lookup must be performed again the next time
+    EXPECT_CALL(*dbusProxy, GetConnectionAppArmorSecurityContext(caller))
+        .Times(2)
+        .WillOnce(Return(firstReply))
+        .WillOnce(Return(secondReply));
+
+    EXPECT_CALL(*firstReply, waitForFinished())
+        .Times(1);
+
+    EXPECT_CALL(*firstReply, isError())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*secondReply, waitForFinished())
+        .Times(1);
+
+    EXPECT_CALL(*secondReply, isError())
+        .Times(1)
+        .WillOnce(Return(false));
+
+    EXPECT_CALL(*secondReply, value())
+        .Times(1)
+        .WillOnce(Return(QString("APPID")));
+
+    QScopedPointer<AppArmor> appArmor(new AppArmor(conn));
+
+    QCOMPARE(QString(), appArmor->appId(caller));
+    QCOMPARE(QString("APPID"), appArmor->appId(caller));
+
+    QVERIFY(Mock::VerifyAndClearExpectations(dbusProxy));
+    QVERIFY(Mock::VerifyAndClearExpectations(_dbusProxyFactory));
+}
+
 void
 TestAppArmor::testIsConfinedEmptyString() {
     QString caller = "";
@@ -40,6 +40,7 @@ public:
 
     void testAppIdError();
     void testAppId();
+    void testAppIdErrorNotCached();
     void testIsConfinedEmptyString();
     void testIsConfinedUnconfinedString();
     void testIsConfinedAppIdString();
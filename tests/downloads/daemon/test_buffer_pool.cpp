@@ -0,0 +1,114 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <ubuntu/transfers/system/buffer_pool.h>
+#include "test_buffer_pool.h"
+
+using namespace Ubuntu::Transfers::System;
+
+void
+TestBufferPool::cleanup() {
+    BaseTestCase::cleanup();
+    BufferPool::deleteInstance();
+}
+
+void
+TestBufferPool::testReuseReleased() {
+    auto pool = BufferPool::instance();
+    auto buffer = pool->acquire();
+    pool->release(buffer);
+    QCOMPARE(pool->freeCount(), 1);
+
+    // the released buffer is handed out again
+    QCOMPARE(pool->acquire(), buffer);
+    QCOMPARE(pool->freeCount(), 0);
+    pool->release(buffer);
+}
+
+void
+TestBufferPool::testAcquireWhenEmpty() {
+    auto pool = BufferPool::instance();
+    auto first = pool->acquire();
+    auto second = pool->acquire();
+    QVERIFY(first != nullptr);
+    QVERIFY(second != nullptr);
+    QVERIFY(first != second);
+
+    pool->release(first);
+    pool->release(second);
+    QCOMPARE(pool->freeCount(), 2);
+}
+
+void
+TestBufferPool::testMaxFreeBuffers() {
+    auto pool = BufferPool::instance();
+    QList<char*> buffers;
+    for (int index = 0; index < BufferPool::MAX_FREE_BUFFERS + 5; index++) {
+        buffers.append(pool->acquire());
+    }
+
+    foreach(char* buffer, buffers) {
+        pool->release(buffer);
+    }
+    QCOMPARE(pool->freeCount(), static_cast<int>(BufferPool::MAX_FREE_BUFFERS));
+}
+
+void
+TestBufferPool::testBudgetExhausted() {
+    auto pool = BufferPool::instance();
+    pool->setBudget(4 * BufferPool::BUFFER_SIZE);
+    SignalBarrier spy(pool, SIGNAL(available()));
+
+    QList<char*> buffers;
+    for (int index = 0; index < 4; index++) {
+        buffers.append(pool->acquire());
+    }
+    QCOMPARE(pool->usedCount(), 4);
+    QVERIFY(pool->acquire() == nullptr);
+
+    // readers are only woken up once half of the budget is free
+    pool->release(buffers.takeFirst());
+    QCOMPARE(spy.count(), 0);
+    pool->release(buffers.takeFirst());
+    QCOMPARE(spy.count(), 1);
+
+    buffers.append(pool->acquire());
+    QVERIFY(buffers.last() != nullptr);
+    foreach(char* buffer, buffers) {
+        pool->release(buffer);
+    }
+}
+
+void
+TestBufferPool::testBudgetIncreased() {
+    auto pool = BufferPool::instance();
+    pool->setBudget(BufferPool::BUFFER_SIZE);
+    SignalBarrier spy(pool, SIGNAL(available()));
+
+    auto buffer = pool->acquire();
+    QVERIFY(pool->acquire() == nullptr);
+
+    pool->setBudget(2 * BufferPool::BUFFER_SIZE);
+    QCOMPARE(spy.count(), 1);
+    auto other = pool->acquire();
+    QVERIFY(other != nullptr);
+    pool->release(buffer);
+    pool->release(other);
+}
+
+QTEST_MAIN(TestBufferPool)
@@ -16,17 +16,22 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <QCryptographicHash>
 #include <QDir>
+#include <QFileInfo>
 #include <QNetworkRequest>
 #include <QSslError>
 #include <ubuntu/download_manager/metatypes.h>
 #include <ubuntu/transfers/metadata.h>
+#include <ubuntu/transfers/system/buffer_pool.h>
+#include <ubuntu/transfers/system/file_writer.h>
 #include <ubuntu/transfers/system/hash_algorithm.h>
 #include <ubuntu/transfers/system/uuid_utils.h>
 #include <network_reply.h>
 #include "filename_mutex.h"
 #include "matchers.h"
 #include "process.h"
+#include "timer.h"
 #include "test_download.h"
 
 using ::testing::_;
@@ -34,6 +39,9 @@ using ::testing::Mock;
 using ::testing::AnyNumber;
 using ::testing::Return;
 using ::testing::AnyOf;
+using ::testing::Invoke;
+using ::testing::DoAll;
+using ::testing::SetArgReferee;
 
 using namespace Ubuntu::Transfers::Tests;
 using namespace Ubuntu::Transfers::System;
@@ -293,7 +301,7 @@ TestDownload::testProgress() {
         .Times(1)
         .WillOnce(Return(fileData));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
     // file system expectations
@@ -381,7 +389,7 @@ TestDownload::testProgressNotKnownSize() {
         .Times(1)
         .WillOnce(Return(fileData));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
     // file system expectations
@@ -456,7 +464,7 @@ TestDownload::testTotalSize() {
         .WillOnce(Return(QByteArray()))
         .WillOnce(Return(QByteArray()));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
     // file system expectations
@@ -486,8 +494,11 @@ TestDownload::testTotalSize() {
     EXPECT_CALL(*file, close())
         .Times(1);
 
+    // do not rate limit the progress signals
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::PROGRESS_INTERVAL_KEY] = 0;
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
+        _isConfined, _rootPath, _url, metadata, _headers);
     SignalBarrier spy(download,
         SIGNAL(progress(qulonglong, qulonglong)));
 
@@ -511,6 +522,157 @@ TestDownload::testTotalSize() {
     verifyMocks();
 }
 
+void
+TestDownload::testProgressRateLimited() {
+    qulonglong received = 30ULL;
+    qulonglong total = 200ULL;
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // set expectations to get the request and the reply correctly
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    EXPECT_CALL(*reply, readAll())
+        .Times(2)
+        .WillOnce(Return(QByteArray()))
+        .WillOnce(Return(QByteArray()));
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, write(_))
+        .Times(2)
+        .WillOnce(Return(0))
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, flush())
+        .Times(2)
+        .WillOnce(Return(true))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, size())
+        .Times(2)
+        .WillOnce(Return(0))
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::PROGRESS_INTERVAL_KEY] = 60000;
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+    SignalBarrier spy(download,
+        SIGNAL(progress(qulonglong, qulonglong)));
+
+    // start the download so that we do have access to the reply
+    download->start();  // change state
+    download->startTransfer();
+
+    // the second update arrives within the interval and is dropped
+    emit reply->downloadProgress(received, total);
+    emit reply->downloadProgress(received, 2*total);
+
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(spy.count(), 1);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    verifyMocks();
+}
+
+void
+TestDownload::testProgressOptOut() {
+    qulonglong received = 30ULL;
+    qulonglong total = 200ULL;
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // set expectations to get the request and the reply correctly
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    EXPECT_CALL(*reply, readAll())
+        .Times(2)
+        .WillOnce(Return(QByteArray()))
+        .WillOnce(Return(QByteArray()));
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, write(_))
+        .Times(2)
+        .WillOnce(Return(0))
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, flush())
+        .Times(2)
+        .WillOnce(Return(true))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, size())
+        .Times(2)
+        .WillOnce(Return(0))
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::PROGRESS_INTERVAL_KEY] = -1;
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+    SignalBarrier spy(download,
+        SIGNAL(progress(qulonglong, qulonglong)));
+
+    // start the download so that we do have access to the reply
+    download->start();  // change state
+    download->startTransfer();
+
+    // the client follows the progress batches of the manager
+    emit reply->downloadProgress(received, total);
+    emit reply->downloadProgress(received, 2*total);
+
+    QCOMPARE(spy.count(), 0);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    verifyMocks();
+}
+
 void
 TestDownload::testTotalSizeNoProgress() {
     EXPECT_CALL(*_networkSession, isOnline())
@@ -571,10 +733,10 @@ TestDownload::testSetThrottle() {
         .Times(1)
         .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply, setReadBufferSize(0))
+    EXPECT_CALL(*reply, setThrottle(0, _))
         .Times(1);
 
-    EXPECT_CALL(*reply, setReadBufferSize(speed))
+    EXPECT_CALL(*reply, setThrottle(speed, _))
         .Times(1);
 
     // file system expectations
@@ -821,7 +983,7 @@ TestDownload::testCancelDownload() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
     EXPECT_CALL(*reply.data(), abort())
@@ -901,7 +1063,7 @@ TestDownload::testPauseDownload() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
     EXPECT_CALL(*reply, readAll())
@@ -992,7 +1154,7 @@ TestDownload::testResumeRunning() {
         .Times(1)
         .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
     // file system expectations
@@ -1052,10 +1214,10 @@ TestDownload::testResumeDownload() {
         .WillOnce(Return(firstReply))
         .WillOnce(Return(secondReply));
 
-    EXPECT_CALL(*firstReply, setReadBufferSize(_))
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*secondReply, setReadBufferSize(_))
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
         .Times(1);
 
     EXPECT_CALL(*firstReply, readAll())
@@ -1146,7 +1308,7 @@ TestDownload::testStartDownload() {
         .Times(1)
         .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
     // file system expectations
@@ -1199,7 +1361,7 @@ TestDownload::testStartDownloadAlreadyStarted() {
         .Times(1)
         .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
     // file system expectations
@@ -1256,7 +1418,7 @@ TestDownload::testOnSuccessNoHash() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
     EXPECT_CALL(*reply.data(), attribute(_))
@@ -1315,13 +1477,16 @@ TestDownload::testOnSuccessNoHash() {
 }
 
 void
-TestDownload::testOnSuccessHashError() {
-    QScopedPointer<MockFile> file(new MockFile("test"));
+TestDownload::testOnSuccessWaitsForBuffers() {
+    // more than the budget of the pool, the data is written in rounds
+    QByteArray fileData(2 * BufferPool::BUFFER_SIZE + 100, 'b');
+    QByteArray written;
+    auto file = new MockFile("test");
     QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
-    auto hash = new MockCryptographicHash();
 
-    // write the expectations of the reply which is what we are
-    // really testing
+    auto pool = BufferPool::instance();
+    pool->setBudget(BufferPool::BUFFER_SIZE);
+    auto held = pool->acquire();
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
@@ -1330,94 +1495,85 @@ TestDownload::testOnSuccessHashError() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
+    EXPECT_CALL(*reply.data(), readAll())
+        .Times(1)
+        .WillOnce(Return(fileData));
+
     EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
         .WillOnce(Return(QVariant(200)));
 
     EXPECT_CALL(*reply.data(), hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
+        .WillRepeatedly(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file.data()));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file.data(), reset())
-        .Times(1);
-
-    EXPECT_CALL(*file.data(), remove())
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*file, write(_))
+        .WillRepeatedly(Invoke([&written](const QByteArray& data) {
+            written.append(data);
+            return static_cast<qint64>(data.size());
+        }));
 
-    EXPECT_CALL(*file.data(), device())
-        .Times(1)
-        .WillOnce(Return(nullptr));
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Invoke([&written]() {
+            return static_cast<qint64>(written.size());
+        }));
 
     EXPECT_CALL(*file, flush())
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-        .Times(1)
-        .WillOnce(Return(hash));
+    EXPECT_CALL(*file, remove())
+        .Times(0);
 
-    EXPECT_CALL(*hash, addData(_))
+    EXPECT_CALL(*file, close())
         .Times(1);
 
-    EXPECT_CALL(*hash, result())
-        .Times(1)
-        .WillOnce(Return(QByteArray()));
-
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, "imposible-hash-is-not-hex",
-        _algo, _metadata, _headers);
-
-    SignalBarrier hashSpy(download, SIGNAL(hashError(HashErrorStruct)));
-    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
+    // the pool is exhausted, nothing is read and the download must not
+    // be completed when the reply finishes
+    emit reply->downloadProgress(fileData.size(), fileData.size());
     emit reply->finished();
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(written.size(), 0);
 
-    // the has is a random string so we should get an error signal
-
-    QVERIFY(hashSpy.ensureSignalEmitted());
-    QVERIFY(errorSpy.ensureSignalEmitted());
-    QTRY_COMPARE(errorSpy.count(), 1);
-    QTRY_COMPARE(processingSpy.count(), 1);
-    QCOMPARE(download->state(), Download::ERROR);
+    pool->release(held);
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(written.size(), fileData.size());
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
 
     delete download;
+    pool->setBudget(BufferPool::DEFAULT_BUDGET);
 
-    QVERIFY(Mock::VerifyAndClearExpectations(hash));
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
     QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testOnSuccessHash() {
-    auto file = new MockFile("test");
+TestDownload::testPublishNameTaken() {
+    QByteArray fileData(100, 'd');
     QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
-    QByteArray hashData(100, 'f');
-    auto hashString = QString(hashData.toHex());
-    auto hash = new MockCryptographicHash();
-
-    // write the expectations of the reply which is what we are
-    // really testing
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
@@ -1426,103 +1582,78 @@ TestDownload::testOnSuccessHash() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
+    EXPECT_CALL(*reply.data(), readAll())
+        .Times(1)
+        .WillOnce(Return(fileData));
+
     EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
         .WillOnce(Return(QVariant(200)));
 
     EXPECT_CALL(*reply.data(), hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
+        .WillRepeatedly(Return(false));
 
-    // file system expectations
-    EXPECT_CALL(*_fileManager, createFile(_))
+    // the data is published with a link from a real anonymous file
+    EXPECT_CALL(*_fileManager, createAnonymousFile(_))
         .Times(1)
-        .WillOnce(Return(file));
+        .WillOnce(Invoke([this](const QString& dir) {
+            return _fileManager->FileManager::createAnonymousFile(dir);
+        }));
 
-    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(0);
 
-    EXPECT_CALL(*file, reset())
-        .Times(1);
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
 
-    EXPECT_CALL(*file, flush())
-        .Times(1)
-        .WillOnce(Return(true));
+    download->start();  // change state
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
 
-    EXPECT_CALL(*file, remove())
-        .Times(0);
+    // another process creates a file with the name of the download
+    auto taken = download->filePath();
+    QFile other(taken);
+    QVERIFY(other.open(QIODevice::WriteOnly));
+    other.write("other");
+    other.close();
 
-    EXPECT_CALL(*file, close())
-        .Times(1);
+    emit reply->downloadProgress(fileData.size(), fileData.size());
+    emit reply->finished();
 
-    EXPECT_CALL(*file, device())
-        .Times(1)
-        .WillOnce(Return(nullptr));
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-        .Times(1)
-        .WillOnce(Return(hash));
+    auto published = spy.takeFirst().at(0).toString();
+    QVERIFY(published != taken);
+    QCOMPARE(download->filePath(), published);
 
-    EXPECT_CALL(*hash, addData(_))
-        .Times(1);
+    QVERIFY(other.open(QIODevice::ReadOnly));
+    QCOMPARE(other.readAll(), QByteArray("other"));
 
-    EXPECT_CALL(*hash, result())
-        .Times(1)
-        .WillOnce(Return(hashData));
-
-    auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, hashString, _algo, _metadata,
-        _headers);
-    SignalBarrier spy(download, SIGNAL(finished(QString)));
-    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
-
-    download->start();  // change state
-    download->startTransfer();
-    QVERIFY(startedSpy.ensureSignalEmitted());
-
-    emit reply->finished();
-
-    // the hash should be correct and we should get the finish signal
-    QVERIFY(spy.ensureSignalEmitted());
-    QTRY_COMPARE(spy.count(), 1);
-    QTRY_COMPARE(processingSpy.count(), 1);
-    QCOMPARE(download->state(), Download::UNCOLLECTED);
+    QFile data(published);
+    QVERIFY(data.open(QIODevice::ReadOnly));
+    QCOMPARE(data.readAll(), fileData);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(hash));
-    QVERIFY(Mock::VerifyAndClearExpectations(file));
     QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testOnHttpError_data() {
-    QTest::addColumn<int>("code");
-    QTest::addColumn<QString>("message");
-
-    QTest::newRow("Not Found") << 404 << "Not Found";
-    QTest::newRow("Method Not Allowed") << 405 << "Method Not Allowed";
-    QTest::newRow("Not Acceptable") << 406 << "Not Acceptable";
-    QTest::newRow("Request Timeout") << 408 << "Request Timeout";
-}
-
-void
-TestDownload::testOnHttpError() {
-    QFETCH(int, code);
-    QFETCH(QString, message);
-    QScopedPointer<MockFile> file(new MockFile("test"));
+TestDownload::testPublishLinkError() {
+    // the destination dir is removed before the data is published
+    auto path = testDirectory() + QDir::separator() + "removed";
+    QDir().mkpath(path);
+    QByteArray fileData(100, 'd');
     QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
 
-    // write the expectations of the reply which is what we are
-    // really testing
-
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
@@ -1530,64 +1661,61 @@ TestDownload::testOnHttpError() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply.data(),
-             attribute(QNetworkRequest::HttpStatusCodeAttribute))
-        .Times(1)
-        .WillOnce(Return(QVariant(code)));
-
-    EXPECT_CALL(*reply.data(),
-             attribute(QNetworkRequest::HttpReasonPhraseAttribute))
+    EXPECT_CALL(*reply.data(), readAll())
         .Times(1)
-        .WillOnce(Return(QVariant(message)));
+        .WillOnce(Return(fileData));
 
-    // file system expectations
-    EXPECT_CALL(*_fileManager, createFile(_))
+    EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
-        .WillOnce(Return(file.data()));
+        .WillOnce(Return(QVariant(200)));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-    EXPECT_CALL(*file.data(), remove())
+    EXPECT_CALL(*_fileManager, createAnonymousFile(_))
         .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Invoke([this](const QString& dir) {
+            return _fileManager->FileManager::createAnonymousFile(dir);
+        }));
 
     auto download = new FileDownload(_id, _appId, _path,
         _isConfined, _rootPath, _url, _metadata, _headers);
+    download->setDestinationDir(path);
+    SignalBarrier finishedSpy(download, SIGNAL(finished(QString)));
     SignalBarrier errorSpy(download, SIGNAL(error(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier httpErrorSpy(download, SIGNAL(httpError(HttpErrorStruct)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the error and ensure that the signals are raised
-    reply->error(QNetworkReply::ContentAccessDenied);
+    // the anonymous file is not an entry of the dir, it can be removed
+    QVERIFY(QDir(path).removeRecursively());
+
+    emit reply->downloadProgress(fileData.size(), fileData.size());
+    emit reply->finished();
 
     QVERIFY(errorSpy.ensureSignalEmitted());
-    QCOMPARE(httpErrorSpy.count(), 1);
-    QCOMPARE(errorSpy.count(), 1);
+    QTRY_COMPARE(errorSpy.count(), 1);
+    QCOMPARE(finishedSpy.count(), 0);
+    QCOMPARE(download->state(), Download::ERROR);
+    QVERIFY(errorSpy.takeFirst().at(0).toString()
+        .startsWith("FILE SYSTEM ERROR"));
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
     QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testOnSslError() {
-    QScopedPointer<MockFile> file(new MockFile("test"));
+TestDownload::testResumableDataIsNamed() {
+    QByteArray fileData(100, 'd');
     QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
 
-    // write the expectations of the reply which is what we are
-    // really testing
-
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
@@ -1595,63 +1723,74 @@ TestDownload::testOnSslError() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply.data(), canIgnoreSslErrors(_))
+    EXPECT_CALL(*reply.data(), readAll())
         .Times(1)
-        .WillOnce(Return(false));
+        .WillOnce(Return(fileData));
 
-    // file system expectations
-    EXPECT_CALL(*_fileManager, createFile(_))
-        .Times(1)
-        .WillOnce(Return(file.data()));
+    EXPECT_CALL(*reply.data(), attribute(_))
+        .WillRepeatedly(Return(QVariant(200)));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    EXPECT_CALL(*reply.data(), hasRawHeader(QByteArray("Accept-Ranges")))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*reply.data(), rawHeader(QByteArray("Accept-Ranges")))
+        .WillRepeatedly(Return(QByteArray("bytes")));
+
+    EXPECT_CALL(*_fileManager, createAnonymousFile(_))
         .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Invoke([this](const QString& dir) {
+            return _fileManager->FileManager::createAnonymousFile(dir);
+        }));
 
-    EXPECT_CALL(*file.data(), remove())
+    // the temp name is dropped once the data is published
+    EXPECT_CALL(*_fileManager, remove(_))
         .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Invoke([this](const QString& path) {
+            return _fileManager->FileManager::remove(path);
+        }));
+
     auto download = new FileDownload(_id, _appId, _path,
         _isConfined, _rootPath, _url, _metadata, _headers);
-
-    SignalBarrier spy(download, SIGNAL(error(QString)));
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    QList<QSslError> errors;
-    emit reply->sslErrors(errors);
+    // the server lets us resume, the data survives the daemon
+    auto tempPath = download->filePath() + ".tmp";
+    QVERIFY(!QFile::exists(tempPath));
+    emit reply->downloadProgress(fileData.size(), fileData.size());
+    QVERIFY(QFile::exists(tempPath));
+
+    emit reply->finished();
+
     QVERIFY(spy.ensureSignalEmitted());
-    QTRY_COMPARE(spy.count(), 1);;
+    QTRY_COMPARE(spy.count(), 1);
+    QVERIFY(!QFile::exists(tempPath));
+
+    QFile data(download->filePath());
+    QVERIFY(data.open(QIODevice::ReadOnly));
+    QCOMPARE(data.readAll(), fileData);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
     QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testOnNetworkError_data() {
-    QTest::addColumn<int>("code");
-
-    QTest::newRow("Connection Refused Error") << 1;
-    QTest::newRow("RemoteHost Closed Error") << 2;
-    QTest::newRow("Host Not Found Error") << 3;
-    QTest::newRow("Timeout Error") << 4;
-    QTest::newRow("Operation Canceled Error") << 4;
-}
-
-void
-TestDownload::testOnNetworkError() {
-    QFETCH(int, code);
+TestDownload::testOnSuccessHashError() {
     QScopedPointer<MockFile> file(new MockFile("test"));
     QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+    auto hash = new MockCryptographicHash();
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -1663,17 +1802,17 @@ TestDownload::testOnNetworkError() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
     EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
-        .WillOnce(Return(QVariant()));  // invalid variant
-
-    EXPECT_CALL(*reply.data(), errorString())
-        .Times(1)
-        .WillOnce(Return(QString("error")));  // invalid variant
+        .WillOnce(Return(QVariant(200)));
 
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
@@ -1684,38 +1823,70 @@ TestDownload::testOnNetworkError() {
         .Times(1)
         .WillOnce(Return(true));
 
+    EXPECT_CALL(*file.data(), reset())
+        .Times(1);
+
     EXPECT_CALL(*file.data(), remove())
         .Times(1)
         .WillOnce(Return(true));
 
+    EXPECT_CALL(*file.data(), device())
+        .Times(1)
+        .WillOnce(Return(nullptr));
+
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(1)
+        .WillOnce(Return(hash));
+
+    EXPECT_CALL(*hash, addData(_))
+        .Times(1);
+
+    EXPECT_CALL(*hash, result())
+        .Times(1)
+        .WillOnce(Return(QByteArray()));
+
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
+        _isConfined, _rootPath, _url, "imposible-hash-is-not-hex",
+        _algo, _metadata, _headers);
+
+    SignalBarrier hashSpy(download, SIGNAL(hashError(HashErrorStruct)));
     SignalBarrier errorSpy(download, SIGNAL(error(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier networkErrorSpy(download,
-        SIGNAL(networkError(NetworkErrorStruct)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the error and ensure that the signals are raised
-    reply->error((QNetworkReply::NetworkError)code);
+    emit reply->finished();
+
+    // the has is a random string so we should get an error signal
+
+    QVERIFY(hashSpy.ensureSignalEmitted());
     QVERIFY(errorSpy.ensureSignalEmitted());
-    QCOMPARE(networkErrorSpy.count(), 1);
-    QCOMPARE(errorSpy.count(), 1);
+    QTRY_COMPARE(errorSpy.count(), 1);
+    QTRY_COMPARE(processingSpy.count(), 1);
+    QCOMPARE(download->state(), Download::ERROR);
 
     delete download;
 
+    QVERIFY(Mock::VerifyAndClearExpectations(hash));
     QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
     QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testOnAuthError() {
-    QScopedPointer<MockFile> file(new MockFile("test"));
+TestDownload::testOnSuccessHash() {
+    auto file = new MockFile("test");
     QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+    QByteArray hashData(100, 'f');
+    auto hashString = QString(hashData.toHex());
+    auto hash = new MockCryptographicHash();
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -1727,68 +1898,90 @@ TestDownload::testOnAuthError() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
     EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
-        .WillOnce(Return(QVariant()));  // invalid variant
-
-    EXPECT_CALL(*reply.data(), errorString())
-        .Times(1)
-        .WillOnce(Return(QString("error")));  // invalid variant
+        .WillOnce(Return(QVariant(200)));
 
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file.data()));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file.data(), remove())
+    EXPECT_CALL(*file, reset())
+        .Times(1);
+
+    EXPECT_CALL(*file, flush())
         .Times(1)
         .WillOnce(Return(true));
-    auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
 
-    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
+    EXPECT_CALL(*file, remove())
+        .Times(0);
+
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    EXPECT_CALL(*file, device())
+        .Times(1)
+        .WillOnce(Return(nullptr));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(1)
+        .WillOnce(Return(hash));
+
+    EXPECT_CALL(*hash, addData(_))
+        .Times(1);
+
+    EXPECT_CALL(*hash, result())
+        .Times(1)
+        .WillOnce(Return(hashData));
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, hashString, _algo, _metadata,
+        _headers);
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier authErrorSpy(download,
-        SIGNAL(authError(AuthErrorStruct)));
-    SignalBarrier networkErrorSpy(download,
-        SIGNAL(networkError(NetworkErrorStruct)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the error and ensure that the signals are raised
-    reply->error(QNetworkReply::AuthenticationRequiredError);
+    emit reply->finished();
 
-    QVERIFY(errorSpy.ensureSignalEmitted());
-    QCOMPARE(networkErrorSpy.count(), 0);
-    QCOMPARE(authErrorSpy.count(), 1);
-    auto error = authErrorSpy.takeFirst().at(0).value<AuthErrorStruct>();
-    QVERIFY(error.getType() == AuthErrorStruct::Server);
-    QCOMPARE(errorSpy.count(), 1);
+    // the hash should be correct and we should get the finish signal
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE(spy.count(), 1);
+    QTRY_COMPARE(processingSpy.count(), 1);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(hash));
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
     QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testOnProxyAuthError() {
-    QScopedPointer<MockFile> file(new MockFile("test"));
+TestDownload::testOnSuccessIncrementalHash() {
+    auto file = new MockFile("test");
     QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
-
-    // write the expectations of the reply which is what we are
-    // really testing
+    QByteArray fileData(100, 'a');
+    QByteArray hashData(100, 'f');
+    auto hashString = QString(hashData.toHex());
+    auto hash = new MockCryptographicHash();
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
@@ -1797,102 +1990,124 @@ TestDownload::testOnProxyAuthError() {
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply.data(), attribute(_))
+    EXPECT_CALL(*reply.data(), readAll())
         .Times(1)
-        .WillOnce(Return(QVariant()));  // invalid variant
+        .WillOnce(Return(fileData));
 
-    EXPECT_CALL(*reply.data(), errorString())
+    EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
-        .WillOnce(Return(QString("error")));  // invalid variant
+        .WillOnce(Return(QVariant(200)));
 
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file.data()));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file.data(), remove())
+    EXPECT_CALL(*file, write(fileData))
+        .Times(1)
+        .WillOnce(Return(fileData.size()));
+
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
+
+    // the file must not be read again to check the hash
+    EXPECT_CALL(*file, reset())
+        .Times(0);
+
+    EXPECT_CALL(*file, device())
+        .Times(0);
+
+    EXPECT_CALL(*file, flush())
         .Times(1)
         .WillOnce(Return(true));
 
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(1)
+        .WillOnce(Return(hash));
+
+    EXPECT_CALL(*hash, addData(_))
+        .Times(0);
+
+    EXPECT_CALL(*hash, addBytes(fileData))
+        .Times(1);
+
+    EXPECT_CALL(*hash, result())
+        .Times(1)
+        .WillOnce(Return(hashData));
+
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
-    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
+        _isConfined, _rootPath, _url, hashString, _algo, _metadata,
+        _headers);
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier authErrorSpy(download,
-        SIGNAL(authError(AuthErrorStruct)));
-    SignalBarrier networkErrorSpy(download,
-        SIGNAL(networkError(NetworkErrorStruct)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the error and ensure that the signals are raised
-    reply->error(QNetworkReply::ProxyAuthenticationRequiredError);
-    QVERIFY(errorSpy.ensureSignalEmitted());
-    QCOMPARE(networkErrorSpy.count(), 0);
-    QCOMPARE(authErrorSpy.count(), 1);
-    QCOMPARE(errorSpy.count(), 1);
+    emit reply->downloadProgress(fileData.size(), fileData.size());
+    emit reply->finished();
+
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
     QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testSetRawHeadersStart_data() {
-    QTest::addColumn<QMap<QString, QString> >("headers");
-
-    // create a number of headers to assert that thy are added in the request
-    StringMap first, second, third;
-
-    // add headers to be added except range
-    first["Accept"] = "text/plain";
-    first["Accept-Charset"] = "utf-8";
-
-    QTest::newRow("First row") << first;
-
-    second["Accept-Language"] = "en-US";
-    second["Cache-Control"] = "no-cache";
-    second["Connection"] = "keep-alive";
-
-    QTest::newRow("Second row") << second;
-
-    third["Content-Length"] = "348";
-    third["User-Agent"] = "Mozilla/5.0";
-
-    QTest::newRow("Third row") << third;
-}
-
-void
-TestDownload::testSetRawHeadersStart() {
-    QFETCH(StringMap, headers);
-    auto file = new MockFile("test");
-    auto reply = new MockNetworkReply();
+TestDownload::testOnSuccessIncrementalHashWithWriter() {
+    // the file is real, the writer thread appends to its descriptor
+    auto path = testDirectory() + QDir::separator() + "writer_hash";
+    auto file = new MockFile(path);
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+    QByteArray fileData(100, 'a');
+    QByteArray hashData(100, 'f');
+    auto hashString = QString(hashData.toHex());
+    auto hash = new MockCryptographicHash();
 
-    // write the expectations of the reply which is what we are
-    // really testing
+    FileWriter::instance()->start();
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*_reqFactory, get(RequestHeadersEq(headers)))
+    EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
-        .WillOnce(Return(reply));
+        .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
+    EXPECT_CALL(*reply.data(), readAll())
+        .Times(1)
+        .WillOnce(Return(fileData));
+
+    EXPECT_CALL(*reply.data(), attribute(_))
+        .Times(1)
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
@@ -1900,60 +2115,89 @@ TestDownload::testSetRawHeadersStart() {
 
     EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Invoke([file](QIODevice::OpenMode mode) {
+            return file->File::open(mode);
+        }));
 
-    EXPECT_CALL(*file, remove())
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Invoke([file]() {
+            return file->File::size();
+        }));
+
+    // the data was hashed as it was queued, the file must not be read
+    // again to check the hash
+    EXPECT_CALL(*file, reset())
+        .Times(0);
+
+    EXPECT_CALL(*file, device())
         .Times(0);
 
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
     EXPECT_CALL(*file, close())
+        .Times(1)
+        .WillOnce(Invoke([file]() {
+            file->File::close();
+        }));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(1)
+        .WillOnce(Return(hash));
+
+    EXPECT_CALL(*hash, addData(_))
+        .Times(0);
+
+    EXPECT_CALL(*hash, addBytes(fileData))
         .Times(1);
 
+    EXPECT_CALL(*hash, result())
+        .Times(1)
+        .WillOnce(Return(hashData));
+
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, headers);
+        _isConfined, _rootPath, _url, hashString, _algo, _metadata,
+        _headers);
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
 
     download->start();  // change state
     download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    emit reply->downloadProgress(fileData.size(), fileData.size());
+    emit reply->finished();
+
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
 
     delete download;
+    FileWriter::deleteInstance();
+    QFile::remove(path);
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testSetRawHeadersWithRangeStart_data() {
-    QTest::addColumn<StringMap>("headers");
-
-    // create a number of headers to assert that thy are added in the request
-    StringMap first, second, third;
-
-    // add headers to be added except range
-    first["Accept"] = "text/plain";
-    first["Accept-Charset"] = "utf-8";
-    first["Range"] = "gzip, deflate";
-
-    QTest::newRow("First row") << first;
-
-    second["Accept-Language"] = "en-US";
-    second["Cache-Control"] = "no-cache";
-    second["Connection"] = "keep-alive";
-    second["Range"] = "gzip, deflate";
-
-    QTest::newRow("Second row") << second;
-
-    third["Content-Length"] = "348";
-    third["User-Agent"] = "Mozilla/5.0";
-    third["Range"] = "gzip, deflate";
+TestDownload::testOnHttpError_data() {
+    QTest::addColumn<int>("code");
+    QTest::addColumn<QString>("message");
 
-    QTest::newRow("Third row") << third;
+    QTest::newRow("Not Found") << 404 << "Not Found";
+    QTest::newRow("Method Not Allowed") << 405 << "Method Not Allowed";
+    QTest::newRow("Not Acceptable") << 406 << "Not Acceptable";
+    QTest::newRow("Request Timeout") << 408 << "Request Timeout";
 }
 
 void
-TestDownload::testSetRawHeadersWithRangeStart() {
-    QFETCH(StringMap, headers);
-    auto file = new MockFile("test");
-    auto reply = new MockNetworkReply();
+TestDownload::testOnHttpError() {
+    QFETCH(int, code);
+    QFETCH(QString, message);
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -1961,77 +2205,64 @@ TestDownload::testSetRawHeadersWithRangeStart() {
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*_reqFactory,
-            get(RequestDoesNotHaveHeader(QString("Range"))))
+    EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
-        .WillOnce(Return(reply));
+        .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
+    EXPECT_CALL(*reply.data(),
+             attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .Times(1)
+        .WillOnce(Return(QVariant(code)));
+
+    EXPECT_CALL(*reply.data(),
+             attribute(QNetworkRequest::HttpReasonPhraseAttribute))
+        .Times(1)
+        .WillOnce(Return(QVariant(message)));
+
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file));
+        .WillOnce(Return(file.data()));
 
-    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, remove())
-        .Times(0);
-
-    EXPECT_CALL(*file, close())
-        .Times(1);
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
 
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, headers);
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier httpErrorSpy(download, SIGNAL(httpError(HttpErrorStruct)));
 
     download->start();  // change state
     download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    // emit the error and ensure that the signals are raised
+    reply->error(QNetworkReply::ContentAccessDenied);
+
+    QVERIFY(errorSpy.ensureSignalEmitted());
+    QCOMPARE(httpErrorSpy.count(), 1);
+    QCOMPARE(errorSpy.count(), 1);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testSetRawHeadersResume_data() {
-    // same as with start but we test that all the headers
-    // are added + the range one
-    QTest::addColumn<StringMap>("headers");
-
-    // create a number of headers to assert that thy are added in the request
-    StringMap first, second, third;
-
-    // add headers to be added except range
-    first["Accept"] = "text/plain";
-    first["Accept-Charset"] = "utf-8";
-
-    QTest::newRow("First row") << first;
-
-    second["Accept-Language"] = "en-US";
-    second["Cache-Control"] = "no-cache";
-    second["Connection"] = "keep-alive";
-
-    QTest::newRow("Second row") << second;
-
-    third["Content-Length"] = "348";
-    third["User-Agent"] = "Mozilla/5.0";
-
-    QTest::newRow("Third row") << third;
-}
-
-void
-TestDownload::testSetRawHeadersResume() {
-    QFETCH(StringMap, headers);
-    QByteArray data;  // empty data to ensure we do not send the range header
-    auto file = new MockFile("test");
-    QScopedPointer<MockNetworkReply> firstReply(new MockNetworkReply());
-    auto secondReply = new MockNetworkReply();
-    qint64 size = 300;
+TestDownload::testOnSslError() {
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2039,109 +2270,67 @@ TestDownload::testSetRawHeadersResume() {
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    QPair<QString, QString> rangeHeader("Range", QString::number(size));
-    EXPECT_CALL(*_reqFactory,
-            get(AnyOf(RequestHeadersEq(headers),
-                      RequestHasHeader(rangeHeader))))
-        .Times(2)
-        .WillOnce(Return(firstReply.data()))
-        .WillOnce(Return(secondReply));
-
-    EXPECT_CALL(*firstReply.data(), setReadBufferSize(_))
-        .Times(1);
-
-    EXPECT_CALL(*secondReply, setReadBufferSize(_))
-        .Times(1);
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*firstReply.data(), abort())
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*firstReply.data(), readAll())
+    EXPECT_CALL(*reply.data(), canIgnoreSslErrors(_))
         .Times(1)
-        .WillOnce(Return(data));
+        .WillOnce(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file));
+        .WillOnce(Return(file.data()));
 
-    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
-    
-    EXPECT_CALL(*file, remove())
-        .Times(0);
 
-    EXPECT_CALL(*file, write(data))
-        .Times(1)
-        .WillOnce(Return(data.size()));
-
-    EXPECT_CALL(*file, flush())
+    EXPECT_CALL(*file.data(), remove())
         .Times(1)
         .WillOnce(Return(true));
-
-    EXPECT_CALL(*file, size())
-        .Times(1)
-        .WillOnce(Return(size));
-
-    EXPECT_CALL(*file, close())
-        .Times(1);
-
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, headers);
+        _isConfined, _rootPath, _url, _metadata, _headers);
+
+    SignalBarrier spy(download, SIGNAL(error(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier pausedSpy(download, SIGNAL(paused(bool)));
-    SignalBarrier resumedSpy(download, SIGNAL(resumed(bool)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
-    download->pause();
-    download->pauseTransfer();
-    QVERIFY(pausedSpy.ensureSignalEmitted());
-    download->resume();
-    download->resumeTransfer();
-    QVERIFY(resumedSpy.ensureSignalEmitted());
+
+    QList<QSslError> errors;
+    emit reply->sslErrors(errors);
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE(spy.count(), 1);;
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file));
-    QVERIFY(Mock::VerifyAndClearExpectations(firstReply.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testProcessExecutedNoParams_data() {
-    QTest::addColumn<QString>("command");
-    QTest::addColumn<QVariantMap>("metadata");
-    QVariantMap first, second, third;
-    QStringList firstCommand, secondCommand, thirdCommand;
-
-    firstCommand << "touch";
-    first["post-download-command"] = firstCommand;
-
-    QTest::newRow("First row") << firstCommand[0] << first;
-
-    secondCommand << "sudo";
-    second["post-download-command"] = secondCommand;
-
-    QTest::newRow("Second row") << secondCommand[0] << second;
-
-    thirdCommand << "grep";
-    third["post-download-command"] = thirdCommand;
+TestDownload::testOnNetworkError_data() {
+    QTest::addColumn<int>("code");
 
-    QTest::newRow("Third row") << thirdCommand[0] << third;
+    QTest::newRow("Connection Refused Error") << 1;
+    QTest::newRow("RemoteHost Closed Error") << 2;
+    QTest::newRow("Host Not Found Error") << 3;
+    QTest::newRow("Timeout Error") << 4;
+    QTest::newRow("Operation Canceled Error") << 4;
 }
 
 void
-TestDownload::testProcessExecutedNoParams() {
-    QFETCH(QString, command);
-    QFETCH(QVariantMap, metadata);
-    QStringList args;  // not args
-
+TestDownload::testOnNetworkError() {
+    QFETCH(int, code);
     QScopedPointer<MockFile> file(new MockFile("test"));
-    auto reply = new MockNetworkReply();
-    QScopedPointer<MockProcess> process(new MockProcess());
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2151,19 +2340,19 @@ TestDownload::testProcessExecutedNoParams() {
 
     EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
-        .WillOnce(Return(reply));
+        .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply, attribute(_))
+    EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
-        .WillOnce(Return(QVariant(200)));
+        .WillOnce(Return(QVariant()));  // invalid variant
+
+    EXPECT_CALL(*reply.data(), errorString())
+        .Times(1)
+        .WillOnce(Return(QString("error")));  // invalid variant
 
-    EXPECT_CALL(*reply, hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
@@ -2174,91 +2363,38 @@ TestDownload::testProcessExecutedNoParams() {
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, flush())
-        .Times(1)
-        .WillOnce(Return(true));
-
     EXPECT_CALL(*file.data(), remove())
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-        .Times(0);
-
-    // process factory and process expectation
-    EXPECT_CALL(*_processFactory, createProcess())
-        .Times(1)
-        .WillOnce(Return(process.data()));
-
-    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
-        .Times(1);
-
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, metadata, _headers);
-
-    SignalBarrier spy(download, SIGNAL(finished(QString)));
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+    SignalBarrier networkErrorSpy(download,
+        SIGNAL(networkError(NetworkErrorStruct)));
 
     download->start();  // change state
     download->startTransfer();
-
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the finish signal and expect it to be raised
-    emit reply->finished();
-    emit process->finished(0, QProcess::NormalExit);
-
-    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 20000);
-    QTRY_COMPARE_WITH_TIMEOUT(processingSpy.count(), 1, 20000);
-    QCOMPARE(download->state(), Download::UNCOLLECTED);
+    // emit the error and ensure that the signals are raised
+    reply->error((QNetworkReply::NetworkError)code);
+    QVERIFY(errorSpy.ensureSignalEmitted());
+    QCOMPARE(networkErrorSpy.count(), 1);
+    QCOMPARE(errorSpy.count(), 1);
 
     delete download;
 
     QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply));
-    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
-    delete reply;
-}
-
-void
-TestDownload::testProcessExecutedWithParams_data() {
-    QTest::addColumn<QString>("command");
-    QTest::addColumn<QStringList>("args");
-    QTest::addColumn<QVariantMap>("metadata");
-    QVariantMap first, second, third;
-    QString firstCommand, secondCommand, thirdCommand;
-    QStringList firstArgs, secondArgs, thirdArgs;
-
-    firstArgs << "test-file";
-    firstCommand = "touch";
-    first["post-download-command"] = QStringList(firstCommand) + firstArgs;
-
-    QTest::newRow("First row") << firstCommand << firstArgs << first;
-
-    secondArgs << "apt-get" << "install" << "click";
-    secondCommand = "sudo";
-    second["post-download-command"] = QStringList(secondCommand) + secondArgs;
-
-    QTest::newRow("Second row") << secondCommand << secondArgs << second;
-
-    thirdArgs << "." << "-Rn";
-    thirdCommand = "grep";
-    third["post-download-command"] = QStringList(thirdCommand) + thirdArgs;
-
-    QTest::newRow("Third row") << thirdCommand << thirdArgs << third;
 }
 
 void
-TestDownload::testProcessExecutedWithParams() {
-    QFETCH(QString, command);
-    QFETCH(QStringList, args);
-    QFETCH(QVariantMap, metadata);
-
+TestDownload::testOnAuthError() {
     QScopedPointer<MockFile> file(new MockFile("test"));
-    auto reply = new MockNetworkReply();
-    QScopedPointer<MockProcess> process(new MockProcess());
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2268,19 +2404,19 @@ TestDownload::testProcessExecutedWithParams() {
 
     EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
-        .WillOnce(Return(reply));
+        .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply, attribute(_))
+    EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
-        .WillOnce(Return(QVariant(200)));
+        .WillOnce(Return(QVariant()));  // invalid variant
+
+    EXPECT_CALL(*reply.data(), errorString())
+        .Times(1)
+        .WillOnce(Return(QString("error")));  // invalid variant
 
-    EXPECT_CALL(*reply, hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
@@ -2291,92 +2427,44 @@ TestDownload::testProcessExecutedWithParams() {
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, flush())
-        .Times(1)
-        .WillOnce(Return(true));
-
     EXPECT_CALL(*file.data(), remove())
         .Times(1)
         .WillOnce(Return(true));
-
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-        .Times(0);
-
-    // process factory and process expectation
-    EXPECT_CALL(*_processFactory, createProcess())
-        .Times(1)
-        .WillOnce(Return(process.data()));
-
-    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
-        .Times(1);
-
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, metadata, _headers);
+        _isConfined, _rootPath, _url, _metadata, _headers);
 
-    SignalBarrier spy(download, SIGNAL(finished(QString)));
+    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
-
-    download->start();  // change state
-    download->startTransfer();
+    SignalBarrier authErrorSpy(download,
+        SIGNAL(authError(AuthErrorStruct)));
+    SignalBarrier networkErrorSpy(download,
+        SIGNAL(networkError(NetworkErrorStruct)));
 
+    download->start();  // change state
+    download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the finish signal and expect it to be raised
-    emit reply->finished();
-    emit process->finished(0, QProcess::NormalExit);
+    // emit the error and ensure that the signals are raised
+    reply->error(QNetworkReply::AuthenticationRequiredError);
 
-    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 20000);
-    QTRY_COMPARE_WITH_TIMEOUT(processingSpy.count(), 1, 20000);
-    QCOMPARE(download->state(), Download::UNCOLLECTED);
+    QVERIFY(errorSpy.ensureSignalEmitted());
+    QCOMPARE(networkErrorSpy.count(), 0);
+    QCOMPARE(authErrorSpy.count(), 1);
+    auto error = authErrorSpy.takeFirst().at(0).value<AuthErrorStruct>();
+    QVERIFY(error.getType() == AuthErrorStruct::Server);
+    QCOMPARE(errorSpy.count(), 1);
 
     delete download;
 
     QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply));
-    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
-
-    delete reply;
-}
-
-void
-TestDownload::testProcessExecutedWithParamsFile_data() {
-    QTest::addColumn<QString>("command");
-    QTest::addColumn<QStringList>("args");
-    QTest::addColumn<QVariantMap>("metadata");
-    QVariantMap first, second, third;
-    QStringList firstArgs, secondArgs, thirdArgs;
-    QString firstCommand, secondCommand, thirdCommand;
-
-    firstArgs << "$file";
-    firstCommand = "touch";
-    first["post-download-command"] = QStringList(firstCommand) + firstArgs;
-
-    QTest::newRow("First row") << firstCommand << firstArgs << first;
-
-    secondArgs << "apt-get" << "install" << "$file";
-    secondCommand = "sudo";
-    second["post-download-command"] = QStringList(secondCommand) + secondArgs;
-
-    QTest::newRow("Second row") << secondCommand << secondArgs << second;
-
-    thirdArgs << "$file" << "-Rn";
-    thirdCommand = "grep";
-    third["post-download-command"] = QStringList(thirdCommand) + thirdArgs;
-
-    QTest::newRow("Third row") << thirdCommand << thirdArgs << third;
 }
 
 void
-TestDownload::testProcessExecutedWithParamsFile() {
-    QFETCH(QString, command);
-    QFETCH(QStringList, args);
-    QFETCH(QVariantMap, metadata);
-
+TestDownload::testOnProxyAuthError() {
     QScopedPointer<MockFile> file(new MockFile("test"));
-    auto reply = new MockNetworkReply();
-    QScopedPointer<MockProcess> process(new MockProcess());
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2386,19 +2474,19 @@ TestDownload::testProcessExecutedWithParamsFile() {
 
     EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
-        .WillOnce(Return(reply));
+        .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply, attribute(_))
+    EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
-        .WillOnce(Return(QVariant(200)));
+        .WillOnce(Return(QVariant()));  // invalid variant
+
+    EXPECT_CALL(*reply.data(), errorString())
+        .Times(1)
+        .WillOnce(Return(QString("error")));  // invalid variant
 
-    EXPECT_CALL(*reply, hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
@@ -2409,74 +2497,67 @@ TestDownload::testProcessExecutedWithParamsFile() {
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, flush())
-        .Times(1)
-        .WillOnce(Return(true));
-
     EXPECT_CALL(*file.data(), remove())
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-        .Times(0);
-
-    // process factory and process expectation
-    EXPECT_CALL(*_processFactory, createProcess())
-        .Times(1)
-        .WillOnce(Return(process.data()));
-
-
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, metadata, _headers);
-
-    // set the expectation after we know the file path
-    QStringList fixedArgs;
-    foreach(auto arg, args) {
-        if (arg == "$file") {
-            fixedArgs << download->filePath();
-        } else {
-            fixedArgs << arg;
-        }
-    }
-    EXPECT_CALL(*process.data(), start(command, StringListEq(fixedArgs), _))
-        .Times(1);
-
-    SignalBarrier spy(download, SIGNAL(finished(QString)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier authErrorSpy(download,
+        SIGNAL(authError(AuthErrorStruct)));
+    SignalBarrier networkErrorSpy(download,
+        SIGNAL(networkError(NetworkErrorStruct)));
 
     download->start();  // change state
     download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the finish signal and expect it to be raised
-    emit reply->finished();
-    emit process->finished(0, QProcess::NormalExit);
-
-    QVERIFY(spy.ensureSignalEmitted());
-    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 20000);
-    QTRY_COMPARE_WITH_TIMEOUT(processingSpy.count(), 1, 20000);
-    QCOMPARE(download->state(), Download::UNCOLLECTED);
+    // emit the error and ensure that the signals are raised
+    reply->error(QNetworkReply::ProxyAuthenticationRequiredError);
+    QVERIFY(errorSpy.ensureSignalEmitted());
+    QCOMPARE(networkErrorSpy.count(), 0);
+    QCOMPARE(authErrorSpy.count(), 1);
+    QCOMPARE(errorSpy.count(), 1);
 
     delete download;
 
     QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply));
-    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
-
-    delete reply;
 }
 
 void
-TestDownload::testProcessFinishedWithError() {
-    auto command = QString("ls");
-    QVariantMap metadata;
-    metadata["post-download-command"] = QStringList(command);
+TestDownload::testSetRawHeadersStart_data() {
+    QTest::addColumn<QMap<QString, QString> >("headers");
 
-    QStringList args;  // not args
+    // create a number of headers to assert that thy are added in the request
+    StringMap first, second, third;
 
-    QScopedPointer<MockFile> file(new MockFile("test"));
-    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
-    QScopedPointer<MockProcess> process(new MockProcess());
+    // add headers to be added except range
+    first["Accept"] = "text/plain";
+    first["Accept-Charset"] = "utf-8";
+
+    QTest::newRow("First row") << first;
+
+    second["Accept-Language"] = "en-US";
+    second["Cache-Control"] = "no-cache";
+    second["Connection"] = "keep-alive";
+
+    QTest::newRow("Second row") << second;
+
+    third["Content-Length"] = "348";
+    third["User-Agent"] = "Mozilla/5.0";
+
+    QTest::newRow("Third row") << third;
+}
+
+void
+TestDownload::testSetRawHeadersStart() {
+    QFETCH(StringMap, headers);
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2484,118 +2565,74 @@ TestDownload::testProcessFinishedWithError() {
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*_reqFactory, get(_))
+    EXPECT_CALL(*_reqFactory, get(RequestHeadersEq(headers)))
         .Times(1)
-        .WillOnce(Return(reply.data()));
+        .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply.data(), attribute(_))
-        .Times(1)
-        .WillOnce(Return(QVariant(200)));
-
-    EXPECT_CALL(*reply.data(), hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
-
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file.data()));
-
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
-        .Times(1)
-        .WillOnce(Return(true));
-
-    EXPECT_CALL(*file, flush())
-        .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*file.data(), remove())
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+    EXPECT_CALL(*file, remove())
         .Times(0);
 
-    // process factory and process expectation
-    EXPECT_CALL(*_processFactory, createProcess())
-        .Times(1)
-        .WillOnce(Return(process.data()));
-
-    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
+    EXPECT_CALL(*file, close())
         .Times(1);
 
-    EXPECT_CALL(*process.data(), readAllStandardOutput())
-        .Times(1)
-        .WillOnce(Return(QByteArray()));
-
-    EXPECT_CALL(*process.data(), readAllStandardError())
-        .Times(1)
-        .WillOnce(Return(QByteArray()));
-
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, metadata, _headers);
-
-    SignalBarrier spy(download, SIGNAL(error(QString)));
-    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
-    SignalBarrier processErrorSpy(download,
-        SIGNAL(processError(ProcessErrorStruct)));
+        _isConfined, _rootPath, _url, _metadata, headers);
 
     download->start();  // change state
     download->startTransfer();
-    QVERIFY(startedSpy.ensureSignalEmitted());
-
-    // emit the finish signal and expect it to be raised
-    emit reply->finished();
-    emit process->finished(-1, QProcess::NormalExit);
-
-    QVERIFY(spy.ensureSignalEmitted());
-    QCOMPARE(spy.count(), 1);
-    QCOMPARE(processingSpy.count(), 1);
-    QCOMPARE(processErrorSpy.count(), 1);
-    QCOMPARE(download->state(), Download::ERROR);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
     verifyMocks();
 }
 
 void
-TestDownload::testProcessError_data() {
-    QTest::addColumn<int>("code");
-    QTest::addColumn<QString>("stdOut");
-    QTest::addColumn<QString>("stdErr");
-
-    QTest::newRow("First row") << 1 << "Things hapened" <<
-        "Errorooror";
-    QTest::newRow("Second row") << 2 << "Time error" <<
-        "Oh lords!";
-    QTest::newRow("Second row") << 3 << "Read" <<
-        "Error!";
-}
+TestDownload::testSetRawHeadersWithRangeStart_data() {
+    QTest::addColumn<StringMap>("headers");
 
-void
-TestDownload::testProcessError() {
-    QFETCH(int, code);
-    QFETCH(QString, stdOut);
-    QFETCH(QString, stdErr);
+    // create a number of headers to assert that thy are added in the request
+    StringMap first, second, third;
 
-    auto command = QString("ls");
-    QVariantMap metadata;
-    metadata["post-download-command"] = QStringList(command);
+    // add headers to be added except range
+    first["Accept"] = "text/plain";
+    first["Accept-Charset"] = "utf-8";
+    first["Range"] = "gzip, deflate";
 
-    QStringList args;  // not args
+    QTest::newRow("First row") << first;
 
-    QScopedPointer<MockFile> file(new MockFile("test"));
-    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
-    QScopedPointer<MockProcess> process(new MockProcess());
+    second["Accept-Language"] = "en-US";
+    second["Cache-Control"] = "no-cache";
+    second["Connection"] = "keep-alive";
+    second["Range"] = "gzip, deflate";
+
+    QTest::newRow("Second row") << second;
+
+    third["Content-Length"] = "348";
+    third["User-Agent"] = "Mozilla/5.0";
+    third["Range"] = "gzip, deflate";
+
+    QTest::newRow("Third row") << third;
+}
+
+void
+TestDownload::testSetRawHeadersWithRangeStart() {
+    QFETCH(StringMap, headers);
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2603,108 +2640,186 @@ TestDownload::testProcessError() {
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*_reqFactory, get(_))
+    EXPECT_CALL(*_reqFactory,
+            get(RequestDoesNotHaveHeader(QString("Range"))))
         .Times(1)
-        .WillOnce(Return(reply.data()));
+        .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply.data(), attribute(_))
-        .Times(1)
-        .WillOnce(Return(QVariant(200)));
-
-    EXPECT_CALL(*reply.data(), hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
-
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file.data()));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, flush())
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*file, remove())
+        .Times(0);
 
-    EXPECT_CALL(*file.data(), remove())
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*file, close())
+        .Times(1);
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-        .Times(0);
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, headers);
 
-    // process factory and process expectation
-    EXPECT_CALL(*_processFactory, createProcess())
-        .Times(1)
-        .WillOnce(Return(process.data()));
+    download->start();  // change state
+    download->startTransfer();
 
-    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    verifyMocks();
+}
+
+void
+TestDownload::testSetRawHeadersResume_data() {
+    // same as with start but we test that all the headers
+    // are added + the range one
+    QTest::addColumn<StringMap>("headers");
+
+    // create a number of headers to assert that thy are added in the request
+    StringMap first, second, third;
+
+    // add headers to be added except range
+    first["Accept"] = "text/plain";
+    first["Accept-Charset"] = "utf-8";
+
+    QTest::newRow("First row") << first;
+
+    second["Accept-Language"] = "en-US";
+    second["Cache-Control"] = "no-cache";
+    second["Connection"] = "keep-alive";
+
+    QTest::newRow("Second row") << second;
+
+    third["Content-Length"] = "348";
+    third["User-Agent"] = "Mozilla/5.0";
+
+    QTest::newRow("Third row") << third;
+}
+
+void
+TestDownload::testSetRawHeadersResume() {
+    QFETCH(StringMap, headers);
+    QByteArray data;  // empty data to ensure we do not send the range header
+    auto file = new MockFile("test");
+    QScopedPointer<MockNetworkReply> firstReply(new MockNetworkReply());
+    auto secondReply = new MockNetworkReply();
+    qint64 size = 300;
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QPair<QString, QString> rangeHeader("Range", QString::number(size));
+    EXPECT_CALL(*_reqFactory,
+            get(AnyOf(RequestHeadersEq(headers),
+                      RequestHasHeader(rangeHeader))))
+        .Times(2)
+        .WillOnce(Return(firstReply.data()))
+        .WillOnce(Return(secondReply));
+
+    EXPECT_CALL(*firstReply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*process.data(), readAllStandardOutput())
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*firstReply.data(), abort())
+        .Times(1);
+
+    EXPECT_CALL(*firstReply.data(), readAll())
         .Times(1)
-        .WillOnce(Return(stdOut.toUtf8()));
+        .WillOnce(Return(data));
 
-    EXPECT_CALL(*process.data(), readAllStandardError())
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(stdErr.toUtf8()));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*process.data(), program())
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
-        .WillOnce(Return(command));
+        .WillOnce(Return(true));
+    
+    EXPECT_CALL(*file, remove())
+        .Times(0);
 
-    EXPECT_CALL(*process.data(), arguments())
+    EXPECT_CALL(*file, write(data))
         .Times(1)
-        .WillOnce(Return(QStringList()));
+        .WillOnce(Return(data.size()));
 
-    auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, metadata, _headers);
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
 
-    SignalBarrier spy(download, SIGNAL(error(QString)));
+    EXPECT_CALL(*file, size())
+        .Times(1)
+        .WillOnce(Return(size));
+
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, headers);
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
-    SignalBarrier processErrorSpy(download,
-        SIGNAL(processError(ProcessErrorStruct)));
+    SignalBarrier pausedSpy(download, SIGNAL(paused(bool)));
+    SignalBarrier resumedSpy(download, SIGNAL(resumed(bool)));
 
     download->start();  // change state
     download->startTransfer();
-
     QVERIFY(startedSpy.ensureSignalEmitted());
-
-    // emit the finish signal and expect it to be raised
-    emit reply->finished();
-    emit process->error(static_cast<QProcess::ProcessError>(code));
-
-    QVERIFY(spy.ensureSignalEmitted());
-    QCOMPARE(spy.count(), 1);
-    QCOMPARE(processingSpy.count(), 1);
-    QCOMPARE(processErrorSpy.count(), 1);
-    QCOMPARE(download->state(), Download::ERROR);
+    download->pause();
+    download->pauseTransfer();
+    QVERIFY(pausedSpy.ensureSignalEmitted());
+    download->resume();
+    download->resumeTransfer();
+    QVERIFY(resumedSpy.ensureSignalEmitted());
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testProcessFinishedCrash() {
-    auto command = QString("ls");
-    QVariantMap metadata;
-    metadata["post-download-command"] = QStringList(command);
+TestDownload::testProcessExecutedNoParams_data() {
+    QTest::addColumn<QString>("command");
+    QTest::addColumn<QVariantMap>("metadata");
+    QVariantMap first, second, third;
+    QStringList firstCommand, secondCommand, thirdCommand;
+
+    firstCommand << "touch";
+    first["post-download-command"] = firstCommand;
+
+    QTest::newRow("First row") << firstCommand[0] << first;
+
+    secondCommand << "sudo";
+    second["post-download-command"] = secondCommand;
+
+    QTest::newRow("Second row") << secondCommand[0] << second;
+
+    thirdCommand << "grep";
+    third["post-download-command"] = thirdCommand;
+
+    QTest::newRow("Third row") << thirdCommand[0] << third;
+}
 
+void
+TestDownload::testProcessExecutedNoParams() {
+    QFETCH(QString, command);
+    QFETCH(QVariantMap, metadata);
     QStringList args;  // not args
 
     QScopedPointer<MockFile> file(new MockFile("test"));
-    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+    auto reply = new MockNetworkReply();
     QScopedPointer<MockProcess> process(new MockProcess());
 
     // write the expectations of the reply which is what we are
@@ -2715,16 +2830,16 @@ TestDownload::testProcessFinishedCrash() {
 
     EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
-        .WillOnce(Return(reply.data()));
+        .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply.data(), attribute(_))
+    EXPECT_CALL(*reply, attribute(_))
         .Times(1)
         .WillOnce(Return(QVariant(200)));
 
-    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+    EXPECT_CALL(*reply, hasRawHeader(_))
         .Times(2)
         .WillOnce(Return(false))
         .WillOnce(Return(false));
@@ -2757,22 +2872,12 @@ TestDownload::testProcessFinishedCrash() {
     EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
         .Times(1);
 
-    EXPECT_CALL(*process.data(), readAllStandardOutput())
-        .Times(1)
-        .WillOnce(Return(QByteArray()));
-
-    EXPECT_CALL(*process.data(), readAllStandardError())
-        .Times(1)
-        .WillOnce(Return(QByteArray()));
-
     auto download = new FileDownload(_id, _appId, _path,
         _isConfined, _rootPath, _url, metadata, _headers);
 
-    SignalBarrier spy(download, SIGNAL(error(QString)));
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
     SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
-    SignalBarrier processErrorSpy(download,
-        SIGNAL(processError(ProcessErrorStruct)));
 
     download->start();  // change state
     download->startTransfer();
@@ -2781,26 +2886,58 @@ TestDownload::testProcessFinishedCrash() {
 
     // emit the finish signal and expect it to be raised
     emit reply->finished();
-    emit process->finished(0, QProcess::CrashExit);
+    emit process->finished(0, QProcess::NormalExit);
 
-    QVERIFY(spy.ensureSignalEmitted());
-    QCOMPARE(spy.count(), 1);
-    QCOMPARE(processingSpy.count(), 1);
-    QCOMPARE(processErrorSpy.count(), 1);
-    QCOMPARE(download->state(), Download::ERROR);
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 20000);
+    QTRY_COMPARE_WITH_TIMEOUT(processingSpy.count(), 1, 20000);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
 
     delete download;
 
     QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
     QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
     verifyMocks();
+    delete reply;
 }
 
 void
-TestDownload::testSetRawHeaderAcceptEncoding() {
-    auto file = new MockFile("test");
+TestDownload::testProcessExecutedWithParams_data() {
+    QTest::addColumn<QString>("command");
+    QTest::addColumn<QStringList>("args");
+    QTest::addColumn<QVariantMap>("metadata");
+    QVariantMap first, second, third;
+    QString firstCommand, secondCommand, thirdCommand;
+    QStringList firstArgs, secondArgs, thirdArgs;
+
+    firstArgs << "test-file";
+    firstCommand = "touch";
+    first["post-download-command"] = QStringList(firstCommand) + firstArgs;
+
+    QTest::newRow("First row") << firstCommand << firstArgs << first;
+
+    secondArgs << "apt-get" << "install" << "click";
+    secondCommand = "sudo";
+    second["post-download-command"] = QStringList(secondCommand) + secondArgs;
+
+    QTest::newRow("Second row") << secondCommand << secondArgs << second;
+
+    thirdArgs << "." << "-Rn";
+    thirdCommand = "grep";
+    third["post-download-command"] = QStringList(thirdCommand) + thirdArgs;
+
+    QTest::newRow("Third row") << thirdCommand << thirdArgs << third;
+}
+
+void
+TestDownload::testProcessExecutedWithParams() {
+    QFETCH(QString, command);
+    QFETCH(QStringList, args);
+    QFETCH(QVariantMap, metadata);
+
+    QScopedPointer<MockFile> file(new MockFile("test"));
     auto reply = new MockNetworkReply();
+    QScopedPointer<MockProcess> process(new MockProcess());
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2808,57 +2945,117 @@ TestDownload::testSetRawHeaderAcceptEncoding() {
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    QPair<QString, QString> encodingHeader("Accept-Encoding",
-        QString("identity"));
-
-    EXPECT_CALL(*_reqFactory, get(RequestHasHeader(encodingHeader)))
+    EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
         .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
+    EXPECT_CALL(*reply, attribute(_))
+        .Times(1)
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
+
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file));
+        .WillOnce(Return(file.data()));
 
-    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, remove())
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
         .Times(0);
 
-    EXPECT_CALL(*file, close())
+    // process factory and process expectation
+    EXPECT_CALL(*_processFactory, createProcess())
+        .Times(1)
+        .WillOnce(Return(process.data()));
+
+    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
         .Times(1);
 
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
-    QSignalSpy spy(download,
-        SIGNAL(started(bool)));  // NOLINT(readability/function)
+        _isConfined, _rootPath, _url, metadata, _headers);
+
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
 
     download->start();  // change state
     download->startTransfer();
 
-    QCOMPARE(1, spy.count());
-    auto arguments = spy.takeFirst();
-    QVERIFY(arguments.at(0).toBool());
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    // emit the finish signal and expect it to be raised
+    emit reply->finished();
+    emit process->finished(0, QProcess::NormalExit);
+
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 20000);
+    QTRY_COMPARE_WITH_TIMEOUT(processingSpy.count(), 1, 20000);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
     QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
     verifyMocks();
+
+    delete reply;
 }
 
 void
-TestDownload::testSslErrorsIgnored() {
-    QList<QSslError> errors;
-    errors.append(QSslError(QSslError::CertificateExpired));
+TestDownload::testProcessExecutedWithParamsFile_data() {
+    QTest::addColumn<QString>("command");
+    QTest::addColumn<QStringList>("args");
+    QTest::addColumn<QVariantMap>("metadata");
+    QVariantMap first, second, third;
+    QStringList firstArgs, secondArgs, thirdArgs;
+    QString firstCommand, secondCommand, thirdCommand;
 
-    auto file = new MockFile("test");
+    firstArgs << "$file";
+    firstCommand = "touch";
+    first["post-download-command"] = QStringList(firstCommand) + firstArgs;
+
+    QTest::newRow("First row") << firstCommand << firstArgs << first;
+
+    secondArgs << "apt-get" << "install" << "$file";
+    secondCommand = "sudo";
+    second["post-download-command"] = QStringList(secondCommand) + secondArgs;
+
+    QTest::newRow("Second row") << secondCommand << secondArgs << second;
+
+    thirdArgs << "$file" << "-Rn";
+    thirdCommand = "grep";
+    third["post-download-command"] = QStringList(thirdCommand) + thirdArgs;
+
+    QTest::newRow("Third row") << thirdCommand << thirdArgs << third;
+}
+
+void
+TestDownload::testProcessExecutedWithParamsFile() {
+    QFETCH(QString, command);
+    QFETCH(QStringList, args);
+    QFETCH(QVariantMap, metadata);
+
+    QScopedPointer<MockFile> file(new MockFile("test"));
     auto reply = new MockNetworkReply();
+    QScopedPointer<MockProcess> process(new MockProcess());
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2866,64 +3063,99 @@ TestDownload::testSslErrorsIgnored() {
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    QPair<QString, QString> encodingHeader("Accept-Encoding",
-        QString("identity"));
-
-    EXPECT_CALL(*_reqFactory, get(RequestHasHeader(encodingHeader)))
+    EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
         .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply, canIgnoreSslErrors(errors))
+    EXPECT_CALL(*reply, attribute(_))
         .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file));
+        .WillOnce(Return(file.data()));
 
-    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, remove())
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
         .Times(0);
 
-    EXPECT_CALL(*file, close())
-        .Times(1);
+    // process factory and process expectation
+    EXPECT_CALL(*_processFactory, createProcess())
+        .Times(1)
+        .WillOnce(Return(process.data()));
+
 
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
+        _isConfined, _rootPath, _url, metadata, _headers);
 
-    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    // set the expectation after we know the file path
+    QStringList fixedArgs;
+    foreach(auto arg, args) {
+        if (arg == "$file") {
+            fixedArgs << download->filePath();
+        } else {
+            fixedArgs << arg;
+        }
+    }
+    EXPECT_CALL(*process.data(), start(command, StringListEq(fixedArgs), _))
+        .Times(1);
+
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
 
     download->start();  // change state
     download->startTransfer();
 
-    QVERIFY(startedSpy.ensureSignalEmitted());
-
-    QSignalSpy stateSpy(download, SIGNAL(stateChanged()));
-    reply->sslErrors(errors);
+    // emit the finish signal and expect it to be raised
+    emit reply->finished();
+    emit process->finished(0, QProcess::NormalExit);
 
-    QCOMPARE(0, stateSpy.count());  // we did not set it to error
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 20000);
+    QTRY_COMPARE_WITH_TIMEOUT(processingSpy.count(), 1, 20000);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
     QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
     verifyMocks();
+
+    delete reply;
 }
 
 void
-TestDownload::testSslErrorsNotIgnored() {
-    QList<QSslError> errors;
-    errors.append(QSslError(QSslError::CertificateExpired));
+TestDownload::testProcessFinishedWithError() {
+    auto command = QString("ls");
+    QVariantMap metadata;
+    metadata["post-download-command"] = QStringList(command);
+
+    QStringList args;  // not args
 
     QScopedPointer<MockFile> file(new MockFile("test"));
     QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+    QScopedPointer<MockProcess> process(new MockProcess());
 
     // write the expectations of the reply which is what we are
     // really testing
@@ -2931,18 +3163,20 @@ TestDownload::testSslErrorsNotIgnored() {
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    QPair<QString, QString> encodingHeader("Accept-Encoding",
-        QString("identity"));
-
-    EXPECT_CALL(*_reqFactory, get(RequestHasHeader(encodingHeader)))
+    EXPECT_CALL(*_reqFactory, get(_))
         .Times(1)
         .WillOnce(Return(reply.data()));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply.data(), canIgnoreSslErrors(errors))
+    EXPECT_CALL(*reply.data(), attribute(_))
         .Times(1)
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
         .WillOnce(Return(false));
 
     // file system expectations
@@ -2954,277 +3188,2141 @@ TestDownload::testSslErrorsNotIgnored() {
         .Times(1)
         .WillOnce(Return(true));
 
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
     EXPECT_CALL(*file.data(), remove())
         .Times(1)
         .WillOnce(Return(true));
 
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(0);
+
+    // process factory and process expectation
+    EXPECT_CALL(*_processFactory, createProcess())
+        .Times(1)
+        .WillOnce(Return(process.data()));
+
+    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
+        .Times(1);
+
+    EXPECT_CALL(*process.data(), readAllStandardOutput())
+        .Times(1)
+        .WillOnce(Return(QByteArray()));
+
+    EXPECT_CALL(*process.data(), readAllStandardError())
+        .Times(1)
+        .WillOnce(Return(QByteArray()));
+
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
+        _isConfined, _rootPath, _url, metadata, _headers);
+
+    SignalBarrier spy(download, SIGNAL(error(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+    SignalBarrier processErrorSpy(download,
+        SIGNAL(processError(ProcessErrorStruct)));
 
     download->start();  // change state
     download->startTransfer();
-
-    SignalBarrier stateSpy(download, SIGNAL(stateChanged()));
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    // emit the finish signal and expect it to be raised
+    emit reply->finished();
+    emit process->finished(-1, QProcess::NormalExit);
+
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(processingSpy.count(), 1);
+    QCOMPARE(processErrorSpy.count(), 1);
+    QCOMPARE(download->state(), Download::ERROR);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testProcessError_data() {
+    QTest::addColumn<int>("code");
+    QTest::addColumn<QString>("stdOut");
+    QTest::addColumn<QString>("stdErr");
+
+    QTest::newRow("First row") << 1 << "Things hapened" <<
+        "Errorooror";
+    QTest::newRow("Second row") << 2 << "Time error" <<
+        "Oh lords!";
+    QTest::newRow("Second row") << 3 << "Read" <<
+        "Error!";
+}
+
+void
+TestDownload::testProcessError() {
+    QFETCH(int, code);
+    QFETCH(QString, stdOut);
+    QFETCH(QString, stdErr);
+
+    auto command = QString("ls");
+    QVariantMap metadata;
+    metadata["post-download-command"] = QStringList(command);
+
+    QStringList args;  // not args
+
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+    QScopedPointer<MockProcess> process(new MockProcess());
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply.data()));
+
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply.data(), attribute(_))
+        .Times(1)
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file.data()));
+
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(0);
+
+    // process factory and process expectation
+    EXPECT_CALL(*_processFactory, createProcess())
+        .Times(1)
+        .WillOnce(Return(process.data()));
+
+    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
+        .Times(1);
+
+    EXPECT_CALL(*process.data(), readAllStandardOutput())
+        .Times(1)
+        .WillOnce(Return(stdOut.toUtf8()));
+
+    EXPECT_CALL(*process.data(), readAllStandardError())
+        .Times(1)
+        .WillOnce(Return(stdErr.toUtf8()));
+
+    EXPECT_CALL(*process.data(), program())
+        .Times(1)
+        .WillOnce(Return(command));
+
+    EXPECT_CALL(*process.data(), arguments())
+        .Times(1)
+        .WillOnce(Return(QStringList()));
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+
+    SignalBarrier spy(download, SIGNAL(error(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+    SignalBarrier processErrorSpy(download,
+        SIGNAL(processError(ProcessErrorStruct)));
+
+    download->start();  // change state
+    download->startTransfer();
+
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    // emit the finish signal and expect it to be raised
+    emit reply->finished();
+    emit process->error(static_cast<QProcess::ProcessError>(code));
+
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(processingSpy.count(), 1);
+    QCOMPARE(processErrorSpy.count(), 1);
+    QCOMPARE(download->state(), Download::ERROR);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testProcessFinishedCrash() {
+    auto command = QString("ls");
+    QVariantMap metadata;
+    metadata["post-download-command"] = QStringList(command);
+
+    QStringList args;  // not args
+
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+    QScopedPointer<MockProcess> process(new MockProcess());
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply.data()));
+
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply.data(), attribute(_))
+        .Times(1)
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply.data(), hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file.data()));
+
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(0);
+
+    // process factory and process expectation
+    EXPECT_CALL(*_processFactory, createProcess())
+        .Times(1)
+        .WillOnce(Return(process.data()));
+
+    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
+        .Times(1);
+
+    EXPECT_CALL(*process.data(), readAllStandardOutput())
+        .Times(1)
+        .WillOnce(Return(QByteArray()));
+
+    EXPECT_CALL(*process.data(), readAllStandardError())
+        .Times(1)
+        .WillOnce(Return(QByteArray()));
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+
+    SignalBarrier spy(download, SIGNAL(error(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+    SignalBarrier processErrorSpy(download,
+        SIGNAL(processError(ProcessErrorStruct)));
+
+    download->start();  // change state
+    download->startTransfer();
+
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    // emit the finish signal and expect it to be raised
+    emit reply->finished();
+    emit process->finished(0, QProcess::CrashExit);
+
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(processingSpy.count(), 1);
+    QCOMPARE(processErrorSpy.count(), 1);
+    QCOMPARE(download->state(), Download::ERROR);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testSetRawHeaderAcceptEncoding() {
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QPair<QString, QString> encodingHeader("Accept-Encoding",
+        QString("identity"));
+
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeader(encodingHeader)))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, remove())
+        .Times(0);
+
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    QSignalSpy spy(download,
+        SIGNAL(started(bool)));  // NOLINT(readability/function)
+
+    download->start();  // change state
+    download->startTransfer();
+
+    QCOMPARE(1, spy.count());
+    auto arguments = spy.takeFirst();
+    QVERIFY(arguments.at(0).toBool());
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    verifyMocks();
+}
+
+void
+TestDownload::testSslErrorsIgnored() {
+    QList<QSslError> errors;
+    errors.append(QSslError(QSslError::CertificateExpired));
+
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QPair<QString, QString> encodingHeader("Accept-Encoding",
+        QString("identity"));
+
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeader(encodingHeader)))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply, canIgnoreSslErrors(errors))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, remove())
+        .Times(0);
+
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+
+    download->start();  // change state
+    download->startTransfer();
+
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    QSignalSpy stateSpy(download, SIGNAL(stateChanged()));
+    reply->sslErrors(errors);
+
+    QCOMPARE(0, stateSpy.count());  // we did not set it to error
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    verifyMocks();
+}
+
+void
+TestDownload::testSslErrorsNotIgnored() {
+    QList<QSslError> errors;
+    errors.append(QSslError(QSslError::CertificateExpired));
+
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QPair<QString, QString> encodingHeader("Accept-Encoding",
+        QString("identity"));
+
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeader(encodingHeader)))
+        .Times(1)
+        .WillOnce(Return(reply.data()));
+
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply.data(), canIgnoreSslErrors(errors))
+        .Times(1)
+        .WillOnce(Return(false));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file.data()));
+
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+
+    download->start();  // change state
+    download->startTransfer();
+
+    SignalBarrier stateSpy(download, SIGNAL(stateChanged()));
     QVERIFY(startedSpy.ensureSignalEmitted());
 
     reply->sslErrors(errors);
 
-    QVERIFY(stateSpy.ensureSignalEmitted());
-    QCOMPARE(1, stateSpy.count());
-    QCOMPARE(Download::ERROR, download->state());
+    QVERIFY(stateSpy.ensureSignalEmitted());
+    QCOMPARE(1, stateSpy.count());
+    QCOMPARE(Download::ERROR, download->state());
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testLocalPathConfined() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // assert that the root path used is not the one in the metadata
+    QVariantMap metadata;
+    QString localPath = "/home/my/local/path";
+    metadata["local-path"] = localPath;
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        true, _rootPath, _url, metadata, _headers));
+
+    QVERIFY(download->filePath() != localPath);
+    verifyMocks();
+}
+
+void
+TestDownload::testLocalPathNotConfined() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QVariantMap metadata;
+    QString localPath = "/home/my/local/path";
+    metadata["local-path"] = localPath;
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        false, _rootPath, _url, metadata, _headers));
+
+    QCOMPARE(download->filePath(), localPath);
+    verifyMocks();
+}
+
+void
+TestDownload::testInvalidUrl() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, QUrl(), _metadata, _headers));
+
+    QVERIFY(!download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testValidUrl() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers));
+
+    QVERIFY(download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testInvalidHashAlgorithm() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, "hash", "not-valid-algo", _metadata,
+        _headers));
+    QVERIFY(!download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testValidHashAlgorithm_data() {
+    QTest::addColumn<QString>("algo");
+
+    QTest::newRow("md5") << "md5";
+    QTest::newRow("sha1") << "sha1";
+    QTest::newRow("sha224") << "sha224";
+    QTest::newRow("sha256") << "sha256";
+    QTest::newRow("sha384") << "sha384";
+    QTest::newRow("sha512") << "sha512";
+    QTest::newRow("Empty string") << "";
+}
+
+void
+TestDownload::testValidHashAlgorithm() {
+    QFETCH(QString, algo);
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, "hash", algo, _metadata, _headers));
+    QVERIFY(download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testInvalidFilePresent() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // create a file so that we get an error
+    QString filePath = testDirectory() + QDir::separator() + "test_file.jpg";
+    QScopedPointer<QFile> file(new QFile(filePath));
+    file->open(QIODevice::ReadWrite | QFile::Append);
+    file->write("data data data!");
+    file->close();
+
+    QVariantMap metadata;
+    metadata["local-path"] = filePath;
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        false, _rootPath, _url, metadata, _headers));
+    QVERIFY(!download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testValidFileNotPresent() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QString filePath = testDirectory() + QDir::separator() + "test_file.jpg";
+
+    QVariantMap metadata;
+    metadata["local-path"] = filePath;
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        false, _rootPath, _url, metadata, _headers));
+    QVERIFY(download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testDownloadPresent() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // create a download and get the filename to use, then write it
+    // and create the same download and assert that the filename is diff
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        true, _rootPath, _url, _metadata, _headers));
+
+    QString filePath = download->filePath();
+
+    QScopedPointer<QFile> file(new QFile(filePath));
+    file->open(QIODevice::ReadWrite | QFile::Append);
+    file->write("data data data!");
+    file->close();
+
+    QScopedPointer<FileDownload> other(new FileDownload(_id, _appId, _path,
+        true, _rootPath, _url, _metadata, _headers));
+
+    QVERIFY(filePath != other->filePath());
+    verifyMocks();
+}
+
+void
+TestDownload::testDownloadPresentSeveralFiles_data() {
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("One") << 1;
+    QTest::newRow("Some") << 3;
+    QTest::newRow("Several") << 10;
+    QTest::newRow("Plenti") << 100;
+}
+
+void
+TestDownload::testDownloadPresentSeveralFiles() {
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QFETCH(int, count);
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        true, _rootPath, _url, _metadata, _headers));
+
+    QString filePath = download->filePath();
+
+    QScopedPointer<QFile> file(new QFile(filePath));
+    file->open(QIODevice::ReadWrite | QFile::Append);
+    file->write("data data data!");
+    file->close();
+
+    QFileInfo fileInfo(filePath);
+    auto suffix = "." + fileInfo.completeSuffix();
+    qDebug() << "SUFIX" << suffix;
+    auto prefix = filePath.left(filePath.size() - suffix.size());
+    qDebug() << "PREFIX" << prefix;
+
+    // write the rest of the files
+    for(int index=1; index < count; index++) {
+        auto otherPath = QString("%1 (%2)%3").arg(prefix).arg(index).arg(suffix);
+        qDebug() << "Writing a new file" << otherPath;
+        QScopedPointer<QFile> otherFile(new QFile(otherPath));
+        otherFile->open(QIODevice::ReadWrite | QFile::Append);
+        otherFile->write("data data data!");
+        otherFile->close();
+    }
+
+    QScopedPointer<FileDownload> other(new FileDownload(_id, _appId, _path,
+        true, _rootPath, _url, _metadata, _headers));
+
+    QVERIFY(filePath != other->filePath());
+    if (count > 0) {
+        auto expectedPath = QString("%1 (%2)%3").arg(prefix).arg(count).arg(suffix);
+        QCOMPARE(expectedPath, other->filePath());
+    }
+    verifyMocks();
+}
+
+void
+TestDownload::testProcessingJustOnce() {
+    QString command = "touch";
+    QVariantMap metadata;
+    metadata["post-download-command"] = command;
+
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+    QScopedPointer<MockProcess> process(new MockProcess());
+    QByteArray hashData(100, 'f');
+    auto hashString = QString(hashData.toHex());
+    auto hash = new MockCryptographicHash();
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply, attribute(_))
+        .Times(1)
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, reset())
+        .Times(1);
+
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, remove())
+        .Times(0);
+
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    EXPECT_CALL(*file, device())
+        .Times(1)
+        .WillOnce(Return(nullptr));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(1)
+        .WillOnce(Return(hash));
+
+    EXPECT_CALL(*hash, addData(_))
+        .Times(1);
+
+    EXPECT_CALL(*hash, result())
+        .Times(1)
+        .WillOnce(Return(hashData));
+
+    // process factory and process expectation
+    EXPECT_CALL(*_processFactory, createProcess())
+        .Times(1)
+        .WillOnce(Return(process.data()));
+
+    EXPECT_CALL(*process.data(), start(command, _, _))
+        .Times(1);
+
+    auto download = new FileDownload(_id, _appId,
+        _path, _isConfined, _rootPath, _url, hashString, _algo, metadata,
+        _headers);
+
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+
+    download->start();  // change state
+    download->startTransfer();
+
+    // makes the process to be executed
+    reply->finished();
+
+    QVERIFY(processingSpy.ensureSignalEmitted());
+    QCOMPARE(processingSpy.count(), 1);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(hash));
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    verifyMocks();
+
+    delete reply;
+}
+
+void
+TestDownload::testFileSystemErrorProgress() {
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // set expectations to get the request and the reply correctly
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply.data()));
+
+    EXPECT_CALL(*reply.data(), readAll())
+        .Times(1)
+        .WillOnce(Return(QByteArray()));
+
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply, attribute(_))
+        .Times(1)
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file.data()));
+
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file.data(), write(_))
+        .Times(1)
+        .WillOnce(Return(0));
+    
+    EXPECT_CALL(*file.data(), flush())
+        .Times(1)
+        .WillOnce(Return(false));
+
+    EXPECT_CALL(*file.data(), size())
+        .Times(1)
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(*file.data(), error())
+        .Times(1)
+        .WillOnce(Return(QFile::WriteError));  // any error will do
+
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier spy(download, SIGNAL(error(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier progressSpy(download, SIGNAL(progress(qulonglong, qulonglong)));
+
+    download->start();
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    reply->downloadProgress(0, 13);
+    QVERIFY(progressSpy.ensureSignalEmitted());
+    reply->finished(); // emit finished signal so that we try to write
+
+    // assert that the error signal is emitted
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE(spy.count(), 1);
+
+    auto arguments = spy.takeFirst();
+    // assert that the size is not the received but the file size
+    QCOMPARE(arguments.at(0).toString(),
+        QString("FILE SYSTEM ERROR: %1").arg(QFile::WriteError));
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testReserveSpaceError() {
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // set expectations to get the request and the reply correctly
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    EXPECT_CALL(*reply, readAll())
+        .Times(1)
+        .WillOnce(Return(QByteArray()));
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    // the transfer is stopped as soon as we know the space is missing
+    EXPECT_CALL(*reply, abort())
+        .Times(1);
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, write(_))
+        .Times(1)
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, size())
+        .Times(1)
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, reserve(13))
+        .Times(1)
+        .WillOnce(Return(false));
+
+    EXPECT_CALL(*file, close())
+        .Times(AnyNumber());
+
+    EXPECT_CALL(*file, remove())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier spy(download, SIGNAL(error(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier progressSpy(download, SIGNAL(progress(qulonglong, qulonglong)));
+
+    download->start();
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    reply->downloadProgress(0, 13);
+
+    // assert that the error signal is emitted and no progress is reported
+    QVERIFY(spy.ensureSignalEmitted());
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(progressSpy.count(), 0);
+
+    auto arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(0).toString(),
+        QString("FILE SYSTEM ERROR: %1").arg(QFile::ResourceError));
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    verifyMocks();
+}
+
+void
+TestDownload::testFileSystemErrorPause() {
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // set expectations to get the request and the reply correctly
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply.data()));
+
+    EXPECT_CALL(*reply.data(), readAll())
+        .Times(1)
+        .WillOnce(Return(QByteArray()));
+
+    EXPECT_CALL(*reply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply.data(), abort())
+        .Times(1);
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file.data()));
+
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file.data(), write(_))
+        .Times(1)
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(*file.data(), error())
+        .Times(1)
+        .WillOnce(Return(QFile::WriteError));  // any error will do
+
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(false));
+
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier spy(download, SIGNAL(error(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier pausedSpy(download, SIGNAL(paused(bool)));
+
+    download->start();
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+    download->pause();
+    download->pauseTransfer();
+    QVERIFY(pausedSpy.ensureSignalEmitted());
+
+    // assert that the error signal is emitted
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(spy.count(), 1);
+    auto arguments = spy.takeFirst();
+    // assert that the size is not the received but the file size
+    QCOMPARE(arguments.at(0).toString(),
+        QString("FILE SYSTEM ERROR: %1").arg(QFile::WriteError));
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testRedirectCycle() {
+    QUrl redirectUrl("http://one.ubuntu.com");
+    QScopedPointer<MockFile> firstFile(new MockFile("test"));
+    QScopedPointer<MockFile> secondFile(new MockFile("test"));
+    QScopedPointer<MockNetworkReply> firstReply(new MockNetworkReply());
+    QScopedPointer<MockNetworkReply> secondReply(new MockNetworkReply());
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(2)
+        .WillOnce(Return(firstReply.data()))
+        .WillOnce(Return(secondReply.data()));
+
+    EXPECT_CALL(*firstReply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*firstReply.data(),
+            attribute(QNetworkRequest::RedirectionTargetAttribute))
+        .Times(1)
+        .WillOnce(Return(QVariant(redirectUrl)));
+
+    EXPECT_CALL(*secondReply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*secondReply.data(),
+            attribute(QNetworkRequest::RedirectionTargetAttribute))
+        .Times(1)
+        .WillOnce(Return(QVariant(_url)));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(2)
+        .WillOnce(Return(firstFile.data()))
+        .WillOnce(Return(secondFile.data()));
+
+    EXPECT_CALL(*firstFile.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*secondFile.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*firstFile.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*secondFile.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
+    SignalBarrier networkErrorSpy(download,
+        SIGNAL(networkError(NetworkErrorStruct)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier pausedSpy(download, SIGNAL(paused(bool)));
+
+    download->start();  // change state
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    // emit finished and an errors should be emitted
+    firstReply->finished();
+    secondReply->finished();
+
+    QVERIFY(errorSpy.ensureSignalEmitted());
+    QTRY_COMPARE(networkErrorSpy.count(), 1);
+    QTRY_COMPARE(errorSpy.count(), 1);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(firstFile.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(secondFile.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(secondReply.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testSingleRedirect() {
+    QUrl redirectUrl("http://one.ubuntu.com");
+    QScopedPointer<MockFile> firstFile(new MockFile("test"));
+    auto secondFile = new MockFile("test");
+    QScopedPointer<MockNetworkReply> firstReply(new MockNetworkReply());
+    QScopedPointer<MockNetworkReply> secondReply(new MockNetworkReply());
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(2)
+        .WillOnce(Return(firstReply.data()))
+        .WillOnce(Return(secondReply.data()));
+
+    EXPECT_CALL(*firstReply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*firstReply.data(),
+            attribute(QNetworkRequest::RedirectionTargetAttribute))
+        .Times(1)
+        .WillOnce(Return(QVariant(redirectUrl)));
+
+    EXPECT_CALL(*secondReply.data(), setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*secondReply.data(),
+            attribute(QNetworkRequest::RedirectionTargetAttribute))
+        .Times(1)
+        .WillOnce(Return(QVariant()));
+
+    EXPECT_CALL(*secondReply.data(), hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(2)
+        .WillOnce(Return(firstFile.data()))
+        .WillOnce(Return(secondFile));
+
+    EXPECT_CALL(*firstFile.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*secondFile, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*firstFile.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*secondFile, remove())
+        .Times(0);
+
+    EXPECT_CALL(*secondFile, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*secondFile, close())
+        .Times(1);
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+
+    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
+    SignalBarrier networkErrorSpy(download,
+        SIGNAL(networkError(NetworkErrorStruct)));
+    SignalBarrier finishedSpy(download, SIGNAL(finished(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+
+    download->start();
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    firstReply->finished();
+    secondReply->finished();
+
+    QVERIFY(finishedSpy.ensureSignalEmitted());
+    QTRY_COMPARE(networkErrorSpy.count(), 0);
+    QTRY_COMPARE(errorSpy.count(), 0);
+    QTRY_COMPARE(finishedSpy.count(), 1);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(firstFile.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(secondFile));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(secondReply.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testRedirectDoesNotUnlockPath() {
+    auto mutex = new MockFileNameMutex();
+    auto path = QString("random path");
+    FileNameMutex::deleteInstance();
+    FileNameMutex::setInstance(mutex);
+
+    // set the expectations of the filename mutex and rerun the test
+    EXPECT_CALL(*mutex, lockFileName(_))
+        .Times(1)
+        .WillOnce(Return(path));
+
+    EXPECT_CALL(*mutex, unlockFileName(path))
+        .Times(1); // assert that is not unlocked more than once
+
+    testSingleRedirect();
+
+    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
+    FileNameMutex::deleteInstance();
+}
+
+void
+TestDownload::testCancelUnlocksPath() {
+    auto mutex = new MockFileNameMutex();
+    auto path = QString("random path");
+    FileNameMutex::deleteInstance();
+    FileNameMutex::setInstance(mutex);
+
+    // set the expectations of the filename mutex and rerun the test
+    EXPECT_CALL(*mutex, lockFileName(_))
+        .Times(1)
+        .WillOnce(Return(path));
+
+    EXPECT_CALL(*mutex, unlockFileName(path))
+        .Times(1); // assert that is not unlocked more than once
+
+    testCancelDownload();
+
+    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
+    FileNameMutex::deleteInstance();
+}
+
+void
+TestDownload::testFinishUnlocksPath() {
+    auto mutex = new MockFileNameMutex();
+    auto path = QString("random path");
+    FileNameMutex::deleteInstance();
+    FileNameMutex::setInstance(mutex);
+
+    // set the expectations of the filename mutex and rerun the test
+    EXPECT_CALL(*mutex, lockFileName(_))
+        .Times(1)
+        .WillOnce(Return(path));
+
+    EXPECT_CALL(*mutex, unlockFileName(path))
+        .Times(1); // assert that is not unlocked more than once
+
+    testOnSuccessNoHash();
+
+    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
+    FileNameMutex::deleteInstance();
+}
+
+void
+TestDownload::testProcessFinishUnlocksPath() {
+    auto command = QString("touch");
+    QVariantMap metadata;
+    metadata["post-download-command"] = QStringList(command);
+    auto mutex = new MockFileNameMutex();
+    auto path = QString("random path");
+    FileNameMutex::deleteInstance();
+    FileNameMutex::setInstance(mutex);
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    auto reply = new MockNetworkReply();
+    QScopedPointer<MockProcess> process(new MockProcess());
+
+    // set the expectations of the filename mutex and rerun the test
+    EXPECT_CALL(*mutex, lockFileName(_))
+        .Times(1)
+        .WillOnce(Return(path));
+
+    EXPECT_CALL(*mutex, unlockFileName(path))
+        .Times(1); // assert that is not unlocked more than once
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply, attribute(_))
+        .Times(1)
+        .WillOnce(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .Times(2)
+        .WillOnce(Return(false))
+        .WillOnce(Return(false));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file.data()));
+
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file.data(), remove())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+        .Times(0);
+
+    // process factory and process expectation
+    EXPECT_CALL(*_processFactory, createProcess())
+        .Times(1)
+        .WillOnce(Return(process.data()));
+
+    EXPECT_CALL(*process.data(), start(command, _, _))
+        .Times(1);
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+
+    download->start();  // change state
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    // emit the finish signal and expect it to be raised
+    emit reply->finished();
+    emit process->finished(0, QProcess::NormalExit);
+
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(processingSpy.count(), 1);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
+    verifyMocks();
+    FileNameMutex::deleteInstance();
+
+    delete reply;
+}
+
+void
+TestDownload::testErrorUnlocksPath() {
+    auto mutex = new MockFileNameMutex();
+    auto path = QString("random path");
+    FileNameMutex::deleteInstance();
+    FileNameMutex::setInstance(mutex);
+
+    // set the expectations of the filename mutex and rerun the test
+    EXPECT_CALL(*mutex, lockFileName(_))
+        .Times(1)
+        .WillOnce(Return(path));
+
+    EXPECT_CALL(*mutex, unlockFileName(path))
+        .Times(1); // assert that is not unlocked more than once
+
+    testOnSslError();
+
+    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
+    FileNameMutex::deleteInstance();
+}
+
+void
+TestDownload::testLockCustomLocalPath() {
+    auto mutex = new MockFileNameMutex();
+    auto path = QString("random path");
+    FileNameMutex::deleteInstance();
+    FileNameMutex::setInstance(mutex);
+
+    // set the expectations of the filename mutex and rerun the test
+    EXPECT_CALL(*mutex, lockFileName(QStringEndsWith(".tmp")))
+        .Times(1)
+        .WillOnce(Return(path));
+
+    testLocalPathNotConfined();
+
+    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
+    FileNameMutex::deleteInstance();
+}
+
+void
+TestDownload::testSetLocalDirectory() {
+    auto path = testDirectory() + QDir::separator() + "test";
+    QDir().mkpath(path);
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers));
+    auto original = download->filePath();
+    download->setDestinationDir(path);
+    QVERIFY(original != download->filePath());
+    QVERIFY(download->filePath().startsWith(path));
+    verifyMocks();
+}
+
+void
+TestDownload::testSetLocalDirectoryNotAbsolute() {
+    auto path = QString("./path");
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers));
+
+    auto original = download->filePath();
+    download->setDestinationDir(path);
+    QCOMPARE(original, download->filePath());
+    verifyMocks();
+}
+
+void
+TestDownload::testSetLocalDirectoryNotPresent() {
+    auto path = QString("/not/present/path");
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers));
+
+    auto original = download->filePath();
+    download->setDestinationDir(path);
+    QCOMPARE(original, download->filePath());
+    verifyMocks();
+}
+
+void
+TestDownload::testSetLocalDirectoryNotDir() {
+    auto path = testDirectory() + QDir::separator() + "test";
+    QFile file(path);
+    file.open(QIODevice::ReadWrite | QFile::Append);
+    file.write(QByteArray(100, 'w'));
+    file.close();
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers));
+
+    auto original = download->filePath();
+    download->setDestinationDir(path);
+    QCOMPARE(original, download->filePath());
+    verifyMocks();
+}
+
+void
+TestDownload::testSetLocalDirectoryStarted() {
+    auto path = testDirectory() + QDir::separator() + "test";
+    QDir().mkpath(path);
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers));
+
+    auto original = download->filePath();
+    download->start();  // change state
+    download->setDestinationDir(path);
+    QCOMPARE(original, download->filePath());
+    verifyMocks();
+}
+
+void
+TestDownload::testDeflateConstructorError() {
+    // create a download that has a hash AND deflate set to true
+    QVariantMap metadata;
+    metadata[Ubuntu::Transfers::Metadata::DEFLATE_KEY] = true;
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, "hash", "Sha256", metadata, _headers));
+
+    QVERIFY(!download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testDeflateConstructorNoError() {
+    // create a download that has a hash AND deflate set to true
+    QVariantMap metadata;
+    metadata[Ubuntu::Transfers::Metadata::DEFLATE_KEY] = false;
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, "hash", "Sha256", metadata, _headers));
+
+    QVERIFY(download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testDeflateOnRequest() {
+    QVariantMap metadata;
+    metadata[Ubuntu::Transfers::Metadata::DEFLATE_KEY] = true;
+    QString header("Accept-Encoding");
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    // assert that we do have gzip and deflate in the content-encoding header
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(header)))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, remove())
+        .Times(0);
+
+    EXPECT_CALL(*file, close())
+        .Times(1);
+
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+
+    download->start();  // change state
+    download->startTransfer();
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
+    verifyMocks();
+}
+
+void
+TestDownload::testDataUriIsValid() {
+    EXPECT_CALL(*_networkSession, isOnline())
+            .WillRepeatedly(Return(true));
+
+    QUrl url("data:image/gif;base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+            _isConfined, _rootPath, url, _metadata, _headers));
+
+    QVERIFY(download->isValid());
+    verifyMocks();
+}
+
+void
+TestDownload::testDataUriIsValidWithHttpPrefix() {
+    // perform the download and assert that the mime extension used is txt
+    auto file = new MockFile("test");
+    EXPECT_CALL(*_networkSession, isOnline())
+            .WillRepeatedly(Return(true));
+
+    QUrl url("http://images.google.com/data:;base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+            _isConfined, _rootPath, url, _metadata, _headers));
+
+    QVERIFY(download->isValid());
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+            .Times(1)
+            .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+            .Times(1)
+            .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, write(_))
+            .Times(1)
+            .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, close())
+            .Times(1);
+
+    download->startTransfer();
+    QVERIFY(download->filePath().endsWith("txt"));
+}
+
+void
+TestDownload::testDataUriMissingMimeType() {
+    // perform the download and assert that the mime extension used is txt
+    auto file = new MockFile("test");
+    EXPECT_CALL(*_networkSession, isOnline())
+            .WillRepeatedly(Return(true));
+
+    QUrl url("data:;base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+            _isConfined, _rootPath, url, _metadata, _headers));
+
+    QVERIFY(download->isValid());
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+            .Times(1)
+            .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+            .Times(1)
+            .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, write(_))
+            .Times(1)
+            .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, close())
+            .Times(1);
+
+    download->startTransfer();
+    QVERIFY(download->filePath().endsWith("txt"));
+}
+
+void
+TestDownload::testDataUriMimeType_data() {
+    QTest::addColumn<QString>("mime");
+    QTest::addColumn<QString>("extension");
+
+    QTest::newRow("Image gif") << "image/gif" << "gif";
+    QTest::newRow("Image ief") << "image/ief" << "ief";
+    QTest::newRow("Image jpg") << "image/jpeg" << "jpeg";
+    QTest::newRow("Image tiff") << "image/tiff" << "tiff";
+    QTest::newRow("Image rgb") << "image/x-rgb" << "rgb";
+    QTest::newRow("Image bitmap") << "image/x-xbitmap" << "x-xbitmap";
+    QTest::newRow("View MPG") << "video/mpeg" << "mpeg";
+
+}
+
+void
+TestDownload::testDataUriMimeType() {
+    QFETCH(QString, mime);
+    QFETCH(QString, extension);
+    auto file = new MockFile("test");
+    EXPECT_CALL(*_networkSession, isOnline())
+            .WillRepeatedly(Return(true));
+
+    QUrl url("data:" + mime + ";base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
+    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
+            _isConfined, _rootPath, url, _metadata, _headers));
+
+    QVERIFY(download->isValid());
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+            .Times(1)
+            .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+            .Times(1)
+            .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, write(_))
+            .Times(1)
+            .WillOnce(Return(0));
+
+    EXPECT_CALL(*file, close())
+            .Times(1);
+
+    download->startTransfer();
+    QVERIFY(download->filePath().endsWith(extension));
+}
+
+void
+TestDownload::testDataUriPostProcessing_data() {
+    QTest::addColumn<QString>("command");
+    QTest::addColumn<QVariantMap>("metadata");
+    QVariantMap first, second, third;
+    QStringList firstCommand, secondCommand, thirdCommand;
+
+    firstCommand << "touch";
+    first["post-download-command"] = firstCommand;
+
+    QTest::newRow("First row") << firstCommand[0] << first;
+
+    secondCommand << "sudo";
+    second["post-download-command"] = secondCommand;
+
+    QTest::newRow("Second row") << secondCommand[0] << second;
+
+    thirdCommand << "grep";
+    third["post-download-command"] = thirdCommand;
+
+    QTest::newRow("Third row") << thirdCommand[0] << third;
+}
+
+void
+TestDownload::testDataUriPostProcessing() {
+    QFETCH(QString, command);
+    QFETCH(QVariantMap, metadata);
+    QStringList args;  // not args
+
+    QUrl url("data:image/gif;base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
+    QScopedPointer<MockFile> file(new MockFile("test"));
+    QScopedPointer<MockProcess> process(new MockProcess());
+
+    // write the expectations of the reply which is what we are
+    // really testing
+
+    EXPECT_CALL(*_networkSession, isOnline())
+            .WillRepeatedly(Return(true));
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+            .Times(1)
+            .WillOnce(Return(file.data()));
+
+    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+            .Times(1)
+            .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, write(_))
+            .Times(1)
+            .WillOnce(Return(0));
+
+    EXPECT_CALL(*file.data(), remove())
+            .Times(1)
+            .WillOnce(Return(true));
+
+    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
+            .Times(0);
+
+    // process factory and process expectation
+    EXPECT_CALL(*_processFactory, createProcess())
+            .Times(1)
+            .WillOnce(Return(process.data()));
+
+    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
+            .Times(1);
+
+    auto download = new FileDownload(_id, _appId, _path,
+            _isConfined, _rootPath, url, metadata, _headers);
+
+    SignalBarrier spy(download, SIGNAL(finished(QString)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+
+    download->start();  // change state
+    download->startTransfer();
+
+    QVERIFY(startedSpy.ensureSignalEmitted());
+
+    // emit the finish signal and expect it to be raised
+    emit process->finished(0, QProcess::NormalExit);
+
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 20000);
+    QTRY_COMPARE_WITH_TIMEOUT(processingSpy.count(), 1, 20000);
+    QCOMPARE(download->state(), Download::UNCOLLECTED);
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
+    verifyMocks();
+}
+
+void
+TestDownload::testSegmentedDownloadSplit() {
+    QVariantMap metadata;
+    metadata[Ubuntu::Transfers::Metadata::SEGMENTS_KEY] = 4;
+    QByteArray fileData(100, 'a');
+    qint64 total = 8 * 1024 * 1024;
+    qint64 segmentSize = total / 4;
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+    QList<MockNetworkReply*> segmentReplies;
+    for (int index = 0; index < 4; index++) {
+        auto segmentReply = new MockNetworkReply();
+        EXPECT_CALL(*segmentReply, setThrottle(_, _))
+            .Times(1);
+        segmentReplies.append(segmentReply);
+    }
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
+        .Times(1)
+        .WillOnce(Return(reply));
+
+    // the first segment continues where the initial request stopped, the
+    // rest start from scratch
+    for (int index = 0; index < 4; index++) {
+        qint64 start = index * segmentSize + ((index == 0)? fileData.size() : 0);
+        qint64 end = (index + 1) * segmentSize - 1;
+        QString range = "bytes=" + QString::number(start) + "-"
+            + QString::number(end);
+        EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+                QString("Range"), range)))
+            .Times(1)
+            .WillOnce(Return(segmentReplies[index]));
+    }
+
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*reply, readAll())
+        .Times(2)
+        .WillOnce(Return(fileData))
+        .WillOnce(Return(QByteArray()));
+
+    EXPECT_CALL(*reply, attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(200)));
+
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    EXPECT_CALL(*reply, hasRawHeader(QByteArray("Accept-Ranges")))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*reply, rawHeader(QByteArray("Accept-Ranges")))
+        .WillRepeatedly(Return(QByteArray("bytes")));
+
+    EXPECT_CALL(*reply, abort())
+        .Times(1);
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
+
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    delete download;
+    EXPECT_CALL(*file, write(_))
+        .WillRepeatedly(Return(0));
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
-    verifyMocks();
-}
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
 
-void
-TestDownload::testLocalPathConfined() {
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    // the file is reopened to be written in place with the final size
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    // assert that the root path used is not the one in the metadata
-    QVariantMap metadata;
-    QString localPath = "/home/my/local/path";
-    metadata["local-path"] = localPath;
+    EXPECT_CALL(*file, resize(total))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        true, _rootPath, _url, metadata, _headers));
+    EXPECT_CALL(*file, close())
+        .Times(2);
 
-    QVERIFY(download->filePath() != localPath);
-    verifyMocks();
-}
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
 
-void
-TestDownload::testLocalPathNotConfined() {
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    download->start();  // change state
+    download->startTransfer();
 
-    QVariantMap metadata;
-    QString localPath = "/home/my/local/path";
-    metadata["local-path"] = localPath;
+    reply->downloadProgress(fileData.size(), total);
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        false, _rootPath, _url, metadata, _headers));
+    QCOMPARE(download->progress(), qulonglong(fileData.size()));
+    QCOMPARE(download->totalSize(), qulonglong(total));
 
-    QCOMPARE(download->filePath(), localPath);
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
     verifyMocks();
 }
 
 void
-TestDownload::testInvalidUrl() {
+TestDownload::testSegmentedDownloadWritesAtOffset() {
+    QVariantMap metadata;
+    metadata[Ubuntu::Transfers::Metadata::SEGMENTS_KEY] = 4;
+    QByteArray fileData(100, 'a');
+    qint64 total = 8 * 1024 * 1024;
+    qint64 segmentSize = total / 4;
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+    QList<MockNetworkReply*> segmentReplies;
+    for (int index = 0; index < 4; index++) {
+        auto segmentReply = new MockNetworkReply();
+        EXPECT_CALL(*segmentReply, setThrottle(_, _))
+            .Times(1);
+        segmentReplies.append(segmentReply);
+    }
+
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, QUrl(), _metadata, _headers));
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
+        .Times(1)
+        .WillOnce(Return(reply));
 
-    QVERIFY(!download->isValid());
-    verifyMocks();
-}
+    // the first segment continues where the initial request stopped, the
+    // rest start from scratch
+    for (int index = 0; index < 4; index++) {
+        qint64 start = index * segmentSize + ((index == 0)? fileData.size() : 0);
+        qint64 end = (index + 1) * segmentSize - 1;
+        QString range = "bytes=" + QString::number(start) + "-"
+            + QString::number(end);
+        EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+                QString("Range"), range)))
+            .Times(1)
+            .WillOnce(Return(segmentReplies[index]));
+    }
 
-void
-TestDownload::testValidUrl() {
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers));
+    EXPECT_CALL(*reply, readAll())
+        .Times(2)
+        .WillOnce(Return(fileData))
+        .WillOnce(Return(QByteArray()));
 
-    QVERIFY(download->isValid());
-    verifyMocks();
-}
+    EXPECT_CALL(*reply, attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(200)));
 
-void
-TestDownload::testInvalidHashAlgorithm() {
-    EXPECT_CALL(*_networkSession, isOnline())
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    EXPECT_CALL(*reply, hasRawHeader(QByteArray("Accept-Ranges")))
         .WillRepeatedly(Return(true));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, "hash", "not-valid-algo", _metadata,
-        _headers));
-    QVERIFY(!download->isValid());
-    verifyMocks();
-}
+    EXPECT_CALL(*reply, rawHeader(QByteArray("Accept-Ranges")))
+        .WillRepeatedly(Return(QByteArray("bytes")));
 
-void
-TestDownload::testValidHashAlgorithm_data() {
-    QTest::addColumn<QString>("algo");
+    EXPECT_CALL(*reply, abort())
+        .Times(1);
 
-    QTest::newRow("md5") << "md5";
-    QTest::newRow("sha1") << "sha1";
-    QTest::newRow("sha224") << "sha224";
-    QTest::newRow("sha256") << "sha256";
-    QTest::newRow("sha384") << "sha384";
-    QTest::newRow("sha512") << "sha512";
-    QTest::newRow("Empty string") << "";
-}
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
 
-void
-TestDownload::testValidHashAlgorithm() {
-    QFETCH(QString, algo);
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, "hash", algo, _metadata, _headers));
-    QVERIFY(download->isValid());
-    verifyMocks();
-}
+    EXPECT_CALL(*file, write(_))
+        .WillRepeatedly(Return(0));
 
-void
-TestDownload::testInvalidFilePresent() {
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
 
-    // create a file so that we get an error
-    QString filePath = testDirectory() + QDir::separator() + "test_file.jpg";
-    QScopedPointer<QFile> file(new QFile(filePath));
-    file->open(QIODevice::ReadWrite | QFile::Append);
-    file->write("data data data!");
-    file->close();
+    EXPECT_CALL(*segmentReplies[2], readAll())
+        .Times(1)
+        .WillOnce(Return(fileData));
 
-    QVariantMap metadata;
-    metadata["local-path"] = filePath;
+    EXPECT_CALL(*file, writevAt(_, 1, 2 * segmentSize))
+        .Times(1)
+        .WillOnce(Return(fileData.size()));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        false, _rootPath, _url, metadata, _headers));
-    QVERIFY(!download->isValid());
-    verifyMocks();
-}
+    EXPECT_CALL(*file, seek(_))
+        .Times(0);
 
-void
-TestDownload::testValidFileNotPresent() {
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    // the file is reopened to be written in place with the final size
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    QString filePath = testDirectory() + QDir::separator() + "test_file.jpg";
+    EXPECT_CALL(*file, resize(total))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    QVariantMap metadata;
-    metadata["local-path"] = filePath;
+    EXPECT_CALL(*file, close())
+        .Times(2);
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        false, _rootPath, _url, metadata, _headers));
-    QVERIFY(download->isValid());
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+
+    download->start();  // change state
+    download->startTransfer();
+
+    reply->downloadProgress(fileData.size(), total);
+
+    // the data of a segment is written at its own offset without moving
+    // the position of the file
+    segmentReplies[2]->downloadProgress(fileData.size(), segmentSize);
+
+    QCOMPARE(download->progress(), qulonglong(2 * fileData.size()));
+
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
     verifyMocks();
 }
 
 void
-TestDownload::testDownloadPresent() {
+TestDownload::testSegmentedDownloadNoAcceptRanges() {
+    QVariantMap metadata;
+    metadata[Ubuntu::Transfers::Metadata::SEGMENTS_KEY] = 4;
+    QByteArray fileData(100, 'a');
+    qint64 total = 8 * 1024 * 1024;
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
+
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    // create a download and get the filename to use, then write it
-    // and create the same download and assert that the filename is diff
+    // a single request is performed
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        true, _rootPath, _url, _metadata, _headers));
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
 
-    QString filePath = download->filePath();
+    EXPECT_CALL(*reply, readAll())
+        .Times(1)
+        .WillOnce(Return(fileData));
 
-    QScopedPointer<QFile> file(new QFile(filePath));
-    file->open(QIODevice::ReadWrite | QFile::Append);
-    file->write("data data data!");
-    file->close();
+    EXPECT_CALL(*reply, attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(200)));
 
-    QScopedPointer<FileDownload> other(new FileDownload(_id, _appId, _path,
-        true, _rootPath, _url, _metadata, _headers));
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-    QVERIFY(filePath != other->filePath());
-    verifyMocks();
-}
+    EXPECT_CALL(*reply, abort())
+        .Times(0);
 
-void
-TestDownload::testDownloadPresentSeveralFiles_data() {
-    QTest::addColumn<int>("count");
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
 
-    QTest::newRow("One") << 1;
-    QTest::newRow("Some") << 3;
-    QTest::newRow("Several") << 10;
-    QTest::newRow("Plenti") << 100;
-}
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
 
-void
-TestDownload::testDownloadPresentSeveralFiles() {
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*file, write(fileData))
+        .Times(1)
+        .WillOnce(Return(0));
 
-    QFETCH(int, count);
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        true, _rootPath, _url, _metadata, _headers));
+    EXPECT_CALL(*file, resize(_))
+        .Times(0);
 
-    QString filePath = download->filePath();
+    EXPECT_CALL(*file, close())
+        .Times(1);
 
-    QScopedPointer<QFile> file(new QFile(filePath));
-    file->open(QIODevice::ReadWrite | QFile::Append);
-    file->write("data data data!");
-    file->close();
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
 
-    QFileInfo fileInfo(filePath);
-    auto suffix = "." + fileInfo.completeSuffix();
-    qDebug() << "SUFIX" << suffix;
-    auto prefix = filePath.left(filePath.size() - suffix.size());
-    qDebug() << "PREFIX" << prefix;
+    download->start();  // change state
+    download->startTransfer();
 
-    // write the rest of the files
-    for(int index=1; index < count; index++) {
-        auto otherPath = QString("%1 (%2)%3").arg(prefix).arg(index).arg(suffix);
-        qDebug() << "Writing a new file" << otherPath;
-        QScopedPointer<QFile> otherFile(new QFile(otherPath));
-        otherFile->open(QIODevice::ReadWrite | QFile::Append);
-        otherFile->write("data data data!");
-        otherFile->close();
-    }
+    reply->downloadProgress(fileData.size(), total);
 
-    QScopedPointer<FileDownload> other(new FileDownload(_id, _appId, _path,
-        true, _rootPath, _url, _metadata, _headers));
+    QCOMPARE(download->progress(), qulonglong(fileData.size()));
+
+    delete download;
 
-    QVERIFY(filePath != other->filePath());
-    if (count > 0) {
-        auto expectedPath = QString("%1 (%2)%3").arg(prefix).arg(count).arg(suffix);
-        QCOMPARE(expectedPath, other->filePath());
-    }
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(reply));
     verifyMocks();
 }
 
 void
-TestDownload::testProcessingJustOnce() {
-    QString command = "touch";
-    QVariantMap metadata;
-    metadata["post-download-command"] = command;
-
+TestDownload::testProbeSizeBeforeBody() {
+    qint64 total = 1000;
     auto file = new MockFile("test");
+    auto probe = new MockNetworkReply();
     auto reply = new MockNetworkReply();
-    QScopedPointer<MockProcess> process(new MockProcess());
-    QByteArray hashData(100, 'f');
-    auto hashString = QString(hashData.toHex());
-    auto hash = new MockCryptographicHash();
-
-    // write the expectations of the reply which is what we are
-    // really testing
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*_reqFactory, get(_))
+    EXPECT_CALL(*_reqFactory, head(_))
         .Times(1)
-        .WillOnce(Return(reply));
+        .WillOnce(Return(probe));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
-        .Times(1);
+    EXPECT_CALL(*probe, attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(200)));
 
-    EXPECT_CALL(*reply, attribute(_))
+    EXPECT_CALL(*probe, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    EXPECT_CALL(*probe, rawHeader(QByteArray("Content-Length")))
+        .WillRepeatedly(Return(QByteArray::number(total)));
+
+    // the body is only requested once the probe is done
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
         .Times(1)
-        .WillOnce(Return(QVariant(200)));
+        .WillOnce(Return(reply));
 
-    EXPECT_CALL(*reply, hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
@@ -3235,759 +5333,844 @@ TestDownload::testProcessingJustOnce() {
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, reset())
-        .Times(1);
-
-    EXPECT_CALL(*file, flush())
+    EXPECT_CALL(*file, reserve(total))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file, remove())
-        .Times(0);
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier spy(download, SIGNAL(headRequestCompleted()));
 
-    EXPECT_CALL(*file, close())
-        .Times(1);
+    download->start();  // change state
+    download->startTransfer();
+    QCOMPARE(download->totalSize(), qulonglong(0));
 
-    EXPECT_CALL(*file, device())
-        .Times(1)
-        .WillOnce(Return(nullptr));
+    probe->finished();
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-        .Times(1)
-        .WillOnce(Return(hash));
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(download->totalSize(), qulonglong(total));
 
-    EXPECT_CALL(*hash, addData(_))
-        .Times(1);
+    delete download;
 
-    EXPECT_CALL(*hash, result())
+    verifyMocks();
+}
+
+void
+TestDownload::testProbeNotEnoughSpace() {
+    qint64 total = 1000;
+    auto file = new MockFile("test");
+    auto probe = new MockNetworkReply();
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, head(_))
         .Times(1)
-        .WillOnce(Return(hashData));
+        .WillOnce(Return(probe));
 
-    // process factory and process expectation
-    EXPECT_CALL(*_processFactory, createProcess())
+    EXPECT_CALL(*probe, attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(200)));
+
+    EXPECT_CALL(*probe, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    EXPECT_CALL(*probe, rawHeader(QByteArray("Content-Length")))
+        .WillRepeatedly(Return(QByteArray::number(total)));
+
+    // the size is only known after the queue admitted the download
+    EXPECT_CALL(*_fileManager, freeSpace(_, _, _))
+        .WillRepeatedly(DoAll(SetArgReferee<1>(total / 2),
+            SetArgReferee<2>(1), Return(true)));
+
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(0);
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(process.data()));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*process.data(), start(command, _, _))
-        .Times(1);
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    auto download = new FileDownload(_id, _appId,
-        _path, _isConfined, _rootPath, _url, hashString, _algo, metadata,
-        _headers);
+    EXPECT_CALL(*file, reserve(_))
+        .Times(0);
 
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
 
     download->start();  // change state
     download->startTransfer();
 
-    // makes the process to be executed
-    reply->finished();
+    probe->finished();
 
-    QVERIFY(processingSpy.ensureSignalEmitted());
-    QCOMPARE(processingSpy.count(), 1);
+    QVERIFY(errorSpy.ensureSignalEmitted());
+    QCOMPARE(errorSpy.count(), 1);
+    QCOMPARE(download->state(), Download::ERROR);
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(hash));
-    QVERIFY(Mock::VerifyAndClearExpectations(file));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply));
     verifyMocks();
-
-    delete reply;
 }
 
 void
-TestDownload::testFileSystemErrorProgress() {
-    QScopedPointer<MockFile> file(new MockFile("test"));
-    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+TestDownload::testProbeHeadRefused() {
+    qint64 total = 4096;
+    auto file = new MockFile("test");
+    auto probe = new MockNetworkReply();
+    auto rangeProbe = new MockNetworkReply();
+    auto reply = new MockNetworkReply();
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    // set expectations to get the request and the reply correctly
-
-    EXPECT_CALL(*_reqFactory, get(_))
-        .Times(1)
-        .WillOnce(Return(reply.data()));
-
-    EXPECT_CALL(*reply.data(), readAll())
+    EXPECT_CALL(*_reqFactory, head(_))
         .Times(1)
-        .WillOnce(Return(QByteArray()));
+        .WillOnce(Return(probe));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
-        .Times(1);
+    EXPECT_CALL(*probe, attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(405)));
 
-    EXPECT_CALL(*reply, attribute(_))
+    // the first byte is asked for instead
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+            QString("Range"), QString("bytes=0-0"))))
         .Times(1)
-        .WillOnce(Return(QVariant(200)));
+        .WillOnce(Return(rangeProbe));
 
-    EXPECT_CALL(*reply, hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
+    EXPECT_CALL(*rangeProbe,
+            attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(206)));
 
-    // file system expectations
-    EXPECT_CALL(*_fileManager, createFile(_))
-        .Times(1)
-        .WillOnce(Return(file.data()));
+    EXPECT_CALL(*rangeProbe, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*rangeProbe, rawHeader(QByteArray("Content-Range")))
+        .WillRepeatedly(Return(QByteArray("bytes 0-0/4096")));
 
-    EXPECT_CALL(*file.data(), write(_))
-        .Times(1)
-        .WillOnce(Return(0));
-    
-    EXPECT_CALL(*file.data(), flush())
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
         .Times(1)
-        .WillOnce(Return(false));
+        .WillOnce(Return(reply));
 
-    EXPECT_CALL(*file.data(), size())
-        .Times(1)
-        .WillOnce(Return(0));
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
 
-    EXPECT_CALL(*file.data(), error())
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(QFile::WriteError));  // any error will do
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*file.data(), remove())
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
     auto download = new FileDownload(_id, _appId, _path,
         _isConfined, _rootPath, _url, _metadata, _headers);
-    SignalBarrier spy(download, SIGNAL(error(QString)));
-    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier progressSpy(download, SIGNAL(progress(qulonglong, qulonglong)));
 
-    download->start();
+    download->start();  // change state
     download->startTransfer();
-    QVERIFY(startedSpy.ensureSignalEmitted());
-
-    reply->downloadProgress(0, 13);
-    QVERIFY(progressSpy.ensureSignalEmitted());
-    reply->finished(); // emit finished signal so that we try to write
 
-    // assert that the error signal is emitted
-    QVERIFY(spy.ensureSignalEmitted());
-    QTRY_COMPARE(spy.count(), 1);
+    probe->finished();
+    rangeProbe->finished();
 
-    auto arguments = spy.takeFirst();
-    // assert that the size is not the received but the file size
-    QCOMPARE(arguments.at(0).toString(),
-        QString("FILE SYSTEM ERROR: %1").arg(QFile::WriteError));
+    QCOMPARE(download->totalSize(), qulonglong(total));
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testFileSystemErrorPause() {
-    QScopedPointer<MockFile> file(new MockFile("test"));
-    QScopedPointer<MockNetworkReply> reply(new MockNetworkReply());
+TestDownload::testResumeRangeNotHonoured() {
+    QByteArray fileData(100, 'f');
+    auto file = new MockFile("test");
+    auto firstReply = new MockNetworkReply();
+    auto secondReply = new MockNetworkReply();
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    // set expectations to get the request and the reply correctly
-
-    EXPECT_CALL(*_reqFactory, get(_))
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
         .Times(1)
-        .WillOnce(Return(reply.data()));
+        .WillOnce(Return(firstReply));
 
-    EXPECT_CALL(*reply.data(), readAll())
+    // the resumed request is only valid for the same resource
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+            QString("If-Range"), QString("\"v1\""))))
         .Times(1)
-        .WillOnce(Return(QByteArray()));
+        .WillOnce(Return(secondReply));
 
-    EXPECT_CALL(*reply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply.data(), abort())
+    EXPECT_CALL(*firstReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    EXPECT_CALL(*firstReply, hasRawHeader(QByteArray("ETag")))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*firstReply, rawHeader(QByteArray("ETag")))
+        .WillRepeatedly(Return(QByteArray("\"v1\"")));
+
+    EXPECT_CALL(*firstReply, abort())
+        .Times(1);
+
+    EXPECT_CALL(*firstReply, readAll())
+        .Times(1)
+        .WillOnce(Return(fileData));
+
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
         .Times(1);
 
+    // the server sends the whole resource
+    EXPECT_CALL(*secondReply,
+            attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(200)));
+
+    EXPECT_CALL(*secondReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    EXPECT_CALL(*secondReply, readAll())
+        .WillRepeatedly(Return(QByteArray()));
+
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(file.data()));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*file.data(), write(_))
-        .Times(1)
-        .WillOnce(Return(0));
-
-    EXPECT_CALL(*file.data(), error())
+    EXPECT_CALL(*file, write(fileData))
         .Times(1)
-        .WillOnce(Return(QFile::WriteError));  // any error will do
+        .WillOnce(Return(fileData.size()));
 
     EXPECT_CALL(*file, flush())
         .Times(1)
-        .WillOnce(Return(false));
+        .WillOnce(Return(true));
 
-    EXPECT_CALL(*file.data(), remove())
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
+
+    // the data of the old resource is dropped instead of appended to
+    EXPECT_CALL(*file, resize(0))
         .Times(1)
         .WillOnce(Return(true));
 
     auto download = new FileDownload(_id, _appId, _path,
         _isConfined, _rootPath, _url, _metadata, _headers);
-    SignalBarrier spy(download, SIGNAL(error(QString)));
-    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier pausedSpy(download, SIGNAL(paused(bool)));
 
-    download->start();
+    download->start();  // change state
     download->startTransfer();
-    QVERIFY(startedSpy.ensureSignalEmitted());
     download->pause();
     download->pauseTransfer();
-    QVERIFY(pausedSpy.ensureSignalEmitted());
+    QCOMPARE(download->etag(), QByteArray("\"v1\""));
+    download->resume();
+    download->resumeTransfer();
 
-    // assert that the error signal is emitted
-    QVERIFY(spy.ensureSignalEmitted());
-    QCOMPARE(spy.count(), 1);
-    auto arguments = spy.takeFirst();
-    // assert that the size is not the received but the file size
-    QCOMPARE(arguments.at(0).toString(),
-        QString("FILE SYSTEM ERROR: %1").arg(QFile::WriteError));
+    secondReply->downloadProgress(0, 200);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(secondReply));
 
+    delete firstReply;
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testRedirectCycle() {
-    QUrl redirectUrl("http://one.ubuntu.com");
-    QScopedPointer<MockFile> firstFile(new MockFile("test"));
-    QScopedPointer<MockFile> secondFile(new MockFile("test"));
-    QScopedPointer<MockNetworkReply> firstReply(new MockNetworkReply());
-    QScopedPointer<MockNetworkReply> secondReply(new MockNetworkReply());
-
-    // write the expectations of the reply which is what we are
-    // really testing
+TestDownload::testRetryTransientError() {
+    QByteArray fileData(100, 'f');
+    auto file = new MockFile("test");
+    auto firstReply = new MockNetworkReply();
+    auto secondReply = new MockNetworkReply();
+    bool retried = false;
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*_reqFactory, get(_))
-        .Times(2)
-        .WillOnce(Return(firstReply.data()))
-        .WillOnce(Return(secondReply.data()));
-
-    EXPECT_CALL(*firstReply.data(), setReadBufferSize(_))
-        .Times(1);
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
+        .Times(1)
+        .WillOnce(Return(firstReply));
 
-    EXPECT_CALL(*firstReply.data(),
-            attribute(QNetworkRequest::RedirectionTargetAttribute))
+    // the retry asks for the data that was not received
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+            QString("Range"), QString("bytes=100-"))))
         .Times(1)
-        .WillOnce(Return(QVariant(redirectUrl)));
+        .WillOnce(Invoke([&](const QNetworkRequest&) {
+            retried = true;
+            return secondReply;
+        }));
 
-    EXPECT_CALL(*secondReply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*secondReply.data(),
-            attribute(QNetworkRequest::RedirectionTargetAttribute))
+    EXPECT_CALL(*firstReply, attribute(_))
+        .WillRepeatedly(Return(QVariant()));  // invalid variant
+
+    EXPECT_CALL(*firstReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    // the data received before the error is kept
+    EXPECT_CALL(*firstReply, readAll())
         .Times(1)
-        .WillOnce(Return(QVariant(_url)));
+        .WillOnce(Return(fileData));
+
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
+        .Times(1);
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
-        .Times(2)
-        .WillOnce(Return(firstFile.data()))
-        .WillOnce(Return(secondFile.data()));
-
-    EXPECT_CALL(*firstFile.data(), open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*secondFile.data(), open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*firstFile.data(), remove())
+    EXPECT_CALL(*file, write(fileData))
         .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Return(fileData.size()));
 
-    EXPECT_CALL(*secondFile.data(), remove())
+    EXPECT_CALL(*file, flush())
         .Times(1)
         .WillOnce(Return(true));
 
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
+
+    EXPECT_CALL(*file, remove())
+        .Times(0);
+
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::RETRIES_KEY] = 1;
+    metadata[Ubuntu::Transfers::Metadata::RETRY_DELAY_KEY] = 1;
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
-    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
-    SignalBarrier networkErrorSpy(download,
-        SIGNAL(networkError(NetworkErrorStruct)));
+        _isConfined, _rootPath, _url, metadata, _headers);
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier pausedSpy(download, SIGNAL(paused(bool)));
+    QSignalSpy errorSpy(download, SIGNAL(error(QString)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit finished and an errors should be emitted
-    firstReply->finished();
-    secondReply->finished();
+    firstReply->error(QNetworkReply::RemoteHostClosedError);
+    QTRY_VERIFY(retried);
+    QCOMPARE(errorSpy.count(), 0);
 
-    QVERIFY(errorSpy.ensureSignalEmitted());
-    QTRY_COMPARE(networkErrorSpy.count(), 1);
-    QTRY_COMPARE(errorSpy.count(), 1);
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply));
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(firstFile.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(secondFile.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(firstReply.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(secondReply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testSingleRedirect() {
-    QUrl redirectUrl("http://one.ubuntu.com");
-    QScopedPointer<MockFile> firstFile(new MockFile("test"));
-    auto secondFile = new MockFile("test");
-    QScopedPointer<MockNetworkReply> firstReply(new MockNetworkReply());
-    QScopedPointer<MockNetworkReply> secondReply(new MockNetworkReply());
-
-    // write the expectations of the reply which is what we are
-    // really testing
+TestDownload::testDurabilityPeriodicSync() {
+    QByteArray fileData(100, 'f');
+    qint64 syncSize = 16 * 1024 * 1024;
+    qint64 fileSize = syncSize;
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
     EXPECT_CALL(*_reqFactory, get(_))
-        .Times(2)
-        .WillOnce(Return(firstReply.data()))
-        .WillOnce(Return(secondReply.data()));
-
-    EXPECT_CALL(*firstReply.data(), setReadBufferSize(_))
-        .Times(1);
-
-    EXPECT_CALL(*firstReply.data(),
-            attribute(QNetworkRequest::RedirectionTargetAttribute))
         .Times(1)
-        .WillOnce(Return(QVariant(redirectUrl)));
+        .WillOnce(Return(reply));
 
-    EXPECT_CALL(*secondReply.data(), setReadBufferSize(_))
+    EXPECT_CALL(*reply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*secondReply.data(),
-            attribute(QNetworkRequest::RedirectionTargetAttribute))
-        .Times(1)
-        .WillOnce(Return(QVariant()));
+    EXPECT_CALL(*reply, attribute(_))
+        .WillRepeatedly(Return(QVariant()));  // invalid variant
 
-    EXPECT_CALL(*secondReply.data(), hasRawHeader(_))
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    EXPECT_CALL(*reply, readAll())
         .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
+        .WillRepeatedly(Return(fileData));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
-        .Times(2)
-        .WillOnce(Return(firstFile.data()))
-        .WillOnce(Return(secondFile));
-
-    EXPECT_CALL(*firstFile.data(), open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
-        .WillOnce(Return(true));
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*secondFile, open(QIODevice::ReadWrite | QFile::Append))
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*firstFile.data(), remove())
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*file, write(fileData))
+        .Times(2)
+        .WillRepeatedly(Return(fileData.size()));
 
-    EXPECT_CALL(*secondFile, remove())
-        .Times(0);
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Invoke([&fileSize]() {
+            return fileSize;
+        }));
 
-    EXPECT_CALL(*secondFile, flush())
+    // only the first chunk reaches the amount of data between syncs
+    EXPECT_CALL(*file, sync())
         .Times(1)
         .WillOnce(Return(true));
 
-    EXPECT_CALL(*secondFile, close())
-        .Times(1);
-
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::DURABILITY_KEY] =
+        Ubuntu::Transfers::Metadata::DURABILITY_PERIODIC;
     auto download = new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers);
-
-    SignalBarrier errorSpy(download, SIGNAL(error(QString)));
-    SignalBarrier networkErrorSpy(download,
-        SIGNAL(networkError(NetworkErrorStruct)));
-    SignalBarrier finishedSpy(download, SIGNAL(finished(QString)));
+        _isConfined, _rootPath, _url, metadata, _headers);
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
 
-    download->start();
+    download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
+    QCOMPARE(download->durableSize(), qint64(0));
 
-    firstReply->finished();
-    secondReply->finished();
+    QSignalSpy changedSpy(download, SIGNAL(durableSizeChanged()));
+    reply->downloadProgress(fileSize, -1);
+    QCOMPARE(download->durableSize(), syncSize);
+    QCOMPARE(changedSpy.count(), 1);
 
-    QVERIFY(finishedSpy.ensureSignalEmitted());
-    QTRY_COMPARE(networkErrorSpy.count(), 0);
-    QTRY_COMPARE(errorSpy.count(), 0);
-    QTRY_COMPARE(finishedSpy.count(), 1);
+    fileSize += fileData.size();
+    reply->downloadProgress(fileSize, -1);
+    QCOMPARE(download->durableSize(), syncSize);
+    QCOMPARE(changedSpy.count(), 1);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(firstFile.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(secondFile));
-    QVERIFY(Mock::VerifyAndClearExpectations(firstReply.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(secondReply.data()));
     verifyMocks();
 }
 
 void
-TestDownload::testRedirectDoesNotUnlockPath() {
-    auto mutex = new MockFileNameMutex();
-    auto path = QString("random path");
-    FileNameMutex::deleteInstance();
-    FileNameMutex::setInstance(mutex);
+TestDownload::testDurabilityResume_data() {
+    QTest::addColumn<QString>("durability");
+    QTest::addColumn<bool>("restored");
+    QTest::addColumn<QString>("range");
+    QTest::addColumn<int>("resizes");
+
+    // the page cache of the daemon still has the data that was not synced
+    QTest::newRow("Periodic") << Ubuntu::Transfers::Metadata::DURABILITY_PERIODIC
+        << false << "bytes=100-" << 0;
+    QTest::newRow("Finish") << Ubuntu::Transfers::Metadata::DURABILITY_FINISH
+        << false << "bytes=100-" << 0;
+    // after a restart only the durable size stored in the db is trusted
+    QTest::newRow("Periodic restored")
+        << Ubuntu::Transfers::Metadata::DURABILITY_PERIODIC
+        << true << "bytes=40-" << 1;
+    QTest::newRow("Finish restored")
+        << Ubuntu::Transfers::Metadata::DURABILITY_FINISH
+        << true << "bytes=40-" << 1;
+}
 
-    // set the expectations of the filename mutex and rerun the test
-    EXPECT_CALL(*mutex, lockFileName(_))
+void
+TestDownload::testDurabilityResume() {
+    QFETCH(QString, durability);
+    QFETCH(bool, restored);
+    QFETCH(QString, range);
+    QFETCH(int, resizes);
+    QByteArray fileData(100, 'f');
+    auto file = new MockFile("test");
+    auto firstReply = new MockNetworkReply();
+    auto secondReply = new MockNetworkReply();
+
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
         .Times(1)
-        .WillOnce(Return(path));
+        .WillOnce(Return(firstReply));
 
-    EXPECT_CALL(*mutex, unlockFileName(path))
-        .Times(1); // assert that is not unlocked more than once
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+            QString("Range"), range)))
+        .Times(1)
+        .WillOnce(Return(secondReply));
 
-    testSingleRedirect();
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
+        .Times(1);
 
-    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
-    FileNameMutex::deleteInstance();
-}
+    EXPECT_CALL(*firstReply, attribute(_))
+        .WillRepeatedly(Return(QVariant()));  // invalid variant
 
-void
-TestDownload::testCancelUnlocksPath() {
-    auto mutex = new MockFileNameMutex();
-    auto path = QString("random path");
-    FileNameMutex::deleteInstance();
-    FileNameMutex::setInstance(mutex);
+    EXPECT_CALL(*firstReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-    // set the expectations of the filename mutex and rerun the test
-    EXPECT_CALL(*mutex, lockFileName(_))
+    EXPECT_CALL(*firstReply, readAll())
         .Times(1)
-        .WillOnce(Return(path));
+        .WillOnce(Return(fileData));
 
-    EXPECT_CALL(*mutex, unlockFileName(path))
-        .Times(1); // assert that is not unlocked more than once
+    EXPECT_CALL(*firstReply, abort())
+        .Times(1);
 
-    testCancelDownload();
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
+        .Times(1);
 
-    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
-    FileNameMutex::deleteInstance();
-}
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
 
-void
-TestDownload::testFinishUnlocksPath() {
-    auto mutex = new MockFileNameMutex();
-    auto path = QString("random path");
-    FileNameMutex::deleteInstance();
-    FileNameMutex::setInstance(mutex);
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    // set the expectations of the filename mutex and rerun the test
-    EXPECT_CALL(*mutex, lockFileName(_))
+    EXPECT_CALL(*file, write(fileData))
         .Times(1)
-        .WillOnce(Return(path));
+        .WillOnce(Return(fileData.size()));
 
-    EXPECT_CALL(*mutex, unlockFileName(path))
-        .Times(1); // assert that is not unlocked more than once
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
 
-    testOnSuccessNoHash();
+    // pausing makes the data durable
+    EXPECT_CALL(*file, sync())
+        .Times(1)
+        .WillOnce(Return(true));
 
-    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
-    FileNameMutex::deleteInstance();
-}
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
 
-void
-TestDownload::testProcessFinishUnlocksPath() {
-    auto command = QString("touch");
-    QVariantMap metadata;
-    metadata["post-download-command"] = QStringList(command);
-    auto mutex = new MockFileNameMutex();
-    auto path = QString("random path");
-    FileNameMutex::deleteInstance();
-    FileNameMutex::setInstance(mutex);
-    QScopedPointer<MockFile> file(new MockFile("test"));
-    auto reply = new MockNetworkReply();
-    QScopedPointer<MockProcess> process(new MockProcess());
+    EXPECT_CALL(*file, resize(40))
+        .Times(resizes)
+        .WillRepeatedly(Return(true));
 
-    // set the expectations of the filename mutex and rerun the test
-    EXPECT_CALL(*mutex, lockFileName(_))
-        .Times(1)
-        .WillOnce(Return(path));
+    EXPECT_CALL(*file, remove())
+        .Times(0);
 
-    EXPECT_CALL(*mutex, unlockFileName(path))
-        .Times(1); // assert that is not unlocked more than once
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::DURABILITY_KEY] = durability;
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+    SignalBarrier pausedSpy(download, SIGNAL(paused(bool)));
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    SignalBarrier resumedSpy(download, SIGNAL(resumed(bool)));
 
-    // write the expectations of the reply which is what we are
-    // really testing
+    download->start();  // change state
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
+    download->pause();
+    download->pauseTransfer();
+    QVERIFY(pausedSpy.ensureSignalEmitted());
+    QCOMPARE(download->durableSize(), qint64(fileData.size()));
+
+    if (restored) {
+        // as read from the db after the daemon was restarted
+        download->setDurableSize(40);
+    }
+
+    download->resume();
+    download->resumeTransfer();
+    QVERIFY(resumedSpy.ensureSignalEmitted());
+
+    delete firstReply;
+    delete download;
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply));
+    QVERIFY(Mock::VerifyAndClearExpectations(secondReply));
+    verifyMocks();
+}
+
+void
+TestDownload::testRetryAfterServiceUnavailable() {
+    auto file = new MockFile("test");
+    auto firstReply = new MockNetworkReply();
+    auto secondReply = new MockNetworkReply();
+    bool retried = false;
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*_reqFactory, get(_))
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
+        .Times(1)
+        .WillOnce(Return(firstReply));
+
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+            QString("Range"), QString("bytes=0-"))))
         .Times(1)
-        .WillOnce(Return(reply));
+        .WillOnce(Invoke([&](const QNetworkRequest&) {
+            retried = true;
+            return secondReply;
+        }));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
         .Times(1);
 
-    EXPECT_CALL(*reply, attribute(_))
-        .Times(1)
-        .WillOnce(Return(QVariant(200)));
+    EXPECT_CALL(*firstReply,
+            attribute(QNetworkRequest::HttpStatusCodeAttribute))
+        .WillRepeatedly(Return(QVariant(503)));
 
-    EXPECT_CALL(*reply, hasRawHeader(_))
-        .Times(2)
-        .WillOnce(Return(false))
-        .WillOnce(Return(false));
+    EXPECT_CALL(*firstReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-    // file system expectations
-    EXPECT_CALL(*_fileManager, createFile(_))
-        .Times(1)
-        .WillOnce(Return(file.data()));
+    // the server knows when it will be back
+    EXPECT_CALL(*firstReply, hasRawHeader(QByteArray("Retry-After")))
+        .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*firstReply, rawHeader(QByteArray("Retry-After")))
+        .WillRepeatedly(Return(QByteArray("0")));
 
-    EXPECT_CALL(*file, flush())
-        .Times(1)
-        .WillOnce(Return(true));
+    // the error page is not part of the download
+    EXPECT_CALL(*firstReply, readAll())
+        .Times(0);
 
-    EXPECT_CALL(*file.data(), remove())
-        .Times(1)
-        .WillOnce(Return(true));
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
+        .Times(1);
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-        .Times(0);
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
 
-    // process factory and process expectation
-    EXPECT_CALL(*_processFactory, createProcess())
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
         .Times(1)
-        .WillOnce(Return(process.data()));
+        .WillOnce(Return(true));
 
-    EXPECT_CALL(*process.data(), start(command, _, _))
-        .Times(1);
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(0));
 
+    // an hour unless the Retry-After header is followed
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::RETRIES_KEY] = 3;
+    metadata[Ubuntu::Transfers::Metadata::RETRY_DELAY_KEY] = 3600000;
     auto download = new FileDownload(_id, _appId, _path,
         _isConfined, _rootPath, _url, metadata, _headers);
-
-    SignalBarrier spy(download, SIGNAL(finished(QString)));
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
+    QSignalSpy errorSpy(download, SIGNAL(error(QString)));
 
     download->start();  // change state
     download->startTransfer();
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the finish signal and expect it to be raised
-    emit reply->finished();
-    emit process->finished(0, QProcess::NormalExit);
+    firstReply->error(QNetworkReply::ServiceUnavailableError);
+    QTRY_VERIFY(retried);
+    QCOMPARE(errorSpy.count(), 0);
 
-    QVERIFY(spy.ensureSignalEmitted());
-    QCOMPARE(spy.count(), 1);
-    QCOMPARE(processingSpy.count(), 1);
-    QCOMPARE(download->state(), Download::UNCOLLECTED);
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply));
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply));
-    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
     verifyMocks();
-    FileNameMutex::deleteInstance();
-
-    delete reply;
 }
 
 void
-TestDownload::testErrorUnlocksPath() {
-    auto mutex = new MockFileNameMutex();
-    auto path = QString("random path");
-    FileNameMutex::deleteInstance();
-    FileNameMutex::setInstance(mutex);
+TestDownload::testStalledDownloadReconnects() {
+    auto file = new MockFile("test");
+    auto firstReply = new MockNetworkReply();
+    auto secondReply = new MockNetworkReply();
+    auto timer = new MockTimer();
 
-    // set the expectations of the filename mutex and rerun the test
-    EXPECT_CALL(*mutex, lockFileName(_))
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
         .Times(1)
-        .WillOnce(Return(path));
+        .WillOnce(Return(firstReply));
 
-    EXPECT_CALL(*mutex, unlockFileName(path))
-        .Times(1); // assert that is not unlocked more than once
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+            QString("Range"), QString("bytes=0-"))))
+        .Times(1)
+        .WillOnce(Return(secondReply));
 
-    testOnSslError();
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
+        .Times(1);
 
-    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
-    FileNameMutex::deleteInstance();
-}
+    EXPECT_CALL(*firstReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-void
-TestDownload::testLockCustomLocalPath() {
-    auto mutex = new MockFileNameMutex();
-    auto path = QString("random path");
-    FileNameMutex::deleteInstance();
-    FileNameMutex::setInstance(mutex);
+    // the socket that sends nothing is dropped
+    EXPECT_CALL(*firstReply, abort())
+        .Times(1);
 
-    // set the expectations of the filename mutex and rerun the test
-    EXPECT_CALL(*mutex, lockFileName(QStringEndsWith(".tmp")))
+    EXPECT_CALL(*firstReply, readAll())
+        .WillRepeatedly(Return(QByteArray()));
+
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*timer, start(60000))
+        .Times(AnyNumber());
+
+    EXPECT_CALL(*timer, stop())
+        .Times(AnyNumber());
+
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
         .Times(1)
-        .WillOnce(Return(path));
+        .WillOnce(Return(file));
 
-    testLocalPathNotConfined();
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    QVERIFY(Mock::VerifyAndClearExpectations(mutex));
-    FileNameMutex::deleteInstance();
-}
+    EXPECT_CALL(*file, write(_))
+        .WillRepeatedly(Return(0));
 
-void
-TestDownload::testSetLocalDirectory() {
-    auto path = testDirectory() + QDir::separator() + "test";
-    QDir().mkpath(path);
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
 
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(0));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers));
-    auto original = download->filePath();
-    download->setDestinationDir(path);
-    QVERIFY(original != download->filePath());
-    QVERIFY(download->filePath().startsWith(path));
-    verifyMocks();
-}
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, _metadata, _headers);
+    download->setWatchdogTimer(timer);
+    QSignalSpy errorSpy(download, SIGNAL(error(QString)));
 
-void
-TestDownload::testSetLocalDirectoryNotAbsolute() {
-    auto path = QString("./path");
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    download->start();  // change state
+    download->startTransfer();
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers));
+    // no data arrived during the whole window
+    timer->timeout();
+    QCOMPARE(errorSpy.count(), 0);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply));
+    QVERIFY(Mock::VerifyAndClearExpectations(secondReply));
+
+    delete download;
 
-    auto original = download->filePath();
-    download->setDestinationDir(path);
-    QCOMPARE(original, download->filePath());
     verifyMocks();
 }
 
 void
-TestDownload::testSetLocalDirectoryNotPresent() {
-    auto path = QString("/not/present/path");
+TestDownload::testSlowDownloadReconnects() {
+    auto file = new MockFile("test");
+    auto firstReply = new MockNetworkReply();
+    auto secondReply = new MockNetworkReply();
+    auto timer = new MockTimer();
+
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers));
+    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(QString("Range"))))
+        .Times(1)
+        .WillOnce(Return(firstReply));
 
-    auto original = download->filePath();
-    download->setDestinationDir(path);
-    QCOMPARE(original, download->filePath());
-    verifyMocks();
-}
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
+        .Times(1);
 
-void
-TestDownload::testSetLocalDirectoryNotDir() {
-    auto path = testDirectory() + QDir::separator() + "test";
-    QFile file(path);
-    file.open(QIODevice::ReadWrite | QFile::Append);
-    file.write(QByteArray(100, 'w'));
-    file.close();
+    EXPECT_CALL(*firstReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*firstReply, abort())
+        .Times(1);
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers));
+    // fast enough at first and then under the floor
+    EXPECT_CALL(*firstReply, readAll())
+        .WillOnce(Return(QByteArray(1000, 'f')))
+        .WillOnce(Return(QByteArray(10, 'f')))
+        .WillRepeatedly(Return(QByteArray()));
 
-    auto original = download->filePath();
-    download->setDestinationDir(path);
-    QCOMPARE(original, download->filePath());
-    verifyMocks();
-}
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
+        .Times(1);
 
-void
-TestDownload::testSetLocalDirectoryStarted() {
-    auto path = testDirectory() + QDir::separator() + "test";
-    QDir().mkpath(path);
+    EXPECT_CALL(*timer, start(1000))
+        .Times(AnyNumber());
 
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*timer, stop())
+        .Times(AnyNumber());
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, _metadata, _headers));
+    // file system expectations
+    EXPECT_CALL(*_fileManager, createFile(_))
+        .Times(1)
+        .WillOnce(Return(file));
 
-    auto original = download->filePath();
-    download->start();  // change state
-    download->setDestinationDir(path);
-    QCOMPARE(original, download->filePath());
-    verifyMocks();
-}
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
 
-void
-TestDownload::testDeflateConstructorError() {
-    // create a download that has a hash AND deflate set to true
-    QVariantMap metadata;
-    metadata[Ubuntu::Transfers::Metadata::DEFLATE_KEY] = true;
+    EXPECT_CALL(*file, write(_))
+        .WillRepeatedly(Invoke([](const QByteArray& data) {
+            return static_cast<qint64>(data.size());
+        }));
 
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, "hash", "Sha256", metadata, _headers));
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(1010));
 
-    QVERIFY(!download->isValid());
-    verifyMocks();
-}
+    // 100 bytes per second measured over a second
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::STALL_TIMEOUT_KEY] = 1000;
+    metadata[Ubuntu::Transfers::Metadata::MIN_SPEED_KEY] = 100;
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+    download->setWatchdogTimer(timer);
 
-void
-TestDownload::testDeflateConstructorNoError() {
-    // create a download that has a hash AND deflate set to true
-    QVariantMap metadata;
-    metadata[Ubuntu::Transfers::Metadata::DEFLATE_KEY] = false;
+    download->start();  // change state
+    download->startTransfer();
 
-    EXPECT_CALL(*_networkSession, isOnline())
-        .WillRepeatedly(Return(true));
+    firstReply->downloadProgress(1000, -1);
+    timer->timeout();
+    QVERIFY(Mock::VerifyAndClearExpectations(_reqFactory));
 
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-        _isConfined, _rootPath, _url, "hash", "Sha256", metadata, _headers));
+    // the reconnection asks for the rest
+    EXPECT_CALL(*_reqFactory, get(RequestHasHeaderWithValue(
+            QString("Range"), QString("bytes=1010-"))))
+        .Times(1)
+        .WillOnce(Return(secondReply));
 
-    QVERIFY(download->isValid());
-    verifyMocks();
-}
+    firstReply->downloadProgress(1010, -1);
+    timer->timeout();
 
-void
-TestDownload::testDeflateOnRequest() {
-    QVariantMap metadata;
-    metadata[Ubuntu::Transfers::Metadata::DEFLATE_KEY] = true;
-    QString header("Accept-Encoding");
-    auto file = new MockFile("test");
-    auto reply = new MockNetworkReply();
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply));
+    QVERIFY(Mock::VerifyAndClearExpectations(secondReply));
 
-    // write the expectations of the reply which is what we are
-    // really testing
+    delete download;
+
+    verifyMocks();
+}
+
+void
+TestDownload::testMetalinkMirrorFailover() {
+    QByteArray fileData(100, 'f');
+    auto file = new MockFile("test");
+    auto firstReply = new MockNetworkReply();
+    auto secondReply = new MockNetworkReply();
+    QList<QNetworkRequest> requests;
 
     EXPECT_CALL(*_networkSession, isOnline())
         .WillRepeatedly(Return(true));
 
-    // assert that we do have gzip and deflate in the content-encoding header
-    EXPECT_CALL(*_reqFactory, get(RequestDoesNotHaveHeader(header)))
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(2)
+        .WillOnce(Invoke([&](const QNetworkRequest& request) {
+            requests.append(request);
+            return firstReply;
+        }))
+        .WillOnce(Invoke([&](const QNetworkRequest& request) {
+            requests.append(request);
+            return secondReply;
+        }));
+
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
+        .Times(1);
+
+    EXPECT_CALL(*firstReply, attribute(_))
+        .WillRepeatedly(Return(QVariant()));  // invalid variant
+
+    EXPECT_CALL(*firstReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
+
+    // the data of the first mirror is kept
+    EXPECT_CALL(*firstReply, readAll())
         .Times(1)
-        .WillOnce(Return(reply));
+        .WillOnce(Return(fileData));
 
-    EXPECT_CALL(*reply, setReadBufferSize(_))
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
         .Times(1);
 
     // file system expectations
@@ -3999,243 +6182,247 @@ TestDownload::testDeflateOnRequest() {
         .Times(1)
         .WillOnce(Return(true));
 
+    EXPECT_CALL(*file, write(fileData))
+        .Times(1)
+        .WillOnce(Return(fileData.size()));
+
+    EXPECT_CALL(*file, flush())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
+
     EXPECT_CALL(*file, remove())
         .Times(0);
 
-    EXPECT_CALL(*file, close())
-        .Times(1);
-
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::METALINK_KEY] = QString(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+        "<file name=\"image.iso\">"
+        "<url priority=\"2\">http://second.example.com/image.iso</url>"
+        "<url priority=\"1\">http://first.example.com/image.iso</url>"
+        "</file>"
+        "</metalink>");
     auto download = new FileDownload(_id, _appId, _path,
         _isConfined, _rootPath, _url, metadata, _headers);
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    QSignalSpy errorSpy(download, SIGNAL(error(QString)));
+
+    QVERIFY(download->isValid());
+    QCOMPARE(download->url(), QUrl("http://first.example.com/image.iso"));
+    QCOMPARE(QFileInfo(download->filePath()).fileName(), QString("image.iso"));
 
     download->start();  // change state
     download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
 
-    delete download;
+    firstReply->error(QNetworkReply::RemoteHostClosedError);
+    QCOMPARE(errorSpy.count(), 0);
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file));
-    QVERIFY(Mock::VerifyAndClearExpectations(reply));
-    verifyMocks();
-}
+    // the next mirror is asked for the rest of the file
+    QCOMPARE(requests.count(), 2);
+    QCOMPARE(requests[0].url(), QUrl("http://first.example.com/image.iso"));
+    QCOMPARE(requests[1].url(), QUrl("http://second.example.com/image.iso"));
+    QCOMPARE(requests[1].rawHeader("Range"), QByteArray("bytes=100-"));
+    QCOMPARE(download->url(), QUrl("http://second.example.com/image.iso"));
 
-void
-TestDownload::testDataUriIsValid() {
-    EXPECT_CALL(*_networkSession, isOnline())
-            .WillRepeatedly(Return(true));
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply));
 
-    QUrl url("data:image/gif;base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-            _isConfined, _rootPath, url, _metadata, _headers));
+    delete download;
 
-    QVERIFY(download->isValid());
     verifyMocks();
 }
 
 void
-TestDownload::testDataUriIsValidWithHttpPrefix() {
-    // perform the download and assert that the mime extension used is txt
+TestDownload::testMetalinkBadPieceRefetched() {
+    QByteArray firstPiece(4, 'a');
+    QByteArray secondPiece(4, 'b');
+    // the second piece is corrupted
+    QByteArray fileData = firstPiece + QByteArray("bbbX");
     auto file = new MockFile("test");
-    EXPECT_CALL(*_networkSession, isOnline())
-            .WillRepeatedly(Return(true));
-
-    QUrl url("http://images.google.com/data:;base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-            _isConfined, _rootPath, url, _metadata, _headers));
-
-    QVERIFY(download->isValid());
-
-    // file system expectations
-    EXPECT_CALL(*_fileManager, createFile(_))
-            .Times(1)
-            .WillOnce(Return(file));
+    auto firstReply = new MockNetworkReply();
+    auto secondReply = new MockNetworkReply();
+    QList<QNetworkRequest> requests;
 
-    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
-            .Times(1)
-            .WillOnce(Return(true));
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
 
-    EXPECT_CALL(*file, write(_))
-            .Times(1)
-            .WillOnce(Return(0));
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(2)
+        .WillOnce(Invoke([&](const QNetworkRequest& request) {
+            requests.append(request);
+            return firstReply;
+        }))
+        .WillOnce(Invoke([&](const QNetworkRequest& request) {
+            requests.append(request);
+            return secondReply;
+        }));
+
+    EXPECT_CALL(*firstReply, setThrottle(_, _))
+        .Times(1);
 
-    EXPECT_CALL(*file, close())
-            .Times(1);
+    EXPECT_CALL(*firstReply, attribute(_))
+        .WillRepeatedly(Return(QVariant()));  // invalid variant
 
-    download->startTransfer();
-    QVERIFY(download->filePath().endsWith("txt"));
-}
+    EXPECT_CALL(*firstReply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-void
-TestDownload::testDataUriMissingMimeType() {
-    // perform the download and assert that the mime extension used is txt
-    auto file = new MockFile("test");
-    EXPECT_CALL(*_networkSession, isOnline())
-            .WillRepeatedly(Return(true));
+    EXPECT_CALL(*firstReply, readAll())
+        .WillOnce(Return(fileData))
+        .WillRepeatedly(Return(QByteArray()));
 
-    QUrl url("data:;base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-            _isConfined, _rootPath, url, _metadata, _headers));
+    // the mirror that sent the bad piece is dropped
+    EXPECT_CALL(*firstReply, abort())
+        .Times(1);
 
-    QVERIFY(download->isValid());
+    EXPECT_CALL(*secondReply, setThrottle(_, _))
+        .Times(1);
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
-            .Times(1)
-            .WillOnce(Return(file));
+        .Times(1)
+        .WillOnce(Return(file));
 
     EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
-            .Times(1)
-            .WillOnce(Return(true));
-
-    EXPECT_CALL(*file, write(_))
-            .Times(1)
-            .WillOnce(Return(0));
-
-    EXPECT_CALL(*file, close())
-            .Times(1);
-
-    download->startTransfer();
-    QVERIFY(download->filePath().endsWith("txt"));
-}
+        .Times(1)
+        .WillOnce(Return(true));
 
-void
-TestDownload::testDataUriMimeType_data() {
-    QTest::addColumn<QString>("mime");
-    QTest::addColumn<QString>("extension");
+    EXPECT_CALL(*file, write(fileData))
+        .Times(1)
+        .WillOnce(Return(fileData.size()));
 
-    QTest::newRow("Image gif") << "image/gif" << "gif";
-    QTest::newRow("Image ief") << "image/ief" << "ief";
-    QTest::newRow("Image jpg") << "image/jpeg" << "jpeg";
-    QTest::newRow("Image tiff") << "image/tiff" << "tiff";
-    QTest::newRow("Image rgb") << "image/x-rgb" << "rgb";
-    QTest::newRow("Image bitmap") << "image/x-xbitmap" << "x-xbitmap";
-    QTest::newRow("View MPG") << "video/mpeg" << "mpeg";
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileData.size()));
 
-}
+    // only the good piece is kept
+    EXPECT_CALL(*file, resize(firstPiece.size()))
+        .Times(1)
+        .WillOnce(Return(true));
 
-void
-TestDownload::testDataUriMimeType() {
-    QFETCH(QString, mime);
-    QFETCH(QString, extension);
-    auto file = new MockFile("test");
-    EXPECT_CALL(*_networkSession, isOnline())
-            .WillRepeatedly(Return(true));
+    EXPECT_CALL(*file, remove())
+        .Times(0);
 
-    QUrl url("data:" + mime + ";base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
-    QScopedPointer<FileDownload> download(new FileDownload(_id, _appId, _path,
-            _isConfined, _rootPath, url, _metadata, _headers));
+    auto pieceHash = [](const QByteArray& data) {
+        return QString(QCryptographicHash::hash(data,
+            QCryptographicHash::Sha256).toHex());
+    };
+    QVariantMap metadata(_metadata);
+    metadata[Ubuntu::Transfers::Metadata::METALINK_KEY] = QString(
+        "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+        "<file name=\"image.iso\">"
+        "<size>8</size>"
+        "<pieces length=\"4\" type=\"sha-256\">"
+        "<hash>%1</hash>"
+        "<hash>%2</hash>"
+        "</pieces>"
+        "<url>http://first.example.com/image.iso</url>"
+        "<url>http://second.example.com/image.iso</url>"
+        "</file>"
+        "</metalink>").arg(pieceHash(firstPiece)).arg(pieceHash(secondPiece));
+    auto download = new FileDownload(_id, _appId, _path,
+        _isConfined, _rootPath, _url, metadata, _headers);
+    SignalBarrier startedSpy(download, SIGNAL(started(bool)));
+    QSignalSpy errorSpy(download, SIGNAL(error(QString)));
 
-    QVERIFY(download->isValid());
+    download->start();  // change state
+    download->startTransfer();
+    QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // file system expectations
-    EXPECT_CALL(*_fileManager, createFile(_))
-            .Times(1)
-            .WillOnce(Return(file));
+    firstReply->downloadProgress(fileData.size(), fileData.size());
+    QCOMPARE(errorSpy.count(), 0);
 
-    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
-            .Times(1)
-            .WillOnce(Return(true));
+    // the bad piece is requested again from the next mirror
+    QCOMPARE(requests.count(), 2);
+    QCOMPARE(requests[1].url(), QUrl("http://second.example.com/image.iso"));
+    QCOMPARE(requests[1].rawHeader("Range"), QByteArray("bytes=4-"));
 
-    EXPECT_CALL(*file, write(_))
-            .Times(1)
-            .WillOnce(Return(0));
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
+    QVERIFY(Mock::VerifyAndClearExpectations(firstReply));
 
-    EXPECT_CALL(*file, close())
-            .Times(1);
+    delete download;
 
-    download->startTransfer();
-    QVERIFY(download->filePath().endsWith(extension));
+    verifyMocks();
 }
 
 void
-TestDownload::testDataUriPostProcessing_data() {
-    QTest::addColumn<QString>("command");
-    QTest::addColumn<QVariantMap>("metadata");
-    QVariantMap first, second, third;
-    QStringList firstCommand, secondCommand, thirdCommand;
-
-    firstCommand << "touch";
-    first["post-download-command"] = firstCommand;
-
-    QTest::newRow("First row") << firstCommand[0] << first;
-
-    secondCommand << "sudo";
-    second["post-download-command"] = secondCommand;
+TestDownload::testDropCacheThreshold_data() {
+    QTest::addColumn<qint64>("totalSize");
+    QTest::addColumn<bool>("dropCache");
+
+    QTest::newRow("Below threshold") << Q_INT64_C(256 * 1024 * 1024 - 1)
+        << false;
+    QTest::newRow("At threshold") << Q_INT64_C(256 * 1024 * 1024) << true;
+    QTest::newRow("Above threshold") << Q_INT64_C(1024 * 1024 * 1024)
+        << true;
+}
 
-    QTest::newRow("Second row") << secondCommand[0] << second;
+void
+TestDownload::testDropCacheThreshold() {
+    QFETCH(qint64, totalSize);
+    QFETCH(bool, dropCache);
+    qint64 fileSize = 16 * 1024 * 1024;
+    auto file = new MockFile("test");
+    auto reply = new MockNetworkReply();
 
-    thirdCommand << "grep";
-    third["post-download-command"] = thirdCommand;
+    EXPECT_CALL(*_networkSession, isOnline())
+        .WillRepeatedly(Return(true));
 
-    QTest::newRow("Third row") << thirdCommand[0] << third;
-}
+    EXPECT_CALL(*_reqFactory, get(_))
+        .Times(1)
+        .WillOnce(Return(reply));
 
-void
-TestDownload::testDataUriPostProcessing() {
-    QFETCH(QString, command);
-    QFETCH(QVariantMap, metadata);
-    QStringList args;  // not args
+    EXPECT_CALL(*reply, setThrottle(_, _))
+        .Times(1);
 
-    QUrl url("data:image/gif;base64,R0lGODlhAQABAIAAAP///////yH5BAEKAAEALAAAAAABAAEAAAICTAEAOw==");
-    QScopedPointer<MockFile> file(new MockFile("test"));
-    QScopedPointer<MockProcess> process(new MockProcess());
+    EXPECT_CALL(*reply, attribute(_))
+        .WillRepeatedly(Return(QVariant()));  // invalid variant
 
-    // write the expectations of the reply which is what we are
-    // really testing
+    EXPECT_CALL(*reply, hasRawHeader(_))
+        .WillRepeatedly(Return(false));
 
-    EXPECT_CALL(*_networkSession, isOnline())
-            .WillRepeatedly(Return(true));
+    EXPECT_CALL(*reply, readAll())
+        .WillRepeatedly(Return(QByteArray()));
 
     // file system expectations
     EXPECT_CALL(*_fileManager, createFile(_))
-            .Times(1)
-            .WillOnce(Return(file.data()));
-
-    EXPECT_CALL(*file.data(), open(QIODevice::ReadWrite | QFile::Append))
-            .Times(1)
-            .WillOnce(Return(true));
-
-    EXPECT_CALL(*file, write(_))
-            .Times(1)
-            .WillOnce(Return(0));
+        .Times(1)
+        .WillOnce(Return(file));
 
-    EXPECT_CALL(*file.data(), remove())
-            .Times(1)
-            .WillOnce(Return(true));
+    EXPECT_CALL(*file, open(QIODevice::ReadWrite | QFile::Append))
+        .Times(1)
+        .WillOnce(Return(true));
 
-    EXPECT_CALL(*_cryptoFactory, createCryptographicHash(_, _))
-            .Times(0);
+    EXPECT_CALL(*file, size())
+        .WillRepeatedly(Return(fileSize));
 
-    // process factory and process expectation
-    EXPECT_CALL(*_processFactory, createProcess())
-            .Times(1)
-            .WillOnce(Return(process.data()));
+    // the size is known after the first chunk, the data of the later
+    // ones is written back and dropped from the page cache
+    EXPECT_CALL(*file, writeBack(0, fileSize, false))
+        .Times(dropCache ? 1 : 0);
 
-    EXPECT_CALL(*process.data(), start(command, StringListEq(args), _))
-            .Times(1);
+    EXPECT_CALL(*file, dropPages(_, _))
+        .Times(0);
 
     auto download = new FileDownload(_id, _appId, _path,
-            _isConfined, _rootPath, url, metadata, _headers);
-
-    SignalBarrier spy(download, SIGNAL(finished(QString)));
+        _isConfined, _rootPath, _url, _metadata, _headers);
     SignalBarrier startedSpy(download, SIGNAL(started(bool)));
-    SignalBarrier processingSpy(download, SIGNAL(processing(QString)));
 
     download->start();  // change state
     download->startTransfer();
-
     QVERIFY(startedSpy.ensureSignalEmitted());
 
-    // emit the finish signal and expect it to be raised
-    emit process->finished(0, QProcess::NormalExit);
+    reply->downloadProgress(fileSize, totalSize);
+    QCOMPARE(file->dropsCache(), dropCache);
 
-    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 20000);
-    QTRY_COMPARE_WITH_TIMEOUT(processingSpy.count(), 1, 20000);
-    QCOMPARE(download->state(), Download::UNCOLLECTED);
+    reply->downloadProgress(fileSize, totalSize);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(file));
 
     delete download;
 
-    QVERIFY(Mock::VerifyAndClearExpectations(file.data()));
-    QVERIFY(Mock::VerifyAndClearExpectations(process.data()));
     verifyMocks();
 }
 
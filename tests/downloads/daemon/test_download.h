@@ -83,6 +83,8 @@ class TestDownload: public BaseTestCase {
     void testProgress();
     void testProgressNotKnownSize();
     void testTotalSize();
+    void testProgressRateLimited();
+    void testProgressOptOut();
     void testTotalSizeNoProgress();
     void testSetThrottleNoReply();
     void testSetThrottle();
@@ -107,8 +109,14 @@ class TestDownload: public BaseTestCase {
     void testStartDownload();
     void testStartDownloadAlreadyStarted();
     void testOnSuccessNoHash();
+    void testOnSuccessWaitsForBuffers();
+    void testPublishNameTaken();
+    void testPublishLinkError();
+    void testResumableDataIsNamed();
     void testOnSuccessHashError();
     void testOnSuccessHash();
+    void testOnSuccessIncrementalHash();
+    void testOnSuccessIncrementalHashWithWriter();
     void testOnHttpError_data();
     void testOnHttpError();
     void testOnSslError();
@@ -161,6 +169,7 @@ class TestDownload: public BaseTestCase {
     // we fwd the error
     void testFileSystemErrorProgress();
     void testFileSystemErrorPause();
+    void testReserveSpaceError();
 
     // test different redirects
     void testRedirectCycle();
@@ -195,6 +204,26 @@ class TestDownload: public BaseTestCase {
     void testDataUriPostProcessing_data();
     void testDataUriPostProcessing();
 
+    // segmented downloads
+    void testSegmentedDownloadSplit();
+    void testSegmentedDownloadWritesAtOffset();
+    void testSegmentedDownloadNoAcceptRanges();
+    void testProbeSizeBeforeBody();
+    void testProbeNotEnoughSpace();
+    void testProbeHeadRefused();
+    void testResumeRangeNotHonoured();
+    void testRetryTransientError();
+    void testDurabilityPeriodicSync();
+    void testDurabilityResume_data();
+    void testDurabilityResume();
+    void testRetryAfterServiceUnavailable();
+    void testStalledDownloadReconnects();
+    void testSlowDownloadReconnects();
+    void testMetalinkMirrorFailover();
+    void testMetalinkBadPieceRefetched();
+    void testDropCacheThreshold_data();
+    void testDropCacheThreshold();
+
  private:
     QString _id = QString::null;
     QString _appId = QString::null;
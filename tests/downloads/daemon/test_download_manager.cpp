@@ -28,9 +28,11 @@
 #include "matchers.h"
 #include "pending_reply.h"
 #include "test_download_manager.h"
+#include "timer.h"
 
 using ::testing::_;
 using ::testing::Eq;
+using ::testing::InSequence;
 using ::testing::ByRef;
 using ::testing::Mock;
 using ::testing::Return;
@@ -213,6 +215,145 @@ TestDownloadManager::testCreateDownload() {
     verifyMocks();
 }
 
+void
+TestDownloadManager::testCreateDownloads() {
+    QStringList urls;
+    urls << "http://ubuntu.com" << "http://ubuntu.com/phone";
+    QStringList dbusPaths;
+    dbusPaths << "/path/to/first" << "/path/to/second";
+
+    DownloadStructList structs;
+    QList<MockDownload*> downs;
+    for (int index = 0; index < urls.count(); index++) {
+        structs.append(DownloadStruct(urls[index], QVariantMap(),
+            StringMap()));
+        downs.append(new MockDownload("", "", "", "", QUrl(urls[index]),
+            QVariantMap(), StringMap()));
+    }
+
+    SignalBarrier spy(_man, SIGNAL(downloadCreated(QDBusObjectPath)));
+
+    for (int index = 0; index < downs.count(); index++) {
+        auto down = downs[index];
+        auto dbusProxy = new MockDBusProxy();
+        auto reply = new MockPendingReply<QString>();
+        EXPECT_CALL(*_dbusProxyFactory, createDBusProxy(_conn, _))
+                .WillOnce(Return(dbusProxy))
+                .RetiresOnSaturation();
+
+        EXPECT_CALL(*dbusProxy, GetConnectionAppArmorSecurityContext(_))
+                .Times(1)
+                .WillOnce(Return(reply));
+
+        EXPECT_CALL(*reply, waitForFinished())
+                .Times(1);
+
+        EXPECT_CALL(*reply, isError())
+                .Times(1)
+                .WillOnce(Return(false));
+
+        EXPECT_CALL(*reply, value())
+                .Times(1)
+                .WillOnce(Return("TEST_APP_ID"));
+
+        EXPECT_CALL(*_factory, createDownload(_, Eq(urls[index]), _, _))
+                .Times(1)
+                .WillOnce(Return(down));
+
+        EXPECT_CALL(*down, isValid())
+            .Times(1)
+            .WillOnce(Return(true));
+
+        EXPECT_CALL(*down, setThrottle(_man->defaultThrottle()))
+            .Times(1);
+
+        EXPECT_CALL(*down, allowGSMDownload(_))
+            .Times(1);
+
+        EXPECT_CALL(*down, path())
+            .Times(1)
+            .WillRepeatedly(Return(dbusPaths[index]));
+
+        EXPECT_CALL(*down, metadata())
+            .Times(1)
+            .WillRepeatedly(Return(QVariantMap()));
+
+        EXPECT_CALL(*_q, add(down))
+            .Times(1);
+
+        EXPECT_CALL(*_conn, registerObject(dbusPaths[index], down, _))
+            .Times(1)
+            .WillRepeatedly(Return(true));
+    }
+
+    // all the downloads are stored at once and not one by one
+    EXPECT_CALL(*_database, store(_))
+        .Times(0);
+    EXPECT_CALL(*_database, storeAll(_))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    auto paths = _man->createDownloads(structs);
+
+    QCOMPARE(paths.count(), dbusPaths.count());
+    for (int index = 0; index < dbusPaths.count(); index++) {
+        QCOMPARE(paths[index].path(), dbusPaths[index]);
+    }
+
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(spy.count(), dbusPaths.count());
+
+    foreach(MockDownload* down, downs) {
+        QVERIFY(Mock::VerifyAndClearExpectations(down));
+        delete down;
+    }
+    verifyMocks();
+}
+
+void
+TestDownloadManager::testCreateDownloadsInvalid() {
+    DownloadStructList structs;
+    structs.append(DownloadStruct("http://ubuntu.com", QVariantMap(),
+        StringMap()));
+    structs.append(DownloadStruct("http://ubuntu.com/phone", QVariantMap(),
+        StringMap()));
+
+    // the second download is not valid, therefore none is registered
+    auto first = new MockDownload("", "", "", "",
+        QUrl("http://ubuntu.com"), QVariantMap(), StringMap());
+    auto second = new MockDownload("", "", "", "",
+        QUrl("http://ubuntu.com/phone"), QVariantMap(), StringMap());
+
+    EXPECT_CALL(*_factory, createDownload(_, _, _, _))
+            .Times(2)
+            .WillOnce(Return(first))
+            .WillOnce(Return(second));
+
+    EXPECT_CALL(*first, isValid())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*second, isValid())
+        .Times(1)
+        .WillOnce(Return(false));
+
+    EXPECT_CALL(*_database, storeAll(_))
+        .Times(0);
+
+    EXPECT_CALL(*_q, add(_))
+        .Times(0);
+
+    EXPECT_CALL(*_conn, registerObject(_, _, _))
+        .Times(0);
+
+    auto paths = _man->createDownloads(structs);
+    QVERIFY(paths.isEmpty());
+
+    QVERIFY(Mock::VerifyAndClearExpectations(first));
+    QVERIFY(Mock::VerifyAndClearExpectations(second));
+    verifyMocks();
+}
+
 void
 TestDownloadManager::testCreateDownloadWithHash_data() {
     QTest::addColumn<QString>("url");
@@ -505,6 +646,325 @@ TestDownloadManager::testNotStoppable() {
     verifyMocks();
 }
 
+void
+TestDownloadManager::testCreateDownloadDelayed() {
+    QString caller = ":1.42";
+    QString dbusPath = "/path/to/object";
+    QString url = "http://example.com/file";
+    auto msg = QDBusMessage::createMethodCall(caller, "/",
+        "com.canonical.applications.DownloadManager", "createDownload");
+    QScopedPointer<MockDownload> down(new MockDownload("", "", "", "",
+        QUrl(url), QVariantMap(), StringMap()));
+
+    auto q = new MockDownloadQueue();
+    auto factory = new MockDownloadFactory(new MockAppArmor(_conn));
+    auto appArmor = new MockAppArmor(_conn);
+    QScopedPointer<MockDownloadManager> man(
+        new MockDownloadManager(_app, _conn, factory, q));
+    man->setSecurityContexts(appArmor);
+
+    EXPECT_CALL(*man.data(), isCalledFromDBus())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*man.data(), callMessage())
+        .WillRepeatedly(Return(msg));
+    EXPECT_CALL(*man.data(), delayReply())
+        .Times(1);
+    EXPECT_CALL(*appArmor, resolveSecurityContext(caller))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    // nothing is created nor answered until the context is known
+    EXPECT_CALL(*factory, createDownload(_, _, _, _))
+        .Times(0);
+    EXPECT_CALL(*_conn, send(_))
+        .Times(0);
+
+    auto result = man->createDownload(
+        DownloadStruct(url, QVariantMap(), StringMap()));
+    QVERIFY(result.path().isEmpty());
+
+    QVERIFY(Mock::VerifyAndClearExpectations(factory));
+    QVERIFY(Mock::VerifyAndClearExpectations(_conn));
+
+    // once known the download is created and the stored message answered
+    EXPECT_CALL(*factory, createDownload(caller, Eq(url), _, _))
+        .Times(1)
+        .WillOnce(Return(down.data()));
+    EXPECT_CALL(*down.data(), isValid())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*down.data(), path())
+        .WillRepeatedly(Return(dbusPath));
+    EXPECT_CALL(*appArmor, appId(caller))
+        .WillRepeatedly(Return(QString("TEST_APP_ID")));
+    EXPECT_CALL(*appArmor, isConfined(_))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*_database, store(down.data()))
+        .Times(1)
+        .WillOnce(Return(true));
+    EXPECT_CALL(*q, add(down.data()))
+        .Times(1);
+    EXPECT_CALL(*_conn, registerObject(dbusPath, down.data(), _))
+        .Times(1)
+        .WillOnce(Return(true));
+    EXPECT_CALL(*_conn, send(DBusReplyWithPath(dbusPath)))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    appArmor->securityContextResolved(caller, true);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(down.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(appArmor));
+    QVERIFY(Mock::VerifyAndClearExpectations(factory));
+    QVERIFY(Mock::VerifyAndClearExpectations(q));
+    QVERIFY(Mock::VerifyAndClearExpectations(man.data()));
+    verifyMocks();
+}
+
+void
+TestDownloadManager::testDelayedCallsOfSameCaller() {
+    QString caller = ":1.42";
+    QString firstUrl = "http://example.com/first";
+    QString secondUrl = "http://example.com/second";
+    auto msg = QDBusMessage::createMethodCall(caller, "/",
+        "com.canonical.applications.DownloadManager", "createDownload");
+    QScopedPointer<MockDownload> first(new MockDownload("", "", "", "",
+        QUrl(firstUrl), QVariantMap(), StringMap()));
+    QScopedPointer<MockDownload> second(new MockDownload("", "", "", "",
+        QUrl(secondUrl), QVariantMap(), StringMap()));
+
+    auto q = new MockDownloadQueue();
+    auto factory = new MockDownloadFactory(new MockAppArmor(_conn));
+    auto appArmor = new MockAppArmor(_conn);
+    QScopedPointer<MockDownloadManager> man(
+        new MockDownloadManager(_app, _conn, factory, q));
+    man->setSecurityContexts(appArmor);
+
+    EXPECT_CALL(*man.data(), isCalledFromDBus())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*man.data(), callMessage())
+        .WillRepeatedly(Return(msg));
+    EXPECT_CALL(*man.data(), delayReply())
+        .Times(2);
+    // the second call finds the lookup of the first one in progress
+    EXPECT_CALL(*appArmor, resolveSecurityContext(caller))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+
+    man->createDownload(DownloadStruct(firstUrl, QVariantMap(), StringMap()));
+    man->createDownload(DownloadStruct(secondUrl, QVariantMap(),
+        StringMap()));
+
+    // a single answer of the bus finishes both calls in order
+    {
+        InSequence sequence;
+        EXPECT_CALL(*factory, createDownload(caller, Eq(firstUrl), _, _))
+            .WillOnce(Return(first.data()));
+        EXPECT_CALL(*factory, createDownload(caller, Eq(secondUrl), _, _))
+            .WillOnce(Return(second.data()));
+    }
+    EXPECT_CALL(*first.data(), isValid())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*first.data(), path())
+        .WillRepeatedly(Return(QString("/first")));
+    EXPECT_CALL(*second.data(), isValid())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*second.data(), path())
+        .WillRepeatedly(Return(QString("/second")));
+    EXPECT_CALL(*_database, store(_))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*_conn, registerObject(_, _, _))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*_conn, send(DBusReplyWithPath(QString("/first"))))
+        .Times(1)
+        .WillOnce(Return(true));
+    EXPECT_CALL(*_conn, send(DBusReplyWithPath(QString("/second"))))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    appArmor->securityContextResolved(caller, true);
+
+    // the calls are not answered twice
+    appArmor->securityContextResolved(caller, true);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(first.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(second.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(factory));
+    QVERIFY(Mock::VerifyAndClearExpectations(man.data()));
+    verifyMocks();
+}
+
+void
+TestDownloadManager::testDelayedCallFailedContext() {
+    QString caller = ":1.42";
+    QString url = "http://example.com/file";
+    auto msg = QDBusMessage::createMethodCall(caller, "/",
+        "com.canonical.applications.DownloadManager", "createDownload");
+
+    auto q = new MockDownloadQueue();
+    auto factory = new MockDownloadFactory(new MockAppArmor(_conn));
+    auto appArmor = new MockAppArmor(_conn);
+    QScopedPointer<MockDownloadManager> man(
+        new MockDownloadManager(_app, _conn, factory, q));
+    man->setSecurityContexts(appArmor);
+
+    EXPECT_CALL(*man.data(), isCalledFromDBus())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*man.data(), callMessage())
+        .WillRepeatedly(Return(msg));
+    EXPECT_CALL(*man.data(), delayReply())
+        .Times(1);
+    EXPECT_CALL(*appArmor, resolveSecurityContext(caller))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    man->createDownload(DownloadStruct(url, QVariantMap(), StringMap()));
+
+    // the call fails rather than blocking on a new lookup of the context
+    EXPECT_CALL(*appArmor, appId(_))
+        .Times(0);
+    EXPECT_CALL(*factory, createDownload(_, _, _, _))
+        .Times(0);
+    EXPECT_CALL(*_conn, send(DBusErrorReplyEq(
+            QDBusError::errorString(QDBusError::AccessDenied))))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    appArmor->securityContextResolved(caller, false);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(appArmor));
+    QVERIFY(Mock::VerifyAndClearExpectations(factory));
+    QVERIFY(Mock::VerifyAndClearExpectations(man.data()));
+    verifyMocks();
+}
+
+void
+TestDownloadManager::testProgressBatchOnlyChangedDownloads() {
+    auto timer = new MockTimer();
+    _man->setProgressTimer(timer);
+    QScopedPointer<MockDownload> active(new MockDownload("", "", "", "",
+        QUrl(), QVariantMap(), StringMap()));
+    QScopedPointer<MockDownload> paused(new MockDownload("", "", "", "",
+        QUrl(), QVariantMap(), StringMap()));
+    QHash<QString, Transfer*> downs;
+    downs["/active"] = active.data();
+    downs["/paused"] = paused.data();
+
+    // started once and restarted after each of the ticks
+    EXPECT_CALL(*timer, start(100))
+        .Times(4);
+
+    EXPECT_CALL(*_q, transfers())
+        .WillRepeatedly(Return(downs));
+
+    EXPECT_CALL(*active.data(), state())
+        .WillRepeatedly(Return(Transfer::START));
+    EXPECT_CALL(*active.data(), path())
+        .WillRepeatedly(Return(QString("/active")));
+    EXPECT_CALL(*active.data(), progress())
+        .Times(3)
+        .WillOnce(Return(10))
+        .WillOnce(Return(10))
+        .WillOnce(Return(20));
+    EXPECT_CALL(*active.data(), totalSize())
+        .WillRepeatedly(Return(100));
+
+    // downloads that do not transfer data are never reported
+    EXPECT_CALL(*paused.data(), state())
+        .WillRepeatedly(Return(Transfer::PAUSE));
+    EXPECT_CALL(*paused.data(), progress())
+        .Times(0);
+
+    QSignalSpy spy(_man, SIGNAL(progressBatch(ProgressList)));
+    _man->setProgressBatchInterval(100);
+
+    timer->timeout();
+    QCOMPARE(spy.count(), 1);
+    auto batch = spy.takeFirst().at(0).value<ProgressList>();
+    QCOMPARE(batch.count(), 1);
+    QCOMPARE(batch[0].getPath(), QString("/active"));
+    QCOMPARE(batch[0].getReceived(), 10ULL);
+    QCOMPARE(batch[0].getTotal(), 100ULL);
+
+    // no changes, no batch
+    timer->timeout();
+    QCOMPARE(spy.count(), 0);
+
+    timer->timeout();
+    QCOMPARE(spy.count(), 1);
+    batch = spy.takeFirst().at(0).value<ProgressList>();
+    QCOMPARE(batch.count(), 1);
+    QCOMPARE(batch[0].getReceived(), 20ULL);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(timer));
+    QVERIFY(Mock::VerifyAndClearExpectations(active.data()));
+    QVERIFY(Mock::VerifyAndClearExpectations(paused.data()));
+    verifyMocks();
+}
+
+void
+TestDownloadManager::testProgressBatchIntervalZeroStopsTimer() {
+    auto timer = new MockTimer();
+    _man->setProgressTimer(timer);
+
+    // a tick that was already queued does not start the timer again
+    EXPECT_CALL(*timer, start(_))
+        .Times(1);
+    EXPECT_CALL(*timer, stop())
+        .Times(1);
+
+    _man->setProgressBatchInterval(100);
+    _man->setProgressBatchInterval(0);
+    QCOMPARE(_man->progressBatchInterval(), 0);
+
+    timer->timeout();
+
+    QVERIFY(Mock::VerifyAndClearExpectations(timer));
+    verifyMocks();
+}
+
+void
+TestDownloadManager::testProgressBatchIntervalResetsLastProgress() {
+    auto timer = new MockTimer();
+    _man->setProgressTimer(timer);
+    QScopedPointer<MockDownload> active(new MockDownload("", "", "", "",
+        QUrl(), QVariantMap(), StringMap()));
+    QHash<QString, Transfer*> downs;
+    downs["/active"] = active.data();
+
+    EXPECT_CALL(*timer, start(_))
+        .Times(5);
+
+    EXPECT_CALL(*_q, transfers())
+        .WillRepeatedly(Return(downs));
+
+    EXPECT_CALL(*active.data(), state())
+        .WillRepeatedly(Return(Transfer::RESUME));
+    EXPECT_CALL(*active.data(), path())
+        .WillRepeatedly(Return(QString("/active")));
+    EXPECT_CALL(*active.data(), progress())
+        .WillRepeatedly(Return(10));
+    EXPECT_CALL(*active.data(), totalSize())
+        .WillRepeatedly(Return(100));
+
+    QSignalSpy spy(_man, SIGNAL(progressBatch(ProgressList)));
+    _man->setProgressBatchInterval(100);
+
+    timer->timeout();
+    timer->timeout();
+    QCOMPARE(spy.count(), 1);
+
+    // a new interval sends the progress of all the downloads again
+    _man->setProgressBatchInterval(200);
+    timer->timeout();
+    QCOMPARE(spy.count(), 2);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(timer));
+    QVERIFY(Mock::VerifyAndClearExpectations(active.data()));
+    verifyMocks();
+}
+
 void
 TestDownloadManager::testGetAllDownloadsUnconfined() {
     QString expectedAppId = "unconfined";
@@ -32,6 +32,7 @@
 #include "dbus_connection.h"
 #include "dbus_proxy_factory.h"
 #include "factory.h"
+#include "manager.h"
 #include "queue.h"
 #include "network_session.h"
 #include "request_factory.h"
@@ -64,6 +65,8 @@ class TestDownloadManager : public BaseTestCase {
     // tests
     void testCreateDownload();
     void testCreateDownloadWithHash();
+    void testCreateDownloads();
+    void testCreateDownloadsInvalid();
     void testSetThrottleNotDownloads();
     void testSetThrottleWithDownloads();
     void testSizeChangedEmittedOnAddition();
@@ -72,6 +75,16 @@ class TestDownloadManager : public BaseTestCase {
     void testStoppable();
     void testNotStoppable();
 
+    // calls delayed until the security context of the caller is known
+    void testCreateDownloadDelayed();
+    void testDelayedCallsOfSameCaller();
+    void testDelayedCallFailedContext();
+
+    // progress batches
+    void testProgressBatchOnlyChangedDownloads();
+    void testProgressBatchIntervalZeroStopsTimer();
+    void testProgressBatchIntervalResetsLastProgress();
+
     // all downloads tests
     void testGetAllDownloadsUnconfined();
     void testGetAllDownloadsConfined();
@@ -22,6 +22,7 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <ubuntu/download_manager/metatypes.h>
+#include <ubuntu/transfers/metadata.h>
 #include <ubuntu/transfers/system/hash_algorithm.h>
 #include <ubuntu/transfers/system/uuid_utils.h>
 #include <ubuntu/transfers/system/network_session.h>
@@ -37,6 +38,17 @@ namespace {
     const QString SELECT_SINGLE_DOWNLOAD = "SELECT appId, url, dbus_path, local_path, "\
         "hash, hash_algo, state, total_size, throttle, metadata, headers "\
         "FROM SingleDownload WHERE uuid=:uuid;";
+
+    const QString JOURNAL_MODE = "PRAGMA journal_mode;";
+
+    const QString SELECT_VALIDATORS = "SELECT etag, last_modified "\
+        "FROM SingleDownload WHERE uuid=:uuid;";
+
+    const QString OLD_SINGLE_DOWNLOAD_TABLE = "CREATE TABLE SingleDownload("\
+        "uuid VARCHAR(40) PRIMARY KEY, appId TEXT NOT NULL, url TEXT NOT NULL, "\
+        "dbus_path TEXT NOT NULL UNIQUE, local_path TEXT, hash TEXT, "\
+        "hash_algo TEXT, state VARCHAR(6) NOT NULL, total_size TEXT, "\
+        "throttle TEXT, metadata TEXT, headers TEXT)";
 }
 
 TestDownloadsDb::TestDownloadsDb(QObject *parent)
@@ -100,6 +112,21 @@ TestDownloadsDb::testTableExists() {
     QVERIFY(QFile::exists(_db->filename()));
 }
 
+void
+TestDownloadsDb::testWalJournalMode() {
+    _db->init();
+    // the journal mode is persistent, any other connection must see it
+    QSqlDatabase db = _db->db();
+    db.open();
+    QSqlQuery query(db);
+    query.exec(JOURNAL_MODE);
+    QString mode;
+    if (query.next())
+        mode = query.value(0).toString();
+    db.close();
+    QCOMPARE(mode, QString("wal"));
+}
+
 void
 TestDownloadsDb::testStoreSingleDownload_data() {
     QTest::addColumn<QString>("id");
@@ -299,6 +326,50 @@ TestDownloadsDb::testStoreSingleDownloadPresent() {
     }
 }
 
+void
+TestDownloadsDb::testStoreValidators() {
+    _db->init();
+    auto id = UuidUtils::getDBusString(QUuid::createUuid());
+    QScopedPointer<FileDownload> download(new FileDownload(id, "APP",
+        "validators path", false, "", QUrl("http://ubuntu.com"), "", "md5",
+        QVariantMap(), QMap<QString, QString>()));
+    download->setValidators("\"v1\"", "Wed, 21 Oct 2015 07:28:00 GMT");
+
+    _db->storeSingleDownload(download.data());
+    QSqlDatabase db = _db->db();
+    db.open();
+    QSqlQuery query(db);
+    query.prepare(SELECT_VALIDATORS);
+    query.bindValue(":uuid", id);
+    query.exec();
+    if (query.next()) {
+        QCOMPARE(query.value(0).toString(), QString("\"v1\""));
+        QCOMPARE(query.value(1).toString(),
+            QString("Wed, 21 Oct 2015 07:28:00 GMT"));
+        db.close();
+    } else {
+        db.close();
+        QFAIL("Download was not found!");
+    }
+}
+
+void
+TestDownloadsDb::testValidatorColumnsAdded() {
+    // a db created before the validators were stored
+    QSqlDatabase db = _db->db();
+    db.open();
+    QSqlQuery create(db);
+    QVERIFY(create.exec(OLD_SINGLE_DOWNLOAD_TABLE));
+    db.close();
+
+    QVERIFY(_db->init());
+
+    db.open();
+    QSqlQuery query(db);
+    QVERIFY(query.prepare(SELECT_VALIDATORS));
+    db.close();
+}
+
 void
 TestDownloadsDb::testConnectedToDownload() {
     QScopedPointer<TestingDb> testingDb(new TestingDb);
@@ -321,7 +392,32 @@ TestDownloadsDb::testConnectedToDownload() {
     download->setThrottle(90);
     download->setState(Download::PAUSE);
     QVERIFY(spy.ensureSignalEmitted());
-    QTRY_COMPARE(2, spy.count());  // one per update
+    QTRY_COMPARE(1, spy.count());  // both updates are coalesced
+}
+
+void
+TestDownloadsDb::testTerminalStateStoredRightAway() {
+    QScopedPointer<TestingDb> testingDb(new TestingDb);
+    SignalBarrier spy(testingDb.data(), SIGNAL(downloadStored(Download*)));
+
+    auto id = UuidUtils::getDBusString(QUuid::createUuid());
+    auto appId = QString("TEST");
+    QString path = "first path";
+    auto url =  QUrl("http://ubuntu.com");
+    auto hash = QString();
+    QString hashAlgoString = "md5";
+    QVariantMap metadata;
+    QMap<QString, QString> headers;
+
+    QScopedPointer<FileDownload> download(new FileDownload(id, appId, path,
+        true, "", url, hash, hashAlgoString, metadata, headers));
+
+    testingDb->connectToDownload(download.data());
+    // the pending throttle change is written with the final state without
+    // waiting for the batch
+    download->setThrottle(90);
+    download->setState(Download::FINISH);
+    QCOMPARE(1, spy.count());
 }
 
 void
@@ -485,4 +581,54 @@ TestDownloadsDb::testGetUncollectedDownloads() {
     QCOMPARE(download->metadata(), metadata);
 }
 
+void
+TestDownloadsDb::testGetUncollectedDownloadsValidators() {
+    _db->init();
+    auto id = UuidUtils::getDBusString(QUuid::createUuid());
+    auto appId = QString("VALIDATORS APP");
+    QScopedPointer<FileDownload> fileDownload(new FileDownload(id, appId,
+        "restored path", false, "", QUrl("http://ubuntu.com"), "", "md5",
+        QVariantMap(), QMap<QString, QString>()));
+    fileDownload->setValidators("\"v1\"", "Wed, 21 Oct 2015 07:28:00 GMT");
+
+    // stored while paused and updated once done, as the daemon does
+    fileDownload->setState(Download::PAUSE);
+    QVERIFY(_db->storeSingleDownload(fileDownload.data()));
+    fileDownload->setState(Download::UNCOLLECTED);
+    QVERIFY(_db->storeSingleDownload(fileDownload.data()));
+
+    auto uncollected = _db->getUncollectedDownloads(appId);
+    QCOMPARE(uncollected.count(), 1);
+    auto download = qobject_cast<FileDownload*>(uncollected[0]);
+    QVERIFY(download != nullptr);
+    QCOMPARE(download->etag(), QByteArray("\"v1\""));
+    QCOMPARE(download->lastModified(),
+        QByteArray("Wed, 21 Oct 2015 07:28:00 GMT"));
+    qDeleteAll(uncollected);
+}
+
+void
+TestDownloadsDb::testGetUncollectedDownloadsDurableSize() {
+    _db->init();
+    auto id = UuidUtils::getDBusString(QUuid::createUuid());
+    auto appId = QString("DURABLE APP");
+    QVariantMap metadata;
+    metadata[Ubuntu::Transfers::Metadata::DURABILITY_KEY] =
+        Ubuntu::Transfers::Metadata::DURABILITY_PERIODIC;
+    QScopedPointer<FileDownload> fileDownload(new FileDownload(id, appId,
+        "durable path", false, "", QUrl("http://ubuntu.com"), "", "md5",
+        metadata, QMap<QString, QString>()));
+    fileDownload->setDurableSize(4096);
+    fileDownload->setState(Download::UNCOLLECTED);
+    QVERIFY(_db->storeSingleDownload(fileDownload.data()));
+
+    // resume only trusts the data that was synced before the restart
+    auto uncollected = _db->getUncollectedDownloads(appId);
+    QCOMPARE(uncollected.count(), 1);
+    auto download = qobject_cast<FileDownload*>(uncollected[0]);
+    QVERIFY(download != nullptr);
+    QCOMPARE(download->durableSize(), qint64(4096));
+    qDeleteAll(uncollected);
+}
+
 QTEST_MAIN(TestDownloadsDb)
@@ -59,17 +59,23 @@ class TestDownloadsDb : public BaseTestCase {
     void testTableCreations_data();
     void testTableCreations();
     void testTableExists();
+    void testWalJournalMode();
     void testStoreSingleDownload_data();
     void testStoreSingleDownload();
     void testStoreSingleDownloadPresent_data();
     void testStoreSingleDownloadPresent();
+    void testStoreValidators();
+    void testValidatorColumnsAdded();
     void testConnectedToDownload();
     void testDisconnectedFromDownload();
+    void testTerminalStateStoredRightAway();
     void testGetStateMissingDownload();
     void testGetStateDownload_data();
     void testGetStateDownload();
     void testGetUncollectedDownloads_data();
     void testGetUncollectedDownloads();
+    void testGetUncollectedDownloadsValidators();
+    void testGetUncollectedDownloadsDurableSize();
 
  private:
     DownloadsDb* _db;
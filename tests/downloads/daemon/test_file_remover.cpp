@@ -0,0 +1,101 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <QDir>
+#include <QFile>
+#include <ubuntu/transfers/system/file_remover.h>
+#include "test_file_remover.h"
+
+using namespace Ubuntu::Transfers::System;
+
+namespace {
+
+    QString
+    createFile(const QString& path) {
+        QFile file(path);
+        file.open(QIODevice::ReadWrite);
+        file.write(QByteArray(400, 'f'));
+        file.close();
+        return path;
+    }
+
+}
+
+void
+TestFileRemover::cleanup() {
+    BaseTestCase::cleanup();
+    FileRemover::deleteInstance();
+}
+
+void
+TestFileRemover::testRemoveNotStarted() {
+    auto path = createFile(testDirectory() + QDir::separator() + "file");
+
+    QVERIFY(FileRemover::instance()->remove(path));
+    QVERIFY(!QFile::exists(path));
+}
+
+void
+TestFileRemover::testRemoveInBackground() {
+    auto dir = testDirectory();
+    auto listPath = dir + QDir::separator() + "list";
+    auto path = createFile(dir + QDir::separator() + "file");
+
+    auto remover = FileRemover::instance();
+    remover->setListPath(listPath);
+    remover->start();
+
+    // the name is free right away
+    QVERIFY(remover->remove(path));
+    QVERIFY(!QFile::exists(path));
+
+    remover->waitForAll();
+    QCOMPARE(QDir(dir).entryList(QDir::Files | QDir::Hidden),
+        QStringList());
+}
+
+void
+TestFileRemover::testRemoveMissing() {
+    auto path = testDirectory() + QDir::separator() + "missing";
+    FileRemover::instance()->start();
+    QVERIFY(!FileRemover::instance()->remove(path));
+}
+
+void
+TestFileRemover::testRemoveLeftByPreviousRun() {
+    auto dir = testDirectory();
+    auto listPath = dir + QDir::separator() + "list";
+    auto first = createFile(dir + QDir::separator() + ".first");
+    auto second = createFile(dir + QDir::separator() + ".second");
+
+    QFile list(listPath);
+    QVERIFY(list.open(QIODevice::WriteOnly));
+    list.write(QFile::encodeName(first) + "\n" +
+        QFile::encodeName(second) + "\n");
+    list.close();
+
+    auto remover = FileRemover::instance();
+    remover->setListPath(listPath);
+    remover->start();
+    remover->waitForAll();
+
+    QVERIFY(!QFile::exists(first));
+    QVERIFY(!QFile::exists(second));
+    QVERIFY(!QFile::exists(listPath));
+}
+
+QTEST_MAIN(TestFileRemover)
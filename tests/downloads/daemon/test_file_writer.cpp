@@ -0,0 +1,222 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <cstring>
+#include <QDir>
+#include <QScopedPointer>
+#include <ubuntu/transfers/system/buffer_pool.h>
+#include <ubuntu/transfers/system/file_writer.h>
+#include <gmock/gmock.h>
+
+#include "file_manager.h"
+#include "test_file_writer.h"
+
+using namespace Ubuntu::Transfers::System;
+using namespace Ubuntu::Transfers::Tests;
+using ::testing::_;
+using ::testing::InSequence;
+using ::testing::Mock;
+
+namespace {
+
+    const qint64 MB = 1024 * 1024;
+
+    void
+    appendText(File* file, const QByteArray& text) {
+        auto buffer = BufferPool::instance()->acquire();
+        memcpy(buffer, text.constData(), text.size());
+        struct iovec iov;
+        iov.iov_base = buffer;
+        iov.iov_len = text.size();
+        FileWriter::instance()->append(file, &iov, 1);
+    }
+
+    // one buffer per character of the text
+    int
+    fillBuffers(const QByteArray& text, struct iovec* iov) {
+        for (int index = 0; index < text.size(); index++) {
+            auto buffer = BufferPool::instance()->acquire();
+            buffer[0] = text[index];
+            iov[index].iov_base = buffer;
+            iov[index].iov_len = 1;
+        }
+        return text.size();
+    }
+
+}
+
+void
+TestFileWriter::cleanup() {
+    BaseTestCase::cleanup();
+    FileWriter::deleteInstance();
+    BufferPool::deleteInstance();
+}
+
+void
+TestFileWriter::testAppendInOrder() {
+    auto path = testDirectory() + QDir::separator() + "in_order";
+    QScopedPointer<File> file(FileManager::instance()->createFile(path));
+    QVERIFY(file->open(QIODevice::ReadWrite | QFile::Append));
+    QVERIFY(file->resize(0));
+
+    FileWriter::instance()->start();
+    appendText(file.data(), "first ");
+    appendText(file.data(), "second ");
+    appendText(file.data(), "third");
+    FileWriter::instance()->waitForFile(file.data());
+
+    QVERIFY(file->reset());
+    QCOMPARE(file->readAll(), QByteArray("first second third"));
+    file->remove();
+}
+
+void
+TestFileWriter::testSizeWhilePending() {
+    auto path = testDirectory() + QDir::separator() + "size";
+    QScopedPointer<File> file(FileManager::instance()->createFile(path));
+    QVERIFY(file->open(QIODevice::ReadWrite | QFile::Append));
+    QVERIFY(file->resize(0));
+
+    // the data is queued until the thread is started, the size has to
+    // account for it
+    appendText(file.data(), "queued data");
+    QCOMPARE(FileWriter::instance()->size(file.data()), Q_INT64_C(11));
+
+    FileWriter::instance()->start();
+    FileWriter::instance()->waitForFile(file.data());
+    QCOMPARE(file->size(), Q_INT64_C(11));
+    QCOMPARE(FileWriter::instance()->size(file.data()), Q_INT64_C(11));
+    file->remove();
+}
+
+void
+TestFileWriter::testBuffersReleased() {
+    auto path = testDirectory() + QDir::separator() + "released";
+    QScopedPointer<File> file(FileManager::instance()->createFile(path));
+    QVERIFY(file->open(QIODevice::ReadWrite | QFile::Append));
+
+    FileWriter::instance()->start();
+    appendText(file.data(), "data");
+    FileWriter::instance()->waitForFile(file.data());
+    QCOMPARE(BufferPool::instance()->usedCount(), 0);
+    file->remove();
+}
+
+void
+TestFileWriter::testAppendManyBuffers() {
+    auto path = testDirectory() + QDir::separator() + "many";
+    QScopedPointer<File> file(FileManager::instance()->createFile(path));
+    QVERIFY(file->open(QIODevice::ReadWrite | QFile::Append));
+    QVERIFY(file->resize(0));
+
+    // more buffers than a chunk holds
+    QByteArray text("abcdefghijklmnopqrstuvwxyz0123456789");
+    QVERIFY(text.size() > FileWriter::MAX_CHUNK_BUFFERS * 2);
+    struct iovec iov[64];
+    auto count = fillBuffers(text, iov);
+
+    FileWriter::instance()->append(file.data(), iov, count);
+    QCOMPARE(FileWriter::instance()->size(file.data()),
+        static_cast<qint64>(text.size()));
+    FileWriter::instance()->start();
+    FileWriter::instance()->waitForFile(file.data());
+
+    QVERIFY(file->reset());
+    QCOMPARE(file->readAll(), text);
+    QCOMPARE(BufferPool::instance()->usedCount(), 0);
+    file->remove();
+}
+
+void
+TestFileWriter::testWriteManyBuffersAtOffset() {
+    auto path = testDirectory() + QDir::separator() + "many_at_offset";
+    QScopedPointer<File> file(FileManager::instance()->createFile(path));
+    QVERIFY(file->open(QIODevice::ReadWrite));
+    QVERIFY(file->resize(0));
+
+    QByteArray text("abcdefghijklmnopqrstuvwxyz0123456789");
+    struct iovec iov[64];
+    auto count = fillBuffers(text, iov);
+
+    // every chunk is written after the previous one
+    FileWriter::instance()->start();
+    FileWriter::instance()->write(file.data(), iov, count, 4);
+    FileWriter::instance()->waitForFile(file.data());
+
+    QVERIFY(file->reset());
+    QCOMPARE(file->readAll(), QByteArray(4, '\0') + text);
+    QCOMPARE(BufferPool::instance()->usedCount(), 0);
+    file->remove();
+}
+
+void
+TestFileWriter::testReleaseCacheWindows() {
+    MockFile file("cache");
+    file.setDropCache(true);
+
+    {
+        InSequence sequence;
+        // the first window is only written back
+        EXPECT_CALL(file, writeBack(0, 8 * MB, false))
+            .Times(1);
+        // the pages behind the write head are dropped once written back
+        EXPECT_CALL(file, writeBack(0, 8 * MB, true))
+            .Times(1);
+        EXPECT_CALL(file, dropPages(0, 8 * MB))
+            .Times(1);
+        EXPECT_CALL(file, writeBack(8 * MB, 10 * MB, false))
+            .Times(1);
+        EXPECT_CALL(file, writeBack(8 * MB, 10 * MB, true))
+            .Times(1);
+        EXPECT_CALL(file, dropPages(8 * MB, 10 * MB))
+            .Times(1);
+        EXPECT_CALL(file, writeBack(18 * MB, 8 * MB, false))
+            .Times(1);
+        // a truncated file starts again from the beginning
+        EXPECT_CALL(file, writeBack(0, 8 * MB, false))
+            .Times(1);
+    }
+
+    // less than a window does nothing
+    file.releaseCache(4 * MB);
+    file.releaseCache(8 * MB);
+    file.releaseCache(12 * MB);
+    file.releaseCache(18 * MB);
+    file.releaseCache(26 * MB);
+    file.releaseCache(4 * MB);
+    file.releaseCache(8 * MB);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(&file));
+}
+
+void
+TestFileWriter::testReleaseCacheDisabled() {
+    MockFile file("cache");
+
+    EXPECT_CALL(file, writeBack(_, _, _))
+        .Times(0);
+    EXPECT_CALL(file, dropPages(_, _))
+        .Times(0);
+
+    file.releaseCache(8 * MB);
+    file.releaseCache(64 * MB);
+
+    QVERIFY(Mock::VerifyAndClearExpectations(&file));
+}
+
+QTEST_MAIN(TestFileWriter)
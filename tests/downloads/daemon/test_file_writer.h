@@ -0,0 +1,45 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TEST_FILE_WRITER_H
+#define TEST_FILE_WRITER_H
+
+#include <QObject>
+#include "base_testcase.h"
+
+class TestFileWriter : public BaseTestCase {
+    Q_OBJECT
+
+ public:
+    explicit TestFileWriter(QObject *parent = 0)
+        : BaseTestCase("TestFileWriter", parent) { }
+
+ private slots:  // NOLINT(whitespace/indent)
+
+    void cleanup() override;
+
+    void testAppendInOrder();
+    void testSizeWhilePending();
+    void testBuffersReleased();
+    void testAppendManyBuffers();
+    void testWriteManyBuffersAtOffset();
+    void testReleaseCacheWindows();
+    void testReleaseCacheDisabled();
+};
+
+#endif // TEST_FILE_WRITER_H
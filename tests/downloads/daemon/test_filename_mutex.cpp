@@ -103,4 +103,45 @@ TestFileNameMutex::testUnlockPresent() {
     QVERIFY(!mutex->isLocked(locked));
 }
 
+void
+TestFileNameMutex::testSuffixAfterHighestInFileSystem() {
+    auto dir = testDirectory();
+    auto path = dir + QDir::separator() + "image.tar.gz";
+    QScopedPointer<FileNameMutex> mutex(new FileNameMutex());
+
+    foreach(const QString& name, QStringList() << "image.tar.gz"
+            << "image (2).tar.gz" << "image (7).tar.gz" << "image (x).tar.gz") {
+        QFile file(dir + QDir::separator() + name);
+        file.open(QIODevice::ReadWrite);
+        file.close();
+    }
+
+    QCOMPARE(mutex->lockFileName(path),
+        dir + QDir::separator() + "image (8).tar.gz");
+    QCOMPARE(mutex->lockFileName(path),
+        dir + QDir::separator() + "image (9).tar.gz");
+}
+
+void
+TestFileNameMutex::testSuffixCreatedAfterIndex() {
+    auto dir = testDirectory();
+    auto path = dir + QDir::separator() + "image.jpg";
+    QScopedPointer<FileNameMutex> mutex(new FileNameMutex());
+
+    QFile file(path);
+    file.open(QIODevice::ReadWrite);
+    file.close();
+
+    QCOMPARE(mutex->lockFileName(path),
+        dir + QDir::separator() + "image (1).jpg");
+
+    // created by someone else once the dir was indexed
+    QFile other(dir + QDir::separator() + "image (2).jpg");
+    other.open(QIODevice::ReadWrite);
+    other.close();
+
+    QCOMPARE(mutex->lockFileName(path),
+        dir + QDir::separator() + "image (3).jpg");
+}
+
 QTEST_MAIN(TestFileNameMutex)
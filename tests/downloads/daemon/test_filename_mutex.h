@@ -38,6 +38,8 @@ class TestFileNameMutex : public BaseTestCase {
     void testExpectedNameInFileSystem_data();
     void testExpectedNameInFileSystem();
     void testUnlockPresent();
+    void testSuffixAfterHighestInFileSystem();
+    void testSuffixCreatedAfterIndex();
 };
 
 #endif // TEST_FILENAME_MUTEX_H
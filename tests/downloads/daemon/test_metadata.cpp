@@ -353,6 +353,133 @@ TestMetadata::testHasDeflateFalse() {
     QVERIFY(!metadata.hasDeflate());
 }
 
+void
+TestMetadata::testSetDropCache_data() {
+    QTest::addColumn<bool>("drop");
+
+    QTest::newRow("True") << true;
+    QTest::newRow("False") << false;
+}
+
+void
+TestMetadata::testSetDropCache() {
+    QFETCH(bool, drop);
+
+    Metadata metadata;
+    metadata.setDropCache(drop);
+    QCOMPARE(metadata[Metadata::DROP_CACHE_KEY].toBool(), drop);
+    QCOMPARE(metadata.dropCache(), drop);
+}
+
+void
+TestMetadata::testHasDropCacheTrue() {
+    Metadata metadata;
+    metadata.setDropCache(false);
+
+    QVERIFY(metadata.hasDropCache());
+}
+
+void
+TestMetadata::testHasDropCacheFalse() {
+    Metadata metadata;
+    QVERIFY(!metadata.hasDropCache());
+}
+
+void
+TestMetadata::testDurabilityDefault() {
+    Metadata metadata;
+    QVERIFY(!metadata.hasDurability());
+    QCOMPARE(metadata.durability(), Metadata::DURABILITY_NONE);
+}
+
+void
+TestMetadata::testSetDurability_data() {
+    QTest::addColumn<QString>("durability");
+
+    QTest::newRow("None") << Metadata::DURABILITY_NONE;
+    QTest::newRow("Periodic") << Metadata::DURABILITY_PERIODIC;
+    QTest::newRow("Finish") << Metadata::DURABILITY_FINISH;
+}
+
+void
+TestMetadata::testSetDurability() {
+    QFETCH(QString, durability);
+
+    Metadata metadata;
+    metadata.setDurability(durability);
+    QVERIFY(metadata.hasDurability());
+    QCOMPARE(metadata.durability(), durability);
+}
+
+void
+TestMetadata::testRetriesDefault() {
+    Metadata metadata;
+    QVERIFY(!metadata.hasRetries());
+    QVERIFY(!metadata.hasRetryDelay());
+    QCOMPARE(metadata.retries(), 0);
+    QCOMPARE(metadata.retryDelay(), 0);
+}
+
+void
+TestMetadata::testSetRetries() {
+    Metadata metadata;
+    metadata.setRetries(5);
+    QVERIFY(metadata.hasRetries());
+    QCOMPARE(metadata.retries(), 5);
+}
+
+void
+TestMetadata::testSetRetryDelay() {
+    Metadata metadata;
+    metadata.setRetryDelay(2000);
+    QVERIFY(metadata.hasRetryDelay());
+    QCOMPARE(metadata.retryDelay(), 2000);
+}
+
+void
+TestMetadata::testWatchdogDefault() {
+    Metadata metadata;
+    QVERIFY(!metadata.hasStallTimeout());
+    QVERIFY(!metadata.hasMinSpeed());
+    QCOMPARE(metadata.stallTimeout(), 60000);
+    QCOMPARE(metadata.minSpeed(), 0ULL);
+}
+
+void
+TestMetadata::testSetStallTimeout() {
+    Metadata metadata;
+    metadata.setStallTimeout(0);
+    QVERIFY(metadata.hasStallTimeout());
+    QCOMPARE(metadata.stallTimeout(), 0);
+}
+
+void
+TestMetadata::testSetMinSpeed() {
+    Metadata metadata;
+    metadata.setMinSpeed(1024);
+    QVERIFY(metadata.hasMinSpeed());
+    QCOMPARE(metadata.minSpeed(), 1024ULL);
+}
+
+void
+TestMetadata::testSetMetalink() {
+    QString document("<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\"/>");
+    Metadata metadata;
+    QVERIFY(!metadata.hasMetalink());
+    metadata.setMetalink(document);
+    QVERIFY(metadata.hasMetalink());
+    QCOMPARE(metadata.metalink(), document);
+}
+
+void
+TestMetadata::testSetMetalinkUrl() {
+    Metadata metadata;
+    QVERIFY(!metadata.metalinkUrl());
+    metadata.setMetalinkUrl(true);
+    QVERIFY(metadata.hasMetalinkUrl());
+    QVERIFY(metadata.metalinkUrl());
+}
+
 void
 TestMetadata::testDownloadOwner_data() {
     QTest::addColumn<QString>("owner");
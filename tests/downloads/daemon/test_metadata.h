@@ -71,6 +71,21 @@ class TestMetadata : public BaseTestCase {
     void testSetDeflate();
     void testHasDeflateTrue();
     void testHasDeflateFalse();
+    void testSetDropCache_data();
+    void testSetDropCache();
+    void testHasDropCacheTrue();
+    void testHasDropCacheFalse();
+    void testDurabilityDefault();
+    void testSetDurability_data();
+    void testSetDurability();
+    void testRetriesDefault();
+    void testSetRetries();
+    void testSetRetryDelay();
+    void testWatchdogDefault();
+    void testSetStallTimeout();
+    void testSetMinSpeed();
+    void testSetMetalink();
+    void testSetMetalinkUrl();
     void testDownloadOwner_data();
     void testDownloadOwner();
     void testSetDownloadDestinationApp_data();
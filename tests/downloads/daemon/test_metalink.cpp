@@ -0,0 +1,169 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <ubuntu/downloads/metalink.h>
+#include "test_metalink.h"
+
+using namespace Ubuntu::DownloadManager::Daemon;
+
+namespace {
+
+    QByteArray
+    document(const QString& file) {
+        return QString("<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+            "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+            "<published>2015-06-01T12:00:00Z</published>"
+            "%1"
+            "</metalink>").arg(file).toUtf8();
+    }
+
+}
+
+void
+TestMetalink::testParseFile() {
+    Metalink metalink;
+    QVERIFY(metalink.parse(document(
+        "<file name=\"image.iso\">"
+        "<size>14471447</size>"
+        "<description>An image</description>"
+        "<url location=\"de\">http://example.com/image.iso</url>"
+        "</file>")));
+    QCOMPARE(metalink.name(), QString("image.iso"));
+    QCOMPARE(metalink.size(), 14471447LL);
+    QCOMPARE(metalink.urls().count(), 1);
+    QCOMPARE(metalink.urls()[0], QUrl("http://example.com/image.iso"));
+    QVERIFY(metalink.hash().isEmpty());
+    QVERIFY(metalink.pieces().isEmpty());
+}
+
+void
+TestMetalink::testMirrorsByPriority() {
+    Metalink metalink;
+    QVERIFY(metalink.parse(document(
+        "<file name=\"image.iso\">"
+        "<url>http://none.example.com/image.iso</url>"
+        "<url priority=\"2\">http://second.example.com/image.iso</url>"
+        "<url priority=\"1\">http://first.example.com/image.iso</url>"
+        "<url priority=\"2\">http://third.example.com/image.iso</url>"
+        "</file>")));
+
+    // the ones with the same priority keep the order of the document
+    auto urls = metalink.urls();
+    QCOMPARE(urls.count(), 4);
+    QCOMPARE(urls[0], QUrl("http://first.example.com/image.iso"));
+    QCOMPARE(urls[1], QUrl("http://second.example.com/image.iso"));
+    QCOMPARE(urls[2], QUrl("http://third.example.com/image.iso"));
+    QCOMPARE(urls[3], QUrl("http://none.example.com/image.iso"));
+}
+
+void
+TestMetalink::testUnsupportedUrlsIgnored() {
+    Metalink metalink;
+    QVERIFY(metalink.parse(document(
+        "<file name=\"image.iso\">"
+        "<metaurl mediatype=\"torrent\">http://example.com/image.torrent</metaurl>"
+        "<url>rsync://example.com/image.iso</url>"
+        "<url>https://example.com/image.iso</url>"
+        "</file>")));
+    QCOMPARE(metalink.urls().count(), 1);
+    QCOMPARE(metalink.urls()[0], QUrl("https://example.com/image.iso"));
+}
+
+void
+TestMetalink::testStrongestHash() {
+    Metalink metalink;
+    QVERIFY(metalink.parse(document(
+        "<file name=\"image.iso\">"
+        "<hash type=\"md5\">d41d8cd98f00b204e9800998ecf8427e</hash>"
+        "<hash type=\"sha-256\">ABCDEF</hash>"
+        "<hash type=\"whirlpool\">123456</hash>"
+        "<url>http://example.com/image.iso</url>"
+        "</file>")));
+    QCOMPARE(metalink.hashAlgorithm(), QString("sha256"));
+    QCOMPARE(metalink.hash(), QString("abcdef"));
+}
+
+void
+TestMetalink::testPieces() {
+    Metalink metalink;
+    QVERIFY(metalink.parse(document(
+        "<file name=\"image.iso\">"
+        "<size>10</size>"
+        "<pieces length=\"4\" type=\"sha-1\">"
+        "<hash>AA</hash>"
+        "<hash>bb</hash>"
+        "<hash>cc</hash>"
+        "</pieces>"
+        "<url>http://example.com/image.iso</url>"
+        "</file>")));
+    QCOMPARE(metalink.pieceLength(), 4LL);
+    QCOMPARE(metalink.pieceAlgorithm(), QString("sha1"));
+    QCOMPARE(metalink.pieces(), QList<QByteArray>() << "aa" << "bb" << "cc");
+}
+
+void
+TestMetalink::testPiecesNotCoveringFile() {
+    Metalink metalink;
+    QVERIFY(metalink.parse(document(
+        "<file name=\"image.iso\">"
+        "<size>100</size>"
+        "<pieces length=\"4\" type=\"sha-1\">"
+        "<hash>aa</hash>"
+        "</pieces>"
+        "<url>http://example.com/image.iso</url>"
+        "</file>")));
+    QVERIFY(metalink.pieces().isEmpty());
+}
+
+void
+TestMetalink::testNameWithoutDirs() {
+    Metalink metalink;
+    QVERIFY(metalink.parse(document(
+        "<file name=\"../../images/image.iso\">"
+        "<url>http://example.com/image.iso</url>"
+        "</file>")));
+    QCOMPARE(metalink.name(), QString("image.iso"));
+}
+
+void
+TestMetalink::testInvalidDocument_data() {
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("Not xml") << QByteArray("image.iso");
+    QTest::newRow("Other namespace") << QByteArray(
+        "<metalink xmlns=\"http://www.metalinker.org/\"/>");
+    QTest::newRow("No file") << document("");
+    QTest::newRow("No urls") << document(
+        "<file name=\"image.iso\"><size>10</size></file>");
+    QTest::newRow("Several files") << document(
+        "<file name=\"first.iso\"><url>http://example.com/first.iso</url></file>"
+        "<file name=\"second.iso\"><url>http://example.com/second.iso</url></file>");
+    QTest::newRow("Truncated") << document(
+        "<file name=\"image.iso\"><url>http://example.com/image.iso</url>");
+}
+
+void
+TestMetalink::testInvalidDocument() {
+    QFETCH(QByteArray, data);
+
+    Metalink metalink;
+    QVERIFY(!metalink.parse(data));
+    QVERIFY(!metalink.error().isEmpty());
+    QVERIFY(metalink.urls().isEmpty());
+}
+
+QTEST_MAIN(TestMetalink)
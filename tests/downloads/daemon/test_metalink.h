@@ -0,0 +1,45 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TEST_METALINK_H
+#define TEST_METALINK_H
+
+#include <QObject>
+#include "base_testcase.h"
+
+class TestMetalink : public BaseTestCase {
+    Q_OBJECT
+
+ public:
+    explicit TestMetalink(QObject *parent = 0)
+        : BaseTestCase("TestMetalink", parent) { }
+
+ private slots:  // NOLINT(whitespace/indent)
+
+    void testParseFile();
+    void testMirrorsByPriority();
+    void testUnsupportedUrlsIgnored();
+    void testStrongestHash();
+    void testPieces();
+    void testPiecesNotCoveringFile();
+    void testNameWithoutDirs();
+    void testInvalidDocument_data();
+    void testInvalidDocument();
+};
+
+#endif // TEST_METALINK_H
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <ubuntu/downloads/piece_verifier.h>
+#include "test_piece_verifier.h"
+
+using namespace Ubuntu::DownloadManager::Daemon;
+
+namespace {
+
+    // hashes of the pieces of the given length of the data
+    QList<QByteArray>
+    pieceHashes(const QByteArray& data, int length) {
+        QList<QByteArray> hashes;
+        for (int offset = 0; offset < data.size(); offset += length) {
+            hashes.append(QCryptographicHash::hash(data.mid(offset, length),
+                QCryptographicHash::Sha1).toHex());
+        }
+        return hashes;
+    }
+
+}
+
+void
+TestPieceVerifier::testGoodPieces() {
+    QByteArray data("aaaabbbbcccc");
+    PieceVerifier verifier(4, QCryptographicHash::Sha1, pieceHashes(data, 4));
+
+    QVERIFY(verifier.addData(data.constData(), data.size()));
+    QCOMPARE(verifier.verifiedSize(), 12LL);
+    QVERIFY(verifier.finish());
+    QVERIFY(!verifier.hasFailed());
+}
+
+void
+TestPieceVerifier::testDataSplitAcrossCalls() {
+    QByteArray data("aaaabbbbcccc");
+    PieceVerifier verifier(4, QCryptographicHash::Sha1, pieceHashes(data, 4));
+
+    QVERIFY(verifier.addData(data.constData(), 3));
+    QCOMPARE(verifier.verifiedSize(), 0LL);
+    QVERIFY(verifier.addData(data.constData() + 3, 6));
+    QCOMPARE(verifier.verifiedSize(), 8LL);
+    QCOMPARE(verifier.fedSize(), 9LL);
+    QVERIFY(verifier.addData(data.constData() + 9, 3));
+    QVERIFY(verifier.finish());
+}
+
+void
+TestPieceVerifier::testBadPiece() {
+    QByteArray data("aaaabbbbcccc");
+    QByteArray corrupted("aaaabXbbcccc");
+    PieceVerifier verifier(4, QCryptographicHash::Sha1, pieceHashes(data, 4));
+
+    QVERIFY(!verifier.addData(corrupted.constData(), corrupted.size()));
+    QVERIFY(verifier.hasFailed());
+    QCOMPARE(verifier.verifiedSize(), 4LL);
+    QCOMPARE(verifier.fedSize(), 12LL);
+
+    // nothing else is checked until rewound
+    QVERIFY(!verifier.addData(data.constData() + 8, 4));
+    QVERIFY(!verifier.finish());
+}
+
+void
+TestPieceVerifier::testShortLastPiece() {
+    QByteArray data("aaaabbbbcc");
+    PieceVerifier verifier(4, QCryptographicHash::Sha1, pieceHashes(data, 4));
+
+    QVERIFY(verifier.addData(data.constData(), data.size()));
+    QCOMPARE(verifier.verifiedSize(), 8LL);
+    QVERIFY(verifier.finish());
+    QCOMPARE(verifier.verifiedSize(), 10LL);
+}
+
+void
+TestPieceVerifier::testMissingData() {
+    QByteArray data("aaaabbbbcccc");
+    PieceVerifier verifier(4, QCryptographicHash::Sha1, pieceHashes(data, 4));
+
+    // the server closed the connection early
+    QVERIFY(verifier.addData(data.constData(), 6));
+    QVERIFY(!verifier.finish());
+    QCOMPARE(verifier.verifiedSize(), 4LL);
+}
+
+void
+TestPieceVerifier::testRewind() {
+    QByteArray data("aaaabbbbcccc");
+    QByteArray corrupted("aaaabXbbcccc");
+    PieceVerifier verifier(4, QCryptographicHash::Sha1, pieceHashes(data, 4));
+
+    QVERIFY(!verifier.addData(corrupted.constData(), corrupted.size()));
+    QCOMPARE(verifier.rewind(corrupted.size()), 4LL);
+    QVERIFY(!verifier.hasFailed());
+    QCOMPARE(verifier.fedSize(), 4LL);
+
+    // the data fetched again is checked from the bad piece
+    QVERIFY(verifier.addData(data.constData() + 4, 8));
+    QVERIFY(verifier.finish());
+
+    // a file that was cut keeps the pieces that are still complete
+    QCOMPARE(verifier.rewind(7), 4LL);
+}
+
+void
+TestPieceVerifier::testVerifyStoredData() {
+    QByteArray data("aaaabbbbcccc");
+    QByteArray stored("aaaabbbbcXcc");
+    PieceVerifier verifier(4, QCryptographicHash::Sha1, pieceHashes(data, 4));
+
+    QBuffer buffer(&stored);
+    buffer.open(QIODevice::ReadOnly);
+    QCOMPARE(verifier.verify(&buffer, stored.size()), 8LL);
+    QCOMPARE(verifier.fedSize(), 8LL);
+
+    // an incomplete piece is not kept
+    QCOMPARE(verifier.verify(&buffer, 6), 4LL);
+}
+
+QTEST_MAIN(TestPieceVerifier)
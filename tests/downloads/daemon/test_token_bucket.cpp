@@ -0,0 +1,95 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <ubuntu/transfers/system/token_bucket.h>
+#include "test_token_bucket.h"
+
+using namespace Ubuntu::Transfers::System;
+
+namespace {
+    // use a time far from the creation of the bucket so that the results
+    // do not depend on how long the test took to run
+    const qint64 NOW = 1000000;
+}
+
+void
+TestTokenBucket::testUnlimited() {
+    TokenBucket bucket;
+    QVERIFY(!bucket.isLimited());
+    QCOMPARE(bucket.consume(1000, NOW), Q_INT64_C(1000));
+    QCOMPARE(bucket.msecsUntilAvailable(1000, NOW), 0);
+}
+
+void
+TestTokenBucket::testBurst_data() {
+    QTest::addColumn<qulonglong>("rate");
+    QTest::addColumn<qulonglong>("burst");
+    QTest::addColumn<qulonglong>("result");
+
+    QTest::newRow("Default burst") << 1000ULL << 0ULL << 1000ULL;
+    QTest::newRow("Burst smaller than rate") << 1000ULL << 10ULL << 10ULL;
+    QTest::newRow("Burst bigger than rate") << 1000ULL << 5000ULL << 5000ULL;
+}
+
+void
+TestTokenBucket::testBurst() {
+    QFETCH(qulonglong, rate);
+    QFETCH(qulonglong, burst);
+    QFETCH(qulonglong, result);
+
+    TokenBucket bucket(rate, burst);
+    QVERIFY(bucket.isLimited());
+    QCOMPARE(bucket.burst(), result);
+}
+
+void
+TestTokenBucket::testConsumeLimitedByBurst() {
+    TokenBucket bucket(1000, 4000);
+    QCOMPARE(bucket.consume(10000, NOW), Q_INT64_C(4000));
+    QCOMPARE(bucket.consume(1, NOW), Q_INT64_C(0));
+}
+
+void
+TestTokenBucket::testRefill() {
+    TokenBucket bucket(1000, 1000);
+    QCOMPARE(bucket.consume(1000, NOW), Q_INT64_C(1000));
+    QCOMPARE(bucket.consume(1000, NOW + 500), Q_INT64_C(500));
+    // the bucket never holds more than the burst
+    QCOMPARE(bucket.consume(5000, NOW + 10500), Q_INT64_C(1000));
+}
+
+void
+TestTokenBucket::testRefillSmallBurst() {
+    // the rate is kept, the data is just used in smaller pieces
+    TokenBucket bucket(1000, 10);
+    QCOMPARE(bucket.consume(100, NOW), Q_INT64_C(10));
+    QCOMPARE(bucket.consume(100, NOW + 5), Q_INT64_C(5));
+    QCOMPARE(bucket.msecsUntilAvailable(100, NOW + 5), 10);
+}
+
+void
+TestTokenBucket::testMsecsUntilAvailable() {
+    TokenBucket bucket(1000, 1000);
+    QCOMPARE(bucket.msecsUntilAvailable(1000, NOW), 0);
+    bucket.consume(1000, NOW);
+    QCOMPARE(bucket.msecsUntilAvailable(100, NOW), 100);
+    // more than the burst is never available, wait for a full bucket
+    QCOMPARE(bucket.msecsUntilAvailable(5000, NOW), 1000);
+}
+
+QTEST_MAIN(TestTokenBucket)
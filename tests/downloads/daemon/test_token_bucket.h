@@ -0,0 +1,43 @@
+/*
+ * Copyright 2015 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TEST_TOKEN_BUCKET_H
+#define TEST_TOKEN_BUCKET_H
+
+#include <QObject>
+#include "base_testcase.h"
+
+class TestTokenBucket : public BaseTestCase {
+    Q_OBJECT
+
+ public:
+    explicit TestTokenBucket(QObject *parent = 0)
+        : BaseTestCase("TestTokenBucket", parent) { }
+
+ private slots:  // NOLINT(whitespace/indent)
+
+    void testUnlimited();
+    void testBurst_data();
+    void testBurst();
+    void testConsumeLimitedByBurst();
+    void testRefill();
+    void testRefillSmallBurst();
+    void testMsecsUntilAvailable();
+};
+
+#endif // TEST_TOKEN_BUCKET_H
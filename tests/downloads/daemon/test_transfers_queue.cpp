@@ -25,6 +25,8 @@ using ::testing::AnyNumber;
 using ::testing::Return;
 using ::testing::Return;
 using ::testing::AnyOf;
+using ::testing::DoAll;
+using ::testing::SetArgReferee;
 
 void
 TestTransferQueue::verifyMocks() {
@@ -177,6 +179,320 @@ TestTransferQueue::testStartTransferWithCurrent() {
     verifyMocks();
 }
 
+void
+TestTransferQueue::testStartTransferWithCurrentMaxPerApp() {
+    auto path = QString("path");
+    auto secondPath = QString("second path");
+    EXPECT_CALL(*_first, addToQueue())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_first, state())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(Transfer::START));
+
+    EXPECT_CALL(*_first, path())
+        .Times(1)
+        .WillRepeatedly(Return(path));
+
+    EXPECT_CALL(*_first, canTransfer())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_first, startTransfer())
+        .Times(1);
+
+    // second transfer expectations
+    EXPECT_CALL(*_second, addToQueue())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_second, state())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(Transfer::START));
+
+    EXPECT_CALL(*_second, path())
+        .Times(1)
+        .WillRepeatedly(Return(secondPath));
+
+    EXPECT_CALL(*_second, canTransfer())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_second, startTransfer())
+        .Times(1);
+
+    // with two transfers per app both of them must be started in the
+    // order in which they were added
+    _q->setMaxConcurrentPerApp(2);
+    QCOMPARE(_q->maxConcurrentPerApp(), 2);
+
+    SignalBarrier spy(_q, SIGNAL(currentChanged(QString, QString)));
+    _q->add(_first);
+    _q->add(_second);
+
+    _first->stateChanged();
+    _second->stateChanged();
+    QVERIFY(spy.ensureSignalEmitted());
+    QCOMPARE(spy.count(), 2);
+
+    QList<QVariant> arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(1).toString(), path);
+    arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(1).toString(), secondPath);
+    QCOMPARE(_q->currentTransfers(""), QStringList() << path << secondPath);
+    QCOMPARE(_q->currentTransfer(""), path);
+    verifyMocks();
+}
+
+void
+TestTransferQueue::testStartTransferWithCurrentMaxTotal() {
+    auto path = QString("path");
+    auto secondPath = QString("second path");
+    EXPECT_CALL(*_first, addToQueue())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_first, state())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(Transfer::START));
+
+    EXPECT_CALL(*_first, path())
+        .Times(1)
+        .WillRepeatedly(Return(path));
+
+    EXPECT_CALL(*_first, canTransfer())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_first, startTransfer())
+        .Times(1);
+
+    // second transfer expectations
+    EXPECT_CALL(*_second, addToQueue())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_second, state())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(Transfer::START));
+
+    EXPECT_CALL(*_second, path())
+        .Times(1)
+        .WillRepeatedly(Return(secondPath));
+
+    EXPECT_CALL(*_second, canTransfer())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_second, startTransfer())
+        .Times(0);
+
+    // the global limit wins over the per app one
+    _q->setMaxConcurrentPerApp(2);
+    _q->setMaxConcurrent(1);
+    QCOMPARE(_q->maxConcurrent(), 1);
+
+    _q->add(_first);
+    _q->add(_second);
+
+    _first->stateChanged();
+    _second->stateChanged();
+
+    QCOMPARE(_q->currentTransfers(""), QStringList() << path);
+    verifyMocks();
+}
+
+void
+TestTransferQueue::testStartTransferNotEnoughSpace() {
+    auto path = QString("path");
+    auto fileManager = new MockFileManager();
+    FileManager::setInstance(fileManager);
+
+    EXPECT_CALL(*_first, addToQueue())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_first, state())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(Transfer::START));
+
+    EXPECT_CALL(*_first, path())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(path));
+
+    EXPECT_CALL(*_first, canTransfer())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_first, requiredSpace())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(2048));
+
+    EXPECT_CALL(*_first, storagePath())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(QString("/downloads")));
+
+    EXPECT_CALL(*fileManager, freeSpace(QString("/downloads"), _, _))
+        .Times(AnyNumber())
+        .WillRepeatedly(DoAll(SetArgReferee<1>(1024),
+            SetArgReferee<2>(1), Return(true)));
+
+    // the transfer can never fit, do not keep it waiting
+    EXPECT_CALL(*_first, failTransfer(_))
+        .Times(1);
+
+    EXPECT_CALL(*_first, startTransfer())
+        .Times(0);
+
+    _q->add(_first);
+    _first->stateChanged();
+
+    QCOMPARE(_q->currentTransfers(""), QStringList());
+    verifyMocks();
+    QVERIFY(Mock::VerifyAndClearExpectations(fileManager));
+    FileManager::deleteInstance();
+}
+
+void
+TestTransferQueue::testNotEnoughSpaceRemovesTransfer() {
+    auto path = QString("path");
+    auto fileManager = new MockFileManager();
+    FileManager::setInstance(fileManager);
+
+    EXPECT_CALL(*_first, addToQueue())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_first, state())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(Transfer::START));
+
+    EXPECT_CALL(*_first, path())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(path));
+
+    EXPECT_CALL(*_first, canTransfer())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_first, requiredSpace())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(2048));
+
+    EXPECT_CALL(*_first, storagePath())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(QString("/downloads")));
+
+    EXPECT_CALL(*fileManager, freeSpace(QString("/downloads"), _, _))
+        .Times(AnyNumber())
+        .WillRepeatedly(DoAll(SetArgReferee<1>(1024),
+            SetArgReferee<2>(1), Return(true)));
+
+    EXPECT_CALL(*_first, failTransfer(_))
+        .Times(1);
+
+    QSignalSpy spy(_q, SIGNAL(transferRemoved(QString)));
+    _q->add(_first);
+    QCOMPARE(_q->size(), 1);
+    _first->stateChanged();
+
+    // the failed transfer was never current and must not stay around
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).toString(), path);
+    QCOMPARE(_q->size(), 0);
+    QVERIFY(!_q->paths().contains(path));
+    verifyMocks();
+    QVERIFY(Mock::VerifyAndClearExpectations(fileManager));
+    FileManager::deleteInstance();
+}
+
+void
+TestTransferQueue::testStartTransferHeldForSpace() {
+    auto path = QString("path");
+    auto secondPath = QString("second path");
+    auto fileManager = new MockFileManager();
+    FileManager::setInstance(fileManager);
+
+    EXPECT_CALL(*_first, addToQueue())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_first, state())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(Transfer::START));
+
+    EXPECT_CALL(*_first, path())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(path));
+
+    EXPECT_CALL(*_first, canTransfer())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_first, requiredSpace())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(768));
+
+    EXPECT_CALL(*_first, storagePath())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(QString("/downloads")));
+
+    EXPECT_CALL(*_first, startTransfer())
+        .Times(1);
+
+    // second transfer expectations
+    EXPECT_CALL(*_second, addToQueue())
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*_second, state())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(Transfer::START));
+
+    EXPECT_CALL(*_second, path())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(secondPath));
+
+    EXPECT_CALL(*_second, canTransfer())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*_second, requiredSpace())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(512));
+
+    EXPECT_CALL(*_second, storagePath())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(QString("/downloads/other")));
+
+    // both paths are in the same file system
+    EXPECT_CALL(*fileManager, freeSpace(_, _, _))
+        .Times(AnyNumber())
+        .WillRepeatedly(DoAll(SetArgReferee<1>(1024),
+            SetArgReferee<2>(1), Return(true)));
+
+    // the second one fits alone but not with the first one running
+    EXPECT_CALL(*_second, failTransfer(_))
+        .Times(0);
+
+    EXPECT_CALL(*_second, startTransfer())
+        .Times(0);
+
+    _q->setMaxConcurrentPerApp(2);
+
+    _q->add(_first);
+    _q->add(_second);
+
+    _first->stateChanged();
+    _second->stateChanged();
+
+    QCOMPARE(_q->currentTransfers(""), QStringList() << path);
+    verifyMocks();
+    QVERIFY(Mock::VerifyAndClearExpectations(fileManager));
+    FileManager::deleteInstance();
+}
+
 void
 TestTransferQueue::testStartTransferWithNoCurrentCannotTransfer() {
     auto path = QString("path");
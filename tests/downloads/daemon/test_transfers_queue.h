@@ -26,6 +26,7 @@
 #include <network_session.h>
 
 #include "base_testcase.h"
+#include "file_manager.h"
 #include "transfer.h"
 
 using namespace Ubuntu::Transfers;
@@ -50,7 +51,12 @@ class TestTransferQueue : public BaseTestCase {
     void testAddTransfer();
     void testStartTransferWithNoCurrent();
     void testStartTransferWithCurrent();
+    void testStartTransferWithCurrentMaxPerApp();
+    void testStartTransferWithCurrentMaxTotal();
     void testStartTransferWithNoCurrentCannotTransfer();
+    void testStartTransferNotEnoughSpace();
+    void testNotEnoughSpaceRemovesTransfer();
+    void testStartTransferHeldForSpace();
     void testPauseTransferNoOtherReady();
     void testPauseTransferOtherReady();
     void testResumeTransferNoOtherPresent();
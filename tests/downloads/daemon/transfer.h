@@ -35,7 +35,11 @@ class MockTransfer : public Transfer {
              bool isConfined,
              const QString& rootPath,
              QObject* parent = 0)
-        : Transfer(id, "", path, isConfined, rootPath, parent) {}
+        : Transfer(id, "", path, isConfined, rootPath, parent) {
+        // do not care about the disk unless a test asks for it
+        ON_CALL(*this, requiredSpace())
+            .WillByDefault(::testing::Return(0));
+    }
 
     MOCK_CONST_METHOD0(transferId, QString());
     MOCK_CONST_METHOD0(path, QString());
@@ -51,6 +55,9 @@ class MockTransfer : public Transfer {
     MOCK_METHOD0(pauseTransfer, void());
     MOCK_METHOD0(resumeTransfer, void());
     MOCK_METHOD0(startTransfer, void());
+    MOCK_METHOD0(requiredSpace, qint64());
+    MOCK_METHOD0(storagePath, QString());
+    MOCK_METHOD1(failTransfer, void(const QString&));
     MOCK_METHOD1(setThrottle, void(qulonglong));
     MOCK_METHOD0(throttle, qulonglong());
     MOCK_METHOD1(allowGSMDownload, void(bool));
@@ -37,6 +37,9 @@ class MockManager : public Manager {
         const QVariantMap&, StringMap));
     MOCK_METHOD7(createDownload, void(StructList, const QString&, bool,
         const QVariantMap&, StringMap, GroupCb, GroupCb));
+    MOCK_METHOD1(createDownloads, void(DownloadStructList));
+    MOCK_METHOD3(createDownloads, void(DownloadStructList, DownloadsListCb,
+        DownloadsListCb));
     MOCK_METHOD0(getAllDownloads, void(const QString&, bool));
     MOCK_METHOD2(getAllDownloads, void(const QString&, bool, DownloadsListCb, DownloadsListCb));
     MOCK_METHOD2(getAllDownloadsWithMetadata, void(const QString&,
@@ -49,6 +52,8 @@ class MockManager : public Manager {
     MOCK_METHOD0(isMobileDataDownload, bool());
     MOCK_METHOD0(defaultThrottle, qulonglong());
     MOCK_METHOD1(setDefaultThrottle, void(qulonglong));
+    MOCK_METHOD0(progressBatchInterval, int());
+    MOCK_METHOD1(setProgressBatchInterval, void(int));
     MOCK_METHOD0(exit, void());
 };
 